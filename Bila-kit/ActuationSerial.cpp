@@ -26,4 +26,33 @@ void conductActuationSerial(bool rupture_flag, bool recovery_flag, int number_of
             }
         }
     }
-}
\ No newline at end of file
+}
+
+// Send the speed control signal toward Arduino from the estimated stimuli of BK (opProb < 0: not estimated).
+void conductActuationStimuli(int BKstimuli, double opProb, double stimuli) {
+    if (opProb < 0) {
+        sendSerial("0\n");
+        return;
+    }
+    if (BKstimuli == 0) {
+        // voltage addition (stimuli: -100 mV ~ +100 mV)
+        if (stimuli < -80) sendSerial("9\n");
+        else if (stimuli < -60) sendSerial("8\n");
+        else if (stimuli < -40) sendSerial("7\n");
+        else if (stimuli < -20) sendSerial("6\n");
+        else if (stimuli < 0) sendSerial("5\n");
+        else if (stimuli < 10) sendSerial("4\n");
+        else if (stimuli < 20) sendSerial("3\n");
+        else if (stimuli < 30) sendSerial("2\n");
+        else sendSerial("1\n");
+    }
+    else if (BKstimuli == 1) {
+        // verapamil addition (stimuli: 0 uM ~ 20 uM)
+        if (stimuli < 1) sendSerial("0\n");
+        else if (stimuli < 4) sendSerial("1\n");
+        else if (stimuli < 8) sendSerial("2\n");
+        else if (stimuli < 12) sendSerial("3\n");
+        else if (stimuli < 16) sendSerial("4\n");
+        else sendSerial("5\n");
+    }
+}
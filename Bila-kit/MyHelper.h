@@ -1,31 +1,39 @@
 #pragma once
 
-#include "MyMain.h"
+// The declarations of the Sense/Processing/Actuation functions. Free of Qt, so that the core also builds headless
+// (see CMakeLists.txt); the GUI-only functions take MyMain, which is only forward declared here.
+class MyMain;
 #define SAMPLE_FREQ 5000   // 5kHz sampling
+#define VOLTAGE_SETTLE_SAMPLES 50   // 10 ms of capacitive transient after switching the holding voltage, excluded from the statistics.
+#define EDGE_KERNEL_SIZE 301        // Default length of the edge filter of nanopores (convolve_EDGE) [samples]
 
 /*  Sense Block  *****************************************************************************/
-// SenseAmplifier.cpp // 
+// SenseAmplifier.cpp (or SenseAmplifierNone.cpp in the builds without the Tecella backend) //
 int setupAmplifier(int choice);
 void readAmplifier(double* timestamp, double* destination, int dataIndex_loop_num);
 void stopAmplifier();
 int finalizeAmplifier();
-void changeVoltageAmplifier(int value);
-// SenseLocal.cpp // 
+double changeVoltageAmplifier(int value);
+// SenseLocal.cpp (GUI; the files are parsed by SenseReplay.cpp) //
 int setupLocal(MyMain* mainwindow, int extension, bool isSeconds, double* dataStartTime);
-int readLocal(double* timestamp, double* destination, int dataIndex_loop_num);
+int readLocal(double* timestamp, double* destination, int dataIndex_loop_num, int* switchIndex);
 
 
 /*  Processing Block  *****************************************************************************/
-// See the comment at "Processing Block" in MyMain.cpp.
+// See ProcessingBlock.cpp.
 // convolve.cpp //
-void convolve_EDGE(double* X, double* Y, double* prevX, int prevX_size);
+void convolve_EDGE(double* X, double* Y, double* prevX, int prevX_size, int kernel_size = EDGE_KERNEL_SIZE);
 
 /*  Actuation Block  *****************************************************************************/
-// qcustomserial.cpp //
+// qcustomserial.cpp (GUI) //
 void setupSerial(MyMain* mainwindow);
+// SerialPort.cpp (headless) //
+int setupSerialDevice(const char* device);
+// qcustomserial.cpp or SerialPort.cpp //
 void sendSerial(const char*);
 void sendSerial_pump();
 void closeSerial();
 extern int serialTarget;
 // ActuationSerial.cpp //
 void conductActuationSerial(bool rupture_flag, bool recovery_flag, int number_of_channel);
+void conductActuationStimuli(int BKstimuli, double opProb, double stimuli);
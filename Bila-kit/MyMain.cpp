@@ -14,27 +14,28 @@
 #include "MyMain.h"
 #include "MyHelper.h"
 #include "qcustomplot.h"
-#include "subWin.h"
+#include "ProtocolScheduler.h"
+#include "ProcessingBlock.h"
+#include "PipelineStages.h"
 
 #include <QTimer>
+#include <QCoreApplication>
+#include <QSignalBlocker>
 #include <string>
-#include <sstream>
-#include <iomanip>
 #include <iostream>
+#include <chrono>
 #include <time.h>
 #include <math.h>
-#include <windows.h>
+#include <climits>
 
 // Important variables
 int dataSource = 1;             // The source where the current is acquired from.  0: Amplifier, 1: Local ATF, 2: Local CSV
 int proteinType = 0;            // The type of target membrane protein.  0: Nanopores (AHL), 1: Ion channels (BK), 2: Ion channels (OR8)
 int BKstimuli = 0;              // The type of stimuli, which will be estimated by BK signals.  0: Membrane voltage, 1: Verapamil inhibition.
 int postprocessType = 0;        // The type of postprocessing. 0: None, 1: Measuring conductance, 2: Emphasis when exceeding threshold
-double opProb = 0;              // The open probability of this 1 s signal.
-double stimuli = 0;             // The estimated stimuli, which leads to the predetermined opProb.
-double stimuli_upper = 0;
-double stimuli_lower = 0;
-QVector<double> stimuli_ALLaverage;
+int idealizerType = 0;          // The method to idealize the raw current.  0: Threshold (hysteresis), 1: HMM (ion channels only), 2: CUSUM (nanopores only)
+ProcessingBlock processing;     // The Processing Block (see ProcessingBlock.cpp): idealization, opProb, stimuli and the CSV logs.
+ProtocolScheduler protocol;     // Automated voltage-step protocol for the Po-V calibration. The fit replaces processing.boltzmann_a/x0.
 
 // Variables for calling 1 Hz callback
 int dataIndex_loop_num = -2;     // The number of loops from the time when "Acquire" button is pushed.  -2 : reset signal
@@ -44,17 +45,87 @@ double dataStartTime = 0;        // (Local data only) the time of the first row.
 // Variables for Processing Block
 int number_of_channel = 0;      // Number of channels (proteins) in the lipid bilayer during 1s period. 
 int prev_num_channels = 0;      // number_of_channel at the previous (1 s ahead) timestep.
-double current_per_channel = 0.0;     // Current per single channel [pA]. Equal to (conductance) * (bias voltage). AHL = 44.5pA @ +50mV, BK = -11.5pA @ -40mV
 double conductance_user_specified = 0.0;        // User input of conductance [nS] per channel.
 int bias_voltage_user_specified = 50;           // User input of bias voltage [mV].
-double baseline = 0.0;          // The baseline currents. Equal to the mean current when all channels are closed (lastOpenNumber == 0). 
 double baseline_user_specified = 0.0;           // User input of baseline [pA].
-bool rupture_flag = false;      // Indicates whether the bilayer is ruptured during the measuring period (1s). 
-bool recovery_flag = false;     // Indicates whether the bilayer is recovering from rupture during the measuring period (1s)
-int lastOpenNumber = 0;
-int on_detection = 0;
-double previousCurrent[500];    // Uses when the previous current is required (e.g. detecting nanopore jumps at exactly N (integer) seconds).
-bool corrections_user_specified[2];
+double cusum_delay_ms = 10;     // Detection delay of the CUSUM detector for a half-nanopore step [ms].
+double target_false_rate = 0.01;    // Target rate of the false events caused by the noise [1/s].  0: fixed thresholds.
+int mains_freq = 50;            // Nominal mains frequency [Hz].
+bool spectrum_replot = false;   // Whether the PSD graph waits for a replot (the render frames are dropped while catching up).
+
+// Variables for the pipeline (see PipelineStages.cpp)
+AcquisitionStage acquisitionStage;  // The Sense Block in a worker thread, feeding the Processing Block through a bounded queue.
+ProcessingStage processingStage;    // The Processing and Actuation Blocks in a worker thread (see process_block() and actuate_block()).
+ExportStage exportStage;        // Writes the CSV rows in a worker thread.
+StageStats actuationStats;      // Service time of the Actuation Block (in the processing stage).
+StageStats renderStats;         // Service time of the graph updates (on the GUI thread), and the dropped render frames.
+ResultServer resultServer;      // Pushes the results of every block to the subscribers, e.g. the display on a second screen (see PipelineResults.h).
+StreamPublisher streamPublisher;    // The live stream of every processed block in shared memory, for the external tools (see PipelineStream.h).
+bool pipeline_warned = false;   // Whether the processing falling behind the acquisition has been reported.
+bool render_warned = false;     // Whether the graphs falling behind the processing has been reported.
+std::string exportRow;          // The row of the protocol file, built in the processing stage (the other rows are built by the Processing Block).
+#define DISPLAY_TEXT_SIZE 16
+char shown_opProb[DISPLAY_TEXT_SIZE] = "";      // The texts on the result displays (textBrowser_2, 5, 6 and 12),
+char shown_stimuli[DISPLAY_TEXT_SIZE] = "";     // which are updated only when they change (see setDisplayText()).
+char shown_unit[DISPLAY_TEXT_SIZE] = "";
+char shown_channels[DISPLAY_TEXT_SIZE] = "";
+static const int NO_VOLTAGE_REQUEST = INT_MIN;
+std::atomic<int> requested_voltage(NO_VOLTAGE_REQUEST);    // Holding voltage to be applied before the next block, by the Sense worker (amplifier) or by the processing stage (local file).
+
+// The results of one block, handed from the processing stage to the GUI thread (see actuate_block() and show_frame()).
+struct RenderFrame {
+    RenderFrame()
+        : index(0), rupture_flag(false), maxOpenNumber(-1), opProb(-1), stimuli(0), current_per_channel(0), baseline(0),
+          spectrum_updated(false), controls(defaultProcessingControls()), controls_version(0), voltage(NO_VOLTAGE_REQUEST) {}
+
+    int index;                      // dataIndex_loop_num of the block
+    std::vector<double> time;       // processing.currentTime (SAMPLE_FREQ samples)
+    std::vector<double> current;    // processing.currentData
+    std::vector<int> processed;     // processing.processedData
+    bool rupture_flag;
+    int maxOpenNumber;
+    double opProb;
+    double stimuli;
+    double current_per_channel;
+    double baseline;
+    bool spectrum_updated;          // Whether "spectrum" is new since the previous frame queued
+    SpectrumResult spectrum;
+    ProcessingControls controls;    // The controls after the block (the corrections cleared by the Processing Block)
+    int controls_version;           // The version of the check boxes which "controls" derive from (see publishControls())
+    int voltage;                    // A holding voltage switched by the processing (local file or Po-V protocol), to be shown on the spin box.  NO_VOLTAGE_REQUEST: none
+};
+// The render frames from the processing stage to the GUI thread. When the queue is full, the processing stage drops the frame
+// rather than wait for the GUI, and the GUI redraws only the newest of the frames waiting (see update_graph_1Hz()).
+BoundedQueue<RenderFrame> renderQueue;
+
+// The check boxes, published by the GUI thread when they change and copied by the processing stage before its next block.
+std::mutex controls_mutex;
+ProcessingControls shared_controls;     // The latest snapshot of the check boxes (guarded by controls_mutex)
+int shared_controls_version = 0;        // Incremented at every snapshot (guarded by controls_mutex)
+ProcessingControls published_controls;  // (GUI thread) the last snapshot published
+int published_controls_version = 0;     // (GUI thread) its version
+ProcessingControls stage_controls;      // (Processing stage) the controls of the Processing Block
+int stage_controls_version = 0;         // (Processing stage) the version of the snapshot copied into stage_controls
+bool stage_spectrum_pending = false;    // (Processing stage) a new spectrum not yet queued to the GUI
+int stage_voltage_pending = NO_VOLTAGE_REQUEST;     // (Processing stage) a holding voltage switched by the processing, not yet queued to the GUI
+// The Po-V protocol is started and aborted by the GUI thread, and updated by the processing stage.
+std::mutex protocol_mutex;
+bool protocol_started = false;          // The protocol has been started, and its file is not yet truncated (guarded by protocol_mutex)
+
+static bool sameControls(const ProcessingControls& a, const ProcessingControls& b) {
+    return a.filterType == b.filterType && a.filterCutoff == b.filterCutoff && a.mains_cancellation == b.mains_cancellation
+        && a.max_open == b.max_open && a.baseline_correction == b.baseline_correction
+        && a.conductance_correction == b.conductance_correction && a.auto_calibration == b.auto_calibration;
+}
+
+// Show "text" (centered) on a result display only when it differs from "shown", the text on it,
+// since setText() allocates and lays out the document every time.
+static void setDisplayText(QTextBrowser* browser, char* shown, const char* text) {
+    if (strncmp(shown, text, DISPLAY_TEXT_SIZE) == 0) return;
+    snprintf(shown, DISPLAY_TEXT_SIZE, "%s", text);
+    browser->setText(QString::fromLocal8Bit(text));
+    browser->setAlignment(Qt::AlignCenter);
+}
 
 
 MyMain::MyMain(QWidget *parent)
@@ -70,6 +141,12 @@ MyMain::MyMain(QWidget *parent)
     ui.comboBox->addItem("ms");
     ui.comboBox_2->addItem("Voltage");
     ui.comboBox_2->addItem("Inhibitor");
+    ui.comboBox_3->addItem("Idealizer: Threshold");
+    ui.comboBox_3->addItem("Idealizer: HMM");
+    ui.comboBox_3->addItem("Idealizer: CUSUM");
+    ui.comboBox_4->addItem("Filter: None");
+    ui.comboBox_4->addItem("Filter: Gaussian");
+    ui.comboBox_4->addItem("Filter: Bessel (4-pole)");
     ui.spinBox->setMinimum(-200);
     ui.spinBox->setMaximum(200);
     setupSerial(this);
@@ -77,12 +154,38 @@ MyMain::MyMain(QWidget *parent)
     displayInfo("**------**");
     ui.pushButton_2->setEnabled(false);
     ui.pushButton_3->setEnabled(false);
+    exportStage.start(64);
+    exportRow.reserve(256);
+    // The messages of the Processing Block come from the processing stage.
+    processing.setMessageFunction([this](const char* text) { postInfo(text); });
+    // The results are served to the display clients (cli/bilakit_display.cpp on the second display) on this PC only.
+    // The messages are not authenticated, so the other PCs are served only when it is asked for on the command line,
+    // e.g. "Bila-kit.exe --results tcp:0.0.0.0:5757" (the trusted network of the lab).
+    std::string result_endpoint = "tcp:127.0.0.1:" + std::to_string(RESULT_DEFAULT_PORT);
+    QStringList arguments = QCoreApplication::arguments();
+    int results_option = arguments.indexOf("--results");
+    if (results_option >= 0 && results_option + 1 < arguments.size()) result_endpoint = arguments[results_option + 1].toStdString();
+    int result_server = resultServer.start(result_endpoint);
+    char disp_str[128];
+    if (result_server == 0) {
+        processing.setResultServer(&resultServer);
+        snprintf(disp_str, sizeof(disp_str), "Serving the results on %s.", result_endpoint.c_str());
+    }
+    else {
+        snprintf(disp_str, sizeof(disp_str), "Unable to serve the results on %s (%d).", result_endpoint.c_str(), result_server);
+    }
+    displayInfo(disp_str);
     // clock_t start_time = clock();
     // clock_t end_time = clock();
     // std::cout << "elapsed time: " << double(end_time - start_time) / CLOCKS_PER_SEC << "sec" << std::endl;
 }
 
 MyMain::~MyMain() {
+    acquisitionStage.stop();
+    processingStage.stop();
+    exportStage.stop();
+    processing.setResultServer(nullptr);
+    resultServer.stop();
     closeSerial();
     if (dataSource == 0) finalizeAmplifier(); // Disconnect amplifier and release memories associated with it.
 }
@@ -156,15 +259,13 @@ void MyMain::on_pushBtnClicked() {
             bias_voltage_user_specified = -40;   // [mV]
             ui.textBrowser_4->setText(QString::fromLocal8Bit("Estimated Membrane Potential"));
             ui.textBrowser_4->setAlignment(Qt::AlignCenter);
-            ui.textBrowser_6->setText(QString::fromLocal8Bit("mV"));
-            ui.textBrowser_6->setAlignment(Qt::AlignCenter);
+            setDisplayText(ui.textBrowser_6, shown_unit, "mV");
         }
         else if (BKstimuli == 1) {
             bias_voltage_user_specified = 30;   // [mV]
             ui.textBrowser_4->setText(QString::fromLocal8Bit("Estimated Verapamil Concentration"));
             ui.textBrowser_4->setAlignment(Qt::AlignCenter);
-            ui.textBrowser_6->setText(QString::fromLocal8Bit("uM"));
-            ui.textBrowser_6->setAlignment(Qt::AlignCenter);
+            setDisplayText(ui.textBrowser_6, shown_unit, "uM");
         }
     }
     /*
@@ -189,6 +290,17 @@ void MyMain::on_pushBtnClicked() {
         return;
     }
 
+    // ****** Define the idealization method.
+    idealizerType = ui.comboBox_3->currentIndex();
+    if (idealizerType == 1 && proteinType != 1) {
+        displayInfo("HMM idealization is available only for ion channels. Threshold is used instead.");
+        idealizerType = 0;
+    }
+    if (idealizerType == 2 && proteinType != 0) {
+        displayInfo("CUSUM idealization is available only for nanopores. Threshold is used instead.");
+        idealizerType = 0;
+    }
+
     // ****** Define the postprocessing.
     if (ui.radioButton_13->isChecked()) {
         postprocessType = 1;
@@ -214,7 +326,7 @@ void MyMain::on_pushBtnClicked() {
     if (ok) {
         bias_voltage_user_specified = d2;
     }
-    current_per_channel = conductance_user_specified * (double)bias_voltage_user_specified;  // [pA]
+    double current_per_channel = conductance_user_specified * (double)bias_voltage_user_specified;  // [pA]
     ui.spinBox->setValue(bias_voltage_user_specified);
 
     baseline_user_specified = 0.0;
@@ -224,6 +336,26 @@ void MyMain::on_pushBtnClicked() {
     if (ok) {
         baseline_user_specified = d3;
     }
+    double d5 = QInputDialog::getDouble(this, "QInputDialog::getDouble()",
+        "Do you want to modify the target false-event rate of the thresholds [1/s]? (0: fixed thresholds)", target_false_rate, 0, 10, 3, &ok,
+        Qt::WindowFlags(), 0.001);
+    if (ok) {
+        target_false_rate = d5;
+    }
+    int d6 = QInputDialog::getInt(this, "QInputDialog::getInt()",
+        "Do you want to modify the mains frequency [Hz]?", mains_freq, 45, 65, 1, &ok,
+        Qt::WindowFlags());
+    if (ok) {
+        mains_freq = d6;
+    }
+    if (idealizerType == 2) {
+        double d4 = QInputDialog::getDouble(this, "QInputDialog::getDouble()",
+            "Do you want to modify the detection delay of CUSUM [ms]?", cusum_delay_ms, 0.2, 1000, 1, &ok,
+            Qt::WindowFlags(), 1);
+        if (ok) {
+            cusum_delay_ms = d4;
+        }
+    }
 
     std::string disp_str = "Current per Channel: ";
     disp_str = disp_str + std::to_string(current_per_channel);
@@ -238,19 +370,6 @@ void MyMain::on_pushBtnClicked() {
     disp_str = disp_str + " [mV]";
     this->displayInfo(disp_str.c_str());
 
-    // ****** Opening of the result emphasis window upon starting acquisition
-    if (proteinType == 1 && postprocessType == 2){
-        subWindow = new subWin(this);
-        subWindow->setWindowFlags(Qt::Window);
-        subWindow->show();
-        subWindow->changeFontColor(1);
-        if (BKstimuli == 1) {
-            subWindow->changeString(3, "[Verapamil] is now");
-            subWindow->changeString(4, "uM");
-        }
-    }
-
-
     // ****** Initialization of graphs
     this->initialize_graphs();
 
@@ -263,12 +382,9 @@ void MyMain::on_pushBtnClicked() {
 // Start acquisition and drawing graphs.
 void MyMain::on_pushBtn2Clicked() {
     // ****** Start graphs and register the 1 Hz callback function [update_graph_1Hz()].
+    // The first state of the checkboxes is recorded by the Processing Block, to enable the corrections again after a voltage switch.
     this->start_graphs();
 
-    // Record the first state of checkboxes
-    corrections_user_specified[0] = ui.checkBox->isChecked();
-    corrections_user_specified[1] = ui.checkBox_2->isChecked();
-    
     displayInfo("Acquisition has started.  Push Stop button to stop acquisition.");
     displayInfo("**------**");
     this->ui.pushButton->setEnabled(false);
@@ -293,20 +409,72 @@ void MyMain::on_pushBtn3Clicked() {
 // Set the value to amplifier if possible.
 void MyMain::on_spinBoxChanged(int value) {
     // Apply the holding voltage to amplifier if applicable.
-    if (dataSource == 0) changeVoltageAmplifier(value);
-    // Change the current_per_channel through the pre-determined conducntance.
-    bias_voltage_user_specified = value;
-    current_per_channel = conductance_user_specified * (double)bias_voltage_user_specified;  // [pA]
-
-    // If necessary, automatically conducts baseline/conductance correction.
-    if (corrections_user_specified[0] == true) {
-        baseline = baseline_user_specified;
-        ui.checkBox->setChecked(true);
+    // The amplifier restarts acquisition every block, so the new voltage is effective from the first sample of the next block.
+    // While acquiring, the amplifier is driven by the Sense worker: the voltage is applied there before its next block,
+    // and applyHoldingVoltage() is called when that block is processed (the blocks in the queue are still at the old voltage,
+    // and the Po-V protocol does not count them). A local file is switched by the processing stage before its next block.
+    if (dataTimer_1Hz.isActive()) {
+        requested_voltage.store(value);
+        return;
     }
-    if (corrections_user_specified[1] == true) {
-        ui.checkBox_2->setChecked(true);
+    ProcessingControls controls;
+    readControls(&controls);
+    applyHoldingVoltage(value, (dataSource == 0) ? changeVoltageAmplifier(value) : 0, &controls);
+    writeControls(controls);
+}
+
+// Switch the processing to the new holding voltage.  latency: the time spent for reprogramming the amplifier [ms] (-1: failed).
+// Called in the processing stage while acquiring, otherwise on the GUI thread. The corrections are enabled again in "controls".
+void MyMain::applyHoldingVoltage(int value, double latency, ProcessingControls* controls) {
+    if (dataSource == 0) {
+        processing.voltage_switch_index = 0;
+        std::string disp_str = "Holding voltage: ";
+        disp_str = disp_str + std::to_string(value);
+        if (latency < 0) {
+            disp_str = disp_str + " [mV] could not be applied.";
+        }
+        else {
+            disp_str = disp_str + " [mV] applied in ";
+            disp_str = disp_str + std::to_string(latency);
+            disp_str = disp_str + " [ms]";
+        }
+        this->postInfo(disp_str.c_str());
     }
-    stimuli_ALLaverage.clear();
+    // Change the current_per_channel through the pre-determined conducntance (see ProcessingBlock::setHoldingVoltage()).
+    // If necessary, the baseline/conductance corrections are enabled again.
+    bias_voltage_user_specified = value;
+    processing.setHoldingVoltage(value, controls);
+}
+
+// The check boxes and the spin boxes which the Processing Block reads every block.
+void MyMain::readControls(ProcessingControls* controls) {
+    controls->filterType = ui.comboBox_4->currentIndex();
+    controls->filterCutoff = ui.spinBox_3->value();
+    controls->mains_cancellation = ui.checkBox_5->isChecked();
+    controls->max_open = ui.checkBox_3->isChecked() ? ui.spinBox_2->value() : -1;
+    controls->baseline_correction = ui.checkBox->isChecked();
+    controls->conductance_correction = ui.checkBox_2->isChecked();
+    controls->auto_calibration = ui.checkBox_4->isChecked();
+}
+
+// Reflect the corrections enabled or disabled by the Processing Block on the check boxes.
+void MyMain::writeControls(const ProcessingControls& controls) {
+    if (ui.checkBox->isChecked() != controls.baseline_correction) ui.checkBox->setChecked(controls.baseline_correction);
+    if (ui.checkBox_2->isChecked() != controls.conductance_correction) ui.checkBox_2->setChecked(controls.conductance_correction);
+}
+
+// Publish the check boxes to the processing stage when they have changed (called on the GUI thread by the 1 Hz callback).
+// The processing stage keeps its own copy between the changes, so that a correction cleared by the Processing Block
+// stays cleared until the check box shows it.
+void MyMain::publishControls() {
+    ProcessingControls controls;
+    readControls(&controls);
+    if (sameControls(controls, published_controls)) return;
+    published_controls = controls;
+    published_controls_version++;
+    std::lock_guard<std::mutex> lock(controls_mutex);
+    shared_controls = controls;
+    shared_controls_version = published_controls_version;
 }
 
 // ********************************************************************************************************
@@ -353,6 +521,57 @@ void MyMain::on_pushBtn13Clicked() {
     ui.spinBox->setValue(-60);
 }
 
+// Function called when "Po-V Protocol" button is pressed.
+// Start (or abort) the automated voltage-step protocol, which ends with the online fitting of the Boltzmann function.
+void MyMain::on_pushBtn14Clicked() {
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex);
+        if (protocol.isRunning()) {
+            protocol.abort();
+            protocol_started = false;
+            displayInfo("Po-V protocol is aborted.");
+            return;
+        }
+    }
+    if (!dataTimer_1Hz.isActive() || dataSource != 0 || proteinType != 1 || BKstimuli != 0) {
+        displayInfo("Po-V protocol requires the acquisition from the amplifier with BK (Voltage).");
+        return;
+    }
+
+    bool ok;
+    QString list = QInputDialog::getText(this, "QInputDialog::getText()",
+        "Holding voltages of the protocol [mV] (comma separated):", QLineEdit::Normal, "-60,-40,-20,20,40,60", &ok);
+    if (!ok) return;
+    std::vector<int> voltages;
+    for (const QString& field : list.split(',', Qt::SkipEmptyParts)) {
+        int v = field.trimmed().toInt(&ok);
+        if (ok && v != 0) voltages.push_back(v);   // 0 mV is skipped because the processing cannot be conducted.
+    }
+    if (voltages.empty()) {
+        displayInfo("No valid voltage is specified.");
+        return;
+    }
+    double target = QInputDialog::getDouble(this, "QInputDialog::getDouble()",
+        "Target half width of the 95% confidence interval of Po:", 0.05, 0.005, 0.5, 3, &ok,
+        Qt::WindowFlags(), 0.005);
+    if (!ok) return;
+    int max_dwell = QInputDialog::getInt(this, "QInputDialog::getInt()",
+        "Maximum dwell time per step [s]:", 60, 5, 3600, 1, &ok);
+    if (!ok) return;
+
+    int first_voltage;
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex);
+        protocol.setup(voltages, target, 5, max_dwell);
+        protocol.start();
+        // The processing stage truncates the protocol file before its next block (the export stage takes the rows of one thread).
+        protocol_started = true;
+        first_voltage = protocol.currentVoltage();
+    }
+    displayInfo("Po-V protocol has started.");
+    ui.spinBox->setValue(first_voltage);
+}
+
 
 // ********************************************************************************************************
 //   Utility functions
@@ -365,6 +584,42 @@ void MyMain::displayInfo(const char* str) {
     sb->setValue(sb->maximum());
 }
 
+// The widgets may be used only on the GUI thread, so a message from another thread is queued to it.
+void MyMain::postInfo(const char* str) {
+    std::string text(str);
+    QMetaObject::invokeMethod(this, [this, text]() { displayInfo(text.c_str()); }, Qt::QueuedConnection);
+}
+
+
+// Sense Block, called in the acquisition worker (see PipelineStages.cpp): read one 1 s block from the amplifier or the local file.
+// A holding voltage requested from the GUI is applied to the amplifier between two blocks, so that it is effective from the first sample
+// of the next block acquired (not of the next block processed, which may already be in the queue).
+static void readSenseBlock(SenseBlock* block) {
+    if (dataSource == 0) {
+        int voltage = requested_voltage.exchange(NO_VOLTAGE_REQUEST);
+        if (voltage != NO_VOLTAGE_REQUEST) {
+            block->status = 1;
+            block->voltage = voltage;
+            block->switch_index = 0;
+            block->latency = changeVoltageAmplifier(voltage);
+        }
+        readAmplifier(block->time.data(), block->current.data(), block->index);
+    }
+    else {
+        int switchIndex = 0;
+        int returnLocal = readLocal(block->time.data(), block->current.data(), block->index, &switchIndex);
+        if (returnLocal == -1) {
+            block->status = -1;     // The data range is over.
+        }
+        else if (returnLocal != 1) {
+            // The local file contains "bias voltage changing signal" at this timestep.
+            block->status = 1;
+            block->voltage = returnLocal;
+            block->switch_index = switchIndex;
+        }
+    }
+}
+
 
 // ********************************************************************************************************
 //   Graph drawing functions
@@ -400,116 +655,140 @@ void MyMain::initialize_graphs() {
     // make left and bottom axes transfer their ranges to right and top axes:
     connect(ui.customPlot_2->xAxis, SIGNAL(rangeChanged(QCPRange)), ui.customPlot_2->xAxis2, SLOT(setRange(QCPRange)));
     connect(ui.customPlot_2->yAxis, SIGNAL(rangeChanged(QCPRange)), ui.customPlot_2->yAxis2, SLOT(setRange(QCPRange)));
+
+    // ****** ui.customPlot_3 is the BOTTOM, GREEN graph. It shows the power spectral density of the raw current (log-log).
+    ui.customPlot_3->addGraph();
+    ui.customPlot_3->graph(0)->setPen(QPen(QColor(40, 160, 80)));
+    QSharedPointer<QCPAxisTickerLog> logTickerX(new QCPAxisTickerLog);
+    QSharedPointer<QCPAxisTickerLog> logTickerY(new QCPAxisTickerLog);
+    ui.customPlot_3->xAxis->setScaleType(QCPAxis::stLogarithmic);
+    ui.customPlot_3->xAxis->setTicker(logTickerX);
+    ui.customPlot_3->yAxis->setScaleType(QCPAxis::stLogarithmic);
+    ui.customPlot_3->yAxis->setTicker(logTickerY);
+    ui.customPlot_3->yAxis->setNumberFormat("eb");
+    ui.customPlot_3->yAxis->setNumberPrecision(0);
+    ui.customPlot_3->xAxis->setLabel("Frequency [Hz]");
+    ui.customPlot_3->yAxis->setLabel("PSD [pA^2/Hz]");
+    ui.customPlot_3->axisRect()->setupFullAxesBox();
+    ui.customPlot_3->xAxis->setRange(1, SAMPLE_FREQ / 2);
+    ui.customPlot_3->yAxis->setRange(1e-6, 1e2);
+    connect(ui.customPlot_3->xAxis, SIGNAL(rangeChanged(QCPRange)), ui.customPlot_3->xAxis2, SLOT(setRange(QCPRange)));
+    connect(ui.customPlot_3->yAxis, SIGNAL(rangeChanged(QCPRange)), ui.customPlot_3->yAxis2, SLOT(setRange(QCPRange)));
 }
 
 // Start the qCustomPlot graphs. (e.g. start the 1 Hz callback function)
 // Also, this function conducts all other necessary procedures to start acquisition. (e.g. delete the previously recorded data / prepare the log file with the first row)
 void MyMain::start_graphs() {
-    // ****** Start the 1 Hz callback function.
+    // ****** Start the 1 Hz callback function. It polls the blocks acquired by the Sense worker (started at the end of this function).
     connect(&dataTimer_1Hz, SIGNAL(timeout()), this, SLOT(update_graph_1Hz()));
-    dataTimer_1Hz.start(0);
+    dataTimer_1Hz.start(10);
     // ****** Set a flag to initialize the local variables in [update_graph_1Hz()].
     dataIndex_loop_num = -2;
     // ****** Delete the previously recorded data.
     ui.customPlot->graph(0)->data()->clear();
     ui.customPlot->graph(1)->data()->clear();
     ui.customPlot_2->graph(0)->data()->clear();
+    ui.customPlot_3->graph(0)->data()->clear();
+    ui.customPlot_3->replot();
     // ****** Move the graphs to their initial positions.
     ui.customPlot->xAxis->setRange(dataStartTime, 8, Qt::AlignLeft);
     ui.customPlot->replot();
     ui.customPlot_2->xAxis->setRange(dataStartTime, 8, Qt::AlignLeft);
     ui.customPlot_2->replot();
 
-    // ****** Prepare the logging output (1. filename)  [Ref] http://rinov.sakura.ne.jp/wp/cpp-date 
-    time_t t = time(nullptr);
-    const tm* lt = localtime(&t);
-    std::stringstream s;
-    s << "log\\";
-    s << lt->tm_year + 1900;
-    s << std::setw(2) << std::setfill('0') << lt->tm_mon + 1;
-    s << std::setw(2) << std::setfill('0') << lt->tm_mday;
-    s << "-";
-    s << std::setw(2) << std::setfill('0') << lt->tm_hour;
-    s << std::setw(2) << std::setfill('0') << lt->tm_min;
-    s << std::setw(2) << std::setfill('0') << lt->tm_sec;
-    switch (proteinType)
+    // ****** Prepare the logging output. The Processing Block creates its files with the first rows (see ProcessingBlock.cpp).
+    std::string result = logFilePrefix("log", proteinType);  // result = "log\\20220619-094610-AHL-"
+    this->myFileName_protocol = result + "Protocol.csv";
+    ProcessingConfig config = defaultProcessingConfig();
+    config.proteinType = proteinType;
+    config.BKstimuli = BKstimuli;
+    config.postprocessType = postprocessType;
+    config.idealizerType = idealizerType;
+    config.conductance = conductance_user_specified;
+    config.bias_voltage = bias_voltage_user_specified;
+    config.baseline = baseline_user_specified;
+    config.target_false_rate = target_false_rate;
+    config.mains_freq = mains_freq;
+    config.cusum_delay_ms = cusum_delay_ms;
+    config.dataStartTime = dataStartTime;
+    config.log_raw = (dataSource == 0);    // In case the current data is acquired from a real amplifier, then the raw value will also be output to file.
+    ProcessingControls controls;
+    readControls(&controls);
+    processing.start(config, controls, result, &exportStage);
+    // ****** The processing stage starts from the same controls, and then copies those published by the 1 Hz callback.
+    published_controls = controls;
+    published_controls_version++;
     {
-    case 0:
-        s << "-AHL-";
-        break;
-    case 1:
-        s << "-BK-";
-        break;
-    case 2:
-        s << "-OR8-";
-        break;
+        std::lock_guard<std::mutex> lock(controls_mutex);
+        shared_controls = controls;
+        shared_controls_version = published_controls_version;
     }
-    std::string result = s.str();  // result = "log\\20220619-094610-AHL-" 
-    this->myFileName_raw = result + "Raw.csv";
-    this->myFileName_processed = result + "Processed.csv";
-    this->myFileName_postprocessed = result + "POSTProcessed.csv";
-
-    // ****** Prepare the logging output (2. initial rows)  
-    // The output will be different based on the type of proteins (nanopore -> number only, ion channel -> open probability and magnitude of stimuli), so the first row should be adjusted.
-    FILE* fp;
-    // Processed data files
-    switch (proteinType)
-    {
-    case 0:
-        fopen_s(&fp, myFileName_processed.c_str(), "w");
-        if (fp) {
-            fprintf(fp, "time [s],num [-]\n");
-            fclose(fp);
-        }
-        break;
-    case 1:
-        fopen_s(&fp, myFileName_processed.c_str(), "w");
-        if (fp) {
-            if (BKstimuli == 0) {
-                fprintf(fp, "time [s],opProb,estimatedVoltage [mV],estimatedVoltage_upper [mV],estimatedVoltage_lower [mV],estimatedVoltage_ALLaverage [mV],appliedVoltage [mV]\n");
-            }
-            else if (BKstimuli == 1) {
-                fprintf(fp, "time [s],opProb,estimatedVerapamil [uM],estimatedVerapamil_upper [uM],estimatedVerapamil_lower [uM],estimatedVerapamil_ALLaverage [uM]\n");
-            }
-            fclose(fp);
-        }
-        break;
-    case 2:
-        fopen_s(&fp, myFileName_processed.c_str(), "w");
-        if (fp) {
-            fprintf(fp, "time [s],opProb,log10concentration [M]\n");
-            fclose(fp);
-        }
-        break;
+    stage_controls = controls;
+    stage_controls_version = published_controls_version;
+    stage_spectrum_pending = false;
+    stage_voltage_pending = NO_VOLTAGE_REQUEST;
+    pipeline_warned = false;
+    render_warned = false;
+    actuationStats.reset();
+    renderStats.reset();
+    // ****** Publish the live stream "bilakit" for the external analysis tools (a failure only disables the stream).
+    int stream_result = streamPublisher.open(BKSTREAM_DEFAULT_NAME, SAMPLE_FREQ, proteinType);
+    if (stream_result != 0) {
+        char disp_str[64];
+        snprintf(disp_str, sizeof(disp_str), "Unable to publish the live stream (%d).", stream_result);
+        displayInfo(disp_str);
     }
+    processing.setStream(streamPublisher.active() ? &streamPublisher : nullptr);
+
+    // ****** Up to 8 render frames (8 s) are queued for the GUI. The slots are sized here, so the hand-off does not allocate.
+    RenderFrame prototype;
+    prototype.time.assign(SAMPLE_FREQ, 0.0);
+    prototype.current.assign(SAMPLE_FREQ, 0.0);
+    prototype.processed.assign(SAMPLE_FREQ, 0);
+    renderQueue.setup(8, prototype);
+
+    // ****** Start the Sense Block in its worker thread. Up to 8 blocks (8 s) are queued while the processing falls behind.
+    // The amplifier paces the blocks by itself, and the local files are replayed at 1 block per second.
+    requested_voltage.store(NO_VOLTAGE_REQUEST);
+    acquisitionStage.setup(SAMPLE_FREQ, 8);
+    if (dataSource == 0) acquisitionStage.start(readSenseBlock, 0, 0);
+    else acquisitionStage.start(readSenseBlock, 1, 1);
+    // ****** Start the Processing and Actuation Blocks in their worker thread, which pops the acquired blocks.
+    processingStage.start(&acquisitionStage, [this](SenseBlock* block) { process_block(block); }, [this](SenseBlock* block) { actuate_block(block); });
+}
 
-    // In case the current data is acquired from a real amplifier, then the raw value will also be output to file.
-    if (dataSource == 0) {
-        fopen_s(&fp, myFileName_raw.c_str(), "w");
-        if (fp) {
-            fprintf(fp, "time [s],current [pA]\n");
-            fclose(fp);
-        }
-    }
-    
-    // PostProcessed Data files
-    if (postprocessType == 1) {
-        // For nanopores, conductance measurement and output.
-        fopen_s(&fp, myFileName_postprocessed.c_str(), "w");
-        if (fp) {
-            fprintf(fp, "step_time [s],conductance [pS]\n");  // [Note: This is completely adjusted to AHL, so I have to extend this to other proteins.] 
-            fclose(fp);
-        }
-    }
-    else if (postprocessType == 2) {
-        // For ion channels, emphasis at new window when exceeding the threshold.
-        // SubWindow setup is not needed here: pass.
-    }
+// Append the service time and the queue depth of every pipeline stage to the pipeline file.
+void MyMain::writePipeline(double time) {
+    processing.writePipeline(time, acquisitionStage.stats(), processingStage.stats(), actuationStats.snapshot(0), renderStats.snapshot(renderQueue.depth()));
 }
 
 // Stop the qCustomPlot graphs. 
+// The blocks already acquired are processed (without redrawing the graphs) before the files are closed.
 void MyMain::stop_graphs() {
     dataTimer_1Hz.stop();
+    acquisitionStage.stop();
+    processingStage.stop(true);
+    while (RenderFrame* frame = renderQueue.readSlot()) {
+        show_frame(frame, false);
+        renderQueue.commitRead();
+    }
+    // A holding voltage requested after the last block is applied now (the processing stage has stopped).
+    int voltage = requested_voltage.exchange(NO_VOLTAGE_REQUEST);
+    if (voltage != NO_VOLTAGE_REQUEST) {
+        ProcessingControls controls;
+        readControls(&controls);
+        applyHoldingVoltage(voltage, (dataSource == 0) ? changeVoltageAmplifier(voltage) : 0, &controls);
+        writeControls(controls);
+    }
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex);
+        protocol.abort();
+        protocol_started = false;
+    }
+    processing.finish();
+    processing.setStream(nullptr);
+    streamPublisher.close();
+    exportStage.flush();
 }
 
 
@@ -525,759 +804,352 @@ void MyMain::stop_graphs() {
 // ********************************************************************************************************
 
 void MyMain::update_graph_1Hz() {
-    // set the timer;
-    static QTime time(QTime::currentTime());
-    static double lastTimerKey = 0;
-
     // On the first loop after pushing "Acquire" button, reset variables.
+    // (The Processing Block and the pipeline are reset in start_graphs().)
     if (dataIndex_loop_num == -2) {
-        time.restart();
-        if (dataSource != 0) lastTimerKey = 0;
-        else lastTimerKey = -1;
-
-        lastOpenNumber = -1;
         number_of_channel = -1;
         prev_num_channels = -1;
-        current_per_channel = conductance_user_specified * (double)bias_voltage_user_specified;  // [pA]
-        baseline = baseline_user_specified;
-        rupture_flag = false;
-        recovery_flag = false;
-        on_detection = 0;
+        spectrum_replot = false;
 
         dataIndex_loop_num = -1;
     }
 
+    // The check boxes, which the processing stage copies before its next block.
+    publishControls();
+
     //***************************************
-    // 1 Hz watchdog 
-    double key = time.elapsed() / 1000.0;
-    if (key - lastTimerKey > 1)
-    {
-        lastTimerKey = floor(key);
-        dataIndex_loop_num++;
-        // 1/8 Hz scrolling
-        if (dataIndex_loop_num % 8 == 0) {
-            ui.customPlot->xAxis->setRange(dataIndex_loop_num + dataStartTime, 8, Qt::AlignLeft);
-            ui.customPlot_2->xAxis->setRange(dataIndex_loop_num + dataStartTime, 8, Qt::AlignLeft);
+    // Pipeline: the Sense Block and the Processing/Actuation Blocks run in their worker threads (see PipelineStages.cpp),
+    // and every processed block arrives here as a render frame. The frames are added to the graphs in order, but only the
+    // newest one waiting is redrawn: when the GUI has fallen behind, the render frames are dropped, and the processing
+    // never waits for the GUI.
+    while (RenderFrame* frame = renderQueue.readSlot()) {
+        bool render = (renderQueue.depth() <= 1);
+        if (!render && !render_warned) {
+            std::string disp_str = "The graphs are behind the processing by ";
+            disp_str = disp_str + std::to_string(renderQueue.depth() - 1);
+            disp_str = disp_str + " [s]. They are not redrawn until they catch up.";
+            this->displayInfo(disp_str.c_str());
+            render_warned = true;
         }
-        // 1/240 Hz buffer clearing for preventing std::bad_alloc error.
-        if (dataIndex_loop_num % 240 == 0) {
-            ui.customPlot->graph(0)->data()->clear();
-            ui.customPlot->graph(1)->data()->clear();
-            ui.customPlot_2->graph(0)->data()->clear();
+        show_frame(frame, render);
+        renderQueue.commitRead();
+    }
+    if (processingStage.endOfData()) {
+        this->on_pushBtn3Clicked();  // If the data range is over, terminate the process.
+    }
+}
+
+// Processing Block of one 1 s block acquired by the Sense worker. Called in the processing stage (see PipelineStages.cpp),
+// so the widgets are not used here: the results are handed to the GUI thread by actuate_block().
+void MyMain::process_block(SenseBlock* block) {
+    // The check boxes published by the GUI thread since the previous block (see publishControls()).
+    {
+        std::lock_guard<std::mutex> lock(controls_mutex);
+        if (shared_controls_version != stage_controls_version) {
+            stage_controls = shared_controls;
+            stage_controls_version = shared_controls_version;
         }
+    }
+    if (acquisitionStage.depth() > 1 && !pipeline_warned) {
+        std::string disp_str = "The processing is behind the acquisition by ";
+        disp_str = disp_str + std::to_string(acquisitionStage.depth() - 1);
+        disp_str = disp_str + " [s].";
+        this->postInfo(disp_str.c_str());
+        pipeline_warned = true;
+    }
 
-        //***************************************************************************************
-        // Sense Block: Acquire the raw (digitized) current data from either of the amplifier or the local file.
-        //***************************************************************************************
-        double currentTime[SAMPLE_FREQ]; // The timestamp of data.
-        double currentData[SAMPLE_FREQ]; // The raw current data (5000 samples per second).
+    //***************************************************************************************
+    // Sense Block: The raw (digitized) current data acquired from either of the amplifier or the local file by the Sense worker (readSenseBlock()).
+    //***************************************************************************************
+    if (dataSource != 0) {
+        // A holding voltage entered on the spin box while replaying a local file (see on_spinBoxChanged()).
+        int voltage = requested_voltage.exchange(NO_VOLTAGE_REQUEST);
+        if (voltage != NO_VOLTAGE_REQUEST) applyHoldingVoltage(voltage, 0, &stage_controls);
+    }
+    if (block->status == 1) {
         if (dataSource == 0) {
-            readAmplifier(currentTime, currentData, dataIndex_loop_num);
+            // The voltage requested in on_spinBoxChanged() has been applied before this block.
+            applyHoldingVoltage(block->voltage, block->latency, &stage_controls);
         }
-        else {
-            int returnLocal = readLocal(currentTime, currentData, dataIndex_loop_num);
-            if (returnLocal == -1) {
-                this->on_pushBtn3Clicked();  // If the data range is over, terminate the process.
-                return;
-            }
-            else if (returnLocal != 1) {
-                // This means that the local file contains "bias voltage changing signal" at this timestep.
-                ui.spinBox->setValue(returnLocal);
-            }
+        else if (block->voltage != bias_voltage_user_specified) {
+            // This means that the local file contains "bias voltage changing signal" at this timestep.
+            processing.voltage_switch_index = block->switch_index;
+            applyHoldingVoltage(block->voltage, 0, &stage_controls);
+            stage_voltage_pending = block->voltage;
         }
+    }
 
-        //***************************************************************************************
-        // Processing Block: Process the raw current to the idealized data, then obtain features like open probability.
-        //***************************************************************************************
-        /*
-        [Important] The autor's comment: 
-        This Processing Block, like other blocks (Sense and Actuation), should be refactored into separate source code,
-        which makes future extensions easier. However, because of the large number of variables used, the too many conditional branches,
-        and the accompanying processing changes, I couldn't refactor this section into separate files. 
-        
-        We sincerely hope that someone will understand and better organize this code someday.
-        */
-
-        // Processing (the former half)*******************************************************
-        // This code receives the raw (digitized) current values from "SenseAmplifier" or "SenseLocal", 
-        //    then idealizes the data to the number of open nanopores/ion channels,
-        int processedData[SAMPLE_FREQ]; // The idealized data (5000 samples per second).
-        for (int idx = 0; idx < SAMPLE_FREQ; idx++) processedData[idx] = -1;
-
-        const double threshold = 0.75;
-        const int rupture_threshold = 300;
-        const double nanopore_detection_threshold = 0.15;  // ~5 pA @ 50mV, 0.89 nS
-        int maxOpenNumber = -1;
-        double filteredData[SAMPLE_FREQ];
-        if (rupture_flag) {
-            prev_num_channels = -1;
-            number_of_channel = -1;
-            lastOpenNumber = -1;
-            on_detection = 0;
-            rupture_flag = false;
-            recovery_flag = false;
-        }
-        
-
-        switch (proteinType)
-        {
-        case 0:
-            // If nanopores
-            convolve_EDGE(currentData, filteredData, previousCurrent, 500);
-            //for (int idx = 0; idx < SAMPLE_FREQ; idx++) currentData[idx] = filteredData[idx];
-            
-            if (lastOpenNumber < 0)lastOpenNumber = 0;
-
-            if (!rupture_flag) {
-                for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
-
-                    double y_now = currentData[idx];
-                    //*******
-                    // If the bilayer is ruptured, break the loop after making "rupture_flag" true.
-                    // To distinguish "the beginning of rupture (number -> OVERFLOW)" and "the end of rupture (OVERFLOW -> number)",
-                    // we also use "recovery_flag", which prevents motor rotation on recovering.
-                    if (y_now > rupture_threshold || y_now < -rupture_threshold) {
-                        rupture_flag = true;
-                        break;
-                    }
-                                        
-                    if (on_detection == 1) {
-                        // find the local maximum ... find the exact position where OpenNumber changes. 
-                        if (current_per_channel > 0.1 && idx >= 1) {   // Positive bias voltage
-                            if (filteredData[idx - 1] > filteredData[idx]) {
-                                lastOpenNumber++;
-                                if (ui.checkBox_3->isChecked() && lastOpenNumber > ui.spinBox_2->value()) lastOpenNumber = ui.spinBox_2->value();
-                                on_detection = 3;
-                            }
-                        }
-                        else if (current_per_channel < -0.1 && idx >= 1) {
-                            if (filteredData[idx - 1] < filteredData[idx]) {
-                                lastOpenNumber++;
-                                if (ui.checkBox_3->isChecked() && lastOpenNumber > ui.spinBox_2->value()) lastOpenNumber = ui.spinBox_2->value();
-                                on_detection = 3;
-                            }
-
-                        }
-                    }
-                    else if (on_detection == 2) {
-                        // find the local minimum ... find the exact position where OpenNumber changes. 
-                        if (current_per_channel > 0.1 && idx >= 1) {   // Positive bias voltage
-                            if (filteredData[idx - 1] < filteredData[idx]) {
-                                lastOpenNumber--;
-                                if (lastOpenNumber < 0) lastOpenNumber = 0;
-                                on_detection = 3;
-                            }
-                        }
-                        else if (current_per_channel < -0.1 && idx >= 1) {
-                            if (filteredData[idx - 1] > filteredData[idx]) {
-                                lastOpenNumber--;
-                                if (lastOpenNumber < 0) lastOpenNumber = 0;
-                                on_detection = 3;
-                            }
-                        }
-                    }
-                    else if (on_detection == 3) {
-                        // find the plateau
-                        if (abs(filteredData[idx]) < 0.5) on_detection = 0;
-                    }
-                    else {
-                        if (current_per_channel > 0.1) {   // Positive bias voltage
-                            if (filteredData[idx] > current_per_channel * nanopore_detection_threshold) {
-                                on_detection = 1;
-                            }
-                            else if (filteredData[idx] < -current_per_channel * nanopore_detection_threshold) {
-                                on_detection = 2;
-                            }
-                        }
-                        else if (current_per_channel < -0.1) {
-                            if (filteredData[idx] < current_per_channel * nanopore_detection_threshold) {
-                                on_detection = 1;
-                            }
-                            else if (filteredData[idx] > -current_per_channel * nanopore_detection_threshold) {
-                                on_detection = 2;
-                            }
-                        }
-                    }
-                    processedData[idx] = lastOpenNumber;
-                    if (lastOpenNumber > maxOpenNumber) maxOpenNumber = lastOpenNumber;
-                }
-            }
-            break;
-        case 1:
-            // If ion channels
-            for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
-                double y_now = currentData[idx];
-                //*******
-                // If the bilayer is ruptured, break the loop after making "rupture_flag" true.
-                // To distinguish "the beginning of rupture (number -> OVERFLOW)" and "the end of rupture (OVERFLOW -> number)",
-                // we also use "recovery_flag", which prevents motor rotation on recovering.
-                if (y_now > rupture_threshold || y_now < -rupture_threshold) {
-                    rupture_flag = true;
-                    break;
-                }
-                // IF the target is inhibitor concentration sensing, we expect that there is only a single channel during sensing.
-                // (i.e. "Fix to the single channel" checkbox is checked)
-                // Under this assumption, we can additionally assume that the Faraday cage is open when the current > 30 pA.
-                // NOTE: This value is heuristic, and was obtained by observing the raw current.
-                double BKstimuliONE_threshold2 = 80;
-                if(BKstimuli == 1 && y_now > BKstimuliONE_threshold2) {
-                    rupture_flag = true; 
-                    stimuli_ALLaverage.clear();
-                    break;
-                }
-                //*******
-                // Open/close determination for each timestep
-                if (!rupture_flag) {
-                    if (current_per_channel > 0.1) {   // Positive bias voltage
-                        if (y_now > (lastOpenNumber + threshold) * current_per_channel + baseline) {
-                            lastOpenNumber++;
-                            if (ui.checkBox_3->isChecked() && lastOpenNumber > ui.spinBox_2->value()) lastOpenNumber = ui.spinBox_2->value(); // DEBUG
-                        }
-                        else if (y_now < (lastOpenNumber - threshold) * current_per_channel + baseline) {
-                            lastOpenNumber--;
-                            if (lastOpenNumber < 0) lastOpenNumber = 0;
-                        }
-                    }
-                    else if (current_per_channel < -0.1) {  // Negative bias voltage
-                        if (y_now < (lastOpenNumber + threshold) * current_per_channel + baseline) {
-                            lastOpenNumber++;
-                            if (ui.checkBox_3->isChecked() && lastOpenNumber > ui.spinBox_2->value()) lastOpenNumber = ui.spinBox_2->value();
-                        }
-                        else if (y_now > (lastOpenNumber - threshold) * current_per_channel + baseline) {
-                            lastOpenNumber--;
-                            if (lastOpenNumber < 0) lastOpenNumber = 0;
-                        }
-                    }
-                    else {   // When 0 mV is applied, the post processing cannnot be conducted.
-                        rupture_flag = true;
-                        recovery_flag = true;
-                    }
-                    processedData[idx] = lastOpenNumber;
-                    if (lastOpenNumber > maxOpenNumber) maxOpenNumber = lastOpenNumber;
-                }
-            }
-            break;
-        }
+    //***************************************************************************************
+    // Processing Block: Process the raw current to the idealized data, then obtain features like open probability.
+    //***************************************************************************************
+    // See ProcessingBlock.cpp, which is shared with the headless runner (cli/bilakit_cli.cpp).
+    // The controls do not change within a block. The conductance correction is done once: it is cleared in stage_controls.
+    processing.process(block, &stage_controls);
+    if (processing.spectrum_updated) stage_spectrum_pending = true;
+
+    // Feature extraction 2: Emphasis of the threshold detection results.
+    // The results of the block (and whether the stimuli exceed the threshold) are pushed to the display clients by
+    // the Processing Block (see PipelineResults.h and cli/bilakit_display.cpp).
+}
 
-        // recovery_flag [true if OVERFLOW -> 0] [true if 2 -> 0]
-        if (rupture_flag) {
-            if (-rupture_threshold < currentData[SAMPLE_FREQ - 1] && currentData[SAMPLE_FREQ - 1] < rupture_threshold) {
-                recovery_flag = true;
-            }
+// Actuation Block, Po-V protocol and the hand-off of the results to the GUI thread, after process_block() in the processing stage.
+void MyMain::actuate_block(SenseBlock* block) {
+    const bool rupture_flag = processing.rupture_flag;
+    const int maxOpenNumber = processing.maxOpenNumber;
+    const double opProb = processing.opProb;
+    const double stimuli = processing.stimuli;
+
+    //***************************************************************************************
+    // Actuation Block: Based on the processing results, drive peripheral devices like stepper motors.
+    //***************************************************************************************
+    // The rupture triggers the reformation, and the estimated stimuli of BK the speed control (see ActuationSerial.cpp).
+    // The commands are written to the serial port by the GUI thread, which owns it (see sendSerial()).
+    std::chrono::steady_clock::time_point actuation_start = std::chrono::steady_clock::now();
+    conductActuationSerial(rupture_flag, processing.recovery_flag, maxOpenNumber);
+    if (proteinType == 1 && !rupture_flag) conductActuationStimuli(BKstimuli, opProb, stimuli);
+    actuationStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - actuation_start).count(), 0);
+
+    //***************************************************************************************
+    // Po-V protocol: Step the holding voltage once the Po of the current step converges.
+    //***************************************************************************************
+    // The new voltage is applied by the Sense worker before the next block it acquires, which may already be waiting in
+    // the queue: the scheduler skips the blocks until the first one at the new voltage (see ProtocolScheduler::update()).
+    {
+        std::lock_guard<std::mutex> lock(protocol_mutex);
+        if (protocol_started) {
+            // Truncated through the export worker, which may hold the file open from a previous run of the protocol.
+            exportStage.append(myFileName_protocol, "time [s],appliedVoltage [mV],opProb,opProb_halfwidth,dwell [s],converged\n", true);
+            protocol_started = false;
         }
-        if (proteinType == 0 && maxOpenNumber >= 2) {
-            rupture_flag = true;
-            if (processedData[SAMPLE_FREQ - 1] == 0) { // Bug fixing
-                recovery_flag = true;
+        if (protocol.isRunning() && protocol.update(rupture_flag ? -1 : opProb, bias_voltage_user_specified)) {
+            const ProtocolStepResult& r = protocol.lastResult();
+            std::string& protocol_row = exportRow;
+            protocol_row.clear();
+            appendf(&protocol_row, "%d,%d,%lf,%lf,%d,%d\n", processing.nowTime, r.voltage, r.opProb, r.opProb_halfwidth, r.dwell, r.converged ? 1 : 0);
+            exportStage.append(myFileName_protocol, protocol_row);
+            if (protocol.isRunning()) {
+                // Requested like a voltage entered on the spin box, which shows it with the next render frame.
+                requested_voltage.store(protocol.currentVoltage());
+                stage_voltage_pending = protocol.currentVoltage();
             }
-        }
-
-        // Baseline correction
-        int num_channels[3] = {};  // If the open channels = 0, 1, or 2, the range will be used for Po calculation.
-        if (!rupture_flag && !recovery_flag) {
-            double zero_value = 0;
-            double one_value = 0;
-            bool updated = false;
-
-            for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
-                if (processedData[idx] == 0) {
-                    zero_value += currentData[idx];
-                    num_channels[0] += 1;
-                }else if (processedData[idx] == 1) {
-                    one_value += currentData[idx];
-                    num_channels[1] += 1;
-                }
-                else if (processedData[idx] == 2) {
-                    num_channels[2] += 1;
+            else {
+                double a, x0, a_se, x0_se;
+                if (protocol.fitBoltzmann(&a, &x0, &a_se, &x0_se)) {
+                    // The upper/lower curves are replaced by the 95% confidence interval of x0.
+                    processing.boltzmann_a[0] = processing.boltzmann_a[1] = processing.boltzmann_a[2] = a;
+                    processing.boltzmann_x0[0] = x0;
+                    processing.boltzmann_x0[1] = x0 + 1.96 * x0_se;
+                    processing.boltzmann_x0[2] = x0 - 1.96 * x0_se;
+                    std::string disp_str = "Po-V protocol finished.  a: ";
+                    disp_str = disp_str + std::to_string(a) + " (SE " + std::to_string(a_se) + "),  x0: ";
+                    disp_str = disp_str + std::to_string(x0) + " (SE " + std::to_string(x0_se) + ") [mV]";
+                    this->postInfo(disp_str.c_str());
                 }
-            }
-
-            // Update the baseline when the change is in ±50% of the single-molecule current.
-            if (ui.checkBox->isChecked()) {
-                if (num_channels[0] >= 10) { // For better stability
-                    double tmp = zero_value / num_channels[0];
-                    if (current_per_channel > 0) {
-                        if (-0.5 * current_per_channel < tmp && tmp < 0.5 * current_per_channel) {
-                            // if (ui.checkBox_2->isChecked()) current_per_channel -= (tmp - baseline);
-                            baseline = tmp;
-                            ui.checkBox->setChecked(false); // Perform correction only once after checking for better analysis result
-                            updated = true;
-                        }
-                    }
-                    else {
-                        if (0.5 * current_per_channel < tmp && tmp < -0.5 * current_per_channel) {
-                            // if (ui.checkBox_2->isChecked()) current_per_channel -= (tmp - baseline);
-                            baseline = tmp;
-                            ui.checkBox->setChecked(false);
-                            updated = true;
-                        }
-                    }
+                else {
+                    this->postInfo("Po-V protocol finished, but the Boltzmann fitting failed.");
                 }
             }
+        }
+    }
 
-            // Update the conductance when the change is in ±25% of the single-molecule current.
-            if (ui.checkBox_2->isChecked()) {
-                if (num_channels[1] >= 10) {
-                    double tmp = one_value / num_channels[1] - baseline;
-                    if (current_per_channel > 0) {
-                        if (0.75 * current_per_channel < tmp && tmp < 1.25 * current_per_channel) {
-                            current_per_channel = tmp;
-                            ui.checkBox_2->setChecked(false);
-                            updated = true;
-                        }
-                    }
-                    else {
-                        if (1.25 * current_per_channel < tmp && tmp < 0.75 * current_per_channel) {
-                            current_per_channel = tmp;
-                            ui.checkBox_2->setChecked(false);
-                            updated = true;
-                        }
-                    }
-                }
-            }
+    //***************************************************************************************
+    // UI Block: Hand the results to the GUI thread (see show_frame()).
+    //***************************************************************************************
+    // When the GUI is behind and the queue is full, the frame is dropped: the processing never waits for the graphs.
+    // A new spectrum and a switched voltage are then carried by the next frame queued.
+    RenderFrame* frame = renderQueue.writeSlot();
+    if (frame == nullptr) {
+        renderStats.drop();
+    }
+    else {
+        // Assigned into the vectors of the slot, which are sized once.
+        frame->index = block->index;
+        frame->time.assign(processing.currentTime.begin(), processing.currentTime.end());
+        frame->current.assign(processing.currentData.begin(), processing.currentData.end());
+        frame->processed.assign(processing.processedData.begin(), processing.processedData.end());
+        frame->rupture_flag = rupture_flag;
+        frame->maxOpenNumber = maxOpenNumber;
+        frame->opProb = opProb;
+        frame->stimuli = stimuli;
+        frame->current_per_channel = processing.current_per_channel;
+        frame->baseline = processing.baseline;
+        frame->spectrum_updated = stage_spectrum_pending;
+        if (stage_spectrum_pending) frame->spectrum = processing.spectrum;
+        frame->controls = stage_controls;
+        frame->controls_version = stage_controls_version;
+        frame->voltage = stage_voltage_pending;
+        renderQueue.commitWrite();
+        stage_spectrum_pending = false;
+        stage_voltage_pending = NO_VOLTAGE_REQUEST;
+    }
 
-            if (updated) {
-                std::string disp_str = "Current per Channel: ";
-                disp_str = disp_str + std::to_string(current_per_channel);
-                disp_str = disp_str + " [pA]   Baseline: ";
-                disp_str = disp_str + std::to_string(baseline);
-                disp_str = disp_str + " [pA]";
-                this->displayInfo(disp_str.c_str());
-            }
+    // Service time and queue depth of every stage in this block.
+    writePipeline(processing.currentTime[0]);
+}
 
+// UI Block of one processed block, on the GUI thread.
+// render: whether the graphs are redrawn (false for a frame followed by newer ones in the queue).
+void MyMain::show_frame(RenderFrame* frame, bool render) {
+    dataIndex_loop_num = frame->index;
+    // 1/8 Hz scrolling
+    if (dataIndex_loop_num % 8 == 0) {
+        ui.customPlot->xAxis->setRange(dataIndex_loop_num + dataStartTime, 8, Qt::AlignLeft);
+        ui.customPlot_2->xAxis->setRange(dataIndex_loop_num + dataStartTime, 8, Qt::AlignLeft);
+    }
+    // 1/240 Hz buffer clearing for preventing std::bad_alloc error.
+    if (dataIndex_loop_num % 240 == 0) {
+        ui.customPlot->graph(0)->data()->clear();
+        ui.customPlot->graph(1)->data()->clear();
+        ui.customPlot_2->graph(0)->data()->clear();
+    }
+    // A holding voltage switched by the processing stage (local file or Po-V protocol) is only shown: it is applied already.
+    if (frame->voltage != NO_VOLTAGE_REQUEST && frame->voltage != ui.spinBox->value()) {
+        const QSignalBlocker blocker(ui.spinBox);
+        ui.spinBox->setValue(frame->voltage);
+    }
+    // The corrections cleared by the Processing Block, unless the check boxes have changed since (the frame is then outdated).
+    if (frame->controls_version == published_controls_version) writeControls(frame->controls);
+
+    const double* currentTime = frame->time.data();
+    const double* currentData = frame->current.data();
+    const int* processedData = frame->processed.data();
+    const bool rupture_flag = frame->rupture_flag;
+    const int maxOpenNumber = frame->maxOpenNumber;
+    const double opProb = frame->opProb;
+    const double stimuli = frame->stimuli;
+
+    // Update the number of channels on the UI.
+    if (!rupture_flag) {
+        if (maxOpenNumber != number_of_channel) {
+            number_of_channel = maxOpenNumber;
+            char text[DISPLAY_TEXT_SIZE];
+            snprintf(text, sizeof(text), "%d", maxOpenNumber);
+            setDisplayText(ui.textBrowser_12, shown_channels, text);
         }
+    }
+    else {
+        setDisplayText(ui.textBrowser_12, shown_channels, "X");
+    }
 
-        // Processing (the latter half)*******************************************************
-        // This code receives the raw current values AND the idealized data,
-        //    then calculates the experiment-specific features (i.e. open probability of ion channels, conductance of nanopores).
-
-        // Calculating the open probability
-        // double opProb = p; 
-        // zero_num / 5000 = (1-p)^maxOpenNumber
-        // p = 1 - pow(zero_num/5000, 1/maxOpenNumber)
-        // if (maxOpenNumber = 0) p = 0;
-        opProb = -99;    // Cannot calculate opProb when the bilayer is ruptured or maxOpenNumber = 0.
-        if (!rupture_flag) {
-            if (maxOpenNumber == 1) {
-                opProb = num_channels[1] / double(SAMPLE_FREQ);  // Po
-                if (opProb < 0.001) opProb = 0.001;
-                if (opProb > 0.999) opProb = 0.999;
-            }
-            else if (maxOpenNumber == 2) {
-                double opProb2 = sqrt(num_channels[2] / double(SAMPLE_FREQ));  // num_channels[2] / 5kHz = Po^2
-                double opProb0 = 1 - sqrt(num_channels[0] / double(SAMPLE_FREQ)); // num_channels[0] / 5kHz = (1-Po)^2
-                double opProb1 = 0.0;
-                if(num_channels[2] >= num_channels[0]) opProb1 = (1 + sqrt(1 - 2 * num_channels[1] / double(SAMPLE_FREQ))) / 2;  // num_channels[1] / 5kHz = 2Po(1-Po)
-                else opProb1 = (1 - sqrt(1 - 2 * num_channels[1] / double(SAMPLE_FREQ))) / 2;
-                //DEBUG
-                std::cout << "Po-0:" << opProb0 << "\tPo-1:" << opProb1 << "\tPo-2:" << opProb2 << std::endl;
-                // Take the average value to estimate the real opProb. However, when a value took "0 (int)" or "1(int)", we remove it from the calculation.
-                if (opProb0 > 0.999) { // When num_channels[0] == 0
-                    opProb = (opProb1 + opProb2) / 2;
-                }
-                else if (opProb2 < 0.001) { // When num_channels[2] == 0
-                    opProb = (opProb0 + opProb1) / 2;
-                }
-                else if (num_channels[1] > 2500) { // Ideally, num[1] won't exceed 2500 in any Po. However, in reality, sometimes num[1] overflows 2500, leading opProb1 to be -infinity.
-                    opProb = (opProb0 + opProb2) / 2;
-                }
-                else {
-                    opProb = (opProb0 + opProb1 + opProb2) / 3;
-                }
-                if (opProb < 0.001) opProb = 0.001;
-                if (opProb > 0.999) opProb = 0.999;
-            }
-            else if(maxOpenNumber > 0) {
-                opProb = 1 - pow(num_channels[0] / double(SAMPLE_FREQ), 1.0 / maxOpenNumber);
-                if (opProb < 0.001) opProb = 0.001;
-                if (opProb > 0.999) opProb = 0.999;
-            }
+    // Add the data and update the graphs on the UI.
+    // The data are always added, but the graphs are redrawn only when "render" (the render frames are dropped while catching up).
+    std::chrono::steady_clock::time_point render_start = std::chrono::steady_clock::now();
+    if (!rupture_flag) {
+        for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
+            ui.customPlot->graph(0)->addData(currentTime[idx], currentData[idx]);
+            ui.customPlot_2->graph(0)->addData(currentTime[idx], processedData[idx]);
         }
-
-        // Feature extraction 1:  Estimating the magnitude of stimuli by the given mathematical relationship.
-        FILE* fp;
-        int nowTime = round(dataIndex_loop_num + dataStartTime) + 1;
-        switch (proteinType)
-        {
-        case 0:
-            // if AHL, do nothing for stimuli estimation.
-            // Export the maxOpenNumber.
-            if (!rupture_flag) {
-                fopen_s(&fp, myFileName_processed.c_str(), "a");
-                if (fp) {
-                    fprintf(fp, "%d,%d\n", nowTime, maxOpenNumber);
-                }
-            }
-            else {
-                fopen_s(&fp, myFileName_processed.c_str(), "a");
-                if (fp) {
-                    fprintf(fp, "%d,#N/A\n", nowTime);
-                }
-            }
-            break;
-        case 1:
-            // if BK, estimate the applied voltage or the applied inhibitor concentration
-            if (opProb > 0 && !rupture_flag) {
-                if (BKstimuli == 0) {
-                    // Given the data of pig-BK, 250mM KCl, 100 uM CaCl2 [20220427_BK channel_mV 変化.abf],
-                    // we can estimate the stimuli(x) from the open probability (p) by applying sigmoidal function.
-                    // p = 1 / (1 + exp(-a*(x-x0)))
-                    // x = x0 + ln(p/(1-p))/a
-                    // According to Excel solver, a = 0.070469599, x0 = -28.3978081   (old version)
-                    // [New version]    a = 0.076469, x0 = -37.8402  [lower]
-                    //                  a = 0.0625493343322725, x0 = -26.0010643562768  [center]
-                    //                  a = 0.066644, x0 = -13.32    [upper]
-                    // 
-                    //stimuli = -28.3978081 + log(opProb / (1 - opProb)) / 0.070469599;
-                    stimuli = -26.0010643562768 + log(opProb / (1 - opProb)) / 0.0625493343322725;
-                    stimuli_lower = -37.8402 + log(opProb / (1 - opProb)) / 0.076469;
-                    stimuli_upper = -13.32 + log(opProb / (1 - opProb)) / 0.066644;
-                    
-                    // Value compensation: the estimated value is usually different to the actual value
-                    // V_estimated [mV] = 0.7096 * V_actual [mV] - 16.877
-                    // V_actual = (V_estimated + 16.877) / 0.7096
-                    // [Autoer's note] This compensation is just temporary, and we didn't use it in the journal.
-                    // Increasing the number of measured lipid bilayers will enhance the accuracy.
-                    
-                    //stimuli = (stimuli + 16.877) / 0.7096;
-                    //stimuli_lower = (stimuli_lower + 16.877) / 0.7096;
-                    //stimuli_upper = (stimuli_upper + 16.877) / 0.7096;
-                    
-                    stimuli_ALLaverage.append(stimuli);
-                    double sum = 0;
-                    for (int i = 0; i < stimuli_ALLaverage.size(); i++) sum += stimuli_ALLaverage.at(i);
-                    double average = sum / stimuli_ALLaverage.size();
-
-                    fopen_s(&fp, myFileName_processed.c_str(), "a");
-                    if (fp) {
-                        fprintf(fp, "%d,%lf,%lf,%lf,%lf,%lf,%d\n", nowTime, opProb, stimuli, stimuli_upper, stimuli_lower, average, bias_voltage_user_specified);
-                    }
-                }
-                else if (BKstimuli == 1) {
-                    // Given the data of pig-BK, 250mM KCl, 2mM CaCl2 [220627 Verapamil - BK.xlsx],
-                    // we can estimate the applied verapamil concentration (x) from the open probability (p) by applying sigmoidal function.
-                    // x' = log10(x [µM]) ... 1 nM = -3, 1 µM = 0, 1 mM = 3.
-                    // p = 1 / (1 + exp(-a*(x'-x'0)))
-                    // x' = x'0 + ln(p/(1-p))/a
-                    // x [uM] = exp10(x'0 + ln(p/(1-p))/a)
-                    // According to Excel solver; 
-                    //   [middle]  a = -0.992555977372338, x'0 = 1.37761700241996 
-                    //   [upper]   a = (same), x'0 = 2.09910501672377 
-                    //   [lower]   a = (same), x'0 = 0.371686045017188
-                    //  
-                    // If x < 0.01, it will be much better that we use [nM].
-                    // If x > 1000, it will be much better that we use [mM].
-
-                    stimuli = pow(10, 1.37761700241996 + log(opProb / (1 - opProb)) / -0.992555977372338);
-                    stimuli_lower = pow(10, 0.371686045017188 + log(opProb / (1 - opProb)) / -0.992555977372338);
-                    stimuli_upper = pow(10, 2.09910501672377 + log(opProb / (1 - opProb)) / -0.992555977372338);
-                    stimuli_ALLaverage.append(stimuli);
-                    double sum = 0;
-                    for (int i = 0; i < stimuli_ALLaverage.size(); i++) sum += stimuli_ALLaverage.at(i);
-                    double average = sum / stimuli_ALLaverage.size();
-
-                    fopen_s(&fp, myFileName_processed.c_str(), "a");
-                    if (fp) {
-                        fprintf(fp, "%d,%lf,%lf,%lf,%lf,%lf\n", nowTime, opProb, stimuli, stimuli_upper, stimuli_lower, average);
-                    }
-                }
-            }
-            else {
-                // 0 V applied, or the moment when openNumber happens to be zero, or the transition between two different voltages (maxOpenNumber will be -1)
-                if (BKstimuli == 0) {
-                    fopen_s(&fp, myFileName_processed.c_str(), "a");
-                    if (fp) {
-                        fprintf(fp, "%d,#N/A,#N/A,#N/A,#N/A,#N/A,%d\n", nowTime, bias_voltage_user_specified);
-                    }
-                }
-                else if (BKstimuli == 1) {
-                    fopen_s(&fp, myFileName_processed.c_str(), "a");
-                    if (fp) {
-                        fprintf(fp, "%d,#N/A,#N/A,#N/A,#N/A,#N/A\n", nowTime);
-                    }
-                }
-            }
-            break;
-        case 2:
-            // if OR8, estimate the applied octenol concentration
-            // Given the data of [Dekel et al., 2016] (https://www.nature.com/articles/srep37330) (TaOR8 vs R-Octenol),
-            // x = log10(concentration)
-            // p = 1 / (1 + exp(-a*(x-x0)))
-            // x = x0 + ln(p/(1-p))/a
-            // concentration = exp10(x0 + ln(p/(1-p))/a)
-            // According to Excel solver, a = 1.597072388, x0 = -6.495105404 
-            // if(x > -6) concentration = exp10(x - (-6)) [uM]
-            // else  concentration = exp10(x - (-9)) [nM]
-            if (opProb > 0 && !rupture_flag) {
-                stimuli = -6.495105404 + log(opProb / (1 - opProb)) / 1.597072388;
-                fopen_s(&fp, myFileName_processed.c_str(), "a");
-                if (fp) {
-                    fprintf(fp, "%d,%lf,%lf\n", nowTime, opProb, stimuli);
-                }
+        if (prev_num_channels != number_of_channel) {
+            // The above graph (raw data)
+            const double current_per_channel = frame->current_per_channel;
+            if (current_per_channel > 0) {
+                int tmp = int((number_of_channel + 0.75) * current_per_channel + frame->baseline);
+                ui.customPlot->yAxis->setRange(-2, tmp);
             }
             else {
-                fopen_s(&fp, myFileName_processed.c_str(), "a");
-                if (fp) {
-                    fprintf(fp, "%d,#N/A,#N/A\n", nowTime);
-                }
+                int tmp = int((number_of_channel + 0.75) * current_per_channel + frame->baseline);
+                ui.customPlot->yAxis->setRange(tmp, 2);
             }
-            break;
+            // The bottom graph (idealized data)
+            ui.customPlot_2->yAxis->setRange(-1.0, 1.0 + number_of_channel);
         }
-        if (fp) fclose(fp);
+        prev_num_channels = number_of_channel;
+    }
+    else {
+        // In case the bilayer is ruptured, only replot the raw data (because the idealized data is not calculated).
+        for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
+            ui.customPlot->graph(0)->addData(currentTime[idx], currentData[idx]);
+        }
+    }
+    if (render) {
+        ui.customPlot->replot();
+        //Sleep(300);
+        ui.customPlot_2->replot();
+    }
 
-        // Also export the raw data if the data is obtained from an amplifier.
-        if (dataSource == 0) {
-            fopen_s(&fp, myFileName_raw.c_str(), "a");
-            if (fp) {
-                for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
-                    fprintf(fp, "%lf,%lf\n", currentTime[idx], currentData[idx]);
-                }
-                fclose(fp);
-            }
+    // The PSD graph is updated when a new spectrum is available: the values are overwritten in place once the bins are set.
+    if (frame->spectrum_updated) {
+        const SpectrumResult& spectrum = frame->spectrum;
+        QSharedPointer<QCPGraphDataContainer> psd_data = ui.customPlot_3->graph(0)->data();
+        if (psd_data->size() == (int)spectrum.psd.size()) {
+            int k = 0;
+            for (QCPGraphDataContainer::iterator it = psd_data->begin(); it != psd_data->end(); ++it, ++k) it->value = spectrum.psd[k];
         }
+        else {
+            QVector<double> freq(spectrum.frequency.begin(), spectrum.frequency.end());
+            QVector<double> psd(spectrum.psd.begin(), spectrum.psd.end());
+            ui.customPlot_3->graph(0)->setData(freq, psd, true);
+        }
+        bool found;
+        QCPRange range = ui.customPlot_3->graph(0)->getValueRange(found, QCP::sdPositive);
+        if (found && range.lower > 0) ui.customPlot_3->yAxis->setRange(range.lower / 2, range.upper * 2);
+        spectrum_replot = true;
+    }
+    if (render && spectrum_replot) {
+        ui.customPlot_3->replot();
+        spectrum_replot = false;
+    }
+    if (render) renderStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - render_start).count(), renderQueue.depth());
+    else renderStats.drop();
 
 
-        // Feature extraction 2: Calculation of single-molecule conductance of nanopores, or emphasis of the threshold detection results.
+
+    // Updating the calculated features (opProb and stimuli)
+    if (!rupture_flag) {
         switch (proteinType)
         {
         case 0:
-            // If AHL, the only option available for now is to calculate the nanopore conductance.
-            if (!recovery_flag) {
-                if (postprocessType == 1) {
-                    // Evaluating the single-molecule conducntance.
-                    for (int idx = 0; idx < SAMPLE_FREQ - 1; idx++) {
-                        // Find the "jumping" point, which corresponds to the nanopore incorporation.
-                        if (processedData[idx + 1] - processedData[idx] == 1 && processedData[idx] != -1) {  //if (processedData[idx] == 0 && processedData[idx + 1] == 1) {
-                            // Use previousCurrent[] to compensate the out-of-range data. (e.g. if idx == 0, most of the data are loaded from previousCurrent[], not currentData[].)
-                            int zero_end_idx = idx;
-                            int zero_start_idx = -1;
-                            double zero_value = 0;
-                            for (zero_start_idx = zero_end_idx; zero_start_idx >= zero_end_idx - 500; zero_start_idx--) {
-                                if (zero_start_idx >= 0) {
-                                    if (processedData[zero_start_idx] != processedData[zero_end_idx]) break;
-                                    zero_value += currentData[zero_start_idx];
-                                }
-                                else {
-                                    zero_value += previousCurrent[500 + zero_start_idx];
-                                }
-                            }
-                            zero_value = zero_value / ((double)zero_end_idx - zero_start_idx);
-
-                            int one_start_idx = idx + 1;
-                            int one_end_idx = -1;
-                            double one_value = 0;
-                            for (one_end_idx = one_start_idx; one_end_idx < SAMPLE_FREQ - 1; one_end_idx++) {
-                                if (processedData[one_end_idx] != processedData[one_start_idx]) break;
-                                if (one_end_idx > idx + 500) break;
-                                one_value += currentData[one_end_idx];
-                            }
-                            one_value = one_value / ((double)one_end_idx - one_start_idx);
-
-                            // If the value is too strange, not use one.
-                            if (one_value - zero_value > current_per_channel * 1.9 || one_value - zero_value < current_per_channel * 0.1) continue;
-
-                            // Graph plotting
-                            //double tmpx[] = { currentTime[zero_start_idx], currentTime[zero_start_idx], currentTime[one_end_idx], currentTime[one_end_idx] };
-                            //double tmpy[] = { 0, 500, 500, 0 };
-                            //for (int i = 0; i < 4; i++) ui.customPlot->graph(1)->addData(tmpx[i], tmpy[i]);
-
-                            // CSV export after converting the current [pA] into conductance [pS] using heuristic knowledge of the bias voltage (50 [mV])
-                            double one_conductance = (one_value - zero_value) * 1000 / 50;
-
-                            std::string disp_str = "Estimated conducatnce: ";
-                            disp_str = disp_str + std::to_string(one_conductance);
-                            disp_str = disp_str + " [pS]";
-                            this->displayInfo(disp_str.c_str());
-
-                            fopen_s(&fp, myFileName_postprocessed.c_str(), "a");
-                            if (fp) {
-                                fprintf(fp, "%lf,%lf\n", std::round(currentTime[one_start_idx] * 100) / 100, std::round(one_conductance * 100) / 100);
-                                fclose(fp);
-                            }
-
-                        }
-
-                        if (processedData[idx] == -1) {
-                            // If the bilayer is ruptured, terminate all process and break.
-                            //this->displayInfo("Rupture detected");
-                            break;
-                        }
-                    }
-
-                }
-            }
+            // if AHL, do nothing
             break;
         case 1:
-            // if BK, the only option available for now is to emphasize the threshold exceeding by wireless communication.
-            if (!rupture_flag && opProb >= 0) {
-                if (postprocessType == 2) {
-                    // Emphasis the threshold exceeding by wireless communication.
-                    subWindow->changeString(0, std::to_string(int(round(stimuli))).c_str());
-                    subWindow->changeString(1, std::to_string(int(round(stimuli_upper))).c_str());
-                    subWindow->changeString(2, std::to_string(int(round(stimuli_lower))).c_str());
-                    if (stimuli > 0) {
-                        subWindow->changeFontColor(2);
-                    }
-                    else {
-                        subWindow->changeFontColor(1);
-                    }
-                }
+            // if BK
+            if (opProb < 0) {
+                setDisplayText(ui.textBrowser_2, shown_opProb, "X");
+                setDisplayText(ui.textBrowser_5, shown_stimuli, "X");
             }
             else {
-                if (postprocessType == 2) {
-                    // Emphasis the threshold exceeding by wireless communication.
-                    subWindow->changeString(0, "[XX]");
-                    subWindow->changeString(1, "[XX]");
-                    subWindow->changeString(2, "[XX]");
-                    subWindow->changeFontColor(1);
-                }
+                char text[DISPLAY_TEXT_SIZE];
+                snprintf(text, sizeof(text), "%d", int(opProb * 100));
+                setDisplayText(ui.textBrowser_2, shown_opProb, text);
+                snprintf(text, sizeof(text), "%d", int(round(stimuli)));
+                setDisplayText(ui.textBrowser_5, shown_stimuli, text);
             }
             break;
         case 2:
-            // if OR8, do nothing
-            break;
-        }
-        
-
-        //***************************************************************************************
-        // Actuation Block: Based on the processing results, drive peripheral devices like stepper motors.
-        //***************************************************************************************
-        conductActuationSerial(rupture_flag, recovery_flag, maxOpenNumber);
-        
-
-        //***************************************************************************************
-        // UI Block: Update the UI.
-        //***************************************************************************************
-        
-        // Update the number of channels on the UI. 
-        if (!rupture_flag) {
-            if (maxOpenNumber != number_of_channel) {
-                number_of_channel = maxOpenNumber;
-                ui.textBrowser_12->setText(QString::fromLocal8Bit(std::to_string(maxOpenNumber).c_str()));
-                ui.textBrowser_12->setAlignment(Qt::AlignCenter);
+            // if OR8
+            if (opProb < 0) {
+                setDisplayText(ui.textBrowser_2, shown_opProb, "X");
+                setDisplayText(ui.textBrowser_5, shown_stimuli, "X");
             }
-        }
-        else {
-            ui.textBrowser_12->setText(QString::fromLocal8Bit("X"));
-            ui.textBrowser_12->setAlignment(Qt::AlignCenter);
-        }
-
-        // Add the data and update the graphs on the UI.
-        if (!rupture_flag) {
-            for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
-                ui.customPlot->graph(0)->addData(currentTime[idx], currentData[idx]);
-                ui.customPlot_2->graph(0)->addData(currentTime[idx], processedData[idx]);
-            }
-            if (prev_num_channels != number_of_channel) {
-                // The above graph (raw data)
-                if (current_per_channel > 0) {
-                    int tmp = int((number_of_channel + 0.75) * current_per_channel + baseline);
-                    ui.customPlot->yAxis->setRange(-2, tmp);
-                }
-                else {
-                    int tmp = int((number_of_channel + 0.75) * current_per_channel + baseline);
-                    ui.customPlot->yAxis->setRange(tmp, 2);
-                }
-                // The bottom graph (idealized data)
-                ui.customPlot_2->yAxis->setRange(-1.0, 1.0 + number_of_channel);
-            }
-            prev_num_channels = number_of_channel;
-        }
-        else {
-            // In case the bilayer is ruptured, only replot the raw data (because the idealized data is not calculated).
-            for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
-                ui.customPlot->graph(0)->addData(currentTime[idx], currentData[idx]);
-            }
-        }
-        ui.customPlot->replot();
-        //Sleep(300);
-        ui.customPlot_2->replot();
-        
-
-
-        // Updating the calculated features (opProb and stimuli)
-        if (!rupture_flag) {
-            switch (proteinType)
-            {
-            case 0:
-                // if AHL, do nothing
-                break;
-            case 1:
-                // if BK
-                if (opProb < 0) {
-                    ui.textBrowser_2->setText(QString::fromLocal8Bit("X"));
-                    ui.textBrowser_2->setAlignment(Qt::AlignCenter);
-                    ui.textBrowser_5->setText(QString::fromLocal8Bit("X"));
-                    ui.textBrowser_5->setAlignment(Qt::AlignCenter);
-                    sendSerial("0\n");
-                }
-                else {
-                    ui.textBrowser_2->setText(QString::fromLocal8Bit(std::to_string(int(opProb * 100)).c_str()));
-                    ui.textBrowser_2->setAlignment(Qt::AlignCenter);
-                    ui.textBrowser_5->setText(QString::fromLocal8Bit(std::to_string(int(round(stimuli))).c_str()));
-                    ui.textBrowser_5->setAlignment(Qt::AlignCenter);
-
-                    // Send speed control signal toward Arduino
-                    if (BKstimuli == 0) {
-                        // voltage addition (stimuli: -100 mV ~ +100 mV)
-                        if (stimuli < -80) sendSerial("9\n");
-                        else if (stimuli < -60) sendSerial("8\n");
-                        else if (stimuli < -40) sendSerial("7\n");
-                        else if (stimuli < -20) sendSerial("6\n");
-                        else if (stimuli < 0) sendSerial("5\n");
-                        else if (stimuli < 10) sendSerial("4\n");
-                        else if (stimuli < 20) sendSerial("3\n");
-                        else if (stimuli < 30) sendSerial("2\n");
-                        else sendSerial("1\n");
-                    }
-                    else if (BKstimuli == 1) {
-                        // verapamil addition (stimuli: 0 uM ~ 20 uM)
-                        if (stimuli < 1) sendSerial("0\n");
-                        else if (stimuli < 4) sendSerial("1\n");
-                        else if (stimuli < 8) sendSerial("2\n");
-                        else if (stimuli < 12) sendSerial("3\n");
-                        else if (stimuli < 16) sendSerial("4\n");
-                        else sendSerial("5\n");
-                    }
-                }
-                break;
-            case 2:
-                // if OR8 
-                if (opProb < 0) {
-                    ui.textBrowser_2->setText(QString::fromLocal8Bit("X"));
-                    ui.textBrowser_2->setAlignment(Qt::AlignCenter);
-                    ui.textBrowser_5->setText(QString::fromLocal8Bit("X"));
-                    ui.textBrowser_5->setAlignment(Qt::AlignCenter);
+            else {
+                char text[DISPLAY_TEXT_SIZE];
+                snprintf(text, sizeof(text), "%d", int(opProb * 100));
+                setDisplayText(ui.textBrowser_2, shown_opProb, text);
+                if (stimuli > -6) {
+                    double concentration_uM = pow(10, stimuli - (-6));
+                    snprintf(text, sizeof(text), "%d", int(round(concentration_uM)));
+                    setDisplayText(ui.textBrowser_5, shown_stimuli, text);
+                    setDisplayText(ui.textBrowser_6, shown_unit, "uM");
                 }
                 else {
-                    ui.textBrowser_2->setText(QString::fromLocal8Bit(std::to_string(int(opProb * 100)).c_str()));
-                    ui.textBrowser_2->setAlignment(Qt::AlignCenter);
-                    if (stimuli > -6) {
-                        double concentration_uM = pow(10, stimuli - (-6));
-                        ui.textBrowser_5->setText(QString::fromLocal8Bit(std::to_string(int(round(concentration_uM))).c_str()));
-                        ui.textBrowser_5->setAlignment(Qt::AlignCenter);
-                        ui.textBrowser_6->setText(QString::fromLocal8Bit("uM"));
-                        ui.textBrowser_6->setAlignment(Qt::AlignCenter);
-                    }
-                    else {
-                        double concentration_nM = pow(10, stimuli - (-9));
-                        ui.textBrowser_5->setText(QString::fromLocal8Bit(std::to_string(int(round(concentration_nM))).c_str()));
-                        ui.textBrowser_5->setAlignment(Qt::AlignCenter);
-                        ui.textBrowser_6->setText(QString::fromLocal8Bit("nM"));
-                        ui.textBrowser_6->setAlignment(Qt::AlignCenter);
-                    }
+                    double concentration_nM = pow(10, stimuli - (-9));
+                    snprintf(text, sizeof(text), "%d", int(round(concentration_nM)));
+                    setDisplayText(ui.textBrowser_5, shown_stimuli, text);
+                    setDisplayText(ui.textBrowser_6, shown_unit, "nM");
                 }
-                break;
             }
+            break;
         }
-        else {
-            // ruptured
-            ui.textBrowser_2->setText(QString::fromLocal8Bit("X"));
-            ui.textBrowser_2->setAlignment(Qt::AlignCenter);
-            ui.textBrowser_5->setText(QString::fromLocal8Bit("X"));
-            ui.textBrowser_5->setAlignment(Qt::AlignCenter);
-        }
+    }
+    else {
+        // ruptured
+        setDisplayText(ui.textBrowser_2, shown_opProb, "X");
+        setDisplayText(ui.textBrowser_5, shown_stimuli, "X");
+    }
 
-        for (int idx = 0; idx < 500; idx++) previousCurrent[idx] = currentData[SAMPLE_FREQ - 500 + idx];
+    // The idealization restarts after a rupture.
+    if (rupture_flag) {
+        prev_num_channels = -1;
+        number_of_channel = -1;
     }
-}
\ No newline at end of file
+}
@@ -2,7 +2,10 @@
 
 #include <QtWidgets/QWidget>
 #include "ui_MyMain.h"
-#include "subWin.h"
+
+struct SenseBlock;
+struct ProcessingControls;
+struct RenderFrame;
 
 class MyMain : public QWidget
 {
@@ -12,6 +15,8 @@ public:
     MyMain(QWidget *parent = Q_NULLPTR);
     ~MyMain();
     void displayInfo(const char*);
+    // displayInfo() from any thread (e.g. the processing stage): the message is shown by the GUI thread.
+    void postInfo(const char*);
 
 private:
     Ui::MyMainClass ui;
@@ -21,13 +26,19 @@ private:
     void start_graphs();
     void stop_graphs();
 
-    // Data export
-    std::string myFileName_raw;
-    std::string myFileName_processed;
-    std::string myFileName_postprocessed;
+    // Data export (the other files are written by the Processing Block, see ProcessingBlock.cpp)
+    std::string myFileName_protocol;
+    void writePipeline(double time);
 
-    // Second window
-    subWin* subWindow;
+    // Processing of the acquired blocks in the processing stage (see PipelineStages.h), and their display (see update_graph_1Hz)
+    void process_block(SenseBlock* block);
+    void actuate_block(SenseBlock* block);
+    void show_frame(RenderFrame* frame, bool render);
+    void applyHoldingVoltage(int value, double latency, ProcessingControls* controls);
+    // The check boxes and the spin boxes for the Processing Block
+    void readControls(ProcessingControls* controls);
+    void writeControls(const ProcessingControls& controls);
+    void publishControls();
 
 private slots:
     // Push buttons
@@ -43,6 +54,7 @@ private slots:
     void on_pushBtn11Clicked();
     void on_pushBtn12Clicked();
     void on_pushBtn13Clicked();
+    void on_pushBtn14Clicked();
 
     // Main function (1 Hz callback)
     void update_graph_1Hz();
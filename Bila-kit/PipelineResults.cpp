@@ -0,0 +1,401 @@
+/******************************************************************************
+// PipelineResults.cpp
+//
+// This code pushes the results of every block to the subscribers over sockets (the protocol is in PipelineResults.h):
+//
+//   * publish() (the Processing Block) stamps the message and puts it into a bounded lock-free queue. If the worker
+//     is behind by the whole queue, the message is dropped; publish() never waits.
+//   * The worker accepts the subscribers, copies every message into the ring of each subscriber, and sends them with
+//     non-blocking sockets. A subscriber which does not read (or a slow network) fills its socket buffer and then its
+//     ring, and from then on loses its oldest messages; the other subscribers are not delayed.
+//   * The subscribers send nothing. A read of 0 bytes (or an error) closes the subscriber.
+//
+// The worker polls the sockets and the queue every 10 ms, which is negligible for the 1 s blocks.
+******************************************************************************/
+
+#include "PipelineResults.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#pragma comment(lib, "ws2_32.lib")
+typedef int socklen_t;
+#define SOCKET_ERROR_CODE WSAGetLastError()
+#define WOULD_BLOCK(e) ((e) == WSAEWOULDBLOCK)
+#define SEND_FLAGS 0
+#define SOCK(s) ((SOCKET)(s))
+static void closeSocket(intptr_t s) { closesocket((SOCKET)s); }
+static void setNonBlocking(intptr_t s) { u_long mode = 1; ioctlsocket((SOCKET)s, FIONBIO, &mode); }
+#else
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#define SOCKET_ERROR_CODE errno
+#define WOULD_BLOCK(e) ((e) == EAGAIN || (e) == EWOULDBLOCK || (e) == EINTR)
+#ifdef MSG_NOSIGNAL
+#define SEND_FLAGS MSG_NOSIGNAL     // A closed subscriber must not raise SIGPIPE.
+#else
+#define SEND_FLAGS 0
+#endif
+#define SOCK(s) ((int)(s))
+static void closeSocket(intptr_t s) { ::close((int)s); }
+static void setNonBlocking(intptr_t s) { fcntl((int)s, F_SETFL, fcntl((int)s, F_GETFL, 0) | O_NONBLOCK); }
+#endif
+
+static_assert(sizeof(ResultMessage) == 88, "the result message layout is fixed");
+
+static const int QUEUE_MESSAGES = 256;
+static const int POLL_MS = 10;
+
+#ifdef _WIN32
+// Winsock is started once per process.
+static void startSockets() {
+    static bool started = false;
+    if (!started) {
+        WSADATA data;
+        WSAStartup(MAKEWORD(2, 2), &data);
+        started = true;
+    }
+}
+#else
+static void startSockets() {}
+#endif
+
+// The address of "tcp:PORT", "tcp:HOST:PORT" or "unix:PATH". Returns false for a syntax error.
+struct Endpoint {
+    bool is_unix;
+    std::string host;
+    int port;
+    std::string path;
+};
+
+static bool parseEndpoint(const std::string& text, Endpoint* e) {
+    e->is_unix = false;
+    e->host = "127.0.0.1";
+    e->port = 0;
+    e->path.clear();
+    if (text.compare(0, 5, "unix:") == 0) {
+#ifdef _WIN32
+        return false;
+#else
+        e->is_unix = true;
+        e->path = text.substr(5);
+        return !e->path.empty() && e->path.size() < sizeof(((sockaddr_un*)nullptr)->sun_path);
+#endif
+    }
+    if (text.compare(0, 4, "tcp:") != 0) return false;
+    std::string rest = text.substr(4);
+    size_t colon = rest.rfind(':');
+    if (colon != std::string::npos) {
+        e->host = rest.substr(0, colon);
+        rest = rest.substr(colon + 1);
+    }
+    char* end;
+    long port = strtol(rest.c_str(), &end, 10);
+    if (rest.empty() || *end != '\0' || port < 0 || port > 65535) return false;
+    e->port = (int)port;
+    return true;
+}
+
+// A connected or listening socket for "e", or -1 (with the error code in *error).
+static intptr_t openSocket(const Endpoint& e, bool listening, int* error) {
+    intptr_t s;
+#ifndef _WIN32
+    if (e.is_unix) {
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, e.path.c_str(), sizeof(addr.sun_path) - 1);
+        s = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (s < 0) {
+            *error = errno;
+            return -1;
+        }
+        if (listening) unlink(e.path.c_str());    // A socket file left by a previous run.
+        int r = listening ? bind(SOCK(s), (sockaddr*)&addr, sizeof(addr)) : ::connect(SOCK(s), (sockaddr*)&addr, sizeof(addr));
+        if (r != 0 || (listening && listen(SOCK(s), 16) != 0)) {
+            *error = errno;
+            closeSocket(s);
+            return -1;
+        }
+        return s;
+    }
+#endif
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((unsigned short)e.port);
+    if (inet_pton(AF_INET, e.host.c_str(), &addr.sin_addr) != 1) {
+        *error = EINVAL;
+        return -1;
+    }
+    s = (intptr_t)socket(AF_INET, SOCK_STREAM, 0);
+    if (s < 0) {
+        *error = SOCKET_ERROR_CODE;
+        return -1;
+    }
+    int one = 1;
+#ifdef _WIN32
+    // SO_REUSEADDR lets another process bind the same port on Windows (and take the subscribers), so the port is held exclusively.
+    if (listening) setsockopt(SOCK(s), SOL_SOCKET, SO_EXCLUSIVEADDRUSE, (const char*)&one, sizeof(one));
+#else
+    // A restarted server can listen again while the connections of the previous one are in TIME_WAIT.
+    if (listening) setsockopt(SOCK(s), SOL_SOCKET, SO_REUSEADDR, (const char*)&one, sizeof(one));
+#endif
+    int r = listening ? bind(SOCK(s), (sockaddr*)&addr, sizeof(addr)) : ::connect(SOCK(s), (sockaddr*)&addr, sizeof(addr));
+    if (r != 0 || (listening && listen(SOCK(s), 16) != 0)) {
+        *error = SOCKET_ERROR_CODE;
+        closeSocket(s);
+        return -1;
+    }
+    setsockopt(SOCK(s), IPPROTO_TCP, TCP_NODELAY, (const char*)&one, sizeof(one));
+    return s;
+}
+
+// ****** ResultServer
+
+ResultServer::ResultServer() : stopping(false), num_clients(0), num_dropped(0) {
+    client_capacity = 64;
+    bound_port = 0;
+    next_seq = 0;
+}
+
+ResultServer::~ResultServer() {
+    stop();
+}
+
+int ResultServer::start(const std::string& endpoint, int client_buffer) {
+    stop();
+    startSockets();
+    Endpoint e;
+    if (!parseEndpoint(endpoint, &e)) return EINVAL;
+    int error = 0;
+    intptr_t s = openSocket(e, true, &error);
+    if (s < 0) return error ? error : -1;
+    setNonBlocking(s);
+    listeners.assign(1, s);
+    bound_port = 0;
+    unix_path = e.is_unix ? e.path : std::string();
+    if (!e.is_unix) {
+        sockaddr_in addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(SOCK(s), (sockaddr*)&addr, &len) == 0) bound_port = ntohs(addr.sin_port);
+    }
+    client_capacity = (client_buffer > 0) ? client_buffer : 1;
+    queue.setup(QUEUE_MESSAGES);
+    next_seq = 0;
+    num_clients.store(0);
+    num_dropped.store(0);
+    stopping.store(false);
+    worker = std::thread(&ResultServer::run, this);
+    return 0;
+}
+
+void ResultServer::stop() {
+    if (!worker.joinable()) return;
+    stopping.store(true);
+    worker.join();
+    for (Client& c : clientList) closeSocket(c.socket);
+    clientList.clear();
+    for (intptr_t s : listeners) closeSocket(s);
+    listeners.clear();
+#ifndef _WIN32
+    if (!unix_path.empty()) unlink(unix_path.c_str());
+#endif
+    unix_path.clear();
+    num_clients.store(0);
+}
+
+void ResultServer::publish(const ResultMessage& message) {
+    if (!worker.joinable()) return;
+    const uint64_t seq = next_seq++;
+    ResultMessage* slot = queue.writeSlot();
+    if (slot == nullptr) {
+        num_dropped.fetch_add(1);
+        return;
+    }
+    *slot = message;
+    slot->magic = RESULT_MAGIC;
+    slot->version = RESULT_VERSION;
+    slot->size = sizeof(ResultMessage);
+    slot->seq = seq;
+    queue.commitWrite();
+}
+
+// Copy the message into the ring of every subscriber, dropping its oldest message if the ring is full.
+void ResultServer::dispatch(const ResultMessage& message) {
+    for (Client& c : clientList) {
+        const size_t capacity = c.ring.size();
+        if (c.count == capacity) {
+            c.head = (c.head + 1) % capacity;
+            c.count--;
+            num_dropped.fetch_add(1);
+        }
+        c.ring[(c.head + c.count) % capacity] = message;
+        c.count++;
+    }
+}
+
+// Send what the socket accepts without blocking. Returns false if the subscriber is gone.
+bool ResultServer::flush(Client* c) {
+    for (;;) {
+        if (c->sent == sizeof(ResultMessage)) {
+            if (c->count == 0) return true;
+            c->sending = c->ring[c->head];
+            c->head = (c->head + 1) % c->ring.size();
+            c->count--;
+            c->sent = 0;
+        }
+        const char* bytes = (const char*)&c->sending + c->sent;
+        int n = (int)send(SOCK(c->socket), bytes, (int)(sizeof(ResultMessage) - c->sent), SEND_FLAGS);
+        if (n < 0) {
+            int e = SOCKET_ERROR_CODE;
+            return WOULD_BLOCK(e);
+        }
+        c->sent += (size_t)n;
+        if (c->sent < sizeof(ResultMessage)) return true;   // The socket buffer is full.
+    }
+}
+
+void ResultServer::run() {
+    while (!stopping.load()) {
+        fd_set readable, writable;
+        FD_ZERO(&readable);
+        FD_ZERO(&writable);
+        intptr_t max_fd = 0;
+        for (intptr_t s : listeners) {
+            FD_SET(s, &readable);
+            if (s > max_fd) max_fd = s;
+        }
+        for (const Client& c : clientList) {
+            FD_SET(c.socket, &readable);
+            if (c.count > 0 || c.sent < sizeof(ResultMessage)) FD_SET(c.socket, &writable);
+            if (c.socket > max_fd) max_fd = c.socket;
+        }
+        timeval timeout;
+        timeout.tv_sec = 0;
+        timeout.tv_usec = POLL_MS * 1000;
+        int ready = select((int)max_fd + 1, &readable, &writable, nullptr, &timeout);
+
+        // New subscribers (they receive the messages published from now on).
+        if (ready > 0) {
+            for (intptr_t s : listeners) {
+                if (!FD_ISSET(s, &readable)) continue;
+                intptr_t fd;
+                while ((fd = (intptr_t)accept(SOCK(s), nullptr, nullptr)) >= 0) {
+#ifdef _WIN32
+                    // An fd_set holds FD_SETSIZE (64) sockets on Windows, including the listener.
+                    if (clientList.size() + listeners.size() >= FD_SETSIZE) {
+                        closeSocket(fd);
+                        continue;
+                    }
+#else
+                    if (fd >= FD_SETSIZE) {
+                        closeSocket(fd);
+                        continue;
+                    }
+#endif
+                    setNonBlocking(fd);
+                    Client c;
+                    c.socket = fd;
+                    c.ring.resize(client_capacity);
+                    c.head = 0;
+                    c.count = 0;
+                    c.sent = sizeof(ResultMessage);     // Nothing being sent
+                    clientList.push_back(c);
+                }
+            }
+        }
+        // The published messages.
+        while (const ResultMessage* m = queue.readSlot()) {
+            dispatch(*m);
+            queue.commitRead();
+        }
+        // Send, and drop the subscribers which are gone.
+        for (size_t k = 0; k < clientList.size();) {
+            Client& c = clientList[k];
+            bool alive = true;
+            if (ready > 0 && FD_ISSET(c.socket, &readable)) {
+                char scratch[256];
+                int n = (int)recv(SOCK(c.socket), scratch, sizeof(scratch), 0);
+                if (n == 0 || (n < 0 && !WOULD_BLOCK(SOCKET_ERROR_CODE))) alive = false;
+            }
+            if (alive) alive = flush(&c);
+            if (!alive) {
+                closeSocket(c.socket);
+                clientList.erase(clientList.begin() + k);
+                continue;
+            }
+            k++;
+        }
+        num_clients.store((int)clientList.size());
+    }
+}
+
+// ****** ResultSubscriber
+
+ResultSubscriber::ResultSubscriber() {
+    socket_fd = -1;
+    filled = 0;
+}
+
+ResultSubscriber::~ResultSubscriber() {
+    close();
+}
+
+int ResultSubscriber::connect(const std::string& endpoint) {
+    close();
+    startSockets();
+    Endpoint e;
+    if (!parseEndpoint(endpoint, &e)) return EINVAL;
+    int error = 0;
+    socket_fd = openSocket(e, false, &error);
+    filled = 0;
+    return (socket_fd >= 0) ? 0 : (error ? error : -1);
+}
+
+void ResultSubscriber::close() {
+    if (socket_fd >= 0) closeSocket(socket_fd);
+    socket_fd = -1;
+    filled = 0;
+}
+
+int ResultSubscriber::receive(ResultMessage* message, int timeout_ms) {
+    if (socket_fd < 0) return -1;
+    while (filled < sizeof(ResultMessage)) {
+        fd_set readable;
+        FD_ZERO(&readable);
+        FD_SET(socket_fd, &readable);
+        timeval timeout;
+        timeout.tv_sec = timeout_ms / 1000;
+        timeout.tv_usec = (timeout_ms % 1000) * 1000;
+        int ready = select((int)socket_fd + 1, &readable, nullptr, nullptr, &timeout);
+        if (ready == 0) return 0;
+        if (ready < 0) {
+            if (WOULD_BLOCK(SOCKET_ERROR_CODE)) continue;
+            close();
+            return -1;
+        }
+        int n = (int)recv(SOCK(socket_fd), buffer + filled, (int)(sizeof(ResultMessage) - filled), 0);
+        if (n <= 0) {
+            close();
+            return -1;
+        }
+        filled += (size_t)n;
+    }
+    filled = 0;
+    memcpy(message, buffer, sizeof(ResultMessage));
+    if (message->magic != RESULT_MAGIC || message->version != RESULT_VERSION || message->size != sizeof(ResultMessage)) {
+        close();
+        return -1;
+    }
+    return 1;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+/******************************************************************************
+* PipelineResults.h
+*
+* The results of every block (Po, the stimuli and its bounds, the channels, the rupture) pushed to any number of
+* subscribers over TCP or Unix sockets, e.g. the display on a second screen (cli/bilakit_display.cpp), which replaces
+* the sub-window mirrored by Miracast. See PipelineResults.cpp.
+******************************************************************************/
+
+#include "PipelineStages.h"
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define RESULT_MAGIC 0x4D524B42u    // "BKRM"
+#define RESULT_VERSION 1
+#define RESULT_DEFAULT_PORT 5757
+
+// ResultMessage::flags
+#define RESULT_RUPTURE 1            // The bilayer is ruptured in this block
+#define RESULT_RECOVERY 2           // The bilayer is recovering from a rupture
+#define RESULT_VALID 4              // opProb (and the stimuli of ion channels) are estimated in this block
+#define RESULT_EMPHASIS 8           // The stimuli exceed the threshold ("Emphasis when exceeding threshold" is selected)
+
+// The message of one block on the wire: 88 bytes in the byte order of the host (little endian on every supported
+// platform), without padding. A subscriber detects the lost messages by the gaps of "seq".
+struct ResultMessage {
+    uint32_t magic;             // RESULT_MAGIC
+    uint16_t version;           // RESULT_VERSION
+    uint16_t size;              // sizeof(ResultMessage)
+    uint64_t seq;               // The sequence number of the block since the server started
+    double time;                // The time of the first sample of the block [s]
+    double opProb;              // The open probability (-99: not estimated)
+    double stimuli;             // The estimated stimuli (ion channels), and its bounds
+    double stimuli_upper;
+    double stimuli_lower;
+    int32_t channels;           // The estimated number of channels (0: not estimated)
+    int32_t max_open;           // The maximum number of open channels (nanopores) in the block, -1: not idealized
+    int32_t flags;              // RESULT_RUPTURE | RESULT_RECOVERY | RESULT_VALID | RESULT_EMPHASIS
+    int32_t bias_voltage;       // [mV]
+    int32_t protein_type;       // 0: Nanopores (AHL), 1: Ion channels (BK), 2: Ion channels (OR8)
+    int32_t stimuli_type;       // 0: Membrane voltage [mV], 1: Verapamil [uM]
+    uint8_t reserved[8];
+};
+
+// The endpoints: "tcp:PORT" (the loopback interface), "tcp:HOST:PORT" (e.g. tcp:0.0.0.0:5757 for the other PCs),
+// or "unix:PATH" (not on Windows). The messages are not authenticated: listen on the other interfaces only in a trusted network.
+// The subscribers are limited by select(): 63 on Windows (FD_SETSIZE is 64 sockets, with the listener), and the file
+// descriptors below FD_SETSIZE (1024) elsewhere. The others are disconnected at once.
+
+// Publishes the messages to the subscribers from a worker thread. publish() only queues the message, and every
+// subscriber has a bounded buffer of its own: a slow subscriber loses its oldest messages, and never stalls the
+// pipeline or the other subscribers.
+class ResultServer
+{
+public:
+    ResultServer();
+    ~ResultServer();
+
+    // Listen on "endpoint" and start the worker. client_buffer: the messages kept per subscriber.
+    // Returns 0, or an error code (e.g. the port is in use).
+    int start(const std::string& endpoint, int client_buffer = 64);
+    void stop();
+    bool running() const { return worker.joinable(); }
+    // The TCP port listened on (e.g. for "tcp:0", which takes any free port). 0 for a Unix socket.
+    int port() const { return bound_port; }
+
+    // (The Processing Block.) Queue the message for every subscriber; magic, version, size and seq are set here.
+    // No system call and no allocation.
+    void publish(const ResultMessage& message);
+
+    int clients() const { return num_clients.load(); }
+    int pending() const { return queue.depth(); }              // The messages queued for the worker
+    long long dropped() const { return num_dropped.load(); }    // The messages lost by the slow subscribers (and by a full queue)
+
+private:
+    struct Client {
+        intptr_t socket;
+        std::vector<ResultMessage> ring;    // The messages not sent yet (the oldest is dropped when it is full)
+        size_t head;
+        size_t count;
+        ResultMessage sending;              // The message being sent, and its bytes sent
+        size_t sent;
+    };
+    void run();
+    void dispatch(const ResultMessage& message);
+    bool flush(Client* client);
+
+    BoundedQueue<ResultMessage> queue;      // publish() -> the worker
+    std::thread worker;
+    std::atomic<bool> stopping;
+    std::vector<intptr_t> listeners;
+    std::vector<Client> clientList;
+    int client_capacity;
+    int bound_port;
+    std::string unix_path;
+    uint64_t next_seq;
+    std::atomic<int> num_clients;
+    std::atomic<long long> num_dropped;
+};
+
+// A subscriber (the display, the tests).
+class ResultSubscriber
+{
+public:
+    ResultSubscriber();
+    ~ResultSubscriber();
+
+    // Connect to "endpoint". Returns 0, or an error code.
+    int connect(const std::string& endpoint);
+    void close();
+    bool connected() const { return socket_fd >= 0; }
+    // Wait up to timeout_ms for the next message. 1: received, 0: timeout, -1: disconnected (or not a Bila-kit server).
+    int receive(ResultMessage* message, int timeout_ms);
+
+private:
+    intptr_t socket_fd;
+    char buffer[sizeof(ResultMessage)];
+    size_t filled;
+};
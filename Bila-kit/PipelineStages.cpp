@@ -0,0 +1,421 @@
+/******************************************************************************
+// PipelineStages.cpp
+//
+// This code runs the 1 s blocks as a pipeline, instead of Sense -> Processing -> export -> UI one after another on
+// the GUI thread:
+//
+//   [Sense: worker]  --(acquisition queue)-->  [Processing, features, actuation: worker]  --(render queue)-->  [UI: GUI thread]
+//                                                                  |
+//                                                                  +--(export queue)-->  [CSV export: worker]
+//
+//   * The stages are connected by bounded single-producer single-consumer rings (BoundedQueue). The slots are
+//     preallocated and filled in place, so no lock and no allocation is needed per block.
+//   * Backpressure policy:
+//       - Acquisition is never dropped: when the acquisition queue is full, the Sense worker waits (the amplifier
+//         buffers up to 2 s internally), so the Processing Block always sees every sample.
+//       - CSV rows are never dropped: when the export queue is full, the Processing Block waits for the disk.
+//       - Render frames are dropped first: when the render queue is full, the processing stage drops the frame rather
+//         than wait for the GUI, and the GUI redraws only the newest of the frames waiting (see MyMain::update_graph_1Hz).
+//   * The processing stage does not touch the widgets: it reads a snapshot of the checkboxes published by the GUI
+//     thread, and its messages and serial commands are queued to the GUI thread (MyMain::postInfo, sendSerial).
+//   * Every stage records its service time and the depth of its input queue (StageStats), which are exported
+//     to the pipeline file every block.
+******************************************************************************/
+
+#include "PipelineStages.h"
+#include "Platform.h"
+#include <chrono>
+#include <stdarg.h>
+
+static double elapsedMs(std::chrono::steady_clock::time_point since) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+void StageStats::reset() {
+    items.store(0);
+    dropped.store(0);
+    stalls.store(0);
+    max_depth.store(0);
+    last_ms.store(0);
+    total_ms.store(0);
+    max_ms.store(0);
+    recent_ms.store(0);
+    recent.clear();
+}
+
+void StageStats::record(double service_ms, int depth) {
+    // Single writer (the thread of the stage), so load + store is enough.
+    items.store(items.load() + 1);
+    last_ms.store(service_ms);
+    total_ms.store(total_ms.load() + service_ms);
+    if (service_ms > max_ms.load()) max_ms.store(service_ms);
+    recent.add(service_ms);
+    recent_ms.store(recent.mean());
+    if (depth > max_depth.load()) max_depth.store(depth);
+}
+
+StageSnapshot StageStats::snapshot(int depth) const {
+    StageSnapshot s;
+    s.items = items.load();
+    s.dropped = dropped.load();
+    s.stalls = stalls.load();
+    s.depth = depth;
+    s.max_depth = max_depth.load();
+    s.service_ms = last_ms.load();
+    s.service_ms_mean = (s.items > 0) ? total_ms.load() / s.items : 0;
+    s.service_ms_recent = recent_ms.load();
+    s.service_ms_max = max_ms.load();
+    return s;
+}
+
+
+// ********************************************************************************************************
+//   Worker thread
+// ********************************************************************************************************
+
+bool WorkerThread::post(Job job_arg, void* context_arg) {
+    if (state.load() != 0) return false;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = job_arg;
+        context = context_arg;
+        quit = false;
+        state.store(1);
+    }
+    if (!worker.joinable()) worker = std::thread(&WorkerThread::run, this);
+    wake.notify_one();
+    return true;
+}
+
+void WorkerThread::wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    finished.wait(lock, [this]() { return state.load() == 0; });
+}
+
+void WorkerThread::stop() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void WorkerThread::run() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this]() { return quit || state.load() != 0; });
+        // A posted job is finished even when stopping, so that wait() returns.
+        if (state.load() != 0) {
+            Job j = job;
+            void* c = context;
+            lock.unlock();
+            j(c);
+            lock.lock();
+            state.store(0);
+            finished.notify_all();
+        }
+        if (quit) break;
+    }
+}
+
+
+// ********************************************************************************************************
+//   Work-stealing pool
+// ********************************************************************************************************
+
+void WorkStealingPool::run(int num_tasks, int num_threads, Task task) {
+    if (num_threads <= 0) num_threads = (int)std::thread::hardware_concurrency();
+    if (num_threads <= 0) num_threads = 1;
+    if (num_threads > num_tasks) num_threads = (num_tasks > 0) ? num_tasks : 1;
+    queues.clear();
+    for (int w = 0; w < num_threads; w++) queues.emplace_back(new TaskQueue());
+    // Worker w owns the tasks w, w + n, w + 2n, ... and takes them in this order from the back of its deque,
+    // while the thieves take the last ones (the short tasks, if the long ones come first) from the front.
+    for (int t = 0; t < num_tasks; t++) queues[t % num_threads]->tasks.push_front(t);
+    stolen.store(0);
+
+    std::vector<std::thread> workers;
+    for (int w = 1; w < num_threads; w++) {
+        workers.emplace_back([this, w, &task]() {
+            int t;
+            while (next(w, &t)) task(t, w);
+        });
+    }
+    int t;
+    while (next(0, &t)) task(t, 0);     // The calling thread is the worker 0.
+    for (std::thread& worker : workers) worker.join();
+}
+
+// The next task of the worker: its own, or stolen from the others. false when all queues are empty.
+// No task is added while running, so an empty sweep over all queues means the end.
+bool WorkStealingPool::next(int worker, int* task) {
+    {
+        TaskQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            *task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    const int n = (int)queues.size();
+    for (int k = 1; k < n; k++) {
+        TaskQueue& victim = *queues[(worker + k) % n];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            *task = victim.tasks.front();
+            victim.tasks.pop_front();
+            stolen.fetch_add(1);
+            return true;
+        }
+    }
+    return false;
+}
+
+
+// ********************************************************************************************************
+//   Acquisition stage
+// ********************************************************************************************************
+
+void AcquisitionStage::setup(int block_size, int capacity) {
+    stop();
+    SenseBlock prototype;
+    prototype.index = 0;
+    prototype.status = 0;
+    prototype.voltage = 0;
+    prototype.switch_index = -1;
+    prototype.latency = 0;
+    prototype.time.assign(block_size, 0.0);
+    prototype.current.assign(block_size, 0.0);
+    queue.setup(capacity, prototype);
+    stage_stats.reset();
+}
+
+void AcquisitionStage::start(ReadFunction read, double period, double first_delay) {
+    stop();
+    queue.clear();
+    stage_stats.reset();
+    running.store(true);
+    worker = std::thread(&AcquisitionStage::run, this, read, period, first_delay);
+}
+
+void AcquisitionStage::stop() {
+    running.store(false);
+    if (worker.joinable()) worker.join();
+}
+
+void AcquisitionStage::run(ReadFunction read, double period, double first_delay) {
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int index = 0; running.load(); index++) {
+        // Pacing (local files are replayed in real time). Wake up regularly to respond to stop().
+        double due = first_delay + index * period;
+        while (running.load() && elapsedMs(start) < due * 1000) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        }
+        // Never drop a block: wait for the Processing Block to free a slot.
+        SenseBlock* block = queue.writeSlot();
+        if (block == nullptr) {
+            stage_stats.stall();
+            while (running.load() && (block = queue.writeSlot()) == nullptr) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+            if (block == nullptr) break;
+        }
+
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        block->index = index;
+        block->status = 0;
+        block->voltage = 0;
+        block->switch_index = -1;
+        block->latency = 0;
+        read(block);
+        bool end = (block->status == -1);
+        queue.commitWrite();
+        stage_stats.record(elapsedMs(t0), queue.depth());
+        if (end) break;
+    }
+}
+
+
+// ********************************************************************************************************
+//   Processing stage
+// ********************************************************************************************************
+
+void ProcessingStage::start(AcquisitionStage* source_arg, BlockFunction process, BlockFunction actuate) {
+    stop();
+    source = source_arg;
+    stage_stats.reset();
+    draining.store(false);
+    finished.store(false);
+    running.store(true);
+    worker = std::thread(&ProcessingStage::run, this, process, actuate);
+}
+
+void ProcessingStage::stop(bool drain) {
+    draining.store(drain);
+    running.store(false);
+    if (worker.joinable()) worker.join();
+}
+
+void ProcessingStage::run(BlockFunction process, BlockFunction actuate) {
+    while (true) {
+        SenseBlock* block = source->front();
+        if (block == nullptr) {
+            if (!running.load()) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (!running.load() && !draining.load()) break;
+        if (block->status == -1) {
+            source->pop();
+            finished.store(true);
+            break;
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        process(block);
+        stage_stats.record(elapsedMs(t0), source->depth());
+        if (actuate) actuate(block);
+        source->pop();
+    }
+}
+
+
+// ********************************************************************************************************
+//   CSV export stage
+// ********************************************************************************************************
+
+void ExportStage::start(int capacity, int record_size_arg) {
+    stop();
+    record_size = (record_size_arg > 0) ? record_size_arg : 1;
+    Record prototype;
+    prototype.command = 0;
+    prototype.truncate = false;
+    prototype.path.reserve(256);
+    prototype.text.reserve(record_size);
+    queue.setup(capacity, prototype);
+    stage_stats.reset();
+    pushed.store(0);
+    written.store(0);
+    running.store(true);
+    worker = std::thread(&ExportStage::run, this);
+}
+
+void ExportStage::stop() {
+    running.store(false);
+    if (worker.joinable()) worker.join();     // The worker writes the remaining rows before it returns.
+}
+
+void ExportStage::flush() {
+    if (!worker.joinable()) return;
+    push(1, std::string(), "", 0, false);
+    while (written.load() < pushed.load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+}
+
+void ExportStage::append(const std::string& path, const std::string& text, bool truncate) {
+    if (!worker.joinable()) {
+        // Not started: write synchronously.
+        FILE* fp;
+        fopen_s(&fp, path.c_str(), truncate ? "w" : "a");
+        if (fp) {
+            fwrite(text.data(), 1, text.size(), fp);
+            fclose(fp);
+        }
+        return;
+    }
+    // The records are written in order, so a long text can be split anywhere.
+    size_t offset = 0;
+    do {
+        size_t length = text.size() - offset;
+        if (length > record_size) length = record_size;
+        push(0, path, text.data() + offset, length, truncate && offset == 0);
+        offset += length;
+    } while (offset < text.size());
+}
+
+void ExportStage::push(int command, const std::string& path, const char* text, size_t length, bool truncate) {
+    Record* r = queue.writeSlot();
+    if (r == nullptr) {
+        stage_stats.stall();
+        while ((r = queue.writeSlot()) == nullptr) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    // Assigned into the preallocated strings of the slot (their capacity is reused).
+    r->command = command;
+    r->truncate = truncate;
+    r->path = path;
+    r->text.assign(text, length);
+    queue.commitWrite();
+    pushed.store(pushed.load() + 1);
+}
+
+void ExportStage::run() {
+    while (true) {
+        Record* r = queue.readSlot();
+        if (r == nullptr) {
+            if (!running.load()) break;
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            continue;
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        if (r->command == 1) {
+            closeFiles();
+        }
+        else {
+            FILE* fp = file(r->path, r->truncate);
+            if (fp) {
+                fwrite(r->text.data(), 1, r->text.size(), fp);
+                fflush(fp);
+            }
+        }
+        queue.commitRead();
+        written.store(written.load() + 1);
+        stage_stats.record(elapsedMs(t0), queue.depth());
+    }
+    closeFiles();
+}
+
+FILE* ExportStage::file(const std::string& path, bool truncate) {
+    for (size_t i = 0; i < open_paths.size(); i++) {
+        if (open_paths[i] == path) {
+            if (!truncate) return open_files[i];
+            if (open_files[i]) fclose(open_files[i]);
+            fopen_s(&open_files[i], path.c_str(), "w");
+            return open_files[i];
+        }
+    }
+    FILE* fp;
+    fopen_s(&fp, path.c_str(), truncate ? "w" : "a");
+    if (fp) {
+        open_paths.push_back(path);
+        open_files.push_back(fp);
+    }
+    return fp;
+}
+
+void ExportStage::closeFiles() {
+    for (size_t i = 0; i < open_files.size(); i++) {
+        if (open_files[i]) fclose(open_files[i]);
+    }
+    open_paths.clear();
+    open_files.clear();
+}
+
+void appendf(std::string* s, const char* format, ...) {
+    char buffer[1024];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof(buffer), format, args);
+    va_end(args);
+    if (n < 0) return;
+    if (n < (int)sizeof(buffer)) {
+        s->append(buffer, n);
+        return;
+    }
+    // Longer than the local buffer: format again directly into the string.
+    size_t old_size = s->size();
+    s->resize(old_size + n + 1);
+    va_start(args, format);
+    vsnprintf(&(*s)[old_size], n + 1, format, args);
+    va_end(args);
+    s->resize(old_size + n);
+}
@@ -0,0 +1,300 @@
+#pragma once
+
+/******************************************************************************
+* PipelineStages.h
+*
+* Bounded lock-free queues and the worker stages (acquisition, CSV export) of the 1 s block pipeline.
+* See PipelineStages.cpp for details.
+******************************************************************************/
+
+#include <vector>
+#include <deque>
+#include <memory>
+#include <string>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <stdio.h>
+#include "ProcessingStats.h"
+
+// Single-producer single-consumer ring of preallocated slots. The producer fills writeSlot() in place and publishes it
+// by commitWrite(); the consumer reads readSlot() in place and releases it by commitRead(). No lock, no allocation.
+template <typename T>
+class BoundedQueue
+{
+public:
+    BoundedQueue() : head(0), tail(0) {}
+
+    // Not thread-safe: call while neither the producer nor the consumer is running.
+    // Every slot starts as a copy of "prototype" (e.g. with the buffers sized once).
+    void setup(int capacity, const T& prototype = T()) {
+        slots.assign(capacity + 1, prototype);     // One slot is kept empty to tell "full" from "empty".
+        head.store(0);
+        tail.store(0);
+    }
+    void clear() {
+        head.store(0);
+        tail.store(0);
+    }
+
+    // Producer side. nullptr if the queue is full.
+    T* writeSlot() {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if (next(t) == head.load(std::memory_order_acquire)) return nullptr;
+        return &slots[t];
+    }
+    void commitWrite() {
+        tail.store(next(tail.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    // Consumer side. nullptr if the queue is empty.
+    T* readSlot() {
+        size_t h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) return nullptr;
+        return &slots[h];
+    }
+    void commitRead() {
+        head.store(next(head.load(std::memory_order_relaxed)), std::memory_order_release);
+    }
+
+    int depth() const {
+        size_t h = head.load(std::memory_order_acquire);
+        size_t t = tail.load(std::memory_order_acquire);
+        return (int)((t + slots.size() - h) % slots.size());
+    }
+    int capacity() const { return (int)slots.size() - 1; }
+
+private:
+    size_t next(size_t i) const { return (i + 1 == slots.size()) ? 0 : i + 1; }
+
+    std::vector<T> slots;
+    alignas(64) std::atomic<size_t> head;   // Next slot to read (written by the consumer only)
+    alignas(64) std::atomic<size_t> tail;   // Next slot to write (written by the producer only)
+};
+
+struct StageSnapshot {
+    long long items;        // Blocks (or records) served
+    long long dropped;      // Frames dropped by the backpressure policy (render stage only)
+    long long stalls;       // Times the stage waited for a full output queue
+    int depth;              // Current depth of the input queue
+    int max_depth;          // Maximum depth of the input queue since the reset
+    double service_ms;      // Service time of the last item [ms]
+    double service_ms_mean; // Mean service time [ms]
+    double service_ms_recent;   // Mean service time of the last STAGE_RECENT_ITEMS items [ms]
+    double service_ms_max;  // Maximum service time [ms]
+};
+
+#define STAGE_RECENT_ITEMS 60   // Items of the recent mean service time (1 min of 1 s blocks)
+
+// Service time and queue depth of a stage. Written by the thread of the stage, read by any thread.
+// The dropped frames and the stalls may be counted by any thread (e.g. a frame dropped by the producer or by the consumer).
+class StageStats
+{
+public:
+    StageStats() : recent(STAGE_RECENT_ITEMS) { reset(); }
+    void reset();
+    // Record an item served in service_ms, with "depth" items waiting in the input queue.
+    void record(double service_ms, int depth);
+    void drop() { dropped.fetch_add(1); }
+    void stall() { stalls.fetch_add(1); }
+    StageSnapshot snapshot(int depth) const;
+
+private:
+    std::atomic<long long> items, dropped, stalls;
+    std::atomic<int> max_depth;
+    std::atomic<double> last_ms, total_ms, max_ms, recent_ms;
+    SlidingMean recent;     // Used by the writer only; its mean is published in recent_ms
+};
+
+// A persistent worker thread running one job at a time (e.g. the PSD or the kinetics fit beside the 1 s blocks).
+// Unlike std::async, neither a thread nor a shared state is created per job, so the steady state does not allocate.
+class WorkerThread
+{
+public:
+    typedef void (*Job)(void* context);
+
+    WorkerThread() : job(nullptr), context(nullptr), state(0), quit(false) {}
+    ~WorkerThread() { stop(); }
+
+    // Run job(context) in the worker. Returns false (ignored) if the previous job is still running.
+    // The thread is started at the first call.
+    bool post(Job job, void* context);
+    bool busy() const { return state.load() != 0; }
+    // Wait until the posted job is finished.
+    void wait();
+    void stop();
+
+private:
+    void run();
+
+    std::thread worker;
+    std::mutex mutex;
+    std::condition_variable wake, finished;
+    Job job;
+    void* context;
+    std::atomic<int> state;     // 0: idle (or finished), 1: a job is posted or running
+    bool quit;
+};
+
+// Runs the independent tasks 0 .. n-1 on a fixed number of threads (e.g. the configurations of the parameter sweep).
+// Every worker has its own deque of tasks: it takes them from the back, and when it runs out, it steals from the front of
+// the others. The tasks of very different lengths (e.g. the recordings of 10 s and 10 min) thus keep every worker busy,
+// while a worker touches the shared queues only when it steals.
+class WorkStealingPool
+{
+public:
+    typedef std::function<void(int task, int worker)> Task;
+
+    WorkStealingPool() : stolen(0) {}
+
+    // Run task(0 .. num_tasks - 1) on num_threads workers (<= 0: the hardware concurrency), and wait until all are done.
+    // The tasks are dealt round-robin in this order, so the long tasks should come first.
+    void run(int num_tasks, int num_threads, Task task);
+    // The number of tasks stolen in the last run().
+    long long steals() const { return stolen.load(); }
+
+private:
+    struct TaskQueue {
+        std::mutex mutex;
+        std::deque<int> tasks;
+    };
+    bool next(int worker, int* task);
+
+    std::vector<std::unique_ptr<TaskQueue>> queues;
+    std::atomic<long long> stolen;
+};
+
+// One 1 s block of the Sense Block, filled in place in the acquisition queue.
+struct SenseBlock {
+    int index;                      // dataIndex_loop_num of the block
+    int status;                     // 0: normal, 1: holding voltage switched (see below), -1: end of the data (no samples)
+    int voltage;                    // The new holding voltage [mV] if status == 1
+    int switch_index;               // The first sample at the new voltage if status == 1
+    double latency;                 // Reprogramming time of the amplifier [ms] if status == 1 (-1: failed, 0: local file)
+    std::vector<double> time;       // [s]
+    std::vector<double> current;    // [pA]
+};
+
+// The Sense Block in a worker thread. The blocks are pushed into a bounded queue, which the Processing Block pops.
+// Backpressure: acquisition is never dropped. When the queue is full, the worker waits for a free slot (the amplifier
+// keeps buffering in the meantime), and each wait is counted as a stall.
+class AcquisitionStage
+{
+public:
+    // Fill block->time / current (block_size samples) and block->status. Called in the worker thread.
+    typedef std::function<void(SenseBlock* block)> ReadFunction;
+
+    AcquisitionStage() : running(false) {}
+    ~AcquisitionStage() { stop(); }
+
+    void setup(int block_size, int capacity);
+    // period: the pacing of the blocks [s] (0: the source paces itself, like the amplifier). first_delay: before the first block [s].
+    void start(ReadFunction read, double period, double first_delay);
+    // Stop the worker (after the block being read). The queued blocks are kept for the consumer.
+    void stop();
+
+    // Consumer side (the Processing Block).
+    SenseBlock* front() { return queue.readSlot(); }
+    void pop() { queue.commitRead(); }
+    int depth() const { return queue.depth(); }
+    int capacity() const { return queue.capacity(); }
+    StageSnapshot stats() const { return stage_stats.snapshot(queue.depth()); }
+
+private:
+    void run(ReadFunction read, double period, double first_delay);
+
+    BoundedQueue<SenseBlock> queue;
+    StageStats stage_stats;
+    std::thread worker;
+    std::atomic<bool> running;
+};
+
+// The Processing and Actuation Blocks in a worker thread, fed by an AcquisitionStage, so that neither waits for the GUI.
+// The blocks are processed in order and none is dropped. The results are handed on by "actuate" (e.g. to the GUI through
+// a BoundedQueue of render frames, which drops frames rather than wait for the GUI).
+class ProcessingStage
+{
+public:
+    // Called in the worker thread for every block, "process" and then "actuate". The block is popped after both.
+    typedef std::function<void(SenseBlock* block)> BlockFunction;
+
+    ProcessingStage() : source(nullptr), running(false), draining(false), finished(false) {}
+    ~ProcessingStage() { stop(); }
+
+    void start(AcquisitionStage* source, BlockFunction process, BlockFunction actuate);
+    // Stop the worker after the block being processed. With "drain", the blocks left in the queue of the source are
+    // processed first (stop the source before).
+    void stop(bool drain = false);
+    // Whether the end of the data (a block with status -1) has been reached. The worker has then returned.
+    bool endOfData() const { return finished.load(); }
+    // The service time of "process" (the Processing Block), with the depth of the input queue.
+    StageSnapshot stats() const { return stage_stats.snapshot(source ? source->depth() : 0); }
+
+private:
+    void run(BlockFunction process, BlockFunction actuate);
+
+    AcquisitionStage* source;
+    StageStats stage_stats;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<bool> draining;
+    std::atomic<bool> finished;
+};
+
+// Appends the CSV rows in a worker thread, so that the Processing Block does not wait for the disk.
+// Backpressure: rows are never dropped. When the queue is full, append() waits for a free slot (counted as a stall).
+// The files are kept open while rows arrive and flushed after every record, so a crash loses nothing written so far.
+// The text of every slot is reserved to record_size bytes and longer texts are split, so append() does not allocate.
+class ExportStage
+{
+public:
+    ExportStage() : running(false), pushed(0), written(0), record_size(16384) {}
+    ~ExportStage() { stop(); }
+
+    void start(int capacity, int record_size = 16384);
+    // Write the queued rows, close the files and stop the worker.
+    void stop();
+    // Wait until the queued rows are written, and close the files (e.g. at the end of an acquisition).
+    void flush();
+
+    // Append "text" to the file (truncated first if "truncate"). Called from one thread at a time (e.g. the processing stage).
+    void append(const std::string& path, const std::string& text, bool truncate = false);
+    int depth() const { return queue.depth(); }
+    StageSnapshot stats() const { return stage_stats.snapshot(queue.depth()); }
+
+private:
+    struct Record {
+        Record() : command(0), truncate(false) {}
+        // A copy keeps the capacity reserved in the original (the slots are set up as copies of a prototype).
+        Record(const Record& other) : command(other.command), truncate(other.truncate) {
+            path.reserve(other.path.capacity());
+            path = other.path;
+            text.reserve(other.text.capacity());
+            text = other.text;
+        }
+        Record& operator=(const Record& other) = default;
+
+        int command;            // 0: write, 1: close the files
+        bool truncate;
+        std::string path;
+        std::string text;
+    };
+    void push(int command, const std::string& path, const char* text, size_t length, bool truncate);
+    void run();
+    FILE* file(const std::string& path, bool truncate);
+    void closeFiles();
+
+    BoundedQueue<Record> queue;
+    StageStats stage_stats;
+    std::thread worker;
+    std::atomic<bool> running;
+    std::atomic<long long> pushed, written;
+    size_t record_size;
+    std::vector<std::string> open_paths;    // Used by the worker only
+    std::vector<FILE*> open_files;
+};
+
+// printf into a std::string (appended), for building the rows passed to ExportStage::append().
+void appendf(std::string* s, const char* format, ...);
@@ -0,0 +1,178 @@
+/******************************************************************************
+// PipelineStream.cpp
+//
+// This code publishes the live stream of the Processing Block in shared memory (the layout is in PipelineStream.h):
+// POSIX shared memory (shm_open, "/<name>") on Linux, and a named file mapping ("Local\<name>") on Windows.
+//
+// publish() only copies the block into the rings and moves the counters, so the readers cost nothing to the
+// pipeline: they never lock anything the writer waits for, and a slow reader loses the samples it did not copy in
+// time (about 52 s at 5 kHz with the default capacity) instead of holding the writer back.
+******************************************************************************/
+
+#include "PipelineStream.h"
+#include <chrono>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <process.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+static_assert(sizeof(BkStreamHeader) == 256, "the stream header layout is fixed");
+static_assert(sizeof(BkStreamFeatures) == 128, "the stream feature layout is fixed");
+
+static bool isPowerOfTwo(uint32_t n) {
+    return n > 0 && (n & (n - 1)) == 0;
+}
+
+StreamPublisher::StreamPublisher() {
+    header = nullptr;
+    ring_time = nullptr;
+    ring_current = nullptr;
+    ring_level = nullptr;
+    ring_features = nullptr;
+    size = 0;
+    name[0] = '\0';
+#ifdef _WIN32
+    mapping = nullptr;
+#endif
+}
+
+StreamPublisher::~StreamPublisher() {
+    close();
+}
+
+int StreamPublisher::open(const char* name_arg, int sample_rate, int protein_type, uint32_t sample_capacity, uint32_t feature_capacity) {
+    close();
+    if (!isPowerOfTwo(sample_capacity) || !isPowerOfTwo(feature_capacity) || name_arg == nullptr || name_arg[0] == '\0') return EINVAL;
+    const uint64_t time_offset = BKSTREAM_HEADER_SIZE;
+    const uint64_t current_offset = time_offset + (uint64_t)sample_capacity * sizeof(double);
+    const uint64_t level_offset = current_offset + (uint64_t)sample_capacity * sizeof(double);
+    const uint64_t feature_offset = (level_offset + (uint64_t)sample_capacity * sizeof(int32_t) + 63) / 64 * 64;
+    const uint64_t total_size = feature_offset + (uint64_t)feature_capacity * sizeof(BkStreamFeatures);
+
+    void* base;
+#ifdef _WIN32
+    snprintf(name, sizeof(name), "Local\\%s", name_arg);
+    HANDLE h = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(total_size >> 32), (DWORD)total_size, name);
+    if (h == NULL) return (int)GetLastError();
+    if (GetLastError() == ERROR_ALREADY_EXISTS) {
+        // A reader still holds the previous session (a mapping cannot be removed by its name on Windows).
+        // The readers close the stream once it is finished, so the next acquisition succeeds.
+        CloseHandle(h);
+        return ERROR_ALREADY_EXISTS;
+    }
+    base = MapViewOfFile(h, FILE_MAP_ALL_ACCESS, 0, 0, 0);
+    if (base == NULL) {
+        int error = (int)GetLastError();
+        CloseHandle(h);
+        return error;
+    }
+    memset(base, 0, (size_t)total_size);
+    mapping = h;
+#else
+    snprintf(name, sizeof(name), "/%s", name_arg);
+    shm_unlink(name);   // The readers of the previous session keep their mapping, and see it finished.
+    int fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) return errno;
+    if (ftruncate(fd, (off_t)total_size) != 0) {
+        int error = errno;
+        ::close(fd);
+        shm_unlink(name);
+        return error;
+    }
+    base = mmap(nullptr, (size_t)total_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (base == MAP_FAILED) {
+        int error = errno;
+        shm_unlink(name);
+        return error;
+    }
+#endif
+    size = (size_t)total_size;
+    header = (BkStreamHeader*)base;
+    header->version = BKSTREAM_VERSION;
+    header->header_size = BKSTREAM_HEADER_SIZE;
+    header->sample_rate = (uint32_t)sample_rate;
+    header->sample_capacity = sample_capacity;
+    header->feature_capacity = feature_capacity;
+    header->feature_size = sizeof(BkStreamFeatures);
+    header->time_offset = time_offset;
+    header->current_offset = current_offset;
+    header->level_offset = level_offset;
+    header->feature_offset = feature_offset;
+    header->total_size = total_size;
+    header->session = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+#ifdef _WIN32
+    header->writer_pid = _getpid();
+#else
+    header->writer_pid = (int32_t)getpid();
+#endif
+    header->protein_type = protein_type;
+    header->state = BKSTREAM_LIVE;
+    ring_time = (double*)((char*)base + time_offset);
+    ring_current = (double*)((char*)base + current_offset);
+    ring_level = (int32_t*)((char*)base + level_offset);
+    ring_features = (BkStreamFeatures*)((char*)base + feature_offset);
+    bkstream_store_release(&header->magic, BKSTREAM_MAGIC);
+    return 0;
+}
+
+void StreamPublisher::publish(const double* time, const double* current, const int* levels, int n, const BkStreamFeatures& features) {
+    if (header == nullptr || n < 0) return;
+    const uint64_t mask = header->sample_capacity - 1;
+    const uint64_t first = header->sample_head;
+    // Only the last sample_capacity samples of a longer block can be kept.
+    int skip = (n > (int)header->sample_capacity) ? n - (int)header->sample_capacity : 0;
+    bkstream_store_release(&header->sample_claimed, first + n);
+    bkstream_fence_release();
+    for (int idx = skip; idx < n; idx++) {
+        uint64_t slot = (first + idx) & mask;
+        ring_time[slot] = time[idx];
+        ring_current[slot] = current[idx];
+        ring_level[slot] = levels ? levels[idx] : -1;
+    }
+    bkstream_store_release(&header->sample_head, first + n);
+
+    const uint64_t seq = header->feature_head;
+    bkstream_store_release(&header->feature_claimed, seq + 1);
+    bkstream_fence_release();
+    BkStreamFeatures& f = ring_features[seq & (header->feature_capacity - 1)];
+    f = features;
+    f.seq = seq;
+    f.first_sample = first;
+    bkstream_store_release(&header->feature_head, seq + 1);
+}
+
+void StreamPublisher::close() {
+    if (header == nullptr) return;
+    header->state = BKSTREAM_FINISHED;
+    bkstream_fence_release();
+#ifdef _WIN32
+    UnmapViewOfFile(header);
+    CloseHandle((HANDLE)mapping);
+    mapping = nullptr;
+#else
+    munmap(header, size);
+    shm_unlink(name);
+#endif
+    header = nullptr;
+    ring_time = nullptr;
+    ring_current = nullptr;
+    ring_level = nullptr;
+    ring_features = nullptr;
+    size = 0;
+}
+
+uint64_t StreamPublisher::samples() const {
+    return header ? header->sample_head : 0;
+}
+
+uint64_t StreamPublisher::blocks() const {
+    return header ? header->feature_head : 0;
+}
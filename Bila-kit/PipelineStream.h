@@ -0,0 +1,182 @@
+#pragma once
+
+/******************************************************************************
+* PipelineStream.h
+*
+* The live stream of the Processing Block in shared memory, for the external analysis tools (Python, Julia, ...):
+* the raw current, the idealized levels and the features of every 1 s block, published by StreamPublisher
+* (PipelineStream.cpp) and read by any number of local readers through the C API below (PipelineStreamReader.c,
+* also built as the shared library bilakit_stream) or by mapping the memory directly.
+*
+* This header is C as well as C++, so that the readers do not need the rest of Bila-kit.
+*
+* Layout (little endian, every offset in bytes from the start of the mapping):
+*
+*   0       BkStreamHeader (256 bytes), padded to BKSTREAM_HEADER_SIZE
+*   time_offset       double  time[sample_capacity]         [s]
+*   current_offset    double  current[sample_capacity]      The raw current (before the mains cancellation and the filter) [pA]
+*   level_offset      int32_t level[sample_capacity]        The idealized level (open channels or nanopores), -1: not idealized
+*   feature_offset    BkStreamFeatures feature[feature_capacity]    One per block
+*
+* Both rings are indexed by the sequence number (the samples and the blocks published since the start of the
+* session): the sample "seq" is in the slot seq % sample_capacity (the capacities are powers of 2).
+* The writer never waits for the readers. The readers map the memory read-only, and detect the samples overwritten
+* while they copied them by the two counters of each ring:
+*
+*   writer:  claimed = head + n;  (release fence)  write the slots;  head = head + n (release)
+*   reader:  h = head (acquire);  copy the slots of [seq, h);  (acquire fence)  c = claimed;
+*            the copies of the sequence numbers < c - capacity may be torn, and are dropped (counted as lost).
+*
+* bkstream_read_samples() and bkstream_read_features() implement this. A new session (a new acquisition) replaces the
+* shared memory; the readers of the previous one see "state" == BKSTREAM_FINISHED and open it again.
+******************************************************************************/
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BKSTREAM_MAGIC 0x4D52545354494B42ull    // "BKITSTRM"
+#define BKSTREAM_VERSION 1
+#define BKSTREAM_HEADER_SIZE 4096
+#define BKSTREAM_SAMPLE_CAPACITY (1u << 18)     // 52 s at 5 kHz
+#define BKSTREAM_FEATURE_CAPACITY (1u << 12)    // 68 min of 1 s blocks
+#define BKSTREAM_DEFAULT_NAME "bilakit"
+
+// BkStreamHeader::state
+#define BKSTREAM_LIVE 1
+#define BKSTREAM_FINISHED 2
+
+// BkStreamFeatures::flags
+#define BKSTREAM_RUPTURE 1          // The bilayer is ruptured in this block (rupture_flag)
+#define BKSTREAM_RECOVERY 2         // The bilayer is recovering from a rupture (recovery_flag)
+#define BKSTREAM_VOLTAGE_SWITCH 4   // The holding voltage was switched at voltage_switch_index
+
+typedef struct BkStreamHeader {
+    // Written once, before "magic".
+    uint64_t magic;                 // BKSTREAM_MAGIC once the header is complete
+    uint32_t version;               // BKSTREAM_VERSION
+    uint32_t header_size;           // BKSTREAM_HEADER_SIZE
+    uint32_t sample_rate;           // [Hz]
+    uint32_t sample_capacity;       // Slots of the sample ring (a power of 2)
+    uint32_t feature_capacity;      // Slots of the feature ring (a power of 2)
+    uint32_t feature_size;          // sizeof(BkStreamFeatures)
+    uint64_t time_offset;
+    uint64_t current_offset;
+    uint64_t level_offset;
+    uint64_t feature_offset;
+    uint64_t total_size;            // Of the mapping
+    uint64_t session;               // The start of the session [ns since the epoch], which tells the sessions apart
+    int32_t writer_pid;
+    int32_t protein_type;           // 0: Nanopores (AHL), 1: Ion channels (BK), 2: Ion channels (OR8)
+    uint8_t reserved[40];
+    // Updated by the writer (offset 128).
+    uint64_t sample_head;           // Samples published: the sequence number of the next one
+    uint64_t sample_claimed;        // Samples being written (>= sample_head)
+    uint64_t feature_head;          // Blocks published
+    uint64_t feature_claimed;
+    uint32_t state;                 // BKSTREAM_LIVE, or BKSTREAM_FINISHED after the last block
+    uint8_t reserved2[92];
+} BkStreamHeader;
+
+typedef struct BkStreamFeatures {
+    uint64_t seq;                   // The sequence number of the block
+    uint64_t first_sample;          // The sequence number of its first sample in the sample ring
+    double time;                    // The time of its first sample [s]
+    double opProb;                  // The open probability (-99: not estimated, as the processed data file)
+    double opProb_se;               // Its standard error
+    double stimuli;                 // The estimated stimuli (ion channels), and its bounds
+    double stimuli_upper;
+    double stimuli_lower;
+    double baseline;                // [pA]
+    double current_per_channel;     // [pA]
+    double noise_sigma;             // The noise which limits the detection [pA] (0: not estimated yet)
+    double conductance_mean;        // The mean nanopore conductance measured in this block [pS] (0: none)
+    int32_t channels;               // The estimated number of channels (0: not estimated)
+    int32_t max_open;               // The maximum number of open channels (nanopores) in the block, -1: not idealized
+    int32_t bias_voltage;           // The holding voltage at the end of the block [mV]
+    int32_t flags;                  // BKSTREAM_RUPTURE | BKSTREAM_RECOVERY | BKSTREAM_VOLTAGE_SWITCH
+    int32_t conductance_events;     // The number of nanopore conductances measured in this block
+    int32_t voltage_switch_index;   // The first sample at the new holding voltage, -1: no switch
+    uint8_t reserved[8];
+} BkStreamFeatures;
+
+// The ordering of the counters of the rings, shared by the writer and the readers (x86/x64 only with MSVC).
+#if defined(_MSC_VER)
+#include <intrin.h>
+static __inline uint64_t bkstream_load_acquire(const volatile uint64_t* p) { uint64_t v = *p; _ReadWriteBarrier(); return v; }
+static __inline void bkstream_store_release(volatile uint64_t* p, uint64_t v) { _ReadWriteBarrier(); *p = v; }
+static __inline void bkstream_fence_acquire(void) { _ReadWriteBarrier(); }
+static __inline void bkstream_fence_release(void) { _ReadWriteBarrier(); }
+#else
+static inline uint64_t bkstream_load_acquire(const volatile uint64_t* p) { return __atomic_load_n(p, __ATOMIC_ACQUIRE); }
+static inline void bkstream_store_release(volatile uint64_t* p, uint64_t v) { __atomic_store_n(p, v, __ATOMIC_RELEASE); }
+static inline void bkstream_fence_acquire(void) { __atomic_thread_fence(__ATOMIC_ACQUIRE); }
+static inline void bkstream_fence_release(void) { __atomic_thread_fence(__ATOMIC_RELEASE); }
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// ****** The reader API (PipelineStreamReader.c)
+
+typedef struct BkStreamReader BkStreamReader;
+
+// Map the stream "name" (e.g. BKSTREAM_DEFAULT_NAME) read-only. NULL if it is not published (or not compatible).
+BkStreamReader* bkstream_open(const char* name);
+void bkstream_close(BkStreamReader* reader);
+
+// The mapping itself, for the zero-copy access (e.g. numpy arrays over the rings; check the heads after reading).
+const BkStreamHeader* bkstream_header(const BkStreamReader* reader);
+uint64_t bkstream_sample_head(const BkStreamReader* reader);
+uint64_t bkstream_feature_head(const BkStreamReader* reader);
+// Non-zero once the writer has published its last block (and the session is over).
+int bkstream_finished(const BkStreamReader* reader);
+
+// Copy up to "max" samples from the sequence number *seq on, and advance *seq past them. Any of time, current and
+// level may be NULL. The samples already overwritten are skipped and added to *lost (if not NULL).
+// Returns the number of samples copied (0 if none is newer than *seq).
+size_t bkstream_read_samples(BkStreamReader* reader, uint64_t* seq, double* time, double* current, int32_t* level, size_t max, uint64_t* lost);
+// The same for the block features.
+size_t bkstream_read_features(BkStreamReader* reader, uint64_t* seq, BkStreamFeatures* features, size_t max, uint64_t* lost);
+
+#ifdef __cplusplus
+}
+
+// ****** The writer (PipelineStream.cpp)
+
+// Publishes the blocks of one session. Not thread-safe: one thread (the Processing Block) publishes.
+class StreamPublisher
+{
+public:
+    StreamPublisher();
+    ~StreamPublisher();
+
+    // Create the shared memory "name", replacing a previous session of the same name. Returns 0, or an error code.
+    int open(const char* name, int sample_rate, int protein_type,
+        uint32_t sample_capacity = BKSTREAM_SAMPLE_CAPACITY, uint32_t feature_capacity = BKSTREAM_FEATURE_CAPACITY);
+    bool active() const { return header != nullptr; }
+    // Publish a block: its samples (levels may be nullptr: not idealized), then its features, whose seq and
+    // first_sample are set here. No allocation and no system call.
+    void publish(const double* time, const double* current, const int* levels, int n, const BkStreamFeatures& features);
+    // Mark the session finished and remove the name (the readers attached keep their mapping).
+    void close();
+
+    uint64_t samples() const;       // Published so far
+    uint64_t blocks() const;
+
+private:
+    StreamPublisher(const StreamPublisher&) = delete;
+    StreamPublisher& operator=(const StreamPublisher&) = delete;
+
+    BkStreamHeader* header;
+    double* ring_time;
+    double* ring_current;
+    int32_t* ring_level;
+    BkStreamFeatures* ring_features;
+    size_t size;
+    char name[64];
+#ifdef _WIN32
+    void* mapping;
+#endif
+};
+#endif
@@ -0,0 +1,189 @@
+/******************************************************************************
+// PipelineStreamReader.c
+//
+// This code is the reader API of the live stream (see PipelineStream.h for the layout and the protocol).
+// It is plain C without the rest of Bila-kit, so that it is also the shared library bilakit_stream for the external
+// tools (e.g. ctypes in Python, ccall in Julia). The mapping is read-only: a reader cannot disturb the writer.
+//
+// A read copies the slots first and validates them afterwards against the "claimed" counter of the ring, so a copy
+// torn by the writer (a reader too slow by a whole ring) is dropped and counted as lost, never returned.
+******************************************************************************/
+
+#include "PipelineStream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+struct BkStreamReader {
+    const BkStreamHeader* header;
+    const char* base;
+    size_t size;
+#ifdef _WIN32
+    HANDLE mapping;
+#endif
+};
+
+BkStreamReader* bkstream_open(const char* name) {
+    char path[96];
+    const char* base;
+    size_t size;
+    BkStreamReader* reader;
+    if (name == NULL || name[0] == '\0') return NULL;
+#ifdef _WIN32
+    HANDLE mapping;
+    MEMORY_BASIC_INFORMATION info;
+    snprintf(path, sizeof(path), "Local\\%s", name);
+    mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, path);
+    if (mapping == NULL) return NULL;
+    base = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (base == NULL) {
+        CloseHandle(mapping);
+        return NULL;
+    }
+    VirtualQuery(base, &info, sizeof(info));
+    size = info.RegionSize;
+#else
+    struct stat st;
+    int fd;
+    snprintf(path, sizeof(path), "/%s", name);
+    fd = shm_open(path, O_RDONLY, 0);
+    if (fd < 0) return NULL;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BkStreamHeader)) {
+        close(fd);
+        return NULL;
+    }
+    size = (size_t)st.st_size;
+    base = (const char*)mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == (const char*)MAP_FAILED) return NULL;
+#endif
+    reader = (BkStreamReader*)calloc(1, sizeof(BkStreamReader));
+    if (reader != NULL) {
+        const BkStreamHeader* h = (const BkStreamHeader*)base;
+        reader->header = h;
+        reader->base = base;
+        reader->size = size;
+#ifdef _WIN32
+        reader->mapping = mapping;
+#endif
+        // The header is complete once "magic" is set (the writer may be starting).
+        if (bkstream_load_acquire(&h->magic) == BKSTREAM_MAGIC && h->version == BKSTREAM_VERSION
+            && h->total_size <= size && h->feature_size == sizeof(BkStreamFeatures)) {
+            return reader;
+        }
+    }
+    // Not ready, or not compatible.
+    free(reader);
+#ifdef _WIN32
+    UnmapViewOfFile(base);
+    CloseHandle(mapping);
+#else
+    munmap((void*)base, size);
+#endif
+    return NULL;
+}
+
+void bkstream_close(BkStreamReader* reader) {
+    if (reader == NULL) return;
+#ifdef _WIN32
+    UnmapViewOfFile(reader->base);
+    CloseHandle(reader->mapping);
+#else
+    munmap((void*)reader->base, reader->size);
+#endif
+    free(reader);
+}
+
+const BkStreamHeader* bkstream_header(const BkStreamReader* reader) {
+    return reader->header;
+}
+
+uint64_t bkstream_sample_head(const BkStreamReader* reader) {
+    return bkstream_load_acquire(&reader->header->sample_head);
+}
+
+uint64_t bkstream_feature_head(const BkStreamReader* reader) {
+    return bkstream_load_acquire(&reader->header->feature_head);
+}
+
+int bkstream_finished(const BkStreamReader* reader) {
+    return *(const volatile uint32_t*)&reader->header->state == BKSTREAM_FINISHED;
+}
+
+// The common part of the two rings: the range [*seq, *seq + count) to copy from a ring of "capacity" slots whose
+// counter is "head", after skipping the slots already overwritten.
+static size_t beginRead(uint64_t head, uint32_t capacity, uint64_t* seq, size_t max, uint64_t* lost) {
+    uint64_t oldest = (head > capacity) ? head - capacity : 0;
+    if (*seq > head) *seq = head;   // (A sequence number of another session.)
+    if (*seq < oldest) {
+        if (lost) *lost += oldest - *seq;
+        *seq = oldest;
+    }
+    return (head - *seq < max) ? (size_t)(head - *seq) : max;
+}
+
+// The number of the copied slots (from "first") which the writer may have overwritten meanwhile.
+static size_t tornSlots(const volatile uint64_t* claimed, uint32_t capacity, uint64_t first, size_t count) {
+    uint64_t c, valid_from;
+    bkstream_fence_acquire();
+    c = bkstream_load_acquire(claimed);
+    valid_from = (c > capacity) ? c - capacity : 0;
+    if (valid_from <= first) return 0;
+    return (valid_from - first < count) ? (size_t)(valid_from - first) : count;
+}
+
+size_t bkstream_read_samples(BkStreamReader* reader, uint64_t* seq, double* time, double* current, int32_t* level, size_t max, uint64_t* lost) {
+    const BkStreamHeader* h = reader->header;
+    const uint64_t mask = h->sample_capacity - 1;
+    const double* ring_time = (const double*)(reader->base + h->time_offset);
+    const double* ring_current = (const double*)(reader->base + h->current_offset);
+    const int32_t* ring_level = (const int32_t*)(reader->base + h->level_offset);
+    uint64_t head = bkstream_load_acquire(&h->sample_head);
+    size_t count = beginRead(head, h->sample_capacity, seq, max, lost);
+    size_t k, done = 0, torn;
+    // Copy in the contiguous runs of the ring.
+    while (done < count) {
+        size_t slot = (size_t)((*seq + done) & mask);
+        size_t run = h->sample_capacity - slot;
+        if (run > count - done) run = count - done;
+        if (time) memcpy(time + done, ring_time + slot, run * sizeof(double));
+        if (current) memcpy(current + done, ring_current + slot, run * sizeof(double));
+        if (level) memcpy(level + done, ring_level + slot, run * sizeof(int32_t));
+        done += run;
+    }
+    torn = tornSlots(&h->sample_claimed, h->sample_capacity, *seq, count);
+    if (torn > 0) {
+        k = count - torn;
+        if (time) memmove(time, time + torn, k * sizeof(double));
+        if (current) memmove(current, current + torn, k * sizeof(double));
+        if (level) memmove(level, level + torn, k * sizeof(int32_t));
+        if (lost) *lost += torn;
+    }
+    *seq += count;
+    return count - torn;
+}
+
+size_t bkstream_read_features(BkStreamReader* reader, uint64_t* seq, BkStreamFeatures* features, size_t max, uint64_t* lost) {
+    const BkStreamHeader* h = reader->header;
+    const uint64_t mask = h->feature_capacity - 1;
+    const BkStreamFeatures* ring = (const BkStreamFeatures*)(reader->base + h->feature_offset);
+    uint64_t head = bkstream_load_acquire(&h->feature_head);
+    size_t count = beginRead(head, h->feature_capacity, seq, max, lost);
+    size_t k, torn;
+    for (k = 0; k < count; k++) memcpy(&features[k], &ring[(*seq + k) & mask], sizeof(BkStreamFeatures));
+    torn = tornSlots(&h->feature_claimed, h->feature_capacity, *seq, count);
+    if (torn > 0) {
+        memmove(features, features + torn, (count - torn) * sizeof(BkStreamFeatures));
+        if (lost) *lost += torn;
+    }
+    *seq += count;
+    return count - torn;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+/******************************************************************************
+* Platform.h
+*
+* Portability shims, so that the core (Sense replay/simulation, Processing Block, logging) also builds with GCC/Clang
+* on Linux for the batch reanalysis. The GUI and the Tecella backend remain Windows only.
+******************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#define PATH_SEPARATOR "\\"
+#else
+#include <sys/stat.h>
+#include <sys/types.h>
+#define PATH_SEPARATOR "/"
+
+// fopen_s() of the MSVC runtime, used for the CSV logs.
+static inline int fopen_s(FILE** fp, const char* path, const char* mode) {
+    *fp = fopen(path, mode);
+    return *fp ? 0 : errno;
+}
+#endif
+
+// Create a directory (e.g. "log"). Returns 0 if it is created or already exists.
+static inline int makeDirectory(const char* path) {
+#ifdef _WIN32
+    int r = _mkdir(path);
+#else
+    int r = mkdir(path, 0755);
+#endif
+    return (r == 0 || errno == EEXIST) ? 0 : -1;
+}
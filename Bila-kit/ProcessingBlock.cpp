@@ -0,0 +1,1104 @@
+/******************************************************************************
+// ProcessingBlock.cpp
+//
+// This code is the Processing Block: it processes the raw current of every 1 s block to the idealized data, then
+// obtains features like open probability, and writes the CSV logs (Processed, Raw, POSTProcessed, Dwell, Quality, Pipeline).
+//
+// It was the middle of MyMain::process_block. It is free of Qt, so that the GUI and the headless runner
+// (cli/bilakit_cli.cpp) give the same outputs for the same input:
+//   * The settings of "Setup" are given as ProcessingConfig at start(), and the check boxes and the spin boxes which
+//     can change while acquiring as ProcessingControls at every block.
+//   * The messages for the operator are passed to the message function.
+//   * The UI (graphs, result displays, the emphasis window), the Actuation Block and the Po-V protocol stay in the
+//     front ends, which read the public state after process().
+******************************************************************************/
+
+#include "ProcessingBlock.h"
+#include "ProcessingThreshold.h"
+#include "ProcessingPipeline.h"
+#include "Platform.h"
+#include <iomanip>
+#include <sstream>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+// Columns appended to the header of the processed data file (see writeBandPower()).
+static const char* BAND_POWER_HEADER = ",noise_1-10Hz [pA rms],noise_10-100Hz [pA rms],noise_100-1000Hz [pA rms],noise_1000Hz-Nyquist [pA rms],noise_floor [pA^2/Hz]\n";
+
+ProcessingConfig defaultProcessingConfig() {
+    ProcessingConfig c;
+    c.proteinType = 0;
+    c.BKstimuli = 0;
+    c.postprocessType = 0;
+    c.idealizerType = 0;
+    c.conductance = 0.89;   // [nS] Journal data from [Tsuji et al., Analytical Chemistry 2013, 85, 10913-10919.]
+    c.bias_voltage = 50;    // [mV]
+    c.baseline = 0;
+    c.target_false_rate = 0.01;
+    c.mains_freq = 50;
+    c.cusum_delay_ms = 10;
+    c.threshold = 0.75;
+    c.detection_threshold = 0.15;   // ~5 pA @ 50mV, 0.89 nS
+    c.edge_kernel_size = EDGE_KERNEL_SIZE;
+    c.drift_guard = 10;         // 2 ms
+    c.conductance_window = 500;
+    c.dataStartTime = 0;
+    c.log_raw = false;
+    c.raw_recording = 0;         // Every sample (the tiered recording drops the raw data away from the events, so it is opted in)
+    c.raw_pre_ms = 500;
+    c.raw_post_ms = 500;
+    c.raw_summary_ms = 50;
+    c.analysis_workers = true;
+    return c;
+}
+
+ProcessingControls defaultProcessingControls() {
+    ProcessingControls c;
+    c.filterType = 0;
+    c.filterCutoff = 500;
+    c.mains_cancellation = false;
+    c.max_open = -1;
+    c.baseline_correction = true;
+    c.conductance_correction = true;
+    c.auto_calibration = false;
+    return c;
+}
+
+// [Ref] http://rinov.sakura.ne.jp/wp/cpp-date
+std::string logFilePrefix(const std::string& directory, int proteinType) {
+    time_t t = time(nullptr);
+    const tm* lt = localtime(&t);
+    std::stringstream s;
+    s << directory << PATH_SEPARATOR;
+    s << lt->tm_year + 1900;
+    s << std::setw(2) << std::setfill('0') << lt->tm_mon + 1;
+    s << std::setw(2) << std::setfill('0') << lt->tm_mday;
+    s << "-";
+    s << std::setw(2) << std::setfill('0') << lt->tm_hour;
+    s << std::setw(2) << std::setfill('0') << lt->tm_min;
+    s << std::setw(2) << std::setfill('0') << lt->tm_sec;
+    switch (proteinType)
+    {
+    case 0:
+        s << "-AHL-";
+        break;
+    case 1:
+        s << "-BK-";
+        break;
+    case 2:
+        s << "-OR8-";
+        break;
+    }
+    return s.str();
+}
+
+ProcessingBlock::ProcessingBlock()
+    : stimuli_ALLmedian(0.5)
+{
+    config = defaultProcessingConfig();
+    voltage_switch_index = -1;
+    nowTime = 0;
+    opProb = 0;
+    stimuli = 0;
+    stimuli_upper = 0;
+    stimuli_lower = 0;
+    boltzmann_a[0] = 0.0625493343322725;
+    boltzmann_a[1] = 0.066644;
+    boltzmann_a[2] = 0.076469;
+    boltzmann_x0[0] = -26.0010643562768;
+    boltzmann_x0[1] = -13.32;
+    boltzmann_x0[2] = -37.8402;
+    current_per_channel = 0;
+    prev_current_per_channel = 0;
+    baseline = 0;
+    rupture_flag = false;
+    recovery_flag = false;
+    maxOpenNumber = -1;
+    currentTime.assign(SAMPLE_FREQ, 0.0);
+    currentData.assign(SAMPLE_FREQ, 0.0);
+    rawData.assign(SAMPLE_FREQ, 0.0);
+    processedData.assign(SAMPLE_FREQ, -1);
+    filteredData.assign(SAMPLE_FREQ, 0.0);
+    spectrum_updated = false;
+    conductance_events = 0;
+    conductance_sum = 0;
+    exporter = nullptr;
+    stream = nullptr;
+    results = nullptr;
+    exportRow.reserve(SAMPLE_FREQ * 32);    // The raw data rows of a block (the longest per-block text).
+    corrections_user_specified[0] = false;
+    corrections_user_specified[1] = false;
+    lastOpenNumber = 0;
+    on_detection = 0;
+    for (int idx = 0; idx < 500; idx++) previousCurrent[idx] = 0;
+    hmm_channels = 4;
+    hmm_clip_warned = false;
+    autocal_displayed[0] = autocal_displayed[1] = 0;
+    baseline_displayed = 0;
+    filterType = -1;
+    filterCutoff = 0;
+    mains_active = false;
+    mains_warned = false;
+    spectrum_valid = false;
+    raw_tiered = false;
+    rawSummaryRows.reserve(SAMPLE_FREQ * 4);
+    rawWindowRows.reserve(4096);
+}
+
+void ProcessingBlock::displayInfo(const char* text) {
+    if (message_function) message_function(text);
+}
+
+void ProcessingBlock::start(const ProcessingConfig& config_arg, const ProcessingControls& controls, const std::string& log_prefix, ExportStage* exporter_arg) {
+    config = config_arg;
+    if (config.conductance_window > 500) config.conductance_window = 500;     // The size of previousCurrent[]
+    if (config.conductance_window < 1) config.conductance_window = 1;
+    exporter = exporter_arg;
+    // Record the first state of checkboxes
+    corrections_user_specified[0] = controls.baseline_correction;
+    corrections_user_specified[1] = controls.conductance_correction;
+
+    // ****** Reset the variables.
+    lastOpenNumber = -1;
+    current_per_channel = config.conductance * (double)config.bias_voltage;  // [pA]
+    baseline = config.baseline;
+    rupture_flag = false;
+    recovery_flag = false;
+    on_detection = 0;
+    voltage_switch_index = -1;
+    hmm_channels = (controls.max_open >= 0) ? controls.max_open : 4;
+    hmm_clip_warned = false;
+    hmm.reset(hmm_channels, SAMPLE_FREQ);
+    cusum.setup(0.5 * current_per_channel, config.cusum_delay_ms, SAMPLE_FREQ);
+    dwellTracker.setup(SAMPLE_FREQ, SAMPLE_FREQ);
+    conductanceEstimator.setup(-300, 300, 0.1, 0.98);     // Within the rupture limits, 0.1 pA bins, time constant of 50 s.
+    conductanceEstimator.reset(baseline, current_per_channel);
+    autocal_displayed[0] = baseline;
+    autocal_displayed[1] = current_per_channel;
+    driftTracker.setup(SAMPLE_FREQ, 0.5, config.drift_guard);    // Random-walk drift of 0.5 pA/sqrt(s), 2 ms guard around the transitions by default.
+    driftTracker.reset(baseline, 0.1 * fabs(current_per_channel) + 0.1);
+    baseline_displayed = baseline;
+    noiseEstimator.setup(SAMPLE_FREQ, (config.target_false_rate > 0) ? config.target_false_rate : 0.01, 0.9, 10);  // Time constant of 10 s.
+    filterType = -1;
+    mainsCanceller.setup(SAMPLE_FREQ, config.mains_freq, 5, 0.5);     // Up to the 5th harmonic, notches of ~0.6 Hz.
+    mains_active = false;
+    mains_warned = false;
+    spectrumMonitor.setup(SAMPLE_FREQ, 4096, 0.5, 0.7);   // 1.2 Hz resolution, 50% overlap, time constant of ~3 s.
+    spectrum_valid = false;
+    spectrum_updated = false;
+
+    // ****** Prepare the logging output (1. filename)
+    myFileName_raw = log_prefix + "Raw.csv";
+    myFileName_processed = log_prefix + "Processed.csv";
+    myFileName_postprocessed = log_prefix + "POSTProcessed.csv";
+    myFileName_dwell = log_prefix + "Dwell.csv";
+    myFileName_quality = log_prefix + "Quality.csv";
+    myFileName_pipeline = log_prefix + "Pipeline.csv";
+    myFileName_raw_summary = log_prefix + "RawSummary.csv";
+    myFileName_raw_windows = log_prefix + "RawWindows.csv";
+    raw_tiered = false;
+    if (exporter == nullptr) return;
+
+    // ****** Prepare the logging output (2. initial rows)
+    // The output will be different based on the type of proteins (nanopore -> number only, ion channel -> open probability and magnitude of stimuli), so the first row should be adjusted.
+    FILE* fp;
+    // Processed data files
+    switch (config.proteinType)
+    {
+    case 0:
+        fopen_s(&fp, myFileName_processed.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "time [s],num [-]%s", BAND_POWER_HEADER);
+            fclose(fp);
+        }
+        break;
+    case 1:
+        fopen_s(&fp, myFileName_processed.c_str(), "w");
+        if (fp) {
+            if (config.BKstimuli == 0) {
+                fprintf(fp, "time [s],opProb,estimatedVoltage [mV],estimatedVoltage_upper [mV],estimatedVoltage_lower [mV],estimatedVoltage_ALLaverage [mV],appliedVoltage [mV],estimatedVoltage_ALLaverage_CIlower [mV],estimatedVoltage_ALLaverage_CIupper [mV],estimatedVoltage_ALLmedian [mV],opProb_se,estimatedN [-]%s", BAND_POWER_HEADER);
+            }
+            else if (config.BKstimuli == 1) {
+                fprintf(fp, "time [s],opProb,estimatedVerapamil [uM],estimatedVerapamil_upper [uM],estimatedVerapamil_lower [uM],estimatedVerapamil_ALLaverage [uM],estimatedVerapamil_ALLaverage_CIlower [uM],estimatedVerapamil_ALLaverage_CIupper [uM],estimatedVerapamil_ALLmedian [uM],opProb_se,estimatedN [-]%s", BAND_POWER_HEADER);
+            }
+            fclose(fp);
+        }
+        break;
+    case 2:
+        fopen_s(&fp, myFileName_processed.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "time [s],opProb,log10concentration [M]%s", BAND_POWER_HEADER);
+            fclose(fp);
+        }
+        break;
+    }
+
+    // Dwell-time event table (every dwell between two transitions of the idealized data).
+    fopen_s(&fp, myFileName_dwell.c_str(), "w");
+    if (fp) {
+        fprintf(fp, "start_time [s],duration [ms],level [-],mean_current [pA]\n");
+        fclose(fp);
+    }
+
+    // Quality of every 1 s block: the noise statistics and the thresholds in use (see ProcessingNoise.cpp).
+    fopen_s(&fp, myFileName_quality.c_str(), "w");
+    if (fp) {
+        fprintf(fp, "time [s],baseline [pA],current_per_channel [pA],snr [-],rms_max [pA],rms_0 [pA],rms_1 [pA],rms_hf [pA],lag1_correlation [-],"
+            "rms_edge_filter [pA],threshold [-],detection_threshold [-],rupture_threshold [pA],false_event_rate_threshold [1/s],false_event_rate_detection [1/s],"
+            "mains_frequency [Hz],mains_rms [pA]\n");
+        fclose(fp);
+    }
+
+    // In case the current data is acquired from a real amplifier, then the raw value will also be output to file.
+    if (config.log_raw) {
+        fopen_s(&fp, myFileName_raw.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "time [s],current [pA]\n");
+            fclose(fp);
+        }
+    }
+    // Tiered: Raw.csv holds the full-rate windows around the events only, RawSummary.csv the min/max/mean elsewhere,
+    // and RawWindows.csv the windows with their events.
+    if (config.log_raw && config.raw_recording == 1) {
+        RecorderParams recorderParams;
+        recorderParams.pre_samples = (int)(config.raw_pre_ms * SAMPLE_FREQ / 1000 + 0.5);
+        recorderParams.post_samples = (int)(config.raw_post_ms * SAMPLE_FREQ / 1000 + 0.5);
+        recorderParams.summary_samples = (int)(config.raw_summary_ms * SAMPLE_FREQ / 1000 + 0.5);
+        // The events are found in the filtered current, as late as the delay of the filter at the lowest cutoff (spinBox_3).
+        LowPassFilter slowest;
+        slowest.setup(FILTER_GAUSSIAN, 50, SAMPLE_FREQ);
+        double lag = slowest.delay();
+        slowest.setup(FILTER_BESSEL, 50, SAMPLE_FREQ);
+        if (slowest.delay() > lag) lag = slowest.delay();
+        recorderParams.lag_samples = (int)ceil(lag);
+        rawRecorder.setup(recorderParams, SAMPLE_FREQ);
+        raw_tiered = true;
+        fopen_s(&fp, myFileName_raw_summary.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "time [s],samples [-],min [pA],max [pA],mean [pA]\n");
+            fclose(fp);
+        }
+        fopen_s(&fp, myFileName_raw_windows.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "start_time [s],end_time [s],events [-],kinds\n");
+            fclose(fp);
+        }
+    }
+
+    // PostProcessed Data files
+    if (config.postprocessType == 1) {
+        // For nanopores, conductance measurement and output.
+        fopen_s(&fp, myFileName_postprocessed.c_str(), "w");
+        if (fp) {
+            fprintf(fp, "step_time [s],conductance [pS]\n");  // [Note: This is completely adjusted to AHL, so I have to extend this to other proteins.]
+            fclose(fp);
+        }
+    }
+
+    // Service time and queue depth of every pipeline stage (see PipelineStages.cpp and writePipeline()).
+    fopen_s(&fp, myFileName_pipeline.c_str(), "w");
+    if (fp) {
+        fprintf(fp, "time [s],sense_depth [-],sense_max_depth [-],sense_ms,sense_stalls [-],processing_ms,processing_mean_ms,processing_recent_ms,processing_max_ms,"
+            "actuation_ms,render_ms,render_dropped [-],export_depth [-],export_max_depth [-],export_ms,export_stalls [-]\n");
+        fclose(fp);
+    }
+}
+
+void ProcessingBlock::setHoldingVoltage(int value, ProcessingControls* controls) {
+    // Change the current_per_channel through the pre-determined conducntance.
+    // The previous value is kept for idealizing the samples before the switch.
+    prev_current_per_channel = current_per_channel;
+    config.bias_voltage = value;
+    current_per_channel = config.conductance * (double)config.bias_voltage;  // [pA]
+
+    // If necessary, automatically conducts baseline/conductance correction.
+    if (corrections_user_specified[0] == true) {
+        baseline = config.baseline;
+        controls->baseline_correction = true;
+    }
+    if (corrections_user_specified[1] == true) {
+        controls->conductance_correction = true;
+    }
+    stimuli_ALLaverage.clear();
+    stimuli_ALLmedian.clear();
+}
+
+// Finish the row of the processed data file with the noise band powers and the noise floor of the latest spectrum
+// (#N/A until the first spectrum is available).
+void ProcessingBlock::writeBandPower(std::string* row) {
+    if (spectrum_valid) {
+        for (int b = 0; b < SPECTRUM_BANDS; b++) appendf(row, ",%lf", spectrum.band_rms[b]);
+        appendf(row, ",%e\n", spectrum.noise_floor);
+    }
+    else {
+        for (int b = 0; b < SPECTRUM_BANDS; b++) row->append(",#N/A");
+        row->append(",#N/A\n");
+    }
+}
+
+// Append the dwells finished in the last DwellTracker::process() to the dwell-time event table.
+// block_start_time: the time of the first sample passed to process() [s].
+// The dwells are found in the filtered current, so their start is moved back by the delay of the low-pass filter.
+void ProcessingBlock::writeDwellEvents(double block_start_time, int num_dwells) {
+    if (num_dwells <= 0) return;
+    std::string& rows = exportRow;
+    rows.clear();
+    const DwellEvent* events = dwellTracker.events();
+    for (int e = 0; e < num_dwells; e++) {
+        appendf(&rows, "%lf,%lf,%d,%lf\n", block_start_time + (events[e].start - lowPassFilter.delay()) / SAMPLE_FREQ,
+            events[e].duration * 1000.0 / SAMPLE_FREQ, events[e].level, events[e].mean_current);
+    }
+    exportRows(myFileName_dwell, rows);
+}
+
+// Append the quality of the current block (noiseEstimate), the thresholds in use and the mains interference to the quality file.
+// The false-event rates are the expected ones for the thresholds in use under the measured noise.
+void ProcessingBlock::writeQuality(double time, double threshold, double detection_threshold, double rupture_threshold) {
+    const NoiseEstimate& e = noiseEstimate;
+    double unit = fabs(current_per_channel);
+    double rate_threshold = noiseEstimator.falseEventRate(e.sigma, e.rho, threshold * unit);
+    double rate_detection = noiseEstimator.falseEventRate(e.sigma_filtered, e.rho_filtered, detection_threshold * unit);
+    std::string& row = exportRow;
+    row.clear();
+    appendf(&row, "%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,", time, baseline, current_per_channel, e.snr, e.sigma,
+        e.level_rms[0], e.level_rms[1], e.sigma_hf, e.rho, e.sigma_filtered, threshold, detection_threshold, rupture_threshold,
+        rate_threshold, rate_detection);
+    // The mains interference (empty if the cancellation is off).
+    if (mains_active) appendf(&row, "%lf,%lf\n", mainsCanceller.frequency(), mainsCanceller.rms());
+    else row.append(",\n");
+    exportRows(myFileName_quality, row);
+}
+
+void ProcessingBlock::exportRows(const std::string& path, const std::string& rows) {
+    if (exporter) exporter->append(path, rows);
+}
+
+void ProcessingBlock::writePipeline(double time, const StageSnapshot& sense, const StageSnapshot& processing, const StageSnapshot& actuation, const StageSnapshot& render) {
+    if (exporter == nullptr) return;
+    StageSnapshot exporting = exporter->stats();
+    std::string& row = exportRow;
+    row.clear();
+    appendf(&row, "%lf,%d,%d,%lf,%lld,%lf,%lf,%lf,%lf,%lf,%lf,%lld,%d,%d,%lf,%lld\n", time, sense.depth, sense.max_depth, sense.service_ms, sense.stalls,
+        processing.service_ms, processing.service_ms_mean, processing.service_ms_recent, processing.service_ms_max, actuation.service_ms, render.service_ms, render.dropped,
+        exporting.depth, exporting.max_depth, exporting.service_ms, exporting.stalls);
+    exportRows(myFileName_pipeline, row);
+}
+
+
+// ********************************************************************************************************
+//   The Processing Block of one 1 s block
+// ********************************************************************************************************
+
+void ProcessingBlock::process(const SenseBlock* block, ProcessingControls* controls) {
+    const int proteinType = config.proteinType;
+    const int BKstimuli = config.BKstimuli;
+    const int idealizerType = config.idealizerType;
+    double* const currentTime = this->currentTime.data();
+    double* const currentData = this->currentData.data();
+    double* const rawData = this->rawData.data();
+    int* const processedData = this->processedData.data();
+    double* const filteredData = this->filteredData.data();
+    for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
+        currentTime[idx] = block->time[idx];
+        currentData[idx] = block->current[idx];
+    }
+
+    // Software low-pass filter (see ProcessingFilter.cpp). The raw data file keeps the unfiltered current.
+    // The filter can be switched while acquiring to trade the time resolution for the S/N ratio; the state restarts then.
+    if (controls->filterType != filterType || controls->filterCutoff != filterCutoff) {
+        filterType = controls->filterType;
+        filterCutoff = controls->filterCutoff;
+        lowPassFilter.setup(filterType, filterCutoff, SAMPLE_FREQ);
+        std::string disp_str = "Software filter: ";
+        if (lowPassFilter.type() == FILTER_NONE) {
+            disp_str = disp_str + "None";
+        }
+        else {
+            disp_str = disp_str + ((lowPassFilter.type() == FILTER_GAUSSIAN) ? "Gaussian " : "Bessel ");
+            disp_str = disp_str + std::to_string(filterCutoff);
+            disp_str = disp_str + " [Hz], delay ";
+            disp_str = disp_str + std::to_string(lowPassFilter.delay() * 1000 / SAMPLE_FREQ);
+            disp_str = disp_str + " [ms]";
+        }
+        this->displayInfo(disp_str.c_str());
+    }
+    for (int idx = 0; idx < SAMPLE_FREQ; idx++) rawData[idx] = currentData[idx];
+
+    // Power spectral density of the raw current (see ProcessingSpectrum.cpp), to judge the noise of the bilayer within seconds.
+    // It is computed in a worker thread while this block is processed, and collected before the export.
+    if (config.analysis_workers) spectrumMonitor.request(rawData, SAMPLE_FREQ);
+
+    // Mains interference cancellation (see ProcessingMains.cpp), before the low-pass filter.
+    // The interference amplitude is reported in the quality file, and shown when it becomes comparable to the channel current.
+    if (controls->mains_cancellation) {
+        if (!mains_active) mainsCanceller.reset();
+        mainsCanceller.process(currentData, currentData, SAMPLE_FREQ);
+        mains_active = true;
+        double interference = mainsCanceller.rms();
+        if (!mains_warned && interference > 0.2 * fabs(current_per_channel)) {
+            char disp_str[96];
+            snprintf(disp_str, sizeof(disp_str), "Mains interference: %f [pA rms] at %f [Hz] is cancelled.", interference, mainsCanceller.frequency());
+            this->displayInfo(disp_str);
+            mains_warned = true;
+        }
+        else if (mains_warned && interference < 0.1 * fabs(current_per_channel)) {
+            mains_warned = false;
+        }
+    }
+    else {
+        mains_active = false;
+    }
+    if (lowPassFilter.type() != FILTER_NONE) lowPassFilter.process(currentData, currentData, SAMPLE_FREQ);
+
+    // Processing (the former half)*******************************************************
+    // This code receives the raw (digitized) current values from "SenseAmplifier" or "SenseLocal",
+    //    then idealizes the data to the number of open nanopores/ion channels,
+    for (int idx = 0; idx < SAMPLE_FREQ; idx++) processedData[idx] = -1;
+
+    // The thresholds are derived from the noise of the previous blocks for the target false-event rate (see ProcessingNoise.cpp).
+    // The constants below are used until enough samples are observed, or if the target rate is 0.
+    // The noise depends on the holding voltage, so the statistics restart after a switch.
+    if (voltage_switch_index >= 0) noiseEstimator.reset();
+    noiseEstimate = noiseEstimator.estimate(current_per_channel, config.threshold, config.detection_threshold, 300);
+    const bool adaptive_thresholds = (config.target_false_rate > 0 && noiseEstimate.valid);
+    const double threshold = adaptive_thresholds ? noiseEstimate.threshold : config.threshold;
+    const double rupture_threshold = adaptive_thresholds ? noiseEstimate.rupture_threshold : 300;
+    const double nanopore_detection_threshold = adaptive_thresholds ? noiseEstimate.detection_threshold : config.detection_threshold;
+    maxOpenNumber = -1;
+    for (int idx = 0; idx < SAMPLE_FREQ; idx++) filteredData[idx] = 0;
+
+    // If the holding voltage was switched in this block, the samples before the switch are idealized with the previous current_per_channel,
+    // and only the samples after the capacitive transient are used for the statistics (Po, baseline and conductance).
+    int stats_start = 0;
+    if (voltage_switch_index >= 0) {
+        stats_start = voltage_switch_index + VOLTAGE_SETTLE_SAMPLES;
+        if (stats_start > SAMPLE_FREQ) stats_start = SAMPLE_FREQ;
+    }
+    int stats_num = SAMPLE_FREQ - stats_start;
+    if (rupture_flag) {
+        lastOpenNumber = -1;
+        on_detection = 0;
+        rupture_flag = false;
+        recovery_flag = false;
+        hmm.reset(hmm_channels, SAMPLE_FREQ);
+        cusum.reset();
+    }
+
+    // Parameters of the idealization pipelines, which are specialized for each protein type and polarity (see ProcessingPipeline.cpp).
+    // The controls do not change within a block, so they are read here only once.
+    PipelineParams pipelineParams;
+    pipelineParams.baseline = baseline;
+    pipelineParams.current_per_channel = current_per_channel;
+    pipelineParams.threshold = threshold;
+    pipelineParams.detection_threshold = nanopore_detection_threshold;
+    pipelineParams.max_open = controls->max_open;
+    pipelineParams.rupture_threshold = rupture_threshold;
+    // IF the target is inhibitor concentration sensing, we expect that there is only a single channel during sensing.
+    // (i.e. "Fix to the single channel" checkbox is checked)
+    // Under this assumption, we can additionally assume that the Faraday cage is open when the current > 30 pA.
+    // NOTE: This value is heuristic, and was obtained by observing the raw current.
+    const double BKstimuliONE_threshold2 = 80;
+    pipelineParams.cage_threshold = BKstimuliONE_threshold2;
+
+    switch (proteinType)
+    {
+    case 0:
+        // If nanopores
+        if (idealizerType == 2) {
+            // CUSUM step detection (see ProcessingCUSUM.cpp). Each step is converted to the change of the number of nanopores.
+            if (lastOpenNumber < 0) lastOpenNumber = 0;
+            if (findOutOfRange(currentData, SAMPLE_FREQ, -rupture_threshold, rupture_threshold) < SAMPLE_FREQ) {
+                rupture_flag = true;
+                break;
+            }
+            // The capacitive transient of the holding voltage switch must not be detected as a step.
+            if (voltage_switch_index >= 0) cusum.setup(0.5 * current_per_channel, config.cusum_delay_ms, SAMPLE_FREQ);
+            StepEvent events[CUSUM_MAX_EVENTS];
+            int num_events = 0;
+            if (current_per_channel > 0.1 || current_per_channel < -0.1) {
+                num_events = cusum.process(currentData + stats_start, stats_num, events, CUSUM_MAX_EVENTS);
+            }
+            int filled = 0;
+            for (int e = 0; e < num_events; e++) {
+                int pos = stats_start + events[e].index;    // Negative index: the step started in the previous block.
+                if (pos < filled) pos = filled;
+                for (; filled < pos; filled++) processedData[filled] = lastOpenNumber;
+                lastOpenNumber += (int)floor(events[e].amplitude / current_per_channel + 0.5);
+                if (lastOpenNumber < 0) lastOpenNumber = 0;
+                if (pipelineParams.max_open >= 0 && lastOpenNumber > pipelineParams.max_open) lastOpenNumber = pipelineParams.max_open;
+            }
+            for (; filled < SAMPLE_FREQ; filled++) processedData[filled] = lastOpenNumber;
+            break;
+        }
+        convolve_EDGE(currentData, filteredData, previousCurrent, 500, config.edge_kernel_size);
+
+        if (lastOpenNumber < 0)lastOpenNumber = 0;
+
+        if (!rupture_flag) {
+            // Edge detection on filteredData: find the peak above nanopore_detection_threshold, then the exact position where
+            // OpenNumber changes (the local extremum), then the plateau. See ProcessingPipeline.cpp.
+            // If the bilayer is ruptured, the idealization stops after making "rupture_flag" true.
+            // To distinguish "the beginning of rupture (number -> OVERFLOW)" and "the end of rupture (OVERFLOW -> number)",
+            // we also use "recovery_flag", which prevents motor rotation on recovering.
+            PipelineState state = { lastOpenNumber, on_detection };
+            if (runIdealization(proteinType, BKstimuli, currentData, filteredData, processedData, SAMPLE_FREQ, pipelineParams, &state) < SAMPLE_FREQ) {
+                rupture_flag = true;
+            }
+            lastOpenNumber = state.lastOpenNumber;
+            on_detection = state.on_detection;
+        }
+        break;
+    case 1:
+        // If ion channels
+        if (idealizerType == 1) {
+            // HMM idealization: check the rupture first, then decode the whole block (see ProcessingHMM.cpp).
+            int aborted = findOutOfRange(currentData, SAMPLE_FREQ, -rupture_threshold, (BKstimuli == 1) ? BKstimuliONE_threshold2 : rupture_threshold);
+            if (aborted < SAMPLE_FREQ) {
+                rupture_flag = true;
+                if (-rupture_threshold <= currentData[aborted] && currentData[aborted] <= rupture_threshold) {
+                    // Faraday cage is open. See BKstimuliONE_threshold2 above.
+                    stimuli_ALLaverage.clear();
+                    stimuli_ALLmedian.clear();
+                }
+                break;
+            }
+            if (-0.1 <= current_per_channel && current_per_channel <= 0.1) {   // When 0 mV is applied, the post processing cannnot be conducted.
+                rupture_flag = true;
+                recovery_flag = true;
+                break;
+            }
+            // If the holding voltage was switched in this block, the samples before the switch are decoded with the previous levels.
+            int hmm_start = 0;
+            if (voltage_switch_index > 0) {
+                hmm_start = voltage_switch_index;
+                if (prev_current_per_channel < -0.1 || 0.1 < prev_current_per_channel) {
+                    hmm.setLevels(baseline, prev_current_per_channel);
+                    hmm.idealize(currentData, processedData, hmm_start, false);
+                }
+                else {
+                    for (int idx = 0; idx < hmm_start; idx++) processedData[idx] = -1;     // Samples at 0 mV are left unidealized.
+                }
+            }
+            hmm.setLevels(baseline, current_per_channel);
+            hmm.idealize(currentData + hmm_start, processedData + hmm_start, SAMPLE_FREQ - hmm_start);
+            lastOpenNumber = processedData[SAMPLE_FREQ - 1];
+            adaptHMMChannels(hmm_start, controls->max_open);
+            break;
+        }
+        {
+            // Open/close determination by the hysteresis threshold (see ProcessingPipeline.cpp and ProcessingThreshold.cpp).
+            // The idealization is aborted at the first sample out of the rupture limits.
+            // To distinguish "the beginning of rupture (number -> OVERFLOW)" and "the end of rupture (OVERFLOW -> number)",
+            // we also use "recovery_flag", which prevents motor rotation on recovering.
+            // Before the holding voltage switch, the samples are idealized with the previous current_per_channel.
+            // Samples at 0 mV are left unidealized (-1).
+            PipelineState state = { lastOpenNumber, 0 };
+            double abort_upper = (BKstimuli == 1) ? BKstimuliONE_threshold2 : rupture_threshold;
+            int seg_start = (voltage_switch_index > 0) ? voltage_switch_index : 0;
+            int aborted = SAMPLE_FREQ;
+            if (seg_start > 0) {
+                PipelineParams prevParams = pipelineParams;
+                prevParams.current_per_channel = prev_current_per_channel;
+                int done;
+                if (-0.1 <= prev_current_per_channel && prev_current_per_channel <= 0.1) {
+                    done = findOutOfRange(currentData, seg_start, -rupture_threshold, abort_upper);
+                }
+                else {
+                    done = runIdealization(proteinType, BKstimuli, currentData, filteredData, processedData, seg_start, prevParams, &state);
+                }
+                if (done < seg_start) aborted = done;
+            }
+            if (aborted == SAMPLE_FREQ) {
+                if (-0.1 <= current_per_channel && current_per_channel <= 0.1) {
+                    // When 0 mV is applied, the post processing cannnot be conducted.
+                    aborted = seg_start + findOutOfRange(currentData + seg_start, SAMPLE_FREQ - seg_start, -rupture_threshold, abort_upper);
+                    if (aborted > seg_start) {
+                        rupture_flag = true;
+                        recovery_flag = true;
+                        processedData[seg_start] = state.lastOpenNumber;
+                    }
+                }
+                else {
+                    aborted = seg_start + runIdealization(proteinType, BKstimuli, currentData + seg_start, filteredData, processedData + seg_start, SAMPLE_FREQ - seg_start, pipelineParams, &state);
+                }
+            }
+            lastOpenNumber = state.lastOpenNumber;
+            if (aborted < SAMPLE_FREQ) {
+                rupture_flag = true;
+                double y_now = currentData[aborted];
+                if (-rupture_threshold <= y_now && y_now <= rupture_threshold) {
+                    // Not a rupture, but the Faraday cage is open.
+                    stimuli_ALLaverage.clear();
+                    stimuli_ALLmedian.clear();
+                }
+            }
+        }
+        break;
+    }
+
+    // Features of the idealized data: maxOpenNumber (from stats_start for ion channels) and the sums for the baseline correction.
+    PipelineFeatures features = emptyFeatures();
+    runFeatures(proteinType, currentData, processedData, stats_start, SAMPLE_FREQ, &features);
+    maxOpenNumber = features.maxOpenNumber;
+
+    // recovery_flag [true if OVERFLOW -> 0] [true if 2 -> 0]
+    if (rupture_flag) {
+        if (-rupture_threshold < currentData[SAMPLE_FREQ - 1] && currentData[SAMPLE_FREQ - 1] < rupture_threshold) {
+            recovery_flag = true;
+        }
+    }
+    if (proteinType == 0 && maxOpenNumber >= 2) {
+        rupture_flag = true;
+        if (processedData[SAMPLE_FREQ - 1] == 0) { // Bug fixing
+            recovery_flag = true;
+        }
+    }
+
+    // Baseline correction
+    // The number of samples with 0 or 1 open channel, used for the baseline/conductance correction.
+    int num_channels[2] = { features.zero_num, features.one_num };
+    if (!rupture_flag && !recovery_flag) {
+        double one_value = features.one_sum;
+        bool updated = false;
+
+        // Track the baseline drift continuously while "Enable BASELINE correction" is checked (see ProcessingDrift.cpp).
+        // The baseline follows the closed-state samples by the Kalman filter, and the thresholds are recomputed every block from it.
+        // A change larger than 25% of the single-molecule current within a block is regarded as a misidentification and ignored.
+        if (voltage_switch_index >= 0) driftTracker.reset(baseline, driftTracker.noiseSD());   // The leak current depends on the voltage.
+        driftTracker.update(currentData + stats_start, processedData + stats_start, stats_num);
+        if (controls->baseline_correction && driftTracker.samplesUsed() >= 10) {   // For better stability
+            double tmp = driftTracker.baseline();
+            if (fabs(tmp - baseline) < 0.25 * fabs(current_per_channel)) {
+                baseline = tmp;
+                if (fabs(baseline - baseline_displayed) > 0.05 * fabs(current_per_channel)) {
+                    baseline_displayed = baseline;
+                    updated = true;
+                }
+            }
+            else {
+                driftTracker.reset(baseline, driftTracker.noiseSD());
+            }
+        }
+
+        // Update the conductance when the change is in ±25% of the single-molecule current.
+        if (controls->conductance_correction) {
+            if (num_channels[1] >= 10) {
+                double tmp = one_value / num_channels[1] - baseline;
+                if (current_per_channel > 0) {
+                    if (0.75 * current_per_channel < tmp && tmp < 1.25 * current_per_channel) {
+                        current_per_channel = tmp;
+                        controls->conductance_correction = false;
+                        updated = true;
+                    }
+                }
+                else {
+                    if (1.25 * current_per_channel < tmp && tmp < 0.75 * current_per_channel) {
+                        current_per_channel = tmp;
+                        controls->conductance_correction = false;
+                        updated = true;
+                    }
+                }
+            }
+        }
+
+        if (updated) {
+            char disp_str[96];
+            snprintf(disp_str, sizeof(disp_str), "Current per Channel: %f [pA]   Baseline: %f [pA]", current_per_channel, baseline);
+            this->displayInfo(disp_str);
+        }
+
+    }
+
+    // Auto calibration (see ProcessingConductance.cpp)
+    // A Gaussian mixture with equally spaced levels is fitted to the all-points amplitude histogram every block.
+    // If "Auto calibration" is checked, the baseline and the current per channel follow the fit once it is resolved and precise,
+    // so that the detector adapts without the operator input. The histogram restarts after a holding voltage switch.
+    // When the drift tracking is also enabled, the baseline is left to the drift tracking, which follows faster.
+    if (voltage_switch_index >= 0) conductanceEstimator.reset(baseline, current_per_channel);
+    if (!rupture_flag && !recovery_flag && stats_num > 0) {
+        conductanceEstimator.update(currentData + stats_start, stats_num);
+        const ConductanceEstimate& ce = conductanceEstimator.estimate();
+        if (controls->auto_calibration && ce.valid && ce.unitary * current_per_channel > 0 && ce.unitary_se < 0.02 * fabs(ce.unitary)) {
+            if (!controls->baseline_correction) baseline = ce.baseline;
+            current_per_channel = ce.unitary;
+            // Show only the significant changes.
+            if (fabs(baseline - autocal_displayed[0]) > 0.1 * fabs(current_per_channel) || fabs(current_per_channel - autocal_displayed[1]) > 0.02 * fabs(current_per_channel)) {
+                autocal_displayed[0] = baseline;
+                autocal_displayed[1] = current_per_channel;
+                char disp_str[128];
+                snprintf(disp_str, sizeof(disp_str), "Auto calibration -- Current per Channel: %f +- %f [pA]   Baseline: %f +- %f [pA]",
+                    current_per_channel, ce.unitary_se, baseline, ce.baseline_se);
+                this->displayInfo(disp_str);
+            }
+        }
+    }
+
+    // Processing (the latter half)*******************************************************
+    // This code receives the raw current values AND the idealized data,
+    //    then calculates the experiment-specific features (i.e. open probability of ion channels, conductance of nanopores).
+
+    // Noise of each idealized level (and of the edge filter output for nanopores), exported as the quality of this block.
+    // The blocks with a rupture are not used, since the idealization is aborted.
+    if (!rupture_flag && !recovery_flag && stats_num > 0) {
+        noiseEstimator.update(currentData + stats_start, processedData + stats_start, stats_num);
+        if (proteinType == 0 && idealizerType != 2) noiseEstimator.updateFiltered(filteredData + stats_start, stats_num);
+    }
+    writeQuality(currentTime[0], threshold, nanopore_detection_threshold, rupture_threshold);
+
+    // Dwell-time events and the kinetics (see ProcessingKinetics.cpp).
+    // The dwells cut by a rupture (unidealized samples) or a holding voltage switch are not recorded,
+    // and the histograms restart after a switch since the kinetics depend on the voltage.
+    int num_dwells;
+    if (voltage_switch_index >= 0) {
+        num_dwells = dwellTracker.process(processedData, currentData, voltage_switch_index);
+        writeDwellEvents(currentTime[0], num_dwells);
+        dwellTracker.breakRun();
+        dwellTracker.clearHistograms();
+        num_dwells = dwellTracker.process(processedData + voltage_switch_index, currentData + voltage_switch_index, SAMPLE_FREQ - voltage_switch_index);
+        writeDwellEvents(currentTime[0] + (double)voltage_switch_index / SAMPLE_FREQ, num_dwells);
+    }
+    else {
+        num_dwells = dwellTracker.process(processedData, currentData, SAMPLE_FREQ);
+        writeDwellEvents(currentTime[0], num_dwells);
+    }
+    // The time constants are fitted every 10 s in a worker thread, and shown when the fit is finished.
+    if (config.analysis_workers && block->index % 10 == 9) {
+        kineticsFitter.request(dwellTracker.closedHistogram(), dwellTracker.openHistogram());
+    }
+    KineticsFit closedFit, openFit;
+    if (kineticsFitter.poll(&closedFit, &openFit) && (closedFit.components > 0 || openFit.components > 0)) {
+        char disp_str[256];
+        int len = snprintf(disp_str, sizeof(disp_str), "Closed time: ");
+        for (int j = 0; j < closedFit.components; j++) {
+            len += snprintf(disp_str + len, sizeof(disp_str) - len, "%f ms (%d%%) ", closedFit.tau[j], int(round(closedFit.weight[j] * 100)));
+        }
+        len += snprintf(disp_str + len, sizeof(disp_str) - len, "  Open time: ");
+        for (int j = 0; j < openFit.components; j++) {
+            len += snprintf(disp_str + len, sizeof(disp_str) - len, "%f ms (%d%%) ", openFit.tau[j], int(round(openFit.weight[j] * 100)));
+        }
+        this->displayInfo(disp_str);
+    }
+
+    // Calculating the open probability
+    // N (the number of channels) and Po are jointly estimated from the idealized data by maximum likelihood under the binomial model:
+    //   (the ratio of samples with k open channels) = C(N, k) * Po^k * (1-Po)^(N-k)
+    // The standard error of Po is also obtained. See ProcessingPoEstimate.cpp.
+    // If "Fix the number of channels" is checked, N is fixed to the specified value.
+    opProb = -99;    // Cannot calculate opProb when the bilayer is ruptured or maxOpenNumber = 0.
+    poEstimate = PoEstimate();
+    if (!rupture_flag && stats_num >= SAMPLE_FREQ / 10) {   // A voltage switch at the very end of the block leaves too few samples.
+        poEstimate = estimateOpenProbability(processedData, stats_start, SAMPLE_FREQ, controls->max_open);
+        if (poEstimate.valid) opProb = poEstimate.opProb;
+    }
+
+    // The spectrum of this block is usually ready by now; otherwise it is collected in the next block.
+    spectrum_updated = config.analysis_workers && spectrumMonitor.poll(&spectrum);
+    if (spectrum_updated) spectrum_valid = true;
+
+    // Feature extraction 1:  Estimating the magnitude of stimuli by the given mathematical relationship.
+    // Every row of the processed data file is followed by the noise band powers (see writeBandPower()).
+    std::string& row = exportRow;   // The row of the processed data file
+    row.clear();
+    nowTime = round(block->index + config.dataStartTime) + 1;
+    switch (proteinType)
+    {
+    case 0:
+        // if AHL, do nothing for stimuli estimation.
+        // Export the maxOpenNumber.
+        if (!rupture_flag) {
+            appendf(&row, "%d,%d", nowTime, maxOpenNumber);
+        }
+        else {
+            appendf(&row, "%d,#N/A", nowTime);
+        }
+        break;
+    case 1:
+        // if BK, estimate the applied voltage or the applied inhibitor concentration
+        if (opProb > 0 && !rupture_flag) {
+            if (BKstimuli == 0) {
+                // Given the data of pig-BK, 250mM KCl, 100 uM CaCl2 [20220427_BK channel_mV 変化.abf],
+                // we can estimate the stimuli(x) from the open probability (p) by applying sigmoidal function.
+                // p = 1 / (1 + exp(-a*(x-x0)))
+                // x = x0 + ln(p/(1-p))/a
+                // According to Excel solver, a = 0.070469599, x0 = -28.3978081   (old version)
+                // [New version]    a = 0.076469, x0 = -37.8402  [lower]
+                //                  a = 0.0625493343322725, x0 = -26.0010643562768  [center]
+                //                  a = 0.066644, x0 = -13.32    [upper]
+                //
+                //stimuli = -28.3978081 + log(opProb / (1 - opProb)) / 0.070469599;
+                // (The parameters are held in boltzmann_a[] and boltzmann_x0[], which can be updated by the Po-V protocol.)
+                stimuli = boltzmann_x0[0] + log(opProb / (1 - opProb)) / boltzmann_a[0];
+                stimuli_upper = boltzmann_x0[1] + log(opProb / (1 - opProb)) / boltzmann_a[1];
+                stimuli_lower = boltzmann_x0[2] + log(opProb / (1 - opProb)) / boltzmann_a[2];
+
+                // Value compensation: the estimated value is usually different to the actual value
+                // V_estimated [mV] = 0.7096 * V_actual [mV] - 16.877
+                // V_actual = (V_estimated + 16.877) / 0.7096
+                // [Autoer's note] This compensation is just temporary, and we didn't use it in the journal.
+                // Increasing the number of measured lipid bilayers will enhance the accuracy.
+
+                //stimuli = (stimuli + 16.877) / 0.7096;
+                //stimuli_lower = (stimuli_lower + 16.877) / 0.7096;
+                //stimuli_upper = (stimuli_upper + 16.877) / 0.7096;
+
+                // The average is accompanied by its 95% confidence interval.
+                stimuli_ALLaverage.add(stimuli);
+                stimuli_ALLmedian.add(stimuli);
+
+                appendf(&row, "%d,%lf,%lf,%lf,%lf,%lf,%d,%lf,%lf,%lf,%lf,%d", nowTime, opProb, stimuli, stimuli_upper, stimuli_lower, stimuli_ALLaverage.mean(), config.bias_voltage,
+                    stimuli_ALLaverage.lower(), stimuli_ALLaverage.upper(), stimuli_ALLmedian.quantile(), poEstimate.opProb_se, poEstimate.N);
+            }
+            else if (BKstimuli == 1) {
+                // Given the data of pig-BK, 250mM KCl, 2mM CaCl2 [220627 Verapamil - BK.xlsx],
+                // we can estimate the applied verapamil concentration (x) from the open probability (p) by applying sigmoidal function.
+                // x' = log10(x [µM]) ... 1 nM = -3, 1 µM = 0, 1 mM = 3.
+                // p = 1 / (1 + exp(-a*(x'-x'0)))
+                // x' = x'0 + ln(p/(1-p))/a
+                // x [uM] = exp10(x'0 + ln(p/(1-p))/a)
+                // According to Excel solver;
+                //   [middle]  a = -0.992555977372338, x'0 = 1.37761700241996
+                //   [upper]   a = (same), x'0 = 2.09910501672377
+                //   [lower]   a = (same), x'0 = 0.371686045017188
+                //
+                // If x < 0.01, it will be much better that we use [nM].
+                // If x > 1000, it will be much better that we use [mM].
+
+                stimuli = pow(10, 1.37761700241996 + log(opProb / (1 - opProb)) / -0.992555977372338);
+                stimuli_lower = pow(10, 0.371686045017188 + log(opProb / (1 - opProb)) / -0.992555977372338);
+                stimuli_upper = pow(10, 2.09910501672377 + log(opProb / (1 - opProb)) / -0.992555977372338);
+                stimuli_ALLaverage.add(stimuli);
+                stimuli_ALLmedian.add(stimuli);
+
+                appendf(&row, "%d,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%lf,%d", nowTime, opProb, stimuli, stimuli_upper, stimuli_lower, stimuli_ALLaverage.mean(),
+                    stimuli_ALLaverage.lower(), stimuli_ALLaverage.upper(), stimuli_ALLmedian.quantile(), poEstimate.opProb_se, poEstimate.N);
+            }
+        }
+        else {
+            // 0 V applied, or the moment when openNumber happens to be zero, or the transition between two different voltages (maxOpenNumber will be -1)
+            if (BKstimuli == 0) {
+                appendf(&row, "%d,#N/A,#N/A,#N/A,#N/A,#N/A,%d,#N/A,#N/A,#N/A,#N/A,#N/A", nowTime, config.bias_voltage);
+            }
+            else if (BKstimuli == 1) {
+                appendf(&row, "%d,#N/A,#N/A,#N/A,#N/A,#N/A,#N/A,#N/A,#N/A,#N/A,#N/A", nowTime);
+            }
+        }
+        break;
+    case 2:
+        // if OR8, estimate the applied octenol concentration
+        // Given the data of [Dekel et al., 2016] (https://www.nature.com/articles/srep37330) (TaOR8 vs R-Octenol),
+        // x = log10(concentration)
+        // p = 1 / (1 + exp(-a*(x-x0)))
+        // x = x0 + ln(p/(1-p))/a
+        // concentration = exp10(x0 + ln(p/(1-p))/a)
+        // According to Excel solver, a = 1.597072388, x0 = -6.495105404
+        // if(x > -6) concentration = exp10(x - (-6)) [uM]
+        // else  concentration = exp10(x - (-9)) [nM]
+        if (opProb > 0 && !rupture_flag) {
+            stimuli = -6.495105404 + log(opProb / (1 - opProb)) / 1.597072388;
+            appendf(&row, "%d,%lf,%lf", nowTime, opProb, stimuli);
+        }
+        else {
+            appendf(&row, "%d,#N/A,#N/A", nowTime);
+        }
+        break;
+    }
+    // The rows are written by the export worker (see PipelineStages.cpp).
+    if (!row.empty()) {
+        writeBandPower(&row);
+        exportRows(myFileName_processed, row);
+    }
+
+    // Also export the raw data if the data is obtained from an amplifier.
+    // Tiered: the block is pushed to the recorder with its events here (the conductance steps are added below),
+    // and the rows are exported at the end of the block. The events found in the filtered current are moved back to
+    // the raw samples by the delay of the low-pass filter (the voltage switch is at its raw sample already).
+    const int filter_lag = (int)lround(lowPassFilter.delay());
+    if (raw_tiered) {
+        rawRecorder.push(currentTime, rawData, SAMPLE_FREQ);
+        rawRecorder.triggerLevels(processedData, SAMPLE_FREQ, filter_lag);
+        if (voltage_switch_index >= 0) rawRecorder.trigger(voltage_switch_index, TRIGGER_VOLTAGE);
+    }
+    else if (config.log_raw) {
+        std::string& rows = exportRow;
+        rows.clear();
+        for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
+            appendf(&rows, "%lf,%lf\n", currentTime[idx], rawData[idx]);
+        }
+        exportRows(myFileName_raw, rows);
+    }
+
+
+    // Feature extraction 2: Calculation of single-molecule conductance of nanopores.
+    // (The emphasis of the threshold detection results for ion channels is shown by the GUI.)
+    conductance_events = 0;
+    conductance_sum = 0;
+    if (proteinType == 0 && !recovery_flag && config.postprocessType == 1) {
+        // Evaluating the single-molecule conducntance.
+        for (int idx = 0; idx < SAMPLE_FREQ - 1; idx++) {
+            // Find the "jumping" point, which corresponds to the nanopore incorporation.
+            if (processedData[idx + 1] - processedData[idx] == 1 && processedData[idx] != -1) {  //if (processedData[idx] == 0 && processedData[idx + 1] == 1) {
+                // Use previousCurrent[] to compensate the out-of-range data. (e.g. if idx == 0, most of the data are loaded from previousCurrent[], not currentData[].)
+                int zero_end_idx = idx;
+                int zero_start_idx = -1;
+                double zero_value = 0;
+                for (zero_start_idx = zero_end_idx; zero_start_idx >= zero_end_idx - config.conductance_window; zero_start_idx--) {
+                    if (zero_start_idx >= 0) {
+                        if (processedData[zero_start_idx] != processedData[zero_end_idx]) break;
+                        zero_value += currentData[zero_start_idx];
+                    }
+                    else {
+                        zero_value += previousCurrent[500 + zero_start_idx];
+                    }
+                }
+                zero_value = zero_value / ((double)zero_end_idx - zero_start_idx);
+
+                int one_start_idx = idx + 1;
+                int one_end_idx = -1;
+                double one_value = 0;
+                for (one_end_idx = one_start_idx; one_end_idx < SAMPLE_FREQ - 1; one_end_idx++) {
+                    if (processedData[one_end_idx] != processedData[one_start_idx]) break;
+                    if (one_end_idx > idx + config.conductance_window) break;
+                    one_value += currentData[one_end_idx];
+                }
+                one_value = one_value / ((double)one_end_idx - one_start_idx);
+
+                // If the value is too strange, not use one.
+                if (one_value - zero_value > current_per_channel * 1.9 || one_value - zero_value < current_per_channel * 0.1) continue;
+
+                // CSV export after converting the current [pA] into conductance [pS] using heuristic knowledge of the bias voltage (50 [mV])
+                double one_conductance = (one_value - zero_value) * 1000 / 50;
+                conductance_events++;
+                conductance_sum += one_conductance;
+                if (raw_tiered) rawRecorder.trigger(one_start_idx - filter_lag, TRIGGER_CONDUCTANCE);
+
+                char disp_str[64];
+                snprintf(disp_str, sizeof(disp_str), "Estimated conducatnce: %f [pS]", one_conductance);
+                this->displayInfo(disp_str);
+
+                std::string& conductance_row = exportRow;
+                conductance_row.clear();
+                double step_time = currentTime[one_start_idx] - lowPassFilter.delay() / SAMPLE_FREQ;
+                appendf(&conductance_row, "%lf,%lf\n", round(step_time * 100) / 100, round(one_conductance * 100) / 100);
+                exportRows(myFileName_postprocessed, conductance_row);
+
+            }
+
+            if (processedData[idx] == -1) {
+                // If the bilayer is ruptured, terminate all process and break.
+                break;
+            }
+        }
+    }
+
+    if (raw_tiered) writeRawTiers(false);
+    if (stream) publishStream();
+    if (results) publishResults();
+
+    for (int idx = 0; idx < 500; idx++) previousCurrent[idx] = currentData[SAMPLE_FREQ - 500 + idx];
+    voltage_switch_index = -1;
+}
+
+// The number of channels of the HMM (idealizerType == 1), from the path decoded in processedData[start ..].
+// A path staying at the top state (N channels open) means that the model may clip more open channels to N, which
+// biases Po. Unless "Fix the number of channels" is checked, the model is then extended by one channel, so that it always
+// has a state above the largest number of open channels seen. Otherwise, the user is warned once when the current at the
+// top state is often beyond the level of N + 1/2 channels.
+void ProcessingBlock::adaptHMMChannels(int start, int max_open) {
+    const int TOP_STATE_SAMPLES = SAMPLE_FREQ / 200;   // 5 ms at the top state in a block (longer than the noise spikes)
+    int n = SAMPLE_FREQ - start;
+    if (n <= 0 || (-0.1 <= current_per_channel && current_per_channel <= 0.1)) return;
+    int top = 0, beyond = 0;
+    for (int idx = start; idx < SAMPLE_FREQ; idx++) {
+        if (processedData[idx] != hmm_channels) continue;
+        top++;
+        beyond += ((currentData[idx] - baseline) / current_per_channel > hmm_channels + 0.5);
+    }
+    if (max_open >= 1) {
+        if (max_open != hmm_channels) {
+            hmm_channels = (max_open < HMM_MAX_CHANNELS) ? max_open : HMM_MAX_CHANNELS;
+            hmm.setChannels(hmm_channels);
+            hmm_clip_warned = false;
+            return;
+        }
+        // With the noise only, the current is beyond N + 1/2 channels for a few percent of the top state at most.
+        if (!hmm_clip_warned && beyond >= TOP_STATE_SAMPLES && beyond > 0.2 * top) {
+            char disp_str[192];
+            snprintf(disp_str, sizeof(disp_str), "HMM: the current exceeds the level of %d channels for %.0f%% of the block. "
+                "More channels may be open; check \"Fix the number of channels\".", hmm_channels, 100.0 * beyond / n);
+            this->displayInfo(disp_str);
+            hmm_clip_warned = true;
+        }
+        return;
+    }
+    if (top >= TOP_STATE_SAMPLES && hmm_channels < HMM_MAX_CHANNELS) {
+        hmm_channels++;
+        hmm.setChannels(hmm_channels);
+        char disp_str[96];
+        snprintf(disp_str, sizeof(disp_str), "HMM: %d channels were open at the same time; %d channels are modelled.", hmm_channels - 1, hmm_channels);
+        this->displayInfo(disp_str);
+    }
+}
+
+// Publish the raw current, the idealized data and the features of this block to the live stream.
+void ProcessingBlock::publishStream() {
+    BkStreamFeatures f;
+    memset(&f, 0, sizeof(f));
+    f.time = currentTime[0];
+    f.opProb = opProb;
+    f.opProb_se = poEstimate.valid ? poEstimate.opProb_se : 0;
+    f.stimuli = stimuli;
+    f.stimuli_upper = stimuli_upper;
+    f.stimuli_lower = stimuli_lower;
+    f.baseline = baseline;
+    f.current_per_channel = current_per_channel;
+    f.noise_sigma = noiseEstimate.valid ? noiseEstimate.sigma : 0;
+    f.conductance_mean = (conductance_events > 0) ? conductance_sum / conductance_events : 0;
+    f.channels = poEstimate.valid ? poEstimate.N : 0;
+    f.max_open = maxOpenNumber;
+    f.bias_voltage = config.bias_voltage;
+    f.flags = (rupture_flag ? BKSTREAM_RUPTURE : 0) | (recovery_flag ? BKSTREAM_RECOVERY : 0) | (voltage_switch_index >= 0 ? BKSTREAM_VOLTAGE_SWITCH : 0);
+    f.conductance_events = conductance_events;
+    f.voltage_switch_index = voltage_switch_index;
+    stream->publish(currentTime.data(), rawData.data(), processedData.data(), SAMPLE_FREQ, f);
+}
+
+// Publish the results of this block to the subscribers (e.g. the display on a second screen).
+// The emphasis of the stimuli exceeding the threshold ("Emphasis when exceeding threshold") is flagged for the display.
+void ProcessingBlock::publishResults() {
+    ResultMessage m;
+    memset(&m, 0, sizeof(m));
+    m.time = currentTime[0];
+    m.opProb = opProb;
+    m.stimuli = stimuli;
+    m.stimuli_upper = stimuli_upper;
+    m.stimuli_lower = stimuli_lower;
+    m.channels = poEstimate.valid ? poEstimate.N : 0;
+    m.max_open = maxOpenNumber;
+    m.flags = (rupture_flag ? RESULT_RUPTURE : 0) | (recovery_flag ? RESULT_RECOVERY : 0);
+    if (!rupture_flag && opProb >= 0) {
+        m.flags |= RESULT_VALID;
+        if (config.proteinType == 1 && config.postprocessType == 2 && stimuli > 0) m.flags |= RESULT_EMPHASIS;
+    }
+    m.bias_voltage = config.bias_voltage;
+    m.protein_type = config.proteinType;
+    m.stimuli_type = config.BKstimuli;
+    results->publish(m);
+}
+
+void ProcessingBlock::finish() {
+    if (raw_tiered) writeRawTiers(true);
+}
+
+// Export the rows of the tiered recorder: the full-rate samples to the raw data file, and the summaries and the windows.
+void ProcessingBlock::writeRawTiers(bool finish) {
+    std::string& rows = exportRow;
+    rows.clear();
+    rawSummaryRows.clear();
+    rawWindowRows.clear();
+    rawRecorder.emit(&rows, &rawSummaryRows, &rawWindowRows, finish);
+    if (!rows.empty()) exportRows(myFileName_raw, rows);
+    if (!rawSummaryRows.empty()) exportRows(myFileName_raw_summary, rawSummaryRows);
+    if (!rawWindowRows.empty()) exportRows(myFileName_raw_windows, rawWindowRows);
+}
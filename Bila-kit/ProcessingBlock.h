@@ -0,0 +1,191 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingBlock.h
+*
+* The Processing Block of the 1 s blocks, without the UI: idealization, corrections, features and the CSV logs.
+* The GUI (MyMain.cpp) and the headless runner (cli/bilakit_cli.cpp) drive the same code. See ProcessingBlock.cpp.
+******************************************************************************/
+
+#include "MyHelper.h"
+#include "PipelineStages.h"
+#include "ProcessingStats.h"
+#include "ProcessingPoEstimate.h"
+#include "ProcessingHMM.h"
+#include "ProcessingCUSUM.h"
+#include "ProcessingKinetics.h"
+#include "ProcessingConductance.h"
+#include "ProcessingDrift.h"
+#include "ProcessingNoise.h"
+#include "ProcessingFilter.h"
+#include "ProcessingMains.h"
+#include "ProcessingSpectrum.h"
+#include "ProcessingRecorder.h"
+#include "PipelineStream.h"
+#include "PipelineResults.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// The analysis chosen at "Setup", fixed during an acquisition (except the holding voltage).
+struct ProcessingConfig {
+    int proteinType;            // 0: Nanopores (AHL), 1: Ion channels (BK), 2: Ion channels (OR8)
+    int BKstimuli;              // 0: Membrane voltage, 1: Verapamil inhibition
+    int postprocessType;        // 0: None, 1: Measuring conductance, 2: Emphasis when exceeding threshold
+    int idealizerType;          // 0: Threshold (hysteresis), 1: HMM (ion channels only), 2: CUSUM (nanopores only)
+    double conductance;         // Conductance per channel [nS]
+    int bias_voltage;           // Holding voltage [mV] (follows setHoldingVoltage())
+    double baseline;            // Baseline at the start and after a voltage switch [pA]
+    double target_false_rate;   // Target rate of the false events caused by the noise [1/s].  0: fixed thresholds.
+    int mains_freq;             // Nominal mains frequency [Hz]
+    double cusum_delay_ms;      // Detection delay of the CUSUM detector for a half-nanopore step [ms]
+    // The tuning constants (the parameter sweep, see ProcessingSweep.cpp).
+    double threshold;           // Hysteresis width of the threshold idealizer [current per channel], while the thresholds are fixed
+    double detection_threshold; // Edge detection threshold of nanopores [current per channel], while the thresholds are fixed
+    int edge_kernel_size;       // Length of the edge filter of nanopores (convolve_EDGE) [samples]
+    int drift_guard;            // Samples around the transitions excluded from the baseline tracking
+    int conductance_window;     // Samples averaged on each side of a nanopore step for its conductance (<= 500)
+    double dataStartTime;       // (Local data only) the time of the first row [s]
+    bool log_raw;               // Whether the raw current is also logged (the amplifier; the local files have it already)
+    int raw_recording;          // 0: every sample, 1: tiered (the full rate around the events, the summaries elsewhere; see ProcessingRecorder.cpp)
+    double raw_pre_ms;          // (Tiered) the full-rate window before each event [ms]
+    double raw_post_ms;         // (Tiered) the full-rate window after each event [ms]
+    double raw_summary_ms;      // (Tiered) the interval of the min/max/mean rows outside the windows [ms]
+    bool analysis_workers;      // Whether the PSD (SpectrumMonitor) and the dwell-time fits (KineticsFitter) run in their worker threads
+};
+
+// The defaults of MyMain: AHL, 0.89 nS at +50 mV, threshold idealizer, no postprocessing.
+ProcessingConfig defaultProcessingConfig();
+
+// The operator controls, which may change between the blocks (the check boxes and the spin boxes of MyMain).
+struct ProcessingControls {
+    int filterType;             // comboBox_4.  0: None, 1: Gaussian, 2: Bessel
+    int filterCutoff;           // spinBox_3 [Hz]
+    bool mains_cancellation;    // checkBox_5
+    int max_open;               // spinBox_2 if "Fix the number of channels" (checkBox_3) is checked, otherwise -1
+    bool baseline_correction;   // checkBox
+    bool conductance_correction;    // checkBox_2 (cleared by process() once the correction is applied)
+    bool auto_calibration;      // checkBox_4
+};
+
+// The default state of the controls in MyMain.ui.
+ProcessingControls defaultProcessingControls();
+
+// The prefix of the log files of an acquisition started now, e.g. "log\\20220619-094610-AHL-" for directory = "log".
+std::string logFilePrefix(const std::string& directory, int proteinType);
+
+class ProcessingBlock
+{
+public:
+    ProcessingBlock();
+
+    // The messages for the operator (the message box of MyMain, or the console).
+    typedef std::function<void(const char* text)> MessageFunction;
+    void setMessageFunction(MessageFunction function) { message_function = function; }
+    // The live stream in shared memory, to which every processed block is published (nullptr: none). See PipelineStream.h.
+    void setStream(StreamPublisher* publisher) { stream = publisher; }
+    // The subscribers of the results (Po, stimuli, channels, rupture) of every block (nullptr: none). See PipelineResults.h.
+    void setResultServer(ResultServer* server) { results = server; }
+
+    // The start of an acquisition: reset the state, and create the log files "<log_prefix>Processed.csv" etc.
+    // with their first rows. The rows are written through "exporter", which must outlive the acquisition.
+    // If "exporter" is nullptr, nothing is logged (e.g. the parameter sweep reads the public state only).
+    void start(const ProcessingConfig& config, const ProcessingControls& controls, const std::string& log_prefix, ExportStage* exporter);
+    // Switch the processing to the new holding voltage. The samples of the current block before voltage_switch_index
+    // are idealized at the previous one. The corrections enabled at start() are enabled again in "controls".
+    void setHoldingVoltage(int value, ProcessingControls* controls);
+    // Process one block (SAMPLE_FREQ samples) and export its rows. See ProcessingBlock.cpp.
+    void process(const SenseBlock* block, ProcessingControls* controls);
+    // The end of an acquisition: write the raw samples still held by the tiered recorder.
+    void finish();
+    // The tiered recorder of the raw current (e.g. for its statistics). Used only if log_raw and raw_recording == 1.
+    const TieredRecorder& rawRecording() const { return rawRecorder; }
+    // Append the service time and the queue depth of every pipeline stage to the pipeline file.
+    void writePipeline(double time, const StageSnapshot& sense, const StageSnapshot& processing, const StageSnapshot& actuation, const StageSnapshot& render);
+
+    // ****** The state, read by the front ends after process() (e.g. for the UI and the Actuation Block)
+    ProcessingConfig config;
+    int voltage_switch_index;   // Index of the first sample at the new holding voltage in the current 1 s block.  -1: no switch in this block.
+    int nowTime;                // The time written to the processed data file for this block [s]
+    double opProb;              // The open probability of this 1 s signal.
+    PoEstimate poEstimate;      // The details of opProb estimation (e.g. the standard error and the estimated number of channels).
+    double stimuli;             // The estimated stimuli, which leads to the predetermined opProb.
+    double stimuli_upper;
+    double stimuli_lower;
+    RunningStats stimuli_ALLaverage;    // Mean and its confidence interval of the stimuli since the last voltage change (O(1) per update).
+    P2Quantile stimuli_ALLmedian;       // Median of the stimuli since the last voltage change, robust to the outliers around Po = 0 or 1.
+    // Boltzmann parameters for estimating the membrane voltage from opProb: p = 1 / (1 + exp(-a*(x-x0))).  See "Feature extraction 1".
+    // The default values are obtained by Excel solver, and they are replaced when the Po-V protocol finishes the online fitting.
+    double boltzmann_a[3];      // center, upper, lower
+    double boltzmann_x0[3];
+    double current_per_channel;     // Current per single channel [pA]. Equal to (conductance) * (bias voltage). AHL = 44.5pA @ +50mV, BK = -11.5pA @ -40mV
+    double prev_current_per_channel;    // current_per_channel before the latest holding voltage switch.
+    double baseline;            // The baseline currents. Equal to the mean current when all channels are closed (lastOpenNumber == 0).
+    bool rupture_flag;          // Indicates whether the bilayer is ruptured during the measuring period (1s).
+    bool recovery_flag;         // Indicates whether the bilayer is recovering from rupture during the measuring period (1s)
+    int maxOpenNumber;          // The maximum number of open channels (nanopores) in the block.  -1: not idealized.
+    std::vector<double> currentTime;    // The timestamp of data.
+    std::vector<double> currentData;    // The current after the mains cancellation and the software filter.
+    std::vector<double> rawData;        // The unfiltered current, for the raw data file.
+    std::vector<int> processedData;     // The idealized data (5000 samples per second).
+    SpectrumResult spectrum;    // The latest PSD and the band powers.
+    bool spectrum_updated;      // Whether "spectrum" was updated in this block.
+    int conductance_events;     // The number of nanopore conductances measured in this block (postprocessType == 1).
+    double conductance_sum;     // Their sum [pS].
+
+private:
+    void displayInfo(const char* text);
+    void writeBandPower(std::string* row);
+    void writeDwellEvents(double block_start_time, int num_dwells);
+    void writeQuality(double time, double threshold, double detection_threshold, double rupture_threshold);
+    void exportRows(const std::string& path, const std::string& rows);
+    void writeRawTiers(bool finish);
+    void publishStream();
+    void publishResults();
+    void adaptHMMChannels(int start, int max_open);
+
+    MessageFunction message_function;
+    StreamPublisher* stream;
+    ResultServer* results;
+    ExportStage* exporter;
+    std::string exportRow;          // The CSV rows of a block, built one file at a time (reserved once, so the rows do not allocate).
+    std::string myFileName_raw;
+    std::string myFileName_processed;
+    std::string myFileName_postprocessed;
+    std::string myFileName_dwell;
+    std::string myFileName_quality;
+    std::string myFileName_pipeline;
+    std::string myFileName_raw_summary;
+    std::string myFileName_raw_windows;
+    bool corrections_user_specified[2]; // The baseline / conductance corrections enabled at start().
+
+    int lastOpenNumber;
+    int on_detection;
+    double previousCurrent[500];    // Uses when the previous current is required (e.g. detecting nanopore jumps at exactly N (integer) seconds).
+    std::vector<double> filteredData;   // The edge filter output (nanopores).
+    HMMIdealizer hmm;               // HMM idealization engine (idealizerType == 1).
+    int hmm_channels;               // The number of channels assumed by the HMM. Fixed to the specified number if "Fix the number of channels" is checked,
+                                    // otherwise raised whenever the decoded path stays at the top state (see adaptHMMChannels()).
+    bool hmm_clip_warned;           // Whether the fixed number of channels looking too small has been reported.
+    CUSUMDetector cusum;            // CUSUM step detector (idealizerType == 2).
+    DwellTracker dwellTracker;      // Dwell-time event table and the open/closed dwell-time histograms.
+    KineticsFitter kineticsFitter;  // Fits the dwell-time histograms in a worker thread.
+    ConductanceEstimator conductanceEstimator;  // Baseline and current per channel from the all-points amplitude histogram ("Auto calibration").
+    double autocal_displayed[2];    // The baseline and current per channel last shown by the auto calibration.
+    DriftTracker driftTracker;      // Continuous baseline tracking ("Enable BASELINE correction").
+    double baseline_displayed;      // The baseline last shown by the drift tracking.
+    NoiseEstimator noiseEstimator;  // Per-state noise and the noise-adaptive detection thresholds.
+    NoiseEstimate noiseEstimate;    // The noise statistics used in the current 1 s block.
+    LowPassFilter lowPassFilter;    // Software low-pass filter applied to the raw current before the Processing Block.
+    int filterType;                 // The software filter in use.  -1: not set up yet.
+    int filterCutoff;               // The cutoff frequency of the software filter in use [Hz].
+    MainsCanceller mainsCanceller;  // Adaptive cancellation of the mains interference ("Mains cancellation").
+    bool mains_active;              // Whether the mains cancellation was applied to the previous block.
+    bool mains_warned;              // Whether the strong interference has been reported (reset when it decreases).
+    SpectrumMonitor spectrumMonitor;    // Welch PSD of the raw current, computed in a worker thread.
+    bool spectrum_valid;            // Whether "spectrum" holds a result since the start of the acquisition.
+    bool raw_tiered;                // Whether the raw current is logged by rawRecorder in this acquisition.
+    TieredRecorder rawRecorder;     // Event-triggered tiered recording of the raw current.
+    std::string rawSummaryRows;     // The rows of rawRecorder (reserved once, like exportRow).
+    std::string rawWindowRows;
+};
@@ -0,0 +1,104 @@
+/******************************************************************************
+// ProcessingCUSUM.cpp
+//
+// This code detects the steps of the current caused by the insertion/removal of nanopores
+// by the two-sided CUSUM (Page-Hinkley) test, instead of the edge filter (convolve_EDGE) and the threshold.
+//
+// For each sample x, with the reference level mu of the current segment and k = min_step / 2,
+//     g_up   = max(0, g_up   + (x - mu) - k)
+//     g_down = max(0, g_down - (x - mu) - k)
+// A step is detected when g_up or g_down exceeds h. The step started at the last sample where the statistic was zero,
+// and its amplitude is the mean of the samples since then minus mu. Since the sum of these samples is kept,
+// the step is reported in O(1) without looking back at the raw data.
+// For a step of min_step, g grows by k per sample, so h = k * (delay in samples) gives the requested detection delay.
+//
+// After a detection, the new segment starts from the samples after the step, so consecutive steps are also detected.
+******************************************************************************/
+
+#include "ProcessingCUSUM.h"
+#include <math.h>
+
+CUSUMDetector::CUSUMDetector()
+    : min_step(1), h(1), level_window(5000)
+{
+    reset();
+}
+
+void CUSUMDetector::setup(double min_step_arg, double delay_ms, double sample_freq) {
+    min_step = fabs(min_step_arg);
+    if (min_step <= 0) min_step = 1;
+    double delay_samples = delay_ms * 0.001 * sample_freq;
+    if (delay_samples < 1) delay_samples = 1;
+    h = 0.5 * min_step * delay_samples;
+    level_window = (int)sample_freq;     // The reference level follows the drift slower than 1 s.
+    if (level_window < 1) level_window = 1;
+    reset();
+}
+
+void CUSUMDetector::reset() {
+    mu = 0;
+    mu_count = 0;
+    g_up = g_down = 0;
+    t = 0;
+    up_start = down_start = 0;
+    up_sum = down_sum = 0;
+}
+
+int CUSUMDetector::process(const double* current, int n, StepEvent* events, int max_events) {
+    int num_events = 0;
+    const double k = 0.5 * min_step;
+    const long long t_block = t;
+    for (int idx = 0; idx < n; idx++, t++) {
+        double x = current[idx];
+        if (mu_count == 0) {
+            mu = x;
+            mu_count = 1;
+            up_start = down_start = t + 1;
+            continue;
+        }
+        double dev = x - mu;
+
+        // Upward step
+        if (g_up <= 0) {
+            up_start = t;
+            up_sum = 0;
+        }
+        g_up += dev - k;
+        up_sum += x;
+        if (g_up < 0) g_up = 0;
+
+        // Downward step
+        if (g_down <= 0) {
+            down_start = t;
+            down_sum = 0;
+        }
+        g_down += -dev - k;
+        down_sum += x;
+        if (g_down < 0) g_down = 0;
+
+        if (g_up > h || g_down > h) {
+            bool up = g_up > h;
+            long long start = up ? up_start : down_start;
+            double sum = up ? up_sum : down_sum;
+            int count = (int)(t - start + 1);
+            double new_level = sum / count;
+            if (num_events < max_events) {
+                events[num_events].index = (int)(start - t_block);
+                events[num_events].amplitude = new_level - mu;
+                num_events++;
+            }
+            // Start the new segment from the samples after the step.
+            mu = new_level;
+            mu_count = count;
+            g_up = g_down = 0;
+            continue;
+        }
+
+        // Update the reference level only while no step is suspected, so that the step does not leak into mu.
+        if (g_up == 0 && g_down == 0) {
+            if (mu_count < level_window) mu_count++;
+            mu += (x - mu) / mu_count;
+        }
+    }
+    return num_events;
+}
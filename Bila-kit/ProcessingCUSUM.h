@@ -0,0 +1,46 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingCUSUM.h
+*
+* Streaming two-sided CUSUM step detector for nanopore insertion/removal events.
+* See ProcessingCUSUM.cpp for details.
+******************************************************************************/
+
+#define CUSUM_MAX_EVENTS 64     // Upper limit of the number of steps reported per block.
+
+// A detected step of the current.
+struct StepEvent {
+    int index;          // Sample index (relative to the block passed to process()) where the step started. Negative if it started in a previous block.
+    double amplitude;   // Size of the step [pA] (level after the step - level before the step)
+};
+
+class CUSUMDetector
+{
+public:
+    CUSUMDetector();
+
+    // min_step: the smallest step [pA] to be detected (e.g. half of the current per nanopore).
+    // delay_ms: the detection delay [ms] for a step of exactly min_step. Larger steps are detected faster.
+    void setup(double min_step, double delay_ms, double sample_freq);
+    // Forget the reference level (e.g. after a rupture). The next sample starts a new segment.
+    void reset();
+
+    // Process n samples. Detected steps are written to events (up to max_events) and their number is returned.
+    // Per-sample cost is O(1), and no memory is allocated.
+    int process(const double* current, int n, StepEvent* events, int max_events);
+
+    double level() const { return mu; }     // Reference level of the current segment [pA]
+
+private:
+    double min_step;
+    double h;               // Decision threshold [pA * samples]
+    int level_window;       // Upper limit of the number of samples in the reference-level average (follows a slow drift)
+
+    double mu;              // Reference level
+    int mu_count;
+    double g_up, g_down;    // CUSUM statistics for an upward/downward step
+    long long t;            // Number of samples processed since setup()/reset()
+    long long up_start, down_start;     // The sample where g_up/g_down left zero (= estimated step location)
+    double up_sum, down_sum;            // Sum of the samples since up_start/down_start
+};
@@ -0,0 +1,275 @@
+/******************************************************************************
+// ProcessingConductance.cpp
+//
+// This code finds the baseline and the unitary (single channel) current without the operator input,
+// from the all-points amplitude histogram of the raw current.
+//
+// * The histogram has fixed bins and is multiplied by the forgetting factor every block, so it follows slow changes.
+// * The model is a Gaussian mixture with equally spaced means:  level k = baseline + k * unitary,  common sigma.
+//   It is fitted by EM on the bins (not on the samples), so the cost per block does not depend on the number of samples.
+//   In the M-step, baseline and unitary are obtained by the weighted linear regression of the bin centers on k.
+// * The model is initialized from the peaks of the histogram (or from the user-specified values),
+//   and levels are added/removed when the top level gains/loses samples.
+// * The standard errors assume independent samples, so they are optimistic for heavily filtered data.
+******************************************************************************/
+
+#include "ProcessingConductance.h"
+#include <math.h>
+
+ConductanceEstimator::ConductanceEstimator()
+    : lower(-300), upper(300), bin_width(0.1), forgetting(0.98), total(0), initialized(false), baseline_guess(0), unitary_guess(0)
+{
+    est = ConductanceEstimate();
+    setup(lower, upper, bin_width, forgetting);
+}
+
+void ConductanceEstimator::setup(double lower_arg, double upper_arg, double bin_width_arg, double forgetting_arg) {
+    lower = lower_arg;
+    upper = upper_arg;
+    bin_width = bin_width_arg;
+    forgetting = forgetting_arg;
+    int bins = (int)ceil((upper - lower) / bin_width);
+    if (bins < 1) bins = 1;
+    hist.assign(bins, 0);
+    resp.assign((size_t)bins * CONDUCTANCE_MAX_LEVELS, 0);
+    smooth.assign(bins, 0);
+    candidates.reserve(3 * bins + 1);       // Up to 3 per peak plus the guess
+    reset();
+}
+
+void ConductanceEstimator::reset(double baseline_guess_arg, double unitary_guess_arg) {
+    for (size_t i = 0; i < hist.size(); i++) hist[i] = 0;
+    total = 0;
+    initialized = false;
+    baseline_guess = baseline_guess_arg;
+    unitary_guess = unitary_guess_arg;
+    est = ConductanceEstimate();
+    est.valid = false;
+}
+
+void ConductanceEstimator::update(const double* current, int n) {
+    const int bins = (int)hist.size();
+    for (int i = 0; i < bins; i++) hist[i] *= forgetting;
+    total *= forgetting;
+    const double inv_width = 1 / bin_width;
+    for (int idx = 0; idx < n; idx++) {
+        int b = (int)floor((current[idx] - lower) * inv_width);
+        if (b < 0 || b >= bins) continue;
+        hist[b] += 1;
+        total += 1;
+    }
+
+    if (!initialized) initializeFromPeaks();
+    if (!initialized) return;
+
+    double prev_ll = -HUGE_VAL;
+    for (int iter = 0; iter < 10; iter++) {
+        double ll = emStep();
+        if (fabs(ll - prev_ll) < 1e-6 * fabs(ll)) break;
+        prev_ll = ll;
+    }
+
+    // Add a level when a significant fraction of the samples lies beyond the top level, and remove the empty top level.
+    int K = est.levels;
+    double top = est.baseline + (K - 1) * est.unitary;
+    double beyond = 0;
+    for (int i = 0; i < bins; i++) {
+        double x = lower + (i + 0.5) * bin_width;
+        if ((x - top) * (est.unitary > 0 ? 1 : -1) > 2.5 * est.sigma) beyond += hist[i];
+    }
+    if (beyond > 0.005 * total && K < CONDUCTANCE_MAX_LEVELS) {
+        est.weight[K] = beyond / total;
+        est.levels = K + 1;
+        emStep();
+    }
+    else if (K > 2 && est.weight[K - 1] < 0.0005) {
+        est.levels = K - 1;
+        emStep();
+    }
+
+    orient();
+    double open_fraction = 1 - est.weight[0];
+    // Below the resolution of 2 sigma, the mixture is hardly identifiable.
+    est.valid = (est.levels >= 2 && open_fraction > 0.002 && fabs(est.unitary) > 2 * est.sigma);
+}
+
+// Box smoothing of the histogram with (2 * half + 1) bins.
+static void smoothHistogram(const std::vector<double>& hist, int half, std::vector<double>& smooth) {
+    const int bins = (int)hist.size();
+    smooth.assign(bins, 0);
+    double s = 0;
+    for (int j = 0; j < half && j < bins; j++) s += hist[j];
+    for (int i = 0; i < bins; i++) {
+        if (i + half < bins) s += hist[i + half];
+        if (i - half - 1 >= 0) s -= hist[i - half - 1];
+        smooth[i] = s;
+    }
+}
+
+// Set the model from the peaks of the histogram.
+// Since noise and overlapping levels make the peaks ambiguous, several candidates of the unitary current are tried
+// (the spacing to each peak and its 1/2 and 1/3, plus the user-specified guess), and the most likely one is taken by BIC.
+void ConductanceEstimator::initializeFromPeaks() {
+    const int bins = (int)hist.size();
+    if (total < 1000) return;
+
+    // The main peak and its width (-> sigma).
+    smoothHistogram(hist, 3, smooth);
+    int main_peak = 0;
+    for (int i = 1; i < bins; i++) if (smooth[i] > smooth[main_peak]) main_peak = i;
+    int left = main_peak, right = main_peak;
+    while (left > 0 && smooth[left] > 0.5 * smooth[main_peak]) left--;
+    while (right < bins - 1 && smooth[right] > 0.5 * smooth[main_peak]) right++;
+    double sigma0 = (right - left) * bin_width / 2.355;
+    if (sigma0 < bin_width) sigma0 = bin_width;
+
+    // Other peaks, searched with the resolution of the noise.
+    int half = (int)(0.5 * sigma0 / bin_width);
+    if (half < 1) half = 1;
+    smoothHistogram(hist, half, smooth);
+    int window = (int)(1.5 * sigma0 / bin_width);
+    if (window < 1) window = 1;
+    candidates.clear();
+    if (unitary_guess != 0) candidates.push_back(unitary_guess);
+    for (int i = 0; i < bins; i++) {
+        if (i == main_peak || smooth[i] < 0.002 * total) continue;
+        bool is_max = true;
+        for (int j = i - window; j <= i + window && is_max; j++) {
+            if (j < 0 || j >= bins || j == i) continue;
+            if (smooth[j] > smooth[i] || (smooth[j] == smooth[i] && j < i)) is_max = false;
+        }
+        if (!is_max) continue;
+        double d = (i - main_peak) * bin_width;
+        for (int div = 1; div <= 3; div++) {
+            if (fabs(d / div) > 1.5 * sigma0) candidates.push_back(d / div);
+        }
+    }
+    if (candidates.empty()) return;     // Only one level is visible so far.
+
+    double main_x = lower + (main_peak + 0.5) * bin_width;
+    double best_bic = HUGE_VAL;
+    ConductanceEstimate best = est;
+    for (size_t c = 0; c < candidates.size(); c++) {
+        double unitary = candidates[c];
+        // The main peak is the level nearest to the baseline guess (the closed level if no channel is open most of the time).
+        int k_main = (unitary_guess != 0) ? (int)floor((main_x - baseline_guess) / unitary + 0.5) : 0;
+        if (k_main < 0) k_main = 0;
+        if (k_main > CONDUCTANCE_MAX_LEVELS - 2) k_main = CONDUCTANCE_MAX_LEVELS - 2;
+        est.baseline = main_x - k_main * unitary;
+        est.unitary = unitary;
+        est.sigma = (sigma0 < 0.4 * fabs(unitary)) ? sigma0 : 0.4 * fabs(unitary);
+        // Levels covering the samples.
+        int K = 2;
+        for (int i = 0; i < bins; i++) {
+            if (hist[i] < 1e-3 * total / bins) continue;
+            int k = (int)floor((lower + (i + 0.5) * bin_width - est.baseline) / unitary + 0.5);
+            if (k + 1 > K) K = k + 1;
+        }
+        if (K > CONDUCTANCE_MAX_LEVELS) K = CONDUCTANCE_MAX_LEVELS;
+        est.levels = K;
+        for (int k = 0; k < CONDUCTANCE_MAX_LEVELS; k++) est.weight[k] = (k < K) ? 1.0 / K : 0;
+        double ll = 0;
+        for (int iter = 0; iter < 30; iter++) ll = emStep();
+        // Parameters: baseline, unitary, sigma and K - 1 weights.
+        double bic = -2 * ll + (K + 2) * log(total);
+        if (fabs(est.unitary) > 1.5 * est.sigma && bic < best_bic) {
+            best_bic = bic;
+            best = est;
+        }
+    }
+    if (best_bic == HUGE_VAL) return;
+    est = best;
+    initialized = true;
+}
+
+// The ladder of levels can be described from either end; keep the direction of the user-specified unitary current,
+// or otherwise the direction in which the baseline is the level nearest to 0 pA.
+void ConductanceEstimator::orient() {
+    int K = est.levels;
+    double top = est.baseline + (K - 1) * est.unitary;
+    bool flip;
+    if (unitary_guess != 0) flip = (est.unitary > 0) != (unitary_guess > 0);
+    else flip = fabs(top) < fabs(est.baseline);
+    if (!flip) return;
+    est.baseline = top;
+    est.unitary = -est.unitary;
+    for (int k = 0; k < K / 2; k++) {
+        double w = est.weight[k];
+        est.weight[k] = est.weight[K - 1 - k];
+        est.weight[K - 1 - k] = w;
+    }
+    double se = est.baseline_se;    // (approximate: the covariance of baseline and unitary is neglected)
+    est.baseline_se = sqrt(se * se + (K - 1) * (K - 1) * est.unitary_se * est.unitary_se);
+}
+
+// One EM iteration on the bins. Returns the log-likelihood.
+double ConductanceEstimator::emStep() {
+    const int bins = (int)hist.size();
+    const int K = est.levels;
+    const double b = est.baseline, u = est.unitary;
+    const double inv_2var = 1 / (2 * est.sigma * est.sigma);
+    const double norm = 1 / (sqrt(2 * 3.14159265358979323846) * est.sigma);
+    double S0 = 0, S1 = 0, S2 = 0, Tx = 0, Tkx = 0;
+    double nk[CONDUCTANCE_MAX_LEVELS] = {};
+    double ll = 0;
+
+    for (int i = 0; i < bins; i++) {
+        double n = hist[i];
+        if (n < 1e-9) continue;
+        double x = lower + (i + 0.5) * bin_width;
+        double p[CONDUCTANCE_MAX_LEVELS];
+        double sum = 0;
+        for (int k = 0; k < K; k++) {
+            double r = x - (b + k * u);
+            p[k] = est.weight[k] * norm * exp(-r * r * inv_2var);
+            sum += p[k];
+        }
+        if (sum < 1e-300) {     // Outlier: far from every level.
+            for (int k = 0; k < K; k++) resp[(size_t)i * CONDUCTANCE_MAX_LEVELS + k] = 0;
+            continue;
+        }
+        ll += n * log(sum * bin_width);
+        double* r_i = &resp[(size_t)i * CONDUCTANCE_MAX_LEVELS];
+        for (int k = 0; k < K; k++) {
+            r_i[k] = p[k] / sum;
+            double w = n * r_i[k];
+            nk[k] += w;
+            S0 += w;
+            S1 += w * k;
+            S2 += w * k * k;
+            Tx += w * x;
+            Tkx += w * k * x;
+        }
+    }
+    if (S0 <= 0) return ll;
+    double det = S0 * S2 - S1 * S1;
+    if (det > 1e-9 * S0 * S0) {
+        est.baseline = (S2 * Tx - S1 * Tkx) / det;
+        est.unitary = (S0 * Tkx - S1 * Tx) / det;
+    }
+    // Common sigma around the new levels, with the responsibilities of this iteration.
+    double ss = 0;
+    for (int i = 0; i < bins; i++) {
+        double n = hist[i];
+        if (n < 1e-9) continue;
+        double x = lower + (i + 0.5) * bin_width;
+        const double* r_i = &resp[(size_t)i * CONDUCTANCE_MAX_LEVELS];
+        double sum = 0;
+        for (int k = 0; k < K; k++) sum += r_i[k];
+        if (sum == 0) continue;
+        for (int k = 0; k < K; k++) {
+            double r = x - (est.baseline + k * est.unitary);
+            ss += n * r_i[k] * r * r;
+        }
+    }
+    double sigma = sqrt(ss / S0);
+    if (sigma < 0.5 * bin_width) sigma = 0.5 * bin_width;
+    est.sigma = sigma;
+    for (int k = 0; k < K; k++) est.weight[k] = nk[k] / S0;
+    for (int k = K; k < CONDUCTANCE_MAX_LEVELS; k++) est.weight[k] = 0;
+    if (det > 0) {
+        est.baseline_se = sigma * sqrt(S2 / det);
+        est.unitary_se = sigma * sqrt(S0 / det);
+    }
+    return ll;
+}
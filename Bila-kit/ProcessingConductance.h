@@ -0,0 +1,54 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingConductance.h
+*
+* Automatic discovery of the baseline and the unitary current from the all-points amplitude histogram.
+* See ProcessingConductance.cpp for details.
+******************************************************************************/
+
+#include <vector>
+
+#define CONDUCTANCE_MAX_LEVELS 9    // Upper limit of the number of conductance levels (baseline + 8 channels)
+
+struct ConductanceEstimate {
+    bool valid;             // true once two or more levels are resolved (separated by more than 2 sigma)
+    double baseline;        // [pA]
+    double unitary;         // Current per single channel [pA] (signed)
+    double sigma;           // Standard deviation of the noise on each level [pA]
+    double baseline_se;     // Standard errors [pA]
+    double unitary_se;
+    int levels;             // Number of levels in the model (baseline included)
+    double weight[CONDUCTANCE_MAX_LEVELS];  // Fraction of the samples on each level
+};
+
+class ConductanceEstimator
+{
+public:
+    ConductanceEstimator();
+
+    // Histogram range [lower, upper) and bin width [pA]. forgetting: weight of the past blocks (e.g. 0.95 per block).
+    void setup(double lower, double upper, double bin_width, double forgetting);
+    // Forget the histogram and the model. Optional initial guesses (unitary == 0: unknown) speed up the first fit.
+    void reset(double baseline_guess = 0, double unitary_guess = 0);
+
+    // Add the samples of a block to the histogram and refine the model by a few EM iterations.
+    void update(const double* current, int n);
+    const ConductanceEstimate& estimate() const { return est; }
+
+private:
+    void initializeFromPeaks();
+    void orient();
+    double emStep();
+
+    double lower, upper, bin_width, forgetting;
+    std::vector<double> hist;
+    double total;
+
+    bool initialized;
+    double baseline_guess, unitary_guess;
+    ConductanceEstimate est;
+    std::vector<double> resp;   // Work array: responsibilities (bins x levels)
+    std::vector<double> smooth;         // Work array: smoothed histogram
+    std::vector<double> candidates;     // Work array: candidates of the unitary current
+};
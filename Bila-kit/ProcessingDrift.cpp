@@ -0,0 +1,83 @@
+/******************************************************************************
+// ProcessingDrift.cpp
+//
+// The baseline is tracked continuously by the Kalman filter of the local level model:
+//     b[t] = b[t-1] + w,  w ~ N(0, q)       (random-walk drift, q = drift_rate^2 / sample_freq)
+//     y[t] = b[t] + v,    v ~ N(0, R)       (closed-state samples only)
+// Each closed-state sample costs O(1). To be robust against the samples misidealized as closed (e.g. missed short openings),
+// the innovation is clipped at 3 standard deviations (Huber), and the samples near the transitions are skipped.
+// The measurement noise R is also followed by an exponential average of the clipped squared innovation.
+******************************************************************************/
+
+#include "ProcessingDrift.h"
+#include <math.h>
+
+static const double CLIP = 3.0;             // Innovations are clipped at CLIP standard deviations.
+static const double NOISE_ALPHA = 1e-4;     // Weight of a new sample in the noise estimate (time constant of 2 s at 5 kHz).
+
+DriftTracker::DriftTracker()
+    : q(0), guard(0), b(0), P(1), R(NOISE_ALPHA), prev_level(-1), prev_run(0), used(0)
+{
+    R.set(1);
+}
+
+void DriftTracker::setup(double sample_freq, double drift_rate, int guard_arg) {
+    q = drift_rate * drift_rate / sample_freq;
+    guard = (guard_arg < 0) ? 0 : guard_arg;
+    reset(0, 1);
+}
+
+void DriftTracker::reset(double baseline_arg, double noise_sd) {
+    b = baseline_arg;
+    R.set((noise_sd != 0) ? noise_sd * noise_sd : 1);
+    P = R.mean();   // The initial baseline is as uncertain as a single sample.
+    prev_level = -1;
+    prev_run = 0;
+    used = 0;
+}
+
+double DriftTracker::baselineSD() const { return sqrt(P); }
+double DriftTracker::noiseSD() const { return sqrt(R.mean()); }
+
+void DriftTracker::update(const double* current, const int* idealized, int n) {
+    used = 0;
+    int idx = 0;
+    while (idx < n) {
+        // Run of the same level: [idx, run_end)
+        int level = idealized[idx];
+        int run_end = idx + 1;
+        while (run_end < n && idealized[run_end] == level) run_end++;
+        bool continued = (idx == 0 && level == prev_level);
+        int run_before = continued ? prev_run : 0;     // Samples of this run in the previous block
+
+        if (level == 0) {
+            int first = idx + ((guard - run_before > 0) ? guard - run_before : 0);
+            int last = (run_end < n) ? run_end - guard : run_end;   // The end of the last run is not known yet.
+            // After a rupture or at the start, the level before the run is unknown (-1): the guard is applied as well.
+            for (int t = first; t < last; t++) {
+                P += q;
+                double S = P + R.mean();
+                double e = current[t] - b;
+                double limit = CLIP * sqrt(S);
+                if (e > limit) e = limit;
+                else if (e < -limit) e = -limit;
+                double K = P / S;
+                b += K * e;
+                P *= (1 - K);
+                R.add(e * e);
+                used++;
+            }
+            // The samples skipped at the guard are counted as time passing.
+            int skipped = (run_end - idx) - ((last > first) ? last - first : 0);
+            P += q * skipped;
+        }
+        else {
+            P += q * (run_end - idx);
+        }
+        if (run_end == n) {
+            prev_level = level;
+            prev_run = run_before + (run_end - idx);
+        }
+        idx = run_end;
+    }
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingDrift.h
+*
+* Continuous tracking of the baseline drift from the closed-state samples.
+* See ProcessingDrift.cpp for details.
+******************************************************************************/
+
+#include "ProcessingStats.h"
+
+class DriftTracker
+{
+public:
+    DriftTracker();
+
+    // drift_rate: expected random-walk drift of the baseline [pA / sqrt(s)].
+    // guard: samples within this distance from a transition are not used (filter edges, missed short events).
+    void setup(double sample_freq, double drift_rate, int guard);
+    void reset(double baseline, double noise_sd);
+
+    // Update the baseline from the samples idealized as 0 (no open channel). O(1) per sample.
+    void update(const double* current, const int* idealized, int n);
+
+    double baseline() const { return b; }
+    double baselineSD() const;          // Standard deviation of the baseline estimate [pA]
+    double noiseSD() const;             // Standard deviation of the closed-state noise [pA]
+    int samplesUsed() const { return used; }    // Number of samples used in the last update()
+
+private:
+    double q;           // Process noise per sample [pA^2]
+    int guard;
+    double b;           // Baseline estimate
+    double P;           // Variance of b
+    ExpAverage R;       // Measurement noise variance (closed-state noise): the average of the clipped squared innovation
+    int prev_level;     // Idealized level of the last sample of the previous block
+    int prev_run;       // Length of its run (for the guard across blocks)
+    int used;
+};
@@ -0,0 +1,232 @@
+/******************************************************************************
+// ProcessingFilter.cpp
+//
+// Software low-pass filters applied to the raw current before the idealization, in addition to the hardware Bessel
+// of the amplifier (1 kHz, see setup_per_channel_settings). A lower cutoff improves the S/N ratio at the cost of
+// the time resolution, so the filter and the cutoff can be changed while acquiring (the state is cleared then).
+//
+//   * Gaussian FIR: the standard filter of single-channel analysis (no overshoot, sigma = 0.1325 / cutoff [s],
+//     Colquhoun & Sigworth). The kernel is truncated at 4 sigma. The output is delayed by the half width.
+//     Without decimation, the convolution is computed tap by tap over the whole block (out[i] += h[j] * x[i + j]),
+//     which is vectorized with AVX2 / SSE2 / NEON (plain C++ otherwise).
+//   * Bessel: the analog Bessel prototype (normalized to -3 dB at 1 rad/s) converted to the cascade of biquads
+//     by the bilinear transform with the pre-warped cutoff. Nearly constant group delay with a shorter delay than the FIR.
+//     The sections are recursive, so each section runs over the whole block in turn.
+//
+// The last input samples (FIR) or the section states (Bessel) are carried over to the next block, so the output does
+// not depend on the block boundaries. When the output rate is lower, every "decimation"-th output is computed.
+// The Processing Block shifts the events found in the output back by delay().
+******************************************************************************/
+
+#include "ProcessingFilter.h"
+#include <math.h>
+
+// Define FILTER_NO_SIMD to force the plain C++ path (e.g. for testing).
+#if defined(FILTER_NO_SIMD)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define FILTER_USE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define FILTER_USE_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define FILTER_USE_NEON
+#endif
+
+static const double PI = 3.14159265358979323846;
+
+// Poles of the analog Bessel filters normalized to -3 dB at 1 rad/s (one of each conjugate pair).
+static const double BESSEL_POLES_2[][2] = { { -1.1016013306, 0.6360098248 } };
+static const double BESSEL_POLES_4[][2] = { { -1.3700678306, 0.4102497175 }, { -0.9952087645, 1.2571057395 } };
+static const double BESSEL_POLES_6[][2] = { { -1.5715755, 0.3208964 }, { -1.3818581, 0.9714719 }, { -0.9307341, 1.6618777 } };
+static const double BESSEL_POLES_8[][2] = { { -1.7574084, 0.2728676 }, { -1.6369394, 0.8227957 }, { -1.3738412, 1.3883566 }, { -0.8928697, 1.9983258 } };
+
+// y[0 .. n-1] += h * x[0 .. n-1]
+static inline void axpy(double* y, const double* x, double h, int n) {
+    int i = 0;
+#if defined(FILTER_USE_AVX2)
+    const __m256d vh = _mm256_set1_pd(h);
+    for (; i + 4 <= n; i += 4) {
+        __m256d vy = _mm256_loadu_pd(y + i);
+        vy = _mm256_add_pd(vy, _mm256_mul_pd(vh, _mm256_loadu_pd(x + i)));
+        _mm256_storeu_pd(y + i, vy);
+    }
+#elif defined(FILTER_USE_SSE2)
+    const __m128d vh = _mm_set1_pd(h);
+    for (; i + 2 <= n; i += 2) {
+        __m128d vy = _mm_loadu_pd(y + i);
+        vy = _mm_add_pd(vy, _mm_mul_pd(vh, _mm_loadu_pd(x + i)));
+        _mm_storeu_pd(y + i, vy);
+    }
+#elif defined(FILTER_USE_NEON)
+    const float64x2_t vh = vdupq_n_f64(h);
+    for (; i + 2 <= n; i += 2) {
+        vst1q_f64(y + i, vaddq_f64(vld1q_f64(y + i), vmulq_f64(vh, vld1q_f64(x + i))));
+    }
+#endif
+    for (; i < n; i++) y[i] += h * x[i];
+}
+
+LowPassFilter::LowPassFilter()
+    : filter_type(FILTER_NONE), cutoff_freq(0), sample_freq(5000), decimation(1), phase(0), primed(false), delay_samples(0)
+{
+}
+
+void LowPassFilter::setup(int type_arg, double cutoff_arg, double sample_freq_arg, int order, int decimation_arg) {
+    filter_type = type_arg;
+    cutoff_freq = cutoff_arg;
+    sample_freq = sample_freq_arg;
+    decimation = (decimation_arg < 1) ? 1 : decimation_arg;
+    kernel.clear();
+    sections.clear();
+    delay_samples = 0;
+    // A cutoff at or above the Nyquist frequency cannot be realized: no filtering (decimation only).
+    if (cutoff_freq <= 0 || cutoff_freq >= 0.5 * sample_freq) filter_type = FILTER_NONE;
+    if (filter_type == FILTER_GAUSSIAN) designGaussian();
+    else if (filter_type == FILTER_BESSEL) designBessel(order);
+    reset();
+}
+
+void LowPassFilter::reset() {
+    phase = 0;
+    primed = false;
+    buffer.clear();
+    for (size_t s = 0; s < sections.size(); s++) sections[s].s1 = sections[s].s2 = 0;
+}
+
+void LowPassFilter::designGaussian() {
+    double sigma = 0.1325 * sample_freq / cutoff_freq;     // [samples]
+    int half = (int)ceil(4 * sigma);
+    if (half < 1) half = 1;
+    kernel.resize(2 * half + 1);
+    double sum = 0;
+    for (int j = -half; j <= half; j++) {
+        double w = exp(-0.5 * j * j / (sigma * sigma));
+        kernel[j + half] = w;
+        sum += w;
+    }
+    for (size_t j = 0; j < kernel.size(); j++) kernel[j] /= sum;
+    delay_samples = half;
+}
+
+void LowPassFilter::designBessel(int order) {
+    const double (*poles)[2];
+    int pairs;
+    if (order <= 2) { poles = BESSEL_POLES_2; pairs = 1; }
+    else if (order <= 4) { poles = BESSEL_POLES_4; pairs = 2; }
+    else if (order <= 6) { poles = BESSEL_POLES_6; pairs = 3; }
+    else { poles = BESSEL_POLES_8; pairs = 4; }
+
+    const double K = 2 * sample_freq;
+    const double wc = K * tan(PI * cutoff_freq / sample_freq);     // Pre-warped cutoff [rad/s]
+    double delay = 0;
+    for (int k = 0; k < pairs; k++) {
+        double re = poles[k][0] * wc;
+        double im = poles[k][1] * wc;
+        // H(s) = w0^2 / (s^2 + c1 s + w0^2), then s = K (1 - 1/z) / (1 + 1/z).
+        double w0sq = re * re + im * im;
+        double c1 = -2 * re;
+        double D = K * K + c1 * K + w0sq;
+        Biquad q;
+        q.b0 = w0sq / D;
+        q.b1 = 2 * w0sq / D;
+        q.b2 = w0sq / D;
+        q.a1 = (2 * w0sq - 2 * K * K) / D;
+        q.a2 = (K * K - c1 * K + w0sq) / D;
+        q.s1 = q.s2 = 0;
+        sections.push_back(q);
+        delay += 2 * (-re) / w0sq;     // Group delay at DC of the pole pair [s]
+    }
+    delay_samples = delay * sample_freq;
+}
+
+int LowPassFilter::process(const double* in, double* out, int n) {
+    if (n <= 0) return 0;
+
+    if (filter_type == FILTER_GAUSSIAN) {
+        const int K = (int)kernel.size();
+        if (!primed) {
+            buffer.assign(K - 1, in[0]);
+            primed = true;
+        }
+        // buffer = [the last K - 1 samples of the previous blocks, in[0 .. n-1]]
+        buffer.resize(K - 1 + n);
+        for (int i = 0; i < n; i++) buffer[K - 1 + i] = in[i];
+        const double* x = buffer.data();
+        int m = 0;
+        if (decimation == 1) {
+            fir_out.assign(n, 0.0);
+            for (int j = 0; j < K; j++) axpy(fir_out.data(), x + j, kernel[j], n);
+            for (int i = 0; i < n; i++) out[i] = fir_out[i];
+            m = n;
+        }
+        else {
+            for (int i = 0; i < n; i++) {
+                if (phase == 0) {
+                    double y = 0;
+                    for (int j = 0; j < K; j++) y += kernel[j] * x[i + j];
+                    out[m++] = y;
+                    phase = decimation - 1;
+                }
+                else {
+                    phase--;
+                }
+            }
+        }
+        // Keep the last K - 1 samples for the next block.
+        for (int i = 0; i < K - 1; i++) buffer[i] = buffer[n + i];
+        buffer.resize(K - 1);
+        return m;
+    }
+
+    // Bessel (or no filter): the whole block at the input rate, then decimated.
+    double* y;
+    if (decimation == 1) {
+        y = out;
+    }
+    else {
+        iir_out.resize(n);
+        y = iir_out.data();
+    }
+    if (y != in) {
+        for (int i = 0; i < n; i++) y[i] = in[i];
+    }
+    if (filter_type == FILTER_BESSEL) {
+        if (!primed) {
+            // Start from the steady state for in[0] (the DC gain of every section is 1).
+            for (size_t s = 0; s < sections.size(); s++) {
+                Biquad& q = sections[s];
+                q.s1 = in[0] * (1 - q.b0);
+                q.s2 = in[0] * (q.b2 - q.a2);
+            }
+            primed = true;
+        }
+        for (size_t s = 0; s < sections.size(); s++) {
+            const double b0 = sections[s].b0, b1 = sections[s].b1, b2 = sections[s].b2;
+            const double a1 = sections[s].a1, a2 = sections[s].a2;
+            double s1 = sections[s].s1, s2 = sections[s].s2;
+            for (int i = 0; i < n; i++) {
+                double xi = y[i];
+                double yi = b0 * xi + s1;
+                s1 = b1 * xi - a1 * yi + s2;
+                s2 = b2 * xi - a2 * yi;
+                y[i] = yi;
+            }
+            sections[s].s1 = s1;
+            sections[s].s2 = s2;
+        }
+    }
+    if (decimation == 1) return n;
+    int m = 0;
+    for (int i = 0; i < n; i++) {
+        if (phase == 0) {
+            out[m++] = y[i];
+            phase = decimation - 1;
+        }
+        else {
+            phase--;
+        }
+    }
+    return m;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingFilter.h
+*
+* Software low-pass filters (Gaussian FIR / Bessel biquad cascade) with the state carried across the blocks.
+* See ProcessingFilter.cpp for details.
+******************************************************************************/
+
+#include <vector>
+
+#define FILTER_NONE 0
+#define FILTER_GAUSSIAN 1
+#define FILTER_BESSEL 2
+
+class LowPassFilter
+{
+public:
+    LowPassFilter();
+
+    // type: FILTER_NONE, FILTER_GAUSSIAN or FILTER_BESSEL.
+    // cutoff_freq: -3 dB frequency [Hz]. order: the number of poles of the Bessel filter (2, 4, 6 or 8).
+    // decimation: one output sample every "decimation" input samples (1: no decimation).
+    // The cutoff should be below the half of the output rate (sample_freq / decimation) to avoid aliasing.
+    // The state is cleared.
+    void setup(int type, double cutoff_freq, double sample_freq, int order = 4, int decimation = 1);
+    // Clear the state (e.g. after a rupture). The next block is filtered as if the first sample continued infinitely before it.
+    void reset();
+
+    // Filter in[0 .. n-1] into out[] (which may be the same array as in[] when decimation == 1).
+    // Returns the number of output samples. The decimation phase is carried over, so the output rate is exact over the blocks.
+    int process(const double* in, double* out, int n);
+
+    int type() const { return filter_type; }
+    double cutoff() const { return cutoff_freq; }
+    // Delay of the output from the input [samples at the input rate]: the half width of the FIR kernel,
+    // or the group delay at DC of the Bessel filter. The events found in the output are this much later than in the
+    // input (0 without a filter).
+    double delay() const { return delay_samples; }
+
+private:
+    void designGaussian();
+    void designBessel(int order);
+
+    int filter_type;
+    double cutoff_freq;
+    double sample_freq;
+    int decimation;
+    int phase;              // Input samples until the next output sample
+    bool primed;            // false until the first sample is seen (then the state is filled with it)
+    double delay_samples;
+
+    // Gaussian FIR
+    std::vector<double> kernel;     // Symmetric, normalized to the sum of 1
+    std::vector<double> buffer;     // The last (kernel size - 1) input samples followed by the current block
+    std::vector<double> fir_out;    // Work array (decimation == 1)
+
+    // Bessel: second-order sections (b0, b1, b2, a1, a2) in the transposed direct form II
+    struct Biquad {
+        double b0, b1, b2, a1, a2;
+        double s1, s2;
+    };
+    std::vector<Biquad> sections;
+    std::vector<double> iir_out;    // Work array (decimation > 1)
+};
@@ -0,0 +1,193 @@
+/******************************************************************************
+// ProcessingHMM.cpp
+//
+// This code idealizes the raw current into the number of open channels by a hidden Markov model,
+// which is more robust than the threshold (hysteresis) detector when the S/N ratio is low.
+//
+// Model:
+//   * N + 1 hidden states (k = 0 ... N open channels), emitting baseline + k * current_per_channel + Gaussian noise.
+//   * N independent channels, each opening with the probability alpha and closing with beta per sample.
+//     At 5-20 kHz, only the transitions to the neighbouring states (k -> k +/- 1) are considered.
+// The most likely path is obtained by the Viterbi algorithm over each block. The forward scores are carried over
+// to the next block, so the blocks are connected without resetting the model.
+// Since every state has only three predecessors, the cost is O(N) per sample, and the loops over the states are
+// written without branches so that the compiler can vectorize them.
+//
+// After each block, alpha, beta and the noise level are re-estimated from the decoded path
+// (Viterbi training with exponential forgetting), so the model follows the kinetics of the channels.
+******************************************************************************/
+
+#include "ProcessingHMM.h"
+#include <math.h>
+
+static const double LOG_ZERO = -1e30;
+static const double FORGETTING = 0.9;   // Weight of the past blocks in the online learning.
+
+HMMIdealizer::HMMIdealizer()
+    : N(0), sample_freq(5000), baseline(0), current_per_channel(1), sigma(1), alpha(0), beta(0), initialized(false)
+{
+    reset(1, 5000);
+}
+
+void HMMIdealizer::reset(int N_arg, double sample_freq_arg) {
+    N = (N_arg < 1) ? 1 : N_arg;
+    sample_freq = sample_freq_arg;
+    // Default kinetics: each channel opens/closes about 20 times per second.
+    alpha = 20.0 / sample_freq;
+    beta = 20.0 / sample_freq;
+    sigma = -1;     // Determined from current_per_channel in setLevels().
+    initialized = false;
+
+    log_up.assign(N + 1, LOG_ZERO);
+    log_down.assign(N + 1, LOG_ZERO);
+    log_stay.assign(N + 1, 0);
+    up_from_below.assign(N + 1, LOG_ZERO);
+    down_from_above.assign(N + 1, LOG_ZERO);
+    delta.assign(N + 3, LOG_ZERO);
+    delta_next.assign(N + 3, LOG_ZERO);
+
+    acc_up = acc_down = 0;
+    acc_openable = acc_closable = 0;
+    acc_residual = acc_samples = 0;
+    updateTransitions();
+}
+
+void HMMIdealizer::setChannels(int N_arg) {
+    if (N_arg < 1) N_arg = 1;
+    if (N_arg == N) return;
+    const int S_old = N + 1;
+    std::vector<double> scores(delta);
+    N = N_arg;
+    log_up.assign(N + 1, LOG_ZERO);
+    log_down.assign(N + 1, LOG_ZERO);
+    log_stay.assign(N + 1, 0);
+    up_from_below.assign(N + 1, LOG_ZERO);
+    down_from_above.assign(N + 1, LOG_ZERO);
+    delta.assign(N + 3, LOG_ZERO);
+    delta_next.assign(N + 3, LOG_ZERO);
+    // The new states start as unlikely, so the path continues from where it was.
+    for (int k = 0; k < S_old && k <= N; k++) delta[k + 1] = scores[k + 1];
+    updateTransitions();
+}
+
+void HMMIdealizer::setLevels(double baseline_arg, double current_per_channel_arg) {
+    baseline = baseline_arg;
+    current_per_channel = current_per_channel_arg;
+    if (sigma <= 0) sigma = 0.25 * fabs(current_per_channel);     // Initial guess (S/N = 4)
+    if (sigma <= 0) sigma = 1;
+}
+
+void HMMIdealizer::updateTransitions() {
+    // Keep the total leaving probability of every state below 1.
+    double max_rate = 0.5 / N;
+    if (alpha > max_rate) alpha = max_rate;
+    if (beta > max_rate) beta = max_rate;
+    if (alpha < 1e-7) alpha = 1e-7;
+    if (beta < 1e-7) beta = 1e-7;
+    for (int k = 0; k <= N; k++) {
+        double up = (N - k) * alpha;
+        double down = k * beta;
+        log_up[k] = (k < N) ? log(up) : LOG_ZERO;
+        log_down[k] = (k > 0) ? log(down) : LOG_ZERO;
+        log_stay[k] = log(1 - up - down);
+    }
+    for (int k = 0; k <= N; k++) {
+        up_from_below[k] = (k > 0) ? log_up[k - 1] : LOG_ZERO;
+        down_from_above[k] = (k < N) ? log_down[k + 1] : LOG_ZERO;
+    }
+}
+
+void HMMIdealizer::idealize(const double* current, int* destination, int n, bool learn) {
+    if (n <= 0) return;
+    const int S = N + 1;
+    if ((int)backpointer.size() < n * S) backpointer.resize(n * S);
+
+    // delta[] and delta_next[] are padded: delta[k + 1] is the score of state k.
+    double* d = delta.data();
+    double* dn = delta_next.data();
+    const double inv_2var = 1.0 / (2 * sigma * sigma);
+
+    // The first sample of the whole trace has no predecessor.
+    // Otherwise, the first sample of the block follows the last sample of the previous block.
+    int t_start = 0;
+    if (!initialized) {
+        for (int k = 0; k < S; k++) {
+            double r = current[0] - (baseline + k * current_per_channel);
+            d[k + 1] = -r * r * inv_2var;
+            backpointer[k] = 0;
+        }
+        initialized = true;
+        t_start = 1;
+    }
+
+    // up_from_below[k] = log_up[k - 1],  down_from_above[k] = log_down[k + 1], so that the inner loop has no branches.
+    const double* ls = log_stay.data();
+    const double* lu = up_from_below.data();
+    const double* ld = down_from_above.data();
+
+    for (int t = t_start; t < n; t++) {
+        const double y = current[t];
+        signed char* bp = &backpointer[t * S];
+        double max_score = LOG_ZERO;
+        for (int k = 0; k < S; k++) {
+            double stay = d[k + 1] + ls[k];
+            double from_below = d[k] + lu[k];
+            double from_above = d[k + 2] + ld[k];
+            double best = (stay >= from_below) ? stay : from_below;
+            best = (best >= from_above) ? best : from_above;
+            bp[k] = (best == stay) ? 0 : ((best == from_below) ? -1 : 1);
+            double r = y - (baseline + k * current_per_channel);
+            double score = best - r * r * inv_2var;
+            dn[k + 1] = score;
+            max_score = (score > max_score) ? score : max_score;
+        }
+        // Normalization to prevent the scores from diverging.
+        for (int k = 0; k < S; k++) d[k + 1] = dn[k + 1] - max_score;
+    }
+
+    // Traceback from the most likely final state.
+    int state = 0;
+    for (int k = 1; k < S; k++) {
+        if (d[k + 1] > d[state + 1]) state = k;
+    }
+    for (int t = n - 1; t >= 0; t--) {
+        destination[t] = state;
+        state += backpointer[t * S + state];
+        if (state < 0) state = 0;
+        if (state > N) state = N;
+    }
+
+    if (!learn) return;
+
+    // Online learning of the kinetics and the noise level from the decoded path.
+    double ups = 0, downs = 0, openable = 0, closable = 0, residual = 0;
+    for (int t = 0; t < n; t++) {
+        int k = destination[t];
+        openable += N - k;
+        closable += k;
+        double r = current[t] - (baseline + k * current_per_channel);
+        residual += r * r;
+        if (t > 0) {
+            if (k > destination[t - 1]) ups += 1;
+            else if (k < destination[t - 1]) downs += 1;
+        }
+    }
+    acc_up = FORGETTING * acc_up + ups;
+    acc_down = FORGETTING * acc_down + downs;
+    acc_openable = FORGETTING * acc_openable + openable;
+    acc_closable = FORGETTING * acc_closable + closable;
+    acc_residual = FORGETTING * acc_residual + residual;
+    acc_samples = FORGETTING * acc_samples + n;
+
+    // A pseudo-count (one event) keeps the rates away from zero while no transition is observed.
+    if (acc_openable > 0) alpha = (acc_up + 1) / (acc_openable + sample_freq / 20.0);
+    if (acc_closable > 0) beta = (acc_down + 1) / (acc_closable + sample_freq / 20.0);
+    if (acc_samples > 0) {
+        double s = sqrt(acc_residual / acc_samples);
+        // The noise level is not allowed to exceed half of the single channel current, otherwise the levels merge.
+        double s_max = 0.5 * fabs(current_per_channel);
+        if (s_max > 0 && s > s_max) s = s_max;
+        if (s > 1e-6) sigma = s;
+    }
+    updateTransitions();
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingHMM.h
+*
+* Hidden-Markov-model idealization for ion channels with low S/N ratio.
+* See ProcessingHMM.cpp for details.
+******************************************************************************/
+
+#include <vector>
+
+#define HMM_MAX_CHANNELS 32     // Upper limit of the channels modelled (the cost is O(N) per sample).
+
+class HMMIdealizer
+{
+public:
+    HMMIdealizer();
+
+    // Reset the model with N channels (N + 1 conductance levels) and the sampling frequency [Hz].
+    // The transition rates and the noise level are learned again from the default values.
+    void reset(int N, double sample_freq);
+    // Change the number of channels, keeping the learned kinetics and noise level and the scores of the states kept
+    // (e.g. when the decoded path stays at the top state, which means that more channels are open).
+    void setChannels(int N);
+    int channels() const { return N; }
+
+    // Set the current levels: level k = baseline + k * current_per_channel [pA].
+    // This can be changed between two calls of idealize() (e.g. when the holding voltage is switched).
+    void setLevels(double baseline, double current_per_channel);
+
+    // Idealize n samples into the number of open channels.
+    // The forward scores are carried over to the next call, so a long trace can be processed block by block.
+    // When "learn" is true, the transition rates and the noise level are updated from the decoded path.
+    void idealize(const double* current, int* destination, int n, bool learn = true);
+
+    double openRate() const { return alpha * sample_freq; }    // Opening rate per channel [1/s]
+    double closeRate() const { return beta * sample_freq; }    // Closing rate per channel [1/s]
+    double noiseSD() const { return sigma; }                    // Standard deviation of the noise [pA]
+
+private:
+    void updateTransitions();
+
+    int N;
+    double sample_freq;
+    double baseline;
+    double current_per_channel;
+    double sigma;
+    double alpha;       // Opening probability per channel per sample
+    double beta;        // Closing probability per channel per sample
+    bool initialized;   // false until the first sample is processed (then the scores are carried over)
+
+    // Work arrays of size N + 1 (scores are padded by one element on both sides).
+    std::vector<double> log_up;     // log P(k -> k+1)
+    std::vector<double> log_down;   // log P(k -> k-1)
+    std::vector<double> log_stay;   // log P(k -> k)
+    std::vector<double> up_from_below;      // log P(k-1 -> k)
+    std::vector<double> down_from_above;    // log P(k+1 -> k)
+    std::vector<double> delta;      // Viterbi scores (padded)
+    std::vector<double> delta_next; // (padded)
+    std::vector<signed char> backpointer;   // Step (-1, 0, +1) from the predecessor, for each sample and state
+
+    // Accumulated statistics for the online learning (exponentially forgotten every block).
+    double acc_up;
+    double acc_down;
+    double acc_openable;    // Sum of (N - k) over samples
+    double acc_closable;    // Sum of k over samples
+    double acc_residual;    // Sum of squared residuals
+    double acc_samples;
+};
@@ -0,0 +1,240 @@
+/******************************************************************************
+// ProcessingKinetics.cpp
+//
+// This code turns the idealized trace into the dwell-time event stream (start, duration, level and mean current of every dwell)
+// and keeps the open/closed dwell-time histograms, so that the kinetics can be analyzed during the recording
+// instead of exporting the raw data to Clampfit.
+//
+// * The histograms have logarithmic bins (KINETICS_BINS_PER_DECADE per decade, Sigworth & Sine 1987), so that dwells from
+//   one sample to hours are kept in a fixed memory and exponential components appear as separate peaks.
+// * A dwell is recorded only if both of its ends are transitions; the dwells cut by a rupture, a holding voltage switch
+//   or the start of the recording are discarded since their durations are unknown.
+// * The time constants are fitted by maximum likelihood on the binned data. Since the trace is sampled, the dwell time
+//   (in samples) of a component follows the geometric distribution P(d) = (1 - q) * q^(d - 1), q = exp(-dt / tau),
+//   which is integrated exactly over each bin. A mixture of exponentials is fitted by EM, and the number of components
+//   is chosen by BIC. The fit runs in a worker thread (KineticsFitter).
+******************************************************************************/
+
+#include "ProcessingKinetics.h"
+#include <chrono>
+#include <math.h>
+
+static const long long NO_RUN = -1;     // run_start of a dwell that did not start with a transition
+
+// Lower edges of the bins in samples: ceil(10^(i / KINETICS_BINS_PER_DECADE)). Some short bins contain no integer and stay empty.
+static long long binLower(int i) {
+    return (long long)ceil(pow(10.0, (double)i / KINETICS_BINS_PER_DECADE) - 1e-9);
+}
+
+LogHistogram::LogHistogram()
+    : dt_ms(0.2)
+{
+    clear();
+}
+
+void LogHistogram::setup(double dt_ms_arg) {
+    dt_ms = dt_ms_arg;
+    clear();
+}
+
+void LogHistogram::clear() {
+    for (int i = 0; i < KINETICS_BINS; i++) counts[i] = 0;
+    total = 0;
+    sum_ms = 0;
+}
+
+void LogHistogram::add(int duration_samples) {
+    if (duration_samples < 1) return;
+    // The bin i with binLower(i) <= d < binLower(i + 1). The last bin also holds the longer dwells.
+    int i = (int)floor(KINETICS_BINS_PER_DECADE * log10((double)duration_samples));
+    if (i >= KINETICS_BINS) i = KINETICS_BINS - 1;
+    while (i > 0 && binLower(i) > duration_samples) i--;
+    while (i < KINETICS_BINS - 1 && binLower(i + 1) <= duration_samples) i++;
+    counts[i] += 1;
+    total += 1;
+    sum_ms += duration_samples * dt_ms;
+}
+
+double LogHistogram::edge(int i) const {
+    return binLower(i) * dt_ms;
+}
+
+// ****** Fit
+
+// Probability that m = d - 1 falls into [a, b) (b < 0: infinity) under P(m) = (1 - q) q^m, and the sum of m over the bin.
+static void geometricBin(double q, long long a, long long b, double* prob, double* mean_m) {
+    double qa = pow(q, (double)a);
+    double qb = (b < 0) ? 0 : pow(q, (double)b);
+    *prob = qa - qb;
+    // sum_{m >= a} m q^m (1 - q) = a q^a + q^(a + 1) / (1 - q)
+    double s_a = a * qa + q * qa / (1 - q);
+    double s_b = (b < 0) ? 0 : b * qb + q * qb / (1 - q);
+    *mean_m = (*prob > 0) ? (s_a - s_b) / *prob : (double)a;
+}
+
+static double tauFromQ(double q, double dt) { return -dt / log(q); }
+
+KineticsFit fitDwellTimes(const LogHistogram& hist, int max_components) {
+    KineticsFit fit = {};
+    fit.dwells = hist.count();
+    if (hist.count() < 5) return fit;
+    if (max_components > KINETICS_MAX_COMPONENTS) max_components = KINETICS_MAX_COMPONENTS;
+
+    const double dt = hist.dt();
+    long long lower[KINETICS_BINS + 1];
+    for (int i = 0; i <= KINETICS_BINS; i++) lower[i] = binLower(i) - 1;    // In m = d - 1
+    lower[KINETICS_BINS] = -1;  // The last bin is open-ended.
+
+    // Single exponential: closed form from the exact sum of the dwell times.
+    double n = hist.count();
+    double S = hist.sumDuration() / dt - n;     // sum of (d - 1)
+    double q1 = S / (S + n);
+    if (q1 < 1e-12) q1 = 1e-12;
+    double ll1 = 0;
+    for (int i = 0; i < KINETICS_BINS; i++) {
+        if (hist.bin(i) == 0) continue;
+        double p, m;
+        geometricBin(q1, lower[i], lower[i + 1], &p, &m);
+        ll1 += hist.bin(i) * log(p > 1e-300 ? p : 1e-300);
+    }
+    fit.components = 1;
+    fit.tau[0] = tauFromQ(q1, dt);
+    fit.weight[0] = 1;
+    fit.logLikelihood = ll1;
+    if (max_components < 2 || n < 50) return fit;
+
+    // Two exponentials by EM.
+    double q[2], w[2] = { 0.5, 0.5 };
+    for (int j = 0; j < 2; j++) {
+        double tau = fit.tau[0] * (j == 0 ? 0.2 : 5.0);
+        q[j] = exp(-dt / tau);
+    }
+    double ll2 = -HUGE_VAL;
+    for (int iter = 0; iter < 500; iter++) {
+        double resp_n[2] = { 0, 0 }, resp_m[2] = { 0, 0 };
+        double ll = 0;
+        for (int i = 0; i < KINETICS_BINS; i++) {
+            if (hist.bin(i) == 0) continue;
+            double p[2], m[2];
+            for (int j = 0; j < 2; j++) geometricBin(q[j], lower[i], lower[i + 1], &p[j], &m[j]);
+            double total = w[0] * p[0] + w[1] * p[1];
+            if (total < 1e-300) total = 1e-300;
+            ll += hist.bin(i) * log(total);
+            for (int j = 0; j < 2; j++) {
+                double r = hist.bin(i) * w[j] * p[j] / total;
+                resp_n[j] += r;
+                resp_m[j] += r * m[j];
+            }
+        }
+        for (int j = 0; j < 2; j++) {
+            w[j] = resp_n[j] / n;
+            if (resp_n[j] > 0) q[j] = resp_m[j] / (resp_m[j] + resp_n[j]);
+            if (q[j] < 1e-12) q[j] = 1e-12;
+        }
+        if (fabs(ll - ll2) < 1e-9 * fabs(ll)) {
+            ll2 = ll;
+            break;
+        }
+        ll2 = ll;
+    }
+
+    // BIC: 1 parameter for a single exponential, 3 for two.
+    double bic1 = -2 * ll1 + 1 * log(n);
+    double bic2 = -2 * ll2 + 3 * log(n);
+    if (bic2 < bic1 && w[0] > 0.01 && w[1] > 0.01) {
+        int fast = (q[0] < q[1]) ? 0 : 1;
+        fit.components = 2;
+        fit.tau[0] = tauFromQ(q[fast], dt);
+        fit.weight[0] = w[fast];
+        fit.tau[1] = tauFromQ(q[1 - fast], dt);
+        fit.weight[1] = w[1 - fast];
+        fit.logLikelihood = ll2;
+    }
+    return fit;
+}
+
+// ****** DwellTracker
+
+DwellTracker::DwellTracker()
+    : num_dropped(0), run_level(-1), run_start(0), run_sum(0), t(0)
+{
+}
+
+void DwellTracker::setup(double sample_freq, int capacity) {
+    table.assign(capacity > 0 ? capacity : 1, DwellEvent());
+    closed.setup(1000.0 / sample_freq);
+    open.setup(1000.0 / sample_freq);
+    num_dropped = 0;
+    t = 0;
+    breakRun();
+}
+
+void DwellTracker::breakRun() {
+    run_level = -1;
+    run_sum = 0;
+}
+
+void DwellTracker::clearHistograms() {
+    closed.clear();
+    open.clear();
+}
+
+int DwellTracker::process(const int* idealized, const double* current, int n) {
+    const long long t_block = t;
+    const int capacity = (int)table.size();
+    int num_events = 0;
+    num_dropped = 0;
+    for (int idx = 0; idx < n; idx++, t++) {
+        int k = idealized[idx];
+        if (k == run_level) {
+            run_sum += current[idx];
+            continue;
+        }
+        bool transition = (run_level >= 0 && k >= 0);
+        if (transition && run_start != NO_RUN) {
+            // The ongoing dwell ends with a transition.
+            int duration = (int)(t - run_start);
+            if (run_level == 0) closed.add(duration);
+            else open.add(duration);
+            if (num_events < capacity) {
+                DwellEvent& e = table[num_events++];
+                e.start = (int)(run_start - t_block);
+                e.duration = duration;
+                e.level = run_level;
+                e.mean_current = run_sum / duration;
+            }
+            else {
+                num_dropped++;
+            }
+        }
+        run_level = k;
+        run_sum = (k >= 0) ? current[idx] : 0;
+        run_start = transition ? t : NO_RUN;    // A dwell that did not start with a transition has an unknown duration.
+    }
+    return num_events;
+}
+
+// ****** KineticsFitter
+
+bool KineticsFitter::request(const LogHistogram& closed, const LogHistogram& open) {
+    if (requested) return false;
+    closed_hist = closed;
+    open_hist = open;
+    requested = true;
+    worker.post(&KineticsFitter::fit, this);
+    return true;
+}
+
+void KineticsFitter::fit(void* self) {
+    KineticsFitter* f = (KineticsFitter*)self;
+    f->closed_result = fitDwellTimes(f->closed_hist);
+    f->open_result = fitDwellTimes(f->open_hist);
+}
+
+bool KineticsFitter::poll(KineticsFit* closed_fit, KineticsFit* open_fit) {
+    if (!requested || worker.busy()) return false;
+    requested = false;
+    *closed_fit = closed_result;
+    *open_fit = open_result;
+    return true;
+}
@@ -0,0 +1,112 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingKinetics.h
+*
+* Dwell-time event table, log-binned dwell-time histograms and the fit of the time constants.
+* See ProcessingKinetics.cpp for details.
+******************************************************************************/
+
+#include <vector>
+#include "PipelineStages.h"
+
+#define KINETICS_BINS_PER_DECADE 10
+#define KINETICS_DECADES 7
+#define KINETICS_BINS (KINETICS_BINS_PER_DECADE * KINETICS_DECADES)
+#define KINETICS_MAX_COMPONENTS 2
+
+// A finished dwell at a constant number of open channels.
+struct DwellEvent {
+    int start;              // Sample index (relative to the block passed to DwellTracker::process()) of the first sample. Negative if it started in a previous block.
+    int duration;           // [samples]
+    int level;              // Number of open channels
+    double mean_current;    // [pA]
+};
+
+// Dwell-time histogram with logarithmic bins, from one sample up to KINETICS_DECADES decades. The memory is fixed.
+class LogHistogram
+{
+public:
+    LogHistogram();
+    void setup(double dt_ms);       // Sampling interval [ms] = the shortest dwell time
+    void clear();
+    void add(int duration_samples);
+
+    double count() const { return total; }
+    double bin(int i) const { return counts[i]; }
+    double edge(int i) const;       // Lower edge of bin i [ms] (edge(KINETICS_BINS) is the upper limit)
+    double dt() const { return dt_ms; }
+    double sumDuration() const { return sum_ms; }   // Sum of all dwell times [ms] (exact, not binned)
+
+private:
+    double dt_ms;
+    double counts[KINETICS_BINS];
+    double total;
+    double sum_ms;
+};
+
+// Mixture of exponentials fitted to a dwell-time histogram.
+struct KineticsFit {
+    int components;                         // 0 if the fit failed (too few dwells)
+    double tau[KINETICS_MAX_COMPONENTS];    // Time constants [ms], ascending
+    double weight[KINETICS_MAX_COMPONENTS]; // Fractions of the components
+    double logLikelihood;
+    double dwells;                          // Number of dwells used
+};
+
+// Fit 1 and 2 exponentials by maximum likelihood (EM on the binned data), and choose by BIC.
+// Dwells shorter than one sample are not observed, so the distributions are truncated at dt.
+KineticsFit fitDwellTimes(const LogHistogram& hist, int max_components = KINETICS_MAX_COMPONENTS);
+
+// Splits the idealized trace into dwells, block by block, and updates the histograms.
+class DwellTracker
+{
+public:
+    DwellTracker();
+    // capacity: the maximum number of events reported per block (the event table is allocated here only).
+    void setup(double sample_freq, int capacity);
+    // Discard the ongoing dwell (e.g. rupture or holding voltage switch): its duration is unknown.
+    void breakRun();
+    // Clear the histograms (e.g. after a holding voltage switch, since the kinetics depend on the voltage).
+    void clearHistograms();
+
+    // Process n samples. Samples < 0 (not idealized) end the ongoing dwell without recording it.
+    // Returns the number of dwells finished in this block; they are available by events() until the next call.
+    int process(const int* idealized, const double* current, int n);
+    const DwellEvent* events() const { return table.data(); }
+    int dropped() const { return num_dropped; }     // Number of events not stored in the table in the last call (over capacity)
+
+    const LogHistogram& closedHistogram() const { return closed; }  // Dwells with no open channel
+    const LogHistogram& openHistogram() const { return open; }      // Dwells with one or more open channels
+
+private:
+    std::vector<DwellEvent> table;
+    int num_dropped;
+    LogHistogram closed;
+    LogHistogram open;
+
+    int run_level;          // -1 if there is no ongoing dwell
+    long long run_start;    // Absolute sample index of the ongoing dwell
+    double run_sum;         // Sum of the current in the ongoing dwell
+    long long t;            // Absolute sample index of the next sample
+};
+
+// Fits the open/closed dwell-time histograms in a worker thread, so that the 1 Hz callback is not blocked.
+class KineticsFitter
+{
+public:
+    KineticsFitter() : requested(false) {}
+
+    // Start a fit of copies of the histograms. Ignored (returns false) if the previous fit is still running.
+    bool request(const LogHistogram& closed, const LogHistogram& open);
+    // Returns true once when a requested fit has finished, with the results.
+    bool poll(KineticsFit* closed_fit, KineticsFit* open_fit);
+
+private:
+    static void fit(void* self);
+
+    LogHistogram closed_hist, open_hist;    // Copies fitted by the worker
+    KineticsFit closed_result, open_result;
+    bool requested;                         // A fit not yet polled
+    WorkerThread worker;                    // Declared last, so that it is stopped before the members above are destroyed.
+};
@@ -0,0 +1,159 @@
+/******************************************************************************
+// ProcessingMains.cpp
+//
+// This code removes the mains interference (50/60 Hz and its harmonics), which leaks into the current when the Faraday
+// cage is opened or a pump runs, and makes the idealizers miscount the channels.
+//
+// Cancellation (adaptive noise canceller with the internal references):
+//     y_hat[t] = sum_k ( w_c[k] * cos(k * w * t) + w_s[k] * sin(k * w * t) ),   out[t] = in[t] - y_hat[t]
+//     w_c[k] += 2 * mu * e[t] * cos(k * w * t),  w_s[k] += 2 * mu * e[t] * sin(k * w * t)      (LMS)
+// which acts as a set of narrow notches (about 1 / (pi * time_constant) Hz wide) at the harmonics, so the channel
+// currents are hardly affected. The slow mean of the output (the baseline and the channel steps) is removed from the
+// error before the update. The references are generated by rotating (cos, sin) pairs, so the cost per sample is a few
+// multiplications per harmonic (about 50 for 5 harmonics), well below the budget at 20 kHz.
+//
+// Frequency tracking:
+//   The mains frequency deviates from the nominal one by up to ~0.2 Hz, which the narrow notches cannot follow.
+//   The Goertzel algorithm evaluates the input at the tracked fundamental over consecutive windows of 0.2 s,
+//   and the phase advance between the windows in excess of the expected one gives the frequency error
+//   (so the frequency is updated at most every other window).
+//   The frequency is updated only when the fundamental stands out of the noise floor (a Goertzel bin between the harmonics).
+******************************************************************************/
+
+#include "ProcessingMains.h"
+#include <math.h>
+
+static const double PI = 3.14159265358979323846;
+static const double WINDOW_SEC = 0.2;       // Length of the Goertzel windows [s]
+static const double MAX_DEVIATION = 2.0;    // The tracked frequency stays within nominal +/- this value [Hz]
+static const double MEAN_SEC = 0.05;        // Time constant of the mean removed from the LMS error [s]
+
+MainsCanceller::MainsCanceller()
+{
+    setup(5000, 50, 5, 0.5);
+}
+
+void MainsCanceller::setup(double sample_freq_arg, double nominal_freq_arg, int harmonics_arg, double time_constant) {
+    sample_freq = sample_freq_arg;
+    nominal_freq = nominal_freq_arg;
+    harmonics = (harmonics_arg < 1) ? 1 : ((harmonics_arg > MAINS_MAX_HARMONICS) ? MAINS_MAX_HARMONICS : harmonics_arg);
+    // Harmonics above the Nyquist frequency cannot be cancelled.
+    while (harmonics > 1 && harmonics * (nominal_freq + MAX_DEVIATION) >= 0.5 * sample_freq) harmonics--;
+    mu = 1.0 / (time_constant * sample_freq);
+    window = (int)(WINDOW_SEC * sample_freq + 0.5);
+    mean.setAlpha(1.0 / (MEAN_SEC * sample_freq));
+    reset();
+}
+
+void MainsCanceller::reset() {
+    freq = nominal_freq;
+    for (int k = 0; k < MAINS_MAX_HARMONICS; k++) {
+        osc_c[k] = 1;
+        osc_s[k] = 0;
+        w_c[k] = 0;
+        w_s[k] = 0;
+    }
+    mean.set(0);
+    window_count = 0;
+    g_s1 = g_s2 = n_s1 = n_s2 = 0;
+    prev_valid = false;
+    updateRotation();
+}
+
+void MainsCanceller::updateRotation() {
+    for (int k = 0; k < harmonics; k++) {
+        double w = 2 * PI * (k + 1) * freq / sample_freq;
+        rot_c[k] = cos(w);
+        rot_s[k] = sin(w);
+    }
+    g_coef = 2 * cos(2 * PI * freq / sample_freq);
+    // 3.5 Goertzel bins above the fundamental: away from the harmonics and from the main lobe of the fundamental.
+    n_coef = 2 * cos(2 * PI * (freq + 3.5 / WINDOW_SEC) / sample_freq);
+}
+
+void MainsCanceller::process(const double* in, double* out, int n) {
+    const int H = harmonics;
+    const double mu2 = 2 * mu;
+    for (int t = 0; t < n; t++) {
+        const double x = in[t];
+
+        // Interference estimate and the cancellation
+        double y_hat = 0;
+        for (int k = 0; k < H; k++) y_hat += w_c[k] * osc_c[k] + w_s[k] * osc_s[k];
+        const double e = x - y_hat;
+        out[t] = e;
+
+        // LMS update with the slow mean removed, then the references advance by one sample
+        mean.add(e);
+        const double g = mu2 * (e - mean.mean());
+        for (int k = 0; k < H; k++) {
+            w_c[k] += g * osc_c[k];
+            w_s[k] += g * osc_s[k];
+            double c = osc_c[k] * rot_c[k] - osc_s[k] * rot_s[k];
+            double s = osc_s[k] * rot_c[k] + osc_c[k] * rot_s[k];
+            osc_c[k] = c;
+            osc_s[k] = s;
+        }
+
+        // Goertzel at the fundamental and at the noise floor
+        double s0 = x + g_coef * g_s1 - g_s2;
+        g_s2 = g_s1;
+        g_s1 = s0;
+        double n0 = x + n_coef * n_s1 - n_s2;
+        n_s2 = n_s1;
+        n_s1 = n0;
+        if (++window_count == window) trackFrequency();
+    }
+    // Keep the oscillators on the unit circle against the rounding errors.
+    for (int k = 0; k < H; k++) {
+        double r = sqrt(osc_c[k] * osc_c[k] + osc_s[k] * osc_s[k]);
+        osc_c[k] /= r;
+        osc_s[k] /= r;
+    }
+}
+
+void MainsCanceller::trackFrequency() {
+    const double w = 2 * PI * freq / sample_freq;
+    double re = g_s1 - 0.5 * g_coef * g_s2;
+    double im = sin(w) * g_s2;
+    double power = re * re + im * im;
+    double wn = 0.5 * n_coef;
+    double n_re = n_s1 - wn * n_s2;
+    double n_im = sqrt(1 - wn * wn) * n_s2;
+    double noise = n_re * n_re + n_im * n_im;
+
+    bool strong = (power > 16 * noise && power > 0);     // 4 times above the noise floor in amplitude
+    bool updated = false;
+    if (strong && prev_valid) {
+        // Phase advance over a window, in excess of w * window.
+        double d_re = re * prev_re + im * prev_im;
+        double d_im = im * prev_re - re * prev_im;
+        double dphi = atan2(d_im, d_re) - fmod(w * window, 2 * PI);
+        while (dphi > PI) dphi -= 2 * PI;
+        while (dphi < -PI) dphi += 2 * PI;
+        double df = dphi * sample_freq / (2 * PI * window);
+        freq += 0.5 * df;
+        if (freq > nominal_freq + MAX_DEVIATION) freq = nominal_freq + MAX_DEVIATION;
+        if (freq < nominal_freq - MAX_DEVIATION) freq = nominal_freq - MAX_DEVIATION;
+        updateRotation();
+        updated = true;
+    }
+    prev_re = re;
+    prev_im = im;
+    // The phase of the next window is not comparable with this one after the frequency is changed.
+    prev_valid = strong && !updated;
+    window_count = 0;
+    g_s1 = g_s2 = n_s1 = n_s2 = 0;
+}
+
+double MainsCanceller::amplitude(int harmonic) const {
+    int k = harmonic - 1;
+    if (k < 0 || k >= harmonics) return 0;
+    return sqrt(w_c[k] * w_c[k] + w_s[k] * w_s[k]);
+}
+
+double MainsCanceller::rms() const {
+    double sum = 0;
+    for (int k = 0; k < harmonics; k++) sum += w_c[k] * w_c[k] + w_s[k] * w_s[k];
+    return sqrt(0.5 * sum);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingMains.h
+*
+* Adaptive cancellation of the mains (50/60 Hz) interference and its harmonics.
+* See ProcessingMains.cpp for details.
+******************************************************************************/
+
+#include "ProcessingStats.h"
+
+#define MAINS_MAX_HARMONICS 8
+
+class MainsCanceller
+{
+public:
+    MainsCanceller();
+
+    // nominal_freq: 50 or 60 [Hz]. harmonics: the number of the cancelled harmonics including the fundamental.
+    // time_constant: the adaptation time constant of the amplitudes [s] (the notch width is about 1 / (pi * time_constant) Hz).
+    void setup(double sample_freq, double nominal_freq, int harmonics, double time_constant);
+    // Forget the learned amplitudes and the frequency (e.g. after a rupture).
+    void reset();
+
+    // Remove the interference from in[0 .. n-1] into out[] (which may be the same array). The state is carried over.
+    void process(const double* in, double* out, int n);
+
+    double frequency() const { return freq; }       // Tracked fundamental frequency [Hz]
+    double amplitude(int harmonic) const;           // Amplitude of the harmonic (1: fundamental) [pA]
+    double rms() const;                             // RMS of the whole interference [pA]
+
+private:
+    void updateRotation();
+    void trackFrequency();
+
+    double sample_freq;
+    double nominal_freq;
+    int harmonics;
+    double mu;              // LMS step size
+    double freq;
+
+    // Reference oscillators (cos, sin) of each harmonic and their rotation per sample
+    double osc_c[MAINS_MAX_HARMONICS], osc_s[MAINS_MAX_HARMONICS];
+    double rot_c[MAINS_MAX_HARMONICS], rot_s[MAINS_MAX_HARMONICS];
+    // LMS weights of the cos / sin references
+    double w_c[MAINS_MAX_HARMONICS], w_s[MAINS_MAX_HARMONICS];
+    ExpAverage mean;        // Slow mean of the input, removed from the LMS error (the baseline and the channel steps)
+
+    // Goertzel frequency tracking over the windows of "window" samples
+    int window;
+    int window_count;
+    double g_coef, g_s1, g_s2;          // At the tracked fundamental
+    double n_coef, n_s1, n_s2;          // At a frequency between the harmonics (the noise floor)
+    double prev_re, prev_im;            // Goertzel output of the previous window
+    bool prev_valid;
+};
@@ -0,0 +1,222 @@
+/******************************************************************************
+// ProcessingNoise.cpp
+//
+// This code estimates the noise of each idealized level and derives the detection thresholds from it,
+// instead of the constants which suit only the proteins with a high S/N ratio.
+//
+// Noise statistics (exponentially forgotten block by block):
+//   * Level RMS: the RMS around the mean of the samples idealized as k open channels, except near the transitions.
+//     The open-channel noise is often larger than the baseline noise, so the largest RMS limits the detection.
+//   * High-frequency residual: the RMS of the difference of consecutive samples at the same level, divided by sqrt(2).
+//     It is insensitive to the slow drift, and with the level RMS it gives the lag-1 autocorrelation of the noise
+//     (rho = 1 - sigma_hf^2 / sigma^2), i.e. how much the noise is filtered by the amplifier.
+//
+// Thresholds for the target false-event rate:
+//   The rate of the noise crossing the level u above (or below) the mean is approximated by the Rice formula
+//   for the sampled Gaussian noise:
+//       rate = sample_freq * acos(rho) / (2 * pi) * exp(-u^2 / (2 * sigma^2))     (per side)
+//   This is exact for the oversampled noise, and conservative (up to ~3 times larger) for the white noise.
+//   Solving rate * 2 = target_rate for u gives the hysteresis width of the threshold idealizer
+//   (limited to [0.5, 0.95] of the single channel current: below 0.5 the hysteresis is inverted),
+//   and the same for the edge filter output of the nanopores with its own noise and autocorrelation.
+//   The rupture threshold is only raised, so that the noise of the observed levels does not reach it.
+******************************************************************************/
+
+#include "ProcessingNoise.h"
+#include <math.h>
+#include <algorithm>
+
+static const double PI = 3.14159265358979323846;
+static const double MIN_LEVEL_SAMPLES = 200;    // Levels with fewer (effective) samples are not used for sigma.
+static const double MIN_TOTAL_SAMPLES = 1000;   // The estimate is valid after this number of (effective) samples.
+
+NoiseEstimator::NoiseEstimator()
+    : sample_freq(5000), target_rate(0.01), forgetting(0.9), guard(10)
+{
+    var_filtered.setAlpha(1 - forgetting);
+    rho_filtered.setAlpha(1 - forgetting);
+    reset();
+}
+
+void NoiseEstimator::setup(double sample_freq_arg, double target_rate_arg, double forgetting_arg, int guard_arg) {
+    sample_freq = sample_freq_arg;
+    target_rate = target_rate_arg;
+    forgetting = forgetting_arg;
+    var_filtered.setAlpha(1 - forgetting);
+    rho_filtered.setAlpha(1 - forgetting);
+    guard = (guard_arg < 0) ? 0 : guard_arg;
+    reset();
+}
+
+void NoiseEstimator::reset() {
+    for (int k = 0; k <= NOISE_MAX_LEVEL; k++) {
+        n_level[k] = 0;
+        sum_level[k] = 0;
+        sumsq_level[k] = 0;
+    }
+    n_diff = 0;
+    sumsq_diff = 0;
+    var_filtered.clear();
+    rho_filtered.clear();
+}
+
+void NoiseEstimator::update(const double* current, const int* idealized, int n) {
+    double n_block[NOISE_MAX_LEVEL + 1] = {};
+    double sum_block[NOISE_MAX_LEVEL + 1] = {};
+    double sumsq_block[NOISE_MAX_LEVEL + 1] = {};
+    double n_diff_block = 0, sumsq_diff_block = 0;
+
+    // The sums are taken around the first sample of each level to keep the precision (the current can be far from 0).
+    // The shift is removed below, after the accumulation.
+    double offset[NOISE_MAX_LEVEL + 1];
+    bool offset_set[NOISE_MAX_LEVEL + 1] = {};
+
+    int idx = 0;
+    while (idx < n) {
+        // Run of the same level: [idx, run_end)
+        int level = idealized[idx];
+        int run_end = idx + 1;
+        while (run_end < n && idealized[run_end] == level) run_end++;
+        if (level >= 0) {
+            // Sample-to-sample differences within the run.
+            for (int t = idx + 1; t < run_end; t++) {
+                double d = current[t] - current[t - 1];
+                sumsq_diff_block += d * d;
+            }
+            n_diff_block += run_end - idx - 1;
+
+            // Level statistics away from the transitions (the ends of the block are not transitions).
+            int k = (level > NOISE_MAX_LEVEL) ? NOISE_MAX_LEVEL : level;
+            int first = (idx > 0) ? idx + guard : idx;
+            int last = (run_end < n) ? run_end - guard : run_end;
+            if (first < last) {
+                if (!offset_set[k]) {
+                    offset[k] = current[first];
+                    offset_set[k] = true;
+                }
+                const double o = offset[k];
+                double s = 0, ss = 0;
+                for (int t = first; t < last; t++) {
+                    double y = current[t] - o;
+                    s += y;
+                    ss += y * y;
+                }
+                n_block[k] += last - first;
+                sum_block[k] += s;
+                sumsq_block[k] += ss;
+            }
+        }
+        idx = run_end;
+    }
+
+    for (int k = 0; k <= NOISE_MAX_LEVEL; k++) {
+        n_level[k] *= forgetting;
+        sum_level[k] *= forgetting;
+        sumsq_level[k] *= forgetting;
+        if (n_block[k] > 0) {
+            // Shift the block sums from offset[k] to 0: sum(y + o) and sum((y + o)^2).
+            const double o = offset[k];
+            n_level[k] += n_block[k];
+            sum_level[k] += sum_block[k] + n_block[k] * o;
+            sumsq_level[k] += sumsq_block[k] + 2 * o * sum_block[k] + n_block[k] * o * o;
+        }
+    }
+    n_diff = forgetting * n_diff + n_diff_block;
+    sumsq_diff = forgetting * sumsq_diff + sumsq_diff_block;
+}
+
+void NoiseEstimator::updateFiltered(const double* filtered, int n) {
+    if (n <= 1) return;
+    // Robust SD (1.4826 * median absolute value): the edge filter output is 0 on average apart from the insertions.
+    work.assign(filtered, filtered + n);
+    for (int t = 0; t < n; t++) work[t] = fabs(work[t]);
+    std::nth_element(work.begin(), work.begin() + n / 2, work.end());
+    double sd = 1.4826 * work[n / 2];
+    if (sd <= 0) return;
+
+    // Lag-1 autocorrelation, excluding the insertions (|output| > 4 SD).
+    double limit = 4 * sd;
+    double sxy = 0, sxx = 0;
+    for (int t = 1; t < n; t++) {
+        double x = filtered[t - 1], y = filtered[t];
+        if (fabs(x) > limit || fabs(y) > limit) continue;
+        sxy += x * y;
+        sxx += x * x;
+    }
+    double rho_block = (sxx > 0) ? sxy / sxx : 0;
+
+    var_filtered.add(sd * sd);
+    rho_filtered.add(rho_block);
+}
+
+double NoiseEstimator::falseEventRate(double sigma, double rho, double u) const {
+    if (sigma <= 0) return 0;
+    if (rho > 1) rho = 1;
+    if (rho < -1) rho = -1;
+    double z = u / sigma;
+    return 2 * sample_freq * acos(rho) / (2 * PI) * exp(-0.5 * z * z);
+}
+
+double NoiseEstimator::criticalZ(double rho) const {
+    if (rho > 1) rho = 1;
+    if (rho < -1) rho = -1;
+    double ratio = sample_freq * acos(rho) / (PI * target_rate);
+    return (ratio > 1) ? sqrt(2 * log(ratio)) : 0;
+}
+
+NoiseEstimate NoiseEstimator::estimate(double current_per_channel,
+    double default_threshold, double default_detection_threshold, double default_rupture_threshold) const {
+    NoiseEstimate e = {};
+    e.valid = false;
+    e.threshold = default_threshold;
+    e.detection_threshold = default_detection_threshold;
+    e.rupture_threshold = default_rupture_threshold;
+
+    double n_total = 0, var_pooled = 0;
+    double sigma = 0;
+    for (int k = 0; k <= NOISE_MAX_LEVEL; k++) {
+        e.level_samples[k] = n_level[k];
+        if (n_level[k] < 2) continue;
+        double mean = sum_level[k] / n_level[k];
+        double var = sumsq_level[k] / n_level[k] - mean * mean;
+        if (var < 0) var = 0;
+        e.level_mean[k] = mean;
+        e.level_rms[k] = sqrt(var);
+        if (n_level[k] >= MIN_LEVEL_SAMPLES) {
+            n_total += n_level[k];
+            var_pooled += n_level[k] * var;
+            if (e.level_rms[k] > sigma) sigma = e.level_rms[k];
+        }
+    }
+    e.sigma = sigma;
+    e.sigma_hf = (n_diff > 0) ? sqrt(sumsq_diff / n_diff / 2) : 0;
+    if (n_total > 0) var_pooled /= n_total;
+    e.rho = (var_pooled > 0) ? 1 - e.sigma_hf * e.sigma_hf / var_pooled : 0;
+    if (e.rho > 0.999) e.rho = 0.999;
+    if (e.rho < -0.9) e.rho = -0.9;
+    if (!var_filtered.isEmpty()) {
+        e.sigma_filtered = sqrt(var_filtered.mean());
+        e.rho_filtered = rho_filtered.mean();
+    }
+    double unit = fabs(current_per_channel);
+    e.snr = (sigma > 0) ? unit / sigma : 0;
+    if (n_total < MIN_TOTAL_SAMPLES || sigma <= 0 || unit <= 0.1) return e;
+    e.valid = true;
+
+    double z = criticalZ(e.rho);
+    double th = z * sigma / unit;
+    e.threshold = (th < 0.5) ? 0.5 : ((th > 0.95) ? 0.95 : th);
+
+    if (!var_filtered.isEmpty() && e.sigma_filtered > 0) {
+        // A step of the single channel current gives the peak of 0.5 * current_per_channel at the edge filter output.
+        double dt = criticalZ(e.rho_filtered) * e.sigma_filtered / unit;
+        e.detection_threshold = (dt < 0.05) ? 0.05 : ((dt > 0.4) ? 0.4 : dt);
+    }
+
+    for (int k = 0; k <= NOISE_MAX_LEVEL; k++) {
+        if (n_level[k] < MIN_LEVEL_SAMPLES) continue;
+        double reach = fabs(e.level_mean[k]) + 2 * z * e.level_rms[k];
+        if (reach > e.rupture_threshold) e.rupture_threshold = reach;
+    }
+    return e;
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingNoise.h
+*
+* Per-state noise estimation and the noise-adaptive detection thresholds.
+* See ProcessingNoise.cpp for details.
+******************************************************************************/
+
+#include "ProcessingStats.h"
+#include <vector>
+
+#define NOISE_MAX_LEVEL 8   // Levels above this number of open channels are not analyzed separately.
+
+struct NoiseEstimate {
+    bool valid;                 // false until enough samples are observed (then the thresholds are the defaults).
+    double level_mean[NOISE_MAX_LEVEL + 1];     // Mean current of each idealized level [pA]
+    double level_rms[NOISE_MAX_LEVEL + 1];      // RMS around level_mean [pA]
+    double level_samples[NOISE_MAX_LEVEL + 1];  // Effective number of samples (exponentially forgotten)
+    double sigma;               // The largest level RMS with enough samples, which limits the detection [pA]
+    double sigma_hf;            // High-frequency residual: RMS of the sample-to-sample difference / sqrt(2) [pA]
+    double rho;                 // Lag-1 autocorrelation of the noise, from sigma_hf and the pooled level RMS
+    double sigma_filtered;      // Robust SD of the edge filter output (nanopores) [pA], or 0
+    double rho_filtered;        // Lag-1 autocorrelation of the edge filter output
+    double snr;                 // |current_per_channel| / sigma
+    double threshold;           // Hysteresis width for the target false-event rate [units of current_per_channel]
+    double detection_threshold; // Edge detection threshold for the target false-event rate [units of current_per_channel]
+    double rupture_threshold;   // Rupture threshold which the noise of the baseline does not reach [pA]
+};
+
+class NoiseEstimator
+{
+public:
+    NoiseEstimator();
+
+    // target_rate: the acceptable rate of the false events caused by the noise [1/s].
+    // forgetting: weight of the past blocks. guard: samples within this distance from a transition are not used for the level RMS.
+    void setup(double sample_freq, double target_rate, double forgetting, int guard);
+    // Forget the statistics (e.g. after a holding voltage switch, which changes the noise).
+    void reset();
+
+    // Accumulate the statistics of current[0 .. n-1] for each level of idealized[] (samples < 0 are skipped).
+    void update(const double* current, const int* idealized, int n);
+    // Accumulate the noise of the edge filter output (nanopores). The insertions are rare, so the robust SD is used.
+    void updateFiltered(const double* filtered, int n);
+
+    // Noise statistics and the thresholds derived from them.
+    // The defaults are returned (valid == false) until enough samples are observed.
+    NoiseEstimate estimate(double current_per_channel,
+        double default_threshold, double default_detection_threshold, double default_rupture_threshold) const;
+
+    // Expected rate of the false events [1/s] for the noise (sigma, rho) and the distance u from the level [pA],
+    // counting the crossings on both sides.
+    double falseEventRate(double sigma, double rho, double u) const;
+
+private:
+    // The distance from the level [units of sigma] at which the false events occur at target_rate.
+    double criticalZ(double rho) const;
+
+    double sample_freq;
+    double target_rate;
+    double forgetting;
+    int guard;
+
+    double n_level[NOISE_MAX_LEVEL + 1];
+    double sum_level[NOISE_MAX_LEVEL + 1];
+    double sumsq_level[NOISE_MAX_LEVEL + 1];
+    double n_diff;          // Pairs of consecutive samples at the same level
+    double sumsq_diff;
+
+    ExpAverage var_filtered;    // Exponential average of the squared robust SD of the edge filter output (per block)
+    ExpAverage rho_filtered;
+    std::vector<double> work;   // Work array for the median
+};
@@ -0,0 +1,249 @@
+/******************************************************************************
+// ProcessingPipeline.cpp
+//
+// The per-sample loops of the Processing Block used to branch on proteinType, BKstimuli, the sign of current_per_channel
+// and the UI checkboxes in every sample, although none of them changes within a block.
+// Here the idealization and feature stages are templates parameterized on the protein policy (nanopore / ion channel /
+// inhibitor sensing) and the bias polarity (+1 / -1). Each combination is instantiated once, and runIdealization() /
+// runFeatures() select the instantiation once per block, so that the inner loops carry no invariant branches.
+//
+// The generic loops (runIdealizationGeneric / runFeaturesGeneric) are kept as the reference; the specialized pipelines
+// give exactly the same output (see bench/bench_pipeline.cpp).
+******************************************************************************/
+
+#include "ProcessingPipeline.h"
+#include "ProcessingThreshold.h"
+#include <math.h>
+
+// "a is beyond b in the direction of the opening current".
+template <int Polarity>
+static inline bool beyond(double a, double b) {
+    return (Polarity > 0) ? (a > b) : (a < b);
+}
+
+// Nanopores: edge detection on the output of convolve_EDGE.
+// A peak of the filtered current above detection_threshold * current_per_channel is an insertion (removal if negative),
+// counted at the local extremum; then the filtered current has to return to the plateau.
+template <int Polarity>
+static int idealizeEdge(const double* current, const double* filtered, int* destination, int n, const PipelineParams& p, PipelineState* state) {
+    const double rupture = p.rupture_threshold;
+    const double detect = p.current_per_channel * p.detection_threshold;
+    const double detect_reverse = -p.current_per_channel * p.detection_threshold;
+    int L = state->lastOpenNumber;
+    int od = state->on_detection;
+    int idx = 0;
+    for (; idx < n; idx++) {
+        double y_now = current[idx];
+        if (y_now > rupture || y_now < -rupture) break;
+        double f = filtered[idx];
+        if (od == 1) {
+            // find the local maximum ... find the exact position where OpenNumber changes.
+            if (idx >= 1 && beyond<Polarity>(filtered[idx - 1], f)) {
+                L++;
+                if (p.max_open >= 0 && L > p.max_open) L = p.max_open;
+                od = 3;
+            }
+        }
+        else if (od == 2) {
+            // find the local minimum
+            if (idx >= 1 && beyond<Polarity>(f, filtered[idx - 1])) {
+                L--;
+                if (L < 0) L = 0;
+                od = 3;
+            }
+        }
+        else if (od == 3) {
+            // find the plateau
+            if (fabs(f) < 0.5) od = 0;
+        }
+        else {
+            if (beyond<Polarity>(f, detect)) od = 1;
+            else if (beyond<Polarity>(detect_reverse, f)) od = 2;
+        }
+        destination[idx] = L;
+    }
+    state->lastOpenNumber = L;
+    state->on_detection = od;
+    return idx;
+}
+
+template <class Protein, int Polarity>
+int ProcessingPipeline<Protein, Polarity>::idealize(const double* current, const double* filtered, int* destination, int n,
+    const PipelineParams& p, PipelineState* state) {
+    if (Protein::edgeDetection) return idealizeEdge<Polarity>(current, filtered, destination, n, p, state);
+
+    ThresholdParams tp;
+    tp.baseline = p.baseline;
+    tp.current_per_channel = p.current_per_channel;
+    tp.threshold = p.threshold;
+    tp.max_open = p.max_open;
+    tp.abort_lower = -p.rupture_threshold;
+    tp.abort_upper = p.rupture_threshold;
+    if (Protein::cageCheck && p.cage_threshold < tp.abort_upper) tp.abort_upper = p.cage_threshold;
+    return idealizeThresholdFixed<Polarity>(current, destination, n, tp, &state->lastOpenNumber);
+}
+
+template <class Protein, int Polarity>
+void ProcessingPipeline<Protein, Polarity>::features(const double* current, const int* idealized, int start, int n, PipelineFeatures* f) {
+    int max_open = f->maxOpenNumber;
+    for (int idx = Protein::maxFromStatsStart ? start : 0; idx < n; idx++) {
+        max_open = (idealized[idx] > max_open) ? idealized[idx] : max_open;
+    }
+    f->maxOpenNumber = max_open;
+
+    double zero_sum = f->zero_sum, one_sum = f->one_sum;
+    int zero_num = f->zero_num, one_num = f->one_num;
+    for (int idx = start; idx < n; idx++) {
+        int k = idealized[idx];
+        double y = current[idx];
+        zero_sum += (k == 0) ? y : 0.0;
+        zero_num += (k == 0);
+        one_sum += (k == 1) ? y : 0.0;
+        one_num += (k == 1);
+    }
+    f->zero_sum = zero_sum;
+    f->zero_num = zero_num;
+    f->one_sum = one_sum;
+    f->one_num = one_num;
+}
+
+template struct ProcessingPipeline<NanoporePolicy, 1>;
+template struct ProcessingPipeline<NanoporePolicy, -1>;
+template struct ProcessingPipeline<IonChannelPolicy, 1>;
+template struct ProcessingPipeline<IonChannelPolicy, -1>;
+template struct ProcessingPipeline<InhibitorPolicy, 1>;
+template struct ProcessingPipeline<InhibitorPolicy, -1>;
+
+PipelineFeatures emptyFeatures() {
+    PipelineFeatures f;
+    f.maxOpenNumber = -1;
+    f.zero_sum = 0;
+    f.zero_num = 0;
+    f.one_sum = 0;
+    f.one_num = 0;
+    return f;
+}
+
+int runIdealization(int proteinType, int BKstimuli, const double* current, const double* filtered, int* destination, int n,
+    const PipelineParams& p, PipelineState* state) {
+    int polarity = (p.current_per_channel > 0.1) ? 1 : ((p.current_per_channel < -0.1) ? -1 : 0);
+    if (polarity == 0) return runIdealizationGeneric(proteinType, BKstimuli, current, filtered, destination, n, p, state);
+    if (proteinType == 0) {
+        if (polarity > 0) return ProcessingPipeline<NanoporePolicy, 1>::idealize(current, filtered, destination, n, p, state);
+        return ProcessingPipeline<NanoporePolicy, -1>::idealize(current, filtered, destination, n, p, state);
+    }
+    if (proteinType == 1 && BKstimuli == 1) {
+        if (polarity > 0) return ProcessingPipeline<InhibitorPolicy, 1>::idealize(current, filtered, destination, n, p, state);
+        return ProcessingPipeline<InhibitorPolicy, -1>::idealize(current, filtered, destination, n, p, state);
+    }
+    if (polarity > 0) return ProcessingPipeline<IonChannelPolicy, 1>::idealize(current, filtered, destination, n, p, state);
+    return ProcessingPipeline<IonChannelPolicy, -1>::idealize(current, filtered, destination, n, p, state);
+}
+
+void runFeatures(int proteinType, const double* current, const int* idealized, int start, int n, PipelineFeatures* f) {
+    // The features do not depend on the polarity.
+    if (proteinType == 0) ProcessingPipeline<NanoporePolicy, 1>::features(current, idealized, start, n, f);
+    else ProcessingPipeline<IonChannelPolicy, 1>::features(current, idealized, start, n, f);
+}
+
+// ****** The generic loops (as in update_graph_1Hz before the specialization).
+// NOTE: For ion channels, the caller handles |current_per_channel| <= 0.1 (the number is kept unchanged here).
+
+int runIdealizationGeneric(int proteinType, int BKstimuli, const double* current, const double* filtered, int* destination, int n,
+    const PipelineParams& p, PipelineState* state) {
+    const double current_per_channel = p.current_per_channel;
+    int idx = 0;
+    for (; idx < n; idx++) {
+        double y_now = current[idx];
+        if (y_now > p.rupture_threshold || y_now < -p.rupture_threshold) break;
+        if (proteinType == 0) {
+            if (state->on_detection == 1) {
+                if (current_per_channel > 0.1 && idx >= 1) {
+                    if (filtered[idx - 1] > filtered[idx]) {
+                        state->lastOpenNumber++;
+                        if (p.max_open >= 0 && state->lastOpenNumber > p.max_open) state->lastOpenNumber = p.max_open;
+                        state->on_detection = 3;
+                    }
+                }
+                else if (current_per_channel < -0.1 && idx >= 1) {
+                    if (filtered[idx - 1] < filtered[idx]) {
+                        state->lastOpenNumber++;
+                        if (p.max_open >= 0 && state->lastOpenNumber > p.max_open) state->lastOpenNumber = p.max_open;
+                        state->on_detection = 3;
+                    }
+                }
+            }
+            else if (state->on_detection == 2) {
+                if (current_per_channel > 0.1 && idx >= 1) {
+                    if (filtered[idx - 1] < filtered[idx]) {
+                        state->lastOpenNumber--;
+                        if (state->lastOpenNumber < 0) state->lastOpenNumber = 0;
+                        state->on_detection = 3;
+                    }
+                }
+                else if (current_per_channel < -0.1 && idx >= 1) {
+                    if (filtered[idx - 1] > filtered[idx]) {
+                        state->lastOpenNumber--;
+                        if (state->lastOpenNumber < 0) state->lastOpenNumber = 0;
+                        state->on_detection = 3;
+                    }
+                }
+            }
+            else if (state->on_detection == 3) {
+                if (fabs(filtered[idx]) < 0.5) state->on_detection = 0;
+            }
+            else {
+                if (current_per_channel > 0.1) {
+                    if (filtered[idx] > current_per_channel * p.detection_threshold) state->on_detection = 1;
+                    else if (filtered[idx] < -current_per_channel * p.detection_threshold) state->on_detection = 2;
+                }
+                else if (current_per_channel < -0.1) {
+                    if (filtered[idx] < current_per_channel * p.detection_threshold) state->on_detection = 1;
+                    else if (filtered[idx] > -current_per_channel * p.detection_threshold) state->on_detection = 2;
+                }
+            }
+        }
+        else {
+            if (proteinType == 1 && BKstimuli == 1 && y_now > p.cage_threshold) break;
+            if (current_per_channel > 0.1) {
+                if (y_now > (state->lastOpenNumber + p.threshold) * current_per_channel + p.baseline) {
+                    state->lastOpenNumber++;
+                    if (p.max_open >= 0 && state->lastOpenNumber > p.max_open) state->lastOpenNumber = p.max_open;
+                }
+                else if (y_now < (state->lastOpenNumber - p.threshold) * current_per_channel + p.baseline) {
+                    state->lastOpenNumber--;
+                    if (state->lastOpenNumber < 0) state->lastOpenNumber = 0;
+                }
+            }
+            else if (current_per_channel < -0.1) {
+                if (y_now < (state->lastOpenNumber + p.threshold) * current_per_channel + p.baseline) {
+                    state->lastOpenNumber++;
+                    if (p.max_open >= 0 && state->lastOpenNumber > p.max_open) state->lastOpenNumber = p.max_open;
+                }
+                else if (y_now > (state->lastOpenNumber - p.threshold) * current_per_channel + p.baseline) {
+                    state->lastOpenNumber--;
+                    if (state->lastOpenNumber < 0) state->lastOpenNumber = 0;
+                }
+            }
+        }
+        destination[idx] = state->lastOpenNumber;
+    }
+    return idx;
+}
+
+void runFeaturesGeneric(int proteinType, const double* current, const int* idealized, int start, int n, PipelineFeatures* f) {
+    for (int idx = 0; idx < n; idx++) {
+        if (proteinType != 0 && idx < start) continue;
+        if (idealized[idx] > f->maxOpenNumber) f->maxOpenNumber = idealized[idx];
+    }
+    for (int idx = start; idx < n; idx++) {
+        if (idealized[idx] == 0) {
+            f->zero_sum += current[idx];
+            f->zero_num += 1;
+        }
+        else if (idealized[idx] == 1) {
+            f->one_sum += current[idx];
+            f->one_num += 1;
+        }
+    }
+}
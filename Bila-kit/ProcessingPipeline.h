@@ -0,0 +1,72 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingPipeline.h
+*
+* Idealization and feature stages of the Processing Block, specialized at compile time
+* for each protein policy and bias polarity. See ProcessingPipeline.cpp for details.
+******************************************************************************/
+
+// Protein policies. The pipeline is instantiated once for each policy and polarity.
+struct NanoporePolicy {         // proteinType == 0: counting the insertion of nanopores by the edge filter (convolve_EDGE)
+    static const bool edgeDetection = true;
+    static const bool cageCheck = false;
+    static const bool maxFromStatsStart = false;    // maxOpenNumber is taken over the whole block.
+};
+struct IonChannelPolicy {       // proteinType == 1 (voltage sensing) or 2: hysteresis threshold
+    static const bool edgeDetection = false;
+    static const bool cageCheck = false;
+    static const bool maxFromStatsStart = true;     // maxOpenNumber is taken after the voltage switch transient.
+};
+struct InhibitorPolicy {        // proteinType == 1 && BKstimuli == 1: hysteresis threshold with the Faraday cage check
+    static const bool edgeDetection = false;
+    static const bool cageCheck = true;
+    static const bool maxFromStatsStart = true;
+};
+
+struct PipelineParams {
+    double baseline;                // [pA]
+    double current_per_channel;     // [pA]
+    double threshold;               // Hysteresis width in units of current_per_channel (ion channels)
+    double detection_threshold;     // Edge detection threshold in units of current_per_channel (nanopores)
+    int max_open;                   // Upper limit of the number of open channels (< 0: unlimited)
+    double rupture_threshold;       // |current| above this aborts the idealization [pA]
+    double cage_threshold;          // current above this aborts the idealization when the Faraday cage check is enabled [pA]
+};
+
+// Carried over between the blocks.
+struct PipelineState {
+    int lastOpenNumber;
+    int on_detection;   // State of the edge detection (nanopores). 0: idle, 1: rising edge, 2: falling edge, 3: waiting for the plateau
+};
+
+struct PipelineFeatures {
+    int maxOpenNumber;
+    double zero_sum;    // Sum of the current where no channel is open (for the baseline correction)
+    int zero_num;
+    double one_sum;     // Sum of the current where a single channel is open (for the conductance correction)
+    int one_num;
+};
+
+template <class Protein, int Polarity>
+struct ProcessingPipeline {
+    // Idealize current[0 .. n-1] (filtered[]: the output of convolve_EDGE, used by the nanopore policy).
+    // Returns n, or the index of the first sample that aborted the idealization (rupture / Faraday cage).
+    static int idealize(const double* current, const double* filtered, int* destination, int n, const PipelineParams& p, PipelineState* state);
+    // Accumulate the features of idealized[start .. n-1] into f (maxOpenNumber is also taken from 0 for the nanopore policy).
+    static void features(const double* current, const int* idealized, int start, int n, PipelineFeatures* f);
+};
+
+// Select the policy from proteinType / BKstimuli and the polarity from current_per_channel, then run the stage.
+// When |current_per_channel| <= 0.1, the generic path is used.
+int runIdealization(int proteinType, int BKstimuli, const double* current, const double* filtered, int* destination, int n,
+    const PipelineParams& p, PipelineState* state);
+void runFeatures(int proteinType, const double* current, const int* idealized, int start, int n, PipelineFeatures* f);
+
+// The generic loops with the runtime branches in every sample (the reference for the specialized pipelines).
+int runIdealizationGeneric(int proteinType, int BKstimuli, const double* current, const double* filtered, int* destination, int n,
+    const PipelineParams& p, PipelineState* state);
+void runFeaturesGeneric(int proteinType, const double* current, const int* idealized, int start, int n, PipelineFeatures* f);
+
+// Initial value of PipelineFeatures (maxOpenNumber = -1, sums = 0).
+PipelineFeatures emptyFeatures();
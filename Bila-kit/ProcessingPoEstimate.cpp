@@ -0,0 +1,128 @@
+/******************************************************************************
+// ProcessingPoEstimate.cpp
+//
+// This code estimates the number of channels (N) and the open probability (Po) jointly
+// from the idealized trace by maximum likelihood under the binomial model:
+//     P(k channels open) = C(N, k) * Po^k * (1 - Po)^(N - k)
+// For a given N, the likelihood is maximized at Po = (mean of k) / N, so only N has to be searched.
+// The occupancy histogram is built from the run-length encoding of the idealized trace.
+//
+// The consecutive samples are far from independent (a dwell lasts many samples), so the standard errors
+// are computed with the number of dwells as the effective number of observations, instead of the number of samples.
+// For the same reason, a larger N is accepted only when it is significantly more likely (likelihood-ratio test),
+// because N is hardly identifiable from a short trace with a low Po.
+******************************************************************************/
+
+#include "ProcessingPoEstimate.h"
+#include <math.h>
+
+// Trigamma function (the second derivative of lgamma) for x > 0.
+static double trigamma(double x) {
+    double result = 0;
+    while (x < 6) {
+        result += 1 / (x * x);
+        x += 1;
+    }
+    double x2 = 1 / (x * x);
+    result += 1 / x + x2 / 2 + (1 / x) * x2 * (1.0 / 6 - x2 * (1.0 / 30 - x2 * (1.0 / 42 - x2 / 30)));
+    return result;
+}
+
+// Log-likelihood of the histogram for N channels and the open probability p.
+static double binomialLogLikelihood(const int* hist, int kmax, int n, double mean_k, int N, double p) {
+    double ll = 0;
+    double lgN = lgamma(N + 1.0);
+    for (int k = 0; k <= kmax; k++) {
+        if (hist[k] == 0) continue;
+        ll += hist[k] * (lgN - lgamma(k + 1.0) - lgamma(N - k + 1.0));
+    }
+    if (p > 0) ll += n * mean_k * log(p);
+    if (p < 1) ll += n * (N - mean_k) * log(1 - p);
+    return ll;
+}
+
+PoEstimate estimateOpenProbability(const int* idealized, int start, int end, int fixedN) {
+    PoEstimate result = {};
+    result.valid = false;
+    result.N = 0;
+    result.opProb = -99;
+    result.maxOpenNumber = -1;
+
+    // Run-length encoding of the idealized trace -> occupancy histogram.
+    int hist[PO_ESTIMATE_MAX_LEVEL + 1] = {};
+    int n = 0;
+    int runs = 0;
+    int kmax = -1;
+    long long sum_k = 0;
+    int idx = start;
+    while (idx < end) {
+        int level = idealized[idx];
+        int run_end = idx + 1;
+        while (run_end < end && idealized[run_end] == level) run_end++;
+        if (level >= 0) {
+            if (level > PO_ESTIMATE_MAX_LEVEL) level = PO_ESTIMATE_MAX_LEVEL;
+            int length = run_end - idx;
+            hist[level] += length;
+            n += length;
+            sum_k += (long long)level * length;
+            runs++;
+            if (level > kmax) kmax = level;
+        }
+        idx = run_end;
+    }
+    result.samples = n;
+    result.runs = runs;
+    result.maxOpenNumber = kmax;
+    if (n == 0 || kmax <= 0) return result;     // Po cannot be calculated when no channel opened.
+
+    // Profile likelihood over N.
+    double mean_k = sum_k / (double)n;
+    int N_lower = kmax;
+    int N_upper = 2 * kmax + 1;
+    if (fixedN > 0) {
+        // More channels than the estimator handles (e.g. a mistyped "max_open"): the largest number it handles.
+        if (fixedN > PO_ESTIMATE_MAX_LEVEL) fixedN = PO_ESTIMATE_MAX_LEVEL;
+        N_lower = N_upper = (fixedN > kmax) ? fixedN : kmax;
+    }
+    if (N_upper > PO_ESTIMATE_MAX_LEVEL) N_upper = PO_ESTIMATE_MAX_LEVEL;
+    double scale = runs / (double)n;    // Effective number of observations per sample
+    double lls[PO_ESTIMATE_MAX_LEVEL + 1] = {};
+    double max_ll = -HUGE_VAL;
+    for (int N = N_lower; N <= N_upper; N++) {
+        lls[N] = binomialLogLikelihood(hist, kmax, n, mean_k, N, mean_k / N);
+        if (lls[N] > max_ll) max_ll = lls[N];
+    }
+    // The smallest N within the 95% likelihood-ratio bound (chi-square 3.84 / 2) of the maximum.
+    int best_N = N_lower;
+    while (best_N < N_upper && (max_ll - lls[best_N]) * scale > 1.92) best_N++;
+    double best_ll = lls[best_N];
+    double p = mean_k / best_N;
+    if (p < 0.001) p = 0.001;
+    if (p > 0.999) p = 0.999;
+
+    // Observed Fisher information, scaled from the number of samples to the number of dwells.
+    double i_pp = n * (mean_k / (p * p) + (best_N - mean_k) / ((1 - p) * (1 - p))) * scale;
+    double i_pN = n / (1 - p) * scale;
+    double i_NN = 0;
+    double tg = trigamma(best_N + 1.0);
+    for (int k = 1; k <= kmax; k++) {
+        if (hist[k] > 0) i_NN -= hist[k] * (tg - trigamma(best_N - k + 1.0));
+    }
+    i_NN *= scale;
+
+    result.valid = true;
+    result.N = best_N;
+    result.opProb = p;
+    result.logLikelihood = best_ll;
+    double det = i_pp * i_NN - i_pN * i_pN;
+    if (fixedN > 0 || i_NN <= 0 || det <= 0) {
+        // N is fixed (or not identifiable from the histogram): the error of Po only.
+        result.opProb_se = sqrt(1 / i_pp);
+        result.N_se = 0;
+    }
+    else {
+        result.opProb_se = sqrt(i_NN / det);
+        result.N_se = sqrt(i_pp / det);
+    }
+    return result;
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingPoEstimate.h
+*
+* Maximum-likelihood estimation of the number of channels and the open probability.
+* See ProcessingPoEstimate.cpp for details.
+******************************************************************************/
+
+#define PO_ESTIMATE_MAX_LEVEL 128   // Upper limit of the number of channels handled by the estimator.
+
+struct PoEstimate {
+    bool valid;             // false if no channel opened (or no valid sample) in the range.
+    int N;                  // Estimated number of channels
+    double opProb;          // Estimated open probability per channel
+    double opProb_se;       // Standard error of opProb
+    double N_se;            // Standard error of N (N treated as continuous)
+    double logLikelihood;   // Log-likelihood at the estimate (per-sample model)
+    int samples;            // Number of valid samples used
+    int runs;               // Number of dwells (run-lengths) in the idealized trace
+    int maxOpenNumber;      // The largest observed number of open channels
+};
+
+// Estimate N and Po jointly from the idealized trace idealized[start .. end-1] under the binomial model.
+// Samples < 0 (not idealized) are skipped.
+// fixedN > 0 fixes the number of channels (e.g. "Fix the number of channels" checkbox; limited to PO_ESTIMATE_MAX_LEVEL);
+// otherwise N is searched from the observed maximum up to 2 * maximum + 1.
+PoEstimate estimateOpenProbability(const int* idealized, int start, int end, int fixedN = -1);
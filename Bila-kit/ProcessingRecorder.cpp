@@ -0,0 +1,199 @@
+/******************************************************************************
+// ProcessingRecorder.cpp
+//
+// This code records the raw current of the amplifier by tiers, instead of every sample of every second:
+//
+//   * Every event opens a window [event - pre_samples, event + post_samples), which is written at the full rate
+//     (the same rows as the raw data file). The overlapping windows are merged.
+//   * Elsewhere, only one row of min/max/mean is written per summary_samples samples (e.g. 50 ms), which keeps the
+//     baseline and the noise envelope of the idle hours.
+//   * The samples are held in a ring buffer until they are older than pre_samples, since a later event may still
+//     need them at the full rate (pre-trigger). The events found in the filtered current come up to lag_samples late,
+//     so the samples are held that much longer. So the rows lag the acquisition by pre_samples + lag_samples, and
+//     finish (emit with finish = true) writes the rest at the end.
+//
+// The summaries are aligned to the multiples of summary_samples from the start, and cut at the windows.
+// The ring buffer and the window list are allocated once at setup(), so the steady state does not allocate.
+******************************************************************************/
+
+#include "ProcessingRecorder.h"
+#include "PipelineStages.h"
+
+TieredRecorder::TieredRecorder() {
+    params.pre_samples = 0;
+    params.post_samples = 0;
+    params.summary_samples = 1;
+    params.lag_samples = 0;
+    capacity = 0;
+    max_windows = 0;
+    reset();
+}
+
+void TieredRecorder::setup(const RecorderParams& params_arg, int block_size) {
+    params = params_arg;
+    if (params.pre_samples < 0) params.pre_samples = 0;
+    if (params.lag_samples < 0) params.lag_samples = 0;
+    if (params.post_samples < 1) params.post_samples = 1;
+    if (params.summary_samples < 1) params.summary_samples = 1;
+    capacity = params.pre_samples + params.lag_samples + block_size;
+    ring_time.assign(capacity, 0.0);
+    ring_current.assign(capacity, 0.0);
+    // A window spans at least pre + post samples, so this many disjoint windows cover the samples held.
+    max_windows = (size_t)(capacity / (params.pre_samples + params.post_samples) + 2);
+    windows.clear();
+    windows.reserve(max_windows);
+    reset();
+}
+
+void TieredRecorder::reset() {
+    total = 0;
+    block_start = 0;
+    block_length = 0;
+    written = 0;
+    full_written = 0;
+    summary_written = 0;
+    last_level = -2;
+    last_time = 0;
+    windows.clear();
+    summary_n = 0;
+    summary_time = summary_min = summary_max = summary_sum = 0;
+}
+
+void TieredRecorder::push(const double* time, const double* current, int n) {
+    if (capacity == 0) return;
+    // (emit() leaves at most pre_samples + lag_samples held, so a block fits.)
+    if (n > capacity - (int)(total - written)) n = capacity - (int)(total - written);
+    block_start = total;
+    block_length = n;
+    for (int idx = 0; idx < n; idx++) {
+        int slot = (int)((total + idx) % capacity);
+        ring_time[slot] = time[idx];
+        ring_current[slot] = current[idx];
+    }
+    total += n;
+}
+
+void TieredRecorder::trigger(int index, int kind) {
+    if (capacity == 0 || index >= block_length || block_start + index < 0) return;
+    long long t = block_start + index;
+    long long start = t - params.pre_samples;
+    if (start < written) start = written;
+    long long end = t + params.post_samples;
+    if (end <= start) return;   // The whole window is written already.
+    // The events of a block may come in any order (e.g. a voltage switch after the transitions): the first window
+    // which does not end before the new one is merged with it on both ends, or the new one is inserted before it.
+    size_t k = 0;
+    while (k < windows.size() && windows[k].end < start) k++;
+    if (k < windows.size() && windows[k].start <= end) {
+        Window& w = windows[k];
+        if (start < w.start) w.start = start;   // (Not written yet: start >= written.)
+        if (end > w.end) w.end = end;
+        w.events++;
+        w.kinds |= kind;
+        // The following windows reached by the extended one.
+        while (k + 1 < windows.size() && windows[k + 1].start <= w.end) {
+            if (windows[k + 1].end > w.end) w.end = windows[k + 1].end;
+            w.events += windows[k + 1].events;
+            w.kinds |= windows[k + 1].kinds;
+            windows.erase(windows.begin() + k + 1);
+        }
+        return;
+    }
+    if (windows.size() == max_windows) {
+        // (Not expected, see setup().) Extend the neighbouring window rather than allocating.
+        Window& w = windows[(k < windows.size()) ? k : windows.size() - 1];
+        if (start < w.start) w.start = start;
+        if (end > w.end) w.end = end;
+        w.events++;
+        w.kinds |= kind;
+        return;
+    }
+    Window w;
+    w.start = start;
+    w.end = end;
+    w.events = 1;
+    w.kinds = kind;
+    w.start_time = 0;
+    windows.insert(windows.begin() + k, w);
+}
+
+void TieredRecorder::triggerLevels(const int* idealized, int n, int lag) {
+    if (n > block_length) n = block_length;
+    int previous = last_level;
+    for (int idx = 0; idx < n; idx++) {
+        int level = idealized[idx];
+        if (level != previous && previous != -2) {
+            trigger(idx - lag, (level < 0 || previous < 0) ? TRIGGER_RUPTURE : TRIGGER_TRANSITION);
+        }
+        previous = level;
+    }
+    last_level = previous;
+}
+
+void TieredRecorder::flushSummary(std::string* summary_rows) {
+    if (summary_n == 0) return;
+    appendf(summary_rows, "%lf,%d,%lf,%lf,%lf\n", summary_time, summary_n, summary_min, summary_max, summary_sum / summary_n);
+    summary_written++;
+    summary_n = 0;
+}
+
+void TieredRecorder::closeWindow(std::string* window_rows, double end_time) {
+    const Window& w = windows.front();
+    appendf(window_rows, "%lf,%lf,%d,", w.start_time, end_time, w.events);
+    bool first = true;
+    static const char* const NAMES[4] = { "transition", "rupture", "voltage", "conductance" };
+    for (int k = 0; k < 4; k++) {
+        if (!(w.kinds & (1 << k))) continue;
+        if (!first) window_rows->push_back('|');
+        window_rows->append(NAMES[k]);
+        first = false;
+    }
+    window_rows->push_back('\n');
+    windows.erase(windows.begin());
+}
+
+void TieredRecorder::emit(std::string* full_rows, std::string* summary_rows, std::string* window_rows, bool finish) {
+    if (capacity == 0) return;
+    long long limit = finish ? total : total - params.pre_samples - params.lag_samples;
+    while (written < limit) {
+        if (!windows.empty() && windows.front().start <= written) {
+            // In a window: the full rate.
+            Window& w = windows.front();
+            flushSummary(summary_rows);
+            if (written == w.start) w.start_time = ring_time[written % capacity];
+            long long end = (w.end < limit) ? w.end : limit;
+            full_written += end - written;
+            for (; written < end; written++) {
+                int slot = (int)(written % capacity);
+                appendf(full_rows, "%lf,%lf\n", ring_time[slot], ring_current[slot]);
+            }
+            last_time = ring_time[(written - 1) % capacity];
+            if (written >= w.end) closeWindow(window_rows, last_time);
+            continue;
+        }
+        // Outside the windows: the summaries, up to the next window.
+        long long end = limit;
+        if (!windows.empty() && windows.front().start < end) end = windows.front().start;
+        for (; written < end; written++) {
+            int slot = (int)(written % capacity);
+            double v = ring_current[slot];
+            if (summary_n == 0) {
+                summary_time = ring_time[slot];
+                summary_min = summary_max = v;
+                summary_sum = 0;
+            }
+            if (v < summary_min) summary_min = v;
+            if (v > summary_max) summary_max = v;
+            summary_sum += v;
+            summary_n++;
+            if ((written + 1) % params.summary_samples == 0) flushSummary(summary_rows);
+        }
+        last_time = ring_time[(written - 1) % capacity];
+    }
+    if (finish) {
+        flushSummary(summary_rows);
+        // The windows cut by the end of the data.
+        while (!windows.empty() && windows.front().start < total) closeWindow(window_rows, last_time);
+        windows.clear();
+    }
+}
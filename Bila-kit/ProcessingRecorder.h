@@ -0,0 +1,89 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingRecorder.h
+*
+* Event-triggered tiered recording of the raw current: the full rate around the events (transitions, ruptures,
+* holding voltage switches, conductance steps) through a pre-trigger ring buffer, and decimated min/max/mean elsewhere.
+* See ProcessingRecorder.cpp for details.
+******************************************************************************/
+
+#include <string>
+#include <vector>
+
+// The kinds of the events (combined in the window rows).
+enum RecorderTrigger {
+    TRIGGER_TRANSITION = 1,     // The idealized level changed
+    TRIGGER_RUPTURE = 2,        // The idealization was aborted (rupture), or resumed after it
+    TRIGGER_VOLTAGE = 4,        // The holding voltage was switched
+    TRIGGER_CONDUCTANCE = 8     // A nanopore conductance was measured
+};
+
+struct RecorderParams {
+    int pre_samples;            // Full-rate samples kept before each event (the pre-trigger ring buffer)
+    int post_samples;           // Full-rate samples after each event
+    int summary_samples;        // Samples per min/max/mean row outside the windows
+    int lag_samples;            // The largest delay of the events from the samples (e.g. of a low-pass filter), held in addition
+};
+
+class TieredRecorder
+{
+public:
+    TieredRecorder();
+
+    // Allocate the ring buffer for blocks of up to block_size samples, and reset.
+    void setup(const RecorderParams& params, int block_size);
+    void reset();
+    bool ready() const { return capacity > 0; }
+
+    // Every block: push() the samples, then trigger() the events of the block, then emit() the rows.
+    void push(const double* time, const double* current, int n);
+    // An event at the sample "index" of the last pushed block (negative: in the previous blocks, while not written yet).
+    void trigger(int index, int kind);
+    // The transitions of the idealized data of the last pushed block (-1: not idealized, i.e. a rupture). The level
+    // before the block is carried over from the previous call.
+    // lag: the delay of the idealized data from the pushed samples (e.g. of the low-pass filter) [samples]; the events
+    // are triggered that much earlier. Up to lag_samples, their windows are complete.
+    void triggerLevels(const int* idealized, int n, int lag = 0);
+
+    // Append the rows of the samples that can no longer enter a pre-trigger window (all samples if "finish"):
+    //   full_rows:     "time [s],current [pA]" of every sample in a window (the format of the raw data file)
+    //   summary_rows:  "time [s],samples [-],min [pA],max [pA],mean [pA]" of every summary_samples samples elsewhere
+    //   window_rows:   "start_time [s],end_time [s],events [-],kinds" of every window written completely
+    // The strings are appended to, and do not allocate once they have grown to the size of a block of rows.
+    void emit(std::string* full_rows, std::string* summary_rows, std::string* window_rows, bool finish = false);
+
+    long long samples() const { return total; }                 // Pushed so far
+    long long fullSamples() const { return full_written; }      // Written at the full rate so far
+    long long summaryRows() const { return summary_written; }
+
+private:
+    struct Window {
+        long long start, end;   // [start, end) in the global sample index
+        int events;
+        int kinds;
+        double start_time;      // Set when the first sample is written
+    };
+    void flushSummary(std::string* summary_rows);
+    void closeWindow(std::string* window_rows, double end_time);
+
+    RecorderParams params;
+    int capacity;                   // Of the ring buffer: pre_samples + lag_samples + block_size
+    std::vector<double> ring_time;
+    std::vector<double> ring_current;
+    long long total;                // Samples pushed
+    long long block_start;          // Global index of the first sample of the last pushed block
+    int block_length;
+    long long written;              // Samples written (full rate or summarized)
+    long long full_written;
+    long long summary_written;
+    int last_level;                 // The last idealized level of the previous block (-2: none yet)
+    double last_time;               // The time of the last written sample
+
+    std::vector<Window> windows;    // Sorted and disjoint, not written completely yet (capacity reserved at setup)
+    size_t max_windows;
+
+    // The summary row being accumulated
+    int summary_n;
+    double summary_time, summary_min, summary_max, summary_sum;
+};
@@ -0,0 +1,202 @@
+/******************************************************************************
+// ProcessingSpectrum.cpp
+//
+// This code monitors the noise of the current by the power spectral density (Welch's method), so that the quality of
+// a fresh bilayer can be judged within seconds, instead of waiting for the idealization to fail.
+//
+//   * The streaming current is cut into segments of "segment" samples overlapping by "overlap" (50% by default).
+//     The samples left at the end of a block are carried over, so the segments continue across the blocks.
+//   * Each segment is detrended (mean removed), Hann-windowed and transformed by the FFT, whose twiddle factors and
+//     bit-reversal permutation are prepared once (FFTPlan).
+//   * The periodograms of a block are averaged, then exponentially averaged with the previous blocks.
+//     One-sided PSD = 2 |X|^2 / (sample_freq * sum(window^2))  [pA^2/Hz]
+//   * The summary is the RMS current in the bands 1-10, 10-100, 100-1000 Hz and 1 kHz - Nyquist (the integral of the PSD),
+//     and the noise floor (median PSD over 100-1000 Hz, insensitive to the mains peaks).
+// The FFTs run in a worker thread (SpectrumMonitor), like the fit of the dwell-time histograms.
+******************************************************************************/
+
+#include "ProcessingSpectrum.h"
+#include <math.h>
+#include <algorithm>
+
+static const double PI = 3.14159265358979323846;
+static const double BAND_EDGES[SPECTRUM_BANDS + 1] = { 1, 10, 100, 1000, 1e9 };    // [Hz] (the last band ends at Nyquist)
+
+void FFTPlan::setup(int n_arg) {
+    n = n_arg;
+    cos_table.resize(n / 2);
+    sin_table.resize(n / 2);
+    for (int k = 0; k < n / 2; k++) {
+        cos_table[k] = cos(2 * PI * k / n);
+        sin_table[k] = -sin(2 * PI * k / n);
+    }
+    int bits = 0;
+    while ((1 << bits) < n) bits++;
+    bit_reverse.resize(n);
+    for (int k = 0; k < n; k++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) {
+            if (k & (1 << b)) r |= 1 << (bits - 1 - b);
+        }
+        bit_reverse[k] = r;
+    }
+}
+
+void FFTPlan::forward(double* re, double* im) const {
+    for (int k = 0; k < n; k++) {
+        int r = bit_reverse[k];
+        if (r > k) {
+            std::swap(re[k], re[r]);
+            std::swap(im[k], im[r]);
+        }
+    }
+    for (int len = 2; len <= n; len <<= 1) {
+        int half = len >> 1;
+        int stride = n / len;
+        for (int start = 0; start < n; start += len) {
+            for (int j = 0; j < half; j++) {
+                double wr = cos_table[j * stride];
+                double wi = sin_table[j * stride];
+                int a = start + j;
+                int b = a + half;
+                double tr = re[b] * wr - im[b] * wi;
+                double ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+WelchPSD::WelchPSD()
+{
+    setup(5000, 4096, 0.5, 0.7);
+}
+
+void WelchPSD::setup(double sample_freq_arg, int segment_arg, double overlap, double forgetting_arg) {
+    sample_freq = sample_freq_arg;
+    segment = segment_arg;
+    step = (int)(segment * (1 - overlap) + 0.5);
+    if (step < 1) step = 1;
+    if (step > segment) step = segment;
+    forgetting = forgetting_arg;
+    plan.setup(segment);
+    window.resize(segment);
+    window_power = 0;
+    for (int k = 0; k < segment; k++) {
+        window[k] = 0.5 - 0.5 * cos(2 * PI * k / segment);
+        window_power += window[k] * window[k];
+    }
+    re.resize(segment);
+    im.resize(segment);
+    reset();
+}
+
+void WelchPSD::reset() {
+    pending.clear();
+    average.assign(segment / 2 + 1, ExpAverage(1 - forgetting));
+    block_sum.assign(segment / 2 + 1, 0.0);
+    total_segments = 0;
+}
+
+int WelchPSD::push(const double* current, int n) {
+    // Fewer than "segment" samples are carried over, so this allocates only when n grows.
+    pending.reserve(segment + n);
+    pending.insert(pending.end(), current, current + n);
+    std::fill(block_sum.begin(), block_sum.end(), 0.0);
+    const int bins = segment / 2 + 1;
+    const double scale = 2.0 / (sample_freq * window_power);
+    int count = 0;
+    size_t start = 0;
+    for (; start + segment <= pending.size(); start += step) {
+        const double* x = pending.data() + start;
+        double mean = 0;
+        for (int k = 0; k < segment; k++) mean += x[k];
+        mean /= segment;
+        for (int k = 0; k < segment; k++) {
+            re[k] = (x[k] - mean) * window[k];
+            im[k] = 0;
+        }
+        plan.forward(re.data(), im.data());
+        for (int k = 0; k < bins; k++) block_sum[k] += re[k] * re[k] + im[k] * im[k];
+        count++;
+    }
+    pending.erase(pending.begin(), pending.begin() + start);
+    if (count == 0) return 0;
+
+    // One-sided: DC and Nyquist are not doubled.
+    // The first call after the reset starts the average.
+    for (int k = 0; k < bins; k++) {
+        double p = block_sum[k] / count * scale;
+        if (k == 0 || k == bins - 1) p *= 0.5;
+        average[k].add(p);
+    }
+    total_segments += count;
+    return count;
+}
+
+void WelchPSD::result(SpectrumResult* result) {
+    SpectrumResult& r = *result;
+    const int bins = segment / 2 + 1;
+    const double df = sample_freq / segment;
+    r.frequency.resize(bins - 1);
+    r.psd.resize(bins - 1);
+    for (int k = 1; k < bins; k++) {
+        r.frequency[k - 1] = k * df;
+        r.psd[k - 1] = average[k].mean();
+    }
+    for (int b = 0; b < SPECTRUM_BANDS; b++) {
+        double power = 0;
+        for (int k = 1; k < bins; k++) {
+            double f = k * df;
+            if (BAND_EDGES[b] <= f && f < BAND_EDGES[b + 1]) power += average[k].mean() * df;
+        }
+        r.band_rms[b] = sqrt(power);
+    }
+    floor_bins.clear();
+    for (int k = 1; k < bins; k++) {
+        double f = k * df;
+        if (100 <= f && f < 1000) floor_bins.push_back(average[k].mean());
+    }
+    r.noise_floor = 0;
+    if (!floor_bins.empty()) {
+        std::nth_element(floor_bins.begin(), floor_bins.begin() + floor_bins.size() / 2, floor_bins.end());
+        r.noise_floor = floor_bins[floor_bins.size() / 2];
+    }
+    r.segments = total_segments;
+}
+
+void SpectrumMonitor::setup(double sample_freq, int segment, double overlap, double forgetting) {
+    worker.wait();
+    requested = false;
+    welch.setup(sample_freq, segment, overlap, forgetting);
+}
+
+void SpectrumMonitor::reset() {
+    worker.wait();
+    requested = false;
+    welch.reset();
+}
+
+void SpectrumMonitor::request(const double* current, int n) {
+    // An unpolled result is replaced by the new one, which includes its segments in the average.
+    worker.wait();
+    block.assign(current, current + n);     // The capacity is reused after the first block.
+    requested = true;
+    worker.post(&SpectrumMonitor::process, this);
+}
+
+void SpectrumMonitor::process(void* self) {
+    SpectrumMonitor* m = (SpectrumMonitor*)self;
+    m->welch.push(m->block.data(), (int)m->block.size());
+    m->welch.result(&m->latest);
+}
+
+bool SpectrumMonitor::poll(SpectrumResult* result) {
+    if (!requested || worker.busy()) return false;
+    requested = false;
+    *result = latest;       // Copy-assigned into the vectors of "result", which keep their capacity.
+    return true;
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingSpectrum.h
+*
+* Welch power spectral density of the streaming current, computed in a worker thread.
+* See ProcessingSpectrum.cpp for details.
+******************************************************************************/
+
+#include <vector>
+#include "PipelineStages.h"
+#include "ProcessingStats.h"
+
+#define SPECTRUM_BANDS 4    // Bands of the noise summary: 1-10, 10-100, 100-1000 Hz and 1 kHz - Nyquist.
+
+// Radix-2 complex FFT with the twiddle factors and the bit-reversal permutation prepared once.
+class FFTPlan
+{
+public:
+    FFTPlan() : n(0) {}
+    void setup(int n);      // n must be a power of 2.
+    int size() const { return n; }
+    // In-place forward transform of (re[k], im[k]), k = 0 .. n-1.
+    void forward(double* re, double* im) const;
+
+private:
+    int n;
+    std::vector<double> cos_table;
+    std::vector<double> sin_table;
+    std::vector<int> bit_reverse;
+};
+
+struct SpectrumResult {
+    std::vector<double> frequency;  // [Hz], bins 1 .. segment / 2 (DC excluded for the log-log plot)
+    std::vector<double> psd;        // One-sided power spectral density [pA^2/Hz]
+    double band_rms[SPECTRUM_BANDS];    // RMS of the current in each band [pA]
+    double noise_floor;             // Median PSD over 100-1000 Hz [pA^2/Hz]
+    int segments;                   // Number of segments averaged since the reset
+};
+
+class WelchPSD
+{
+public:
+    WelchPSD();
+
+    // segment: the FFT length (power of 2). overlap: the fraction of the overlap of the segments (e.g. 0.5).
+    // forgetting: the weight of the previous blocks in the average (0: only the last block).
+    void setup(double sample_freq, int segment, double overlap, double forgetting);
+    void reset();
+
+    // Add n samples. The samples which do not fill a segment are carried over to the next call.
+    // Returns the number of segments processed.
+    int push(const double* current, int n);
+    // Fill "result" in place (its vectors are reused once sized).
+    void result(SpectrumResult* result);
+
+private:
+    double sample_freq;
+    int segment;
+    int step;               // Samples between the starts of the segments
+    double forgetting;
+    FFTPlan plan;
+    std::vector<double> window;     // Hann window
+    double window_power;            // sum of window^2
+    std::vector<double> pending;    // Samples not yet used by a segment
+    std::vector<ExpAverage> average;    // Averaged PSD per bin (segment / 2 + 1 bins)
+    std::vector<double> block_sum;  // Sum of the periodograms in the current call
+    std::vector<double> re, im;     // Work arrays
+    std::vector<double> floor_bins; // Work array of the noise floor
+    int total_segments;
+};
+
+// Runs WelchPSD in a worker thread once per block, so that the GUI thread does not wait for the FFTs.
+class SpectrumMonitor
+{
+public:
+    void setup(double sample_freq, int segment, double overlap, double forgetting);
+    void reset();
+    SpectrumMonitor() : requested(false) {}
+
+    // Start the processing of a copy of current[0 .. n-1]. If the previous block is still being processed,
+    // it is waited for first, so that no sample is skipped.
+    void request(const double* current, int n);
+    // Returns true once when a requested block has been processed, with the updated spectrum.
+    bool poll(SpectrumResult* result);
+
+private:
+    static void process(void* self);
+
+    WelchPSD welch;             // Used only by the worker while a request is pending.
+    std::vector<double> block;  // Copy of the requested block
+    SpectrumResult latest;      // Written by the worker
+    bool requested;             // A request not yet polled
+    WorkerThread worker;        // Declared last, so that it is stopped before the members above are destroyed.
+};
@@ -0,0 +1,187 @@
+/******************************************************************************
+// ProcessingStats.cpp
+//
+// This code provides streaming statistics for the rolling outputs (e.g. the average of the estimated stimuli).
+// Each update is O(1) and the memory is fixed, so the cost does not grow over long sessions,
+// unlike keeping all values in a QVector and summing them up every second.
+******************************************************************************/
+
+#include "ProcessingStats.h"
+#include <math.h>
+#include <algorithm>
+
+
+// ****** RunningStats
+void RunningStats::clear() {
+    n = 0;
+    m = 0;
+    m2 = 0;
+}
+
+void RunningStats::add(double x) {
+    n++;
+    double delta = x - m;
+    m += delta / n;
+    m2 += delta * (x - m);
+}
+
+double RunningStats::variance() const {
+    return (n > 1) ? m2 / (n - 1) : 0.0;
+}
+
+double RunningStats::stddev() const {
+    return sqrt(variance());
+}
+
+double RunningStats::sem() const {
+    return (n > 1) ? sqrt(variance() / n) : 0.0;
+}
+
+
+// ****** ExpAverage
+void ExpAverage::add(double x) {
+    if (!initialized) {
+        m = x;
+        var = 0;
+        initialized = true;
+        return;
+    }
+    double delta = x - m;
+    m += alpha * delta;
+    var = (1 - alpha) * (var + alpha * delta * delta);
+}
+
+
+// ****** SlidingMean
+SlidingMean::SlidingMean(int window)
+    : buffer(window > 0 ? window : 1)
+{
+    clear();
+}
+
+void SlidingMean::clear() {
+    head = 0;
+    count = 0;
+    since_resum = 0;
+    shift = 0;
+    sum = 0;
+    sum_sq = 0;
+}
+
+void SlidingMean::add(double x) {
+    int window = (int)buffer.size();
+    if (count == 0) shift = x;
+    if (count == window) {
+        double old = buffer[head] - shift;
+        sum -= old;
+        sum_sq -= old * old;
+    }
+    else {
+        count++;
+    }
+    buffer[head] = x;
+    sum += x - shift;
+    sum_sq += (x - shift) * (x - shift);
+    head = (head + 1) % window;
+
+    if (++since_resum >= window) {
+        // The sums are taken about the current mean, so a large offset of the values does not cost digits.
+        since_resum = 0;
+        shift = mean();
+        sum = 0;
+        sum_sq = 0;
+        for (int i = 0; i < count; i++) {
+            sum += buffer[i] - shift;
+            sum_sq += (buffer[i] - shift) * (buffer[i] - shift);
+        }
+    }
+}
+
+double SlidingMean::mean() const {
+    return (count > 0) ? shift + sum / count : 0.0;
+}
+
+double SlidingMean::variance() const {
+    if (count < 2) return 0.0;
+    double v = (sum_sq - sum * sum / count) / (count - 1);
+    return (v > 0) ? v : 0.0;
+}
+
+
+// ****** P2Quantile
+void P2Quantile::clear() {
+    n = 0;
+    for (int i = 0; i < 5; i++) {
+        q[i] = 0;
+        pos[i] = i + 1;
+    }
+    desired[0] = 1;
+    desired[1] = 1 + 2 * p;
+    desired[2] = 1 + 4 * p;
+    desired[3] = 3 + 2 * p;
+    desired[4] = 5;
+    incr[0] = 0;
+    incr[1] = p / 2;
+    incr[2] = p;
+    incr[3] = (1 + p) / 2;
+    incr[4] = 1;
+}
+
+void P2Quantile::add(double x) {
+    // The first five values are simply stored (sorted) as the initial markers.
+    if (n < 5) {
+        q[n++] = x;
+        std::sort(q, q + n);
+        return;
+    }
+    n++;
+
+    // Find the cell k where x falls, and update the extreme markers.
+    int k;
+    if (x < q[0]) {
+        q[0] = x;
+        k = 0;
+    }
+    else if (x >= q[4]) {
+        q[4] = x;
+        k = 3;
+    }
+    else {
+        k = 0;
+        while (k < 3 && x >= q[k + 1]) k++;
+    }
+    for (int i = k + 1; i < 5; i++) pos[i] += 1;
+    for (int i = 0; i < 5; i++) desired[i] += incr[i];
+
+    // Adjust the heights of the middle markers if necessary.
+    for (int i = 1; i < 4; i++) {
+        double d = desired[i] - pos[i];
+        if ((d >= 1 && pos[i + 1] - pos[i] > 1) || (d <= -1 && pos[i - 1] - pos[i] < -1)) {
+            int ds = (d > 0) ? 1 : -1;
+            double qp = parabolic(i, ds);
+            if (q[i - 1] < qp && qp < q[i + 1]) q[i] = qp;
+            else q[i] = linear(i, ds);
+            pos[i] += ds;
+        }
+    }
+}
+
+double P2Quantile::parabolic(int i, int d) const {
+    return q[i] + d / (pos[i + 1] - pos[i - 1]) *
+        ((pos[i] - pos[i - 1] + d) * (q[i + 1] - q[i]) / (pos[i + 1] - pos[i]) +
+         (pos[i + 1] - pos[i] - d) * (q[i] - q[i - 1]) / (pos[i] - pos[i - 1]));
+}
+
+double P2Quantile::linear(int i, int d) const {
+    return q[i] + d * (q[i + d] - q[i]) / (pos[i + d] - pos[i]);
+}
+
+double P2Quantile::quantile() const {
+    if (n == 0) return 0.0;
+    if (n < 5) {
+        // Exact quantile of the stored values (q[] is sorted).
+        int idx = (int)round(p * (n - 1));
+        return q[idx];
+    }
+    return q[2];
+}
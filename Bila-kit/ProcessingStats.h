@@ -0,0 +1,99 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingStats.h
+*
+* Streaming statistics for the rolling outputs of the Processing Block.
+* Every update is O(1) and the memory is bounded. See ProcessingStats.cpp for details.
+******************************************************************************/
+
+#include <vector>
+
+// Mean / variance of all values since the last clear() (Welford's algorithm).
+class RunningStats
+{
+public:
+    RunningStats() { clear(); }
+    void clear();
+    void add(double x);
+    long long size() const { return n; }
+    bool isEmpty() const { return n == 0; }
+    double mean() const { return m; }
+    double variance() const;    // Unbiased sample variance
+    double stddev() const;
+    double sem() const;         // Standard error of the mean
+    // Confidence interval of the mean. z = 1.96 for 95%.
+    double lower(double z = 1.96) const { return m - z * sem(); }
+    double upper(double z = 1.96) const { return m + z * sem(); }
+
+private:
+    long long n;
+    double m;
+    double m2;
+};
+
+// Exponentially weighted moving average and variance. alpha: the weight of a new value (1 / time constant [values]).
+// The first value after clear() is taken as the mean, unless set() gives a prior one.
+class ExpAverage
+{
+public:
+    ExpAverage(double alpha = 0.1) : alpha(alpha) { clear(); }
+    void clear() { initialized = false; m = 0; var = 0; }
+    void set(double mean) { initialized = true; m = mean; var = 0; }
+    void setAlpha(double a) { alpha = a; }
+    void add(double x);
+    bool isEmpty() const { return !initialized; }
+    double mean() const { return m; }
+    double variance() const { return var; }
+
+private:
+    double alpha;
+    bool initialized;
+    double m;
+    double var;
+};
+
+// Mean / variance of the latest "window" values.
+class SlidingMean
+{
+public:
+    SlidingMean(int window = 10);
+    void clear();
+    void add(double x);
+    int size() const { return count; }
+    bool isEmpty() const { return count == 0; }
+    double mean() const;
+    double variance() const;
+
+private:
+    std::vector<double> buffer;
+    int head;
+    int count;
+    int since_resum;    // The sums are recomputed once per window to cancel the accumulated rounding error.
+    double shift;       // The sums are of x - shift (the first value, then the mean at the last recomputation).
+    double sum;
+    double sum_sq;
+};
+
+// Streaming quantile estimation by the P-square algorithm [Jain & Chlamtac, Commun. ACM 28 (1985) 1076].
+// Five markers are kept regardless of the number of values.
+class P2Quantile
+{
+public:
+    P2Quantile(double p = 0.5) : p(p) { clear(); }
+    void clear();
+    void add(double x);
+    long long size() const { return n; }
+    bool isEmpty() const { return n == 0; }
+    double quantile() const;
+
+private:
+    double parabolic(int i, int d) const;
+    double linear(int i, int d) const;
+    double p;
+    long long n;
+    double q[5];        // Marker heights
+    double pos[5];      // Marker positions
+    double desired[5];  // Desired marker positions
+    double incr[5];     // Increments of the desired positions
+};
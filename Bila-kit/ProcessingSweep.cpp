@@ -0,0 +1,251 @@
+/******************************************************************************
+// ProcessingSweep.cpp
+//
+// This code reprocesses recordings offline over grids of the tuning constants of the Processing Block (the hysteresis
+// threshold, the edge filter length, the nanopore detection threshold, the correction windows, ...), instead of editing
+// the constants, rebuilding and replaying the files one by one.
+//
+//   * Every recording is decoded once (ReplayFile), and the jobs read its samples without copying the file.
+//   * A job is one configuration on one recording: a ProcessingBlock of its own runs every block as bilakit_cli does,
+//     without the logs (exporter == nullptr) and without the PSD and dwell-time fitting workers, and its public state
+//     is summarized per block into SweepResult.
+//   * The jobs run on a work-stealing pool (PipelineStages.cpp). The long recordings are dealt first, and the
+//     results are stored by their index, so the result matrix does not depend on the number of threads.
+******************************************************************************/
+
+#include "ProcessingSweep.h"
+#include "PipelineStages.h"
+#include "Platform.h"
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char* const PARAMETER_NAMES = "threshold, detection_threshold (nanopore_detection_threshold), kernel_size, drift_guard, "
+    "conductance_window, conductance, baseline, false_rate, cusum_delay, cutoff, max_open";
+
+const char* sweepParameterNames() {
+    return PARAMETER_NAMES;
+}
+
+bool applySweepParameter(const std::string& name, double value, ProcessingConfig* config, ProcessingControls* controls) {
+    if (name == "threshold") config->threshold = value;
+    else if (name == "detection_threshold" || name == "nanopore_detection_threshold") config->detection_threshold = value;
+    else if (name == "kernel_size") config->edge_kernel_size = (int)lround(value);
+    else if (name == "drift_guard") config->drift_guard = (int)lround(value);
+    else if (name == "conductance_window") config->conductance_window = (int)lround(value);
+    else if (name == "conductance") config->conductance = value;
+    else if (name == "baseline") config->baseline = value;
+    else if (name == "false_rate") config->target_false_rate = value;
+    else if (name == "cusum_delay") config->cusum_delay_ms = value;
+    else if (name == "cutoff") controls->filterCutoff = (int)lround(value);
+    else if (name == "max_open") controls->max_open = (int)lround(value);
+    else return false;
+    return true;
+}
+
+bool parseSweepAxis(const std::string& text, SweepAxis* axis, std::string* error) {
+    size_t eq = text.find('=');
+    if (eq == std::string::npos || eq == 0 || eq + 1 == text.size()) {
+        *error = "expected NAME=VALUES: " + text;
+        return false;
+    }
+    axis->name = text.substr(0, eq);
+    axis->values.clear();
+    ProcessingConfig config = defaultProcessingConfig();
+    ProcessingControls controls = defaultProcessingControls();
+    if (!applySweepParameter(axis->name, 0, &config, &controls)) {
+        *error = "unknown parameter: " + axis->name;
+        return false;
+    }
+    std::string values = text.substr(eq + 1);
+    double first, last, step;
+    char tail;
+    if (values.find(':') != std::string::npos) {
+        // first:last:step (the last value is included within a rounding error of the step)
+        if (sscanf(values.c_str(), "%lf:%lf:%lf%c", &first, &last, &step, &tail) != 3 || step <= 0 || last < first) {
+            *error = "expected FIRST:LAST:STEP with STEP > 0: " + values;
+            return false;
+        }
+        int count = (int)floor((last - first) / step + 1e-9) + 1;
+        for (int k = 0; k < count; k++) axis->values.push_back(first + k * step);
+    }
+    else {
+        size_t start = 0;
+        while (start <= values.size()) {
+            size_t comma = values.find(',', start);
+            if (comma == std::string::npos) comma = values.size();
+            std::string item = values.substr(start, comma - start);
+            char* end = nullptr;
+            double v = strtod(item.c_str(), &end);
+            if (item.empty() || *end != '\0') {
+                *error = "not a number: " + item;
+                return false;
+            }
+            axis->values.push_back(v);
+            start = comma + 1;
+        }
+    }
+    return true;
+}
+
+int sweepConfigurations(const std::vector<SweepAxis>& axes) {
+    int n = 1;
+    for (const SweepAxis& a : axes) n *= (int)a.values.size();
+    return n;
+}
+
+std::vector<double> sweepValues(const std::vector<SweepAxis>& axes, int configuration) {
+    std::vector<double> values(axes.size());
+    for (int k = (int)axes.size() - 1; k >= 0; k--) {
+        int n = (int)axes[k].values.size();
+        values[k] = axes[k].values[configuration % n];
+        configuration /= n;
+    }
+    return values;
+}
+
+SweepResult runSweepJob(const ProcessingConfig& base_config, const ProcessingControls& base_controls,
+    const SweepRecording& recording, int recording_index, const std::vector<SweepAxis>& axes, int configuration) {
+    SweepResult r;
+    r.recording = recording_index;
+    r.configuration = configuration;
+    r.values = sweepValues(axes, configuration);
+    ProcessingConfig config = base_config;
+    ProcessingControls controls = base_controls;
+    config.bias_voltage = recording.bias_voltage;
+    config.dataStartTime = recording.file.startTime();
+    config.log_raw = false;
+    config.analysis_workers = false;    // The PSDs and the dwell-time fits are not summarized, so the two workers per job are not started.
+    for (size_t k = 0; k < axes.size(); k++) applySweepParameter(axes[k].name, r.values[k], &config, &controls);
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    ProcessingBlock processing;
+    processing.start(config, controls, std::string(), nullptr);
+    SenseBlock block;
+    block.time.resize(SAMPLE_FREQ);
+    block.current.resize(SAMPLE_FREQ);
+    r.blocks = 0;
+    r.ruptured_blocks = 0;
+    r.opProb_blocks = 0;
+    r.conductance_events = 0;
+    double opProb_sum = 0, stimuli_sum = 0, channels_sum = 0, conductance_sum = 0;
+    int channels_blocks = 0;
+    long long transitions = 0;
+    const int blocks = recording.file.blocks();
+    for (int b = 0; b < blocks; b++) {
+        block.index = b;
+        block.status = 0;
+        block.switch_index = -1;
+        int switchIndex = 0;
+        int result = recording.file.read(block.time.data(), block.current.data(), b, &switchIndex);
+        if (result == -1) break;
+        if (result != 1) {
+            block.status = 1;
+            block.voltage = result;
+            block.switch_index = switchIndex;
+        }
+        if (block.status == 1 && block.voltage != processing.config.bias_voltage) {
+            processing.voltage_switch_index = block.switch_index;
+            processing.setHoldingVoltage(block.voltage, &controls);
+        }
+        processing.process(&block, &controls);
+
+        r.blocks++;
+        if (processing.rupture_flag) r.ruptured_blocks++;
+        if (config.proteinType != 0 && !processing.rupture_flag && processing.opProb >= 0) {   // A valid estimate, as test_golden and the results
+            r.opProb_blocks++;
+            opProb_sum += processing.opProb;
+            stimuli_sum += processing.stimuli;
+        }
+        if (!processing.rupture_flag && processing.maxOpenNumber >= 0) {
+            channels_blocks++;
+            channels_sum += processing.maxOpenNumber;
+        }
+        const std::vector<int>& idealized = processing.processedData;
+        for (int idx = 1; idx < SAMPLE_FREQ; idx++) {
+            if (idealized[idx] != idealized[idx - 1] && idealized[idx] >= 0 && idealized[idx - 1] >= 0) transitions++;
+        }
+        r.conductance_events += processing.conductance_events;
+        conductance_sum += processing.conductance_sum;
+    }
+    r.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    r.opProb_mean = r.opProb_blocks ? opProb_sum / r.opProb_blocks : NAN;
+    r.stimuli_mean = r.opProb_blocks ? stimuli_sum / r.opProb_blocks : NAN;
+    r.channels_mean = channels_blocks ? channels_sum / channels_blocks : NAN;
+    r.transitions_per_s = r.blocks ? (double)transitions / r.blocks : 0;
+    r.conductance_mean = r.conductance_events ? conductance_sum / r.conductance_events : NAN;
+    r.current_per_channel = processing.current_per_channel;
+    r.baseline = processing.baseline;
+    return r;
+}
+
+std::vector<SweepResult> runSweep(const ProcessingConfig& base_config, const ProcessingControls& base_controls,
+    const std::vector<SweepRecording>& recordings, const std::vector<SweepAxis>& axes, int num_threads,
+    SweepProgress progress, long long* steals) {
+    const int num_configurations = sweepConfigurations(axes);
+    const int num_recordings = (int)recordings.size();
+    const int total = num_configurations * num_recordings;
+    std::vector<SweepResult> results(total);
+
+    // The jobs of the longest recordings first, so that the short ones fill the gaps at the end.
+    std::vector<int> order(num_recordings);
+    for (int k = 0; k < num_recordings; k++) order[k] = k;
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return recordings[a].file.size() > recordings[b].file.size(); });
+    std::vector<int> jobs;
+    jobs.reserve(total);
+    for (int k : order) {
+        for (int c = 0; c < num_configurations; c++) jobs.push_back(c * num_recordings + k);
+    }
+
+    std::mutex progress_mutex;
+    int done = 0;
+    WorkStealingPool pool;
+    pool.run(total, num_threads, [&](int task, int) {
+        int slot = jobs[task];
+        int configuration = slot / num_recordings;
+        int recording = slot % num_recordings;
+        results[slot] = runSweepJob(base_config, base_controls, recordings[recording], recording, axes, configuration);
+        if (progress) {
+            std::lock_guard<std::mutex> lock(progress_mutex);
+            progress(++done, total);
+        }
+    });
+    if (steals) *steals = pool.steals();
+    return results;
+}
+
+// NaN as an empty cell.
+static void printValue(FILE* fp, double v) {
+    if (isnan(v)) fprintf(fp, ",");
+    else fprintf(fp, ",%g", v);
+}
+
+bool writeSweepCSV(const std::string& path, const std::vector<SweepResult>& results, const std::vector<SweepAxis>& axes,
+    const std::vector<SweepRecording>& recordings) {
+    FILE* fp;
+    fopen_s(&fp, path.c_str(), "w");
+    if (!fp) return false;
+    fprintf(fp, "configuration,recording");
+    for (const SweepAxis& a : axes) fprintf(fp, ",%s", a.name.c_str());
+    fprintf(fp, ",blocks [-],ruptured_blocks [-],opProb_blocks [-],opProb_mean,estimatedStimuli_mean,channels_mean [-],transitions [1/s],"
+        "conductance_events [-],conductance_mean [pS],current_per_channel [pA],baseline [pA],processing_time [s]\n");
+    for (const SweepResult& r : results) {
+        fprintf(fp, "%d,%s", r.configuration, recordings[r.recording].name.c_str());
+        for (double v : r.values) fprintf(fp, ",%g", v);
+        fprintf(fp, ",%d,%d,%d", r.blocks, r.ruptured_blocks, r.opProb_blocks);
+        printValue(fp, r.opProb_mean);
+        printValue(fp, r.stimuli_mean);
+        printValue(fp, r.channels_mean);
+        printValue(fp, r.transitions_per_s);
+        fprintf(fp, ",%d", r.conductance_events);
+        printValue(fp, r.conductance_mean);
+        printValue(fp, r.current_per_channel);
+        printValue(fp, r.baseline);
+        printValue(fp, r.seconds);
+        fprintf(fp, "\n");
+    }
+    return fclose(fp) == 0;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingSweep.h
+*
+* Offline reprocessing of recordings over grids of the tuning constants of the Processing Block, in parallel.
+* See ProcessingSweep.cpp for details.
+******************************************************************************/
+
+#include "ProcessingBlock.h"
+#include "SenseReplay.h"
+#include <functional>
+#include <string>
+#include <vector>
+
+// One parameter and its values, e.g. "threshold=0.5:1.0:0.05" or "kernel_size=101,201,301".
+struct SweepAxis {
+    std::string name;
+    std::vector<double> values;
+};
+
+// Parse "name=v1,v2,..." or "name=first:last:step". Returns false (with the reason in *error) for a syntax error
+// or an unknown name. See sweepParameterNames().
+bool parseSweepAxis(const std::string& text, SweepAxis* axis, std::string* error);
+// Set the parameter "name" of the configuration. Returns false for an unknown name.
+bool applySweepParameter(const std::string& name, double value, ProcessingConfig* config, ProcessingControls* controls);
+// The names accepted by applySweepParameter(), separated by ", " (for the usage).
+const char* sweepParameterNames();
+
+// A recording, decoded once and read by every job (ReplayFile::read() does not modify it).
+struct SweepRecording {
+    std::string name;
+    ReplayFile file;
+    int bias_voltage;           // The holding voltage at the start [mV]
+};
+
+// The summary of one configuration on one recording.
+struct SweepResult {
+    int recording;
+    int configuration;
+    std::vector<double> values;     // The value of every axis
+    int blocks;
+    int ruptured_blocks;
+    int opProb_blocks;              // The blocks where Po was estimated (ion channels)
+    double opProb_mean;
+    double stimuli_mean;            // The mean estimated stimuli of those blocks (e.g. the membrane voltage [mV])
+    double channels_mean;           // The mean of maxOpenNumber over the idealized blocks
+    double transitions_per_s;       // The transitions of the idealized data per second
+    int conductance_events;         // (Nanopores, postprocessType == 1)
+    double conductance_mean;        // [pS]
+    double current_per_channel;     // At the end [pA]
+    double baseline;                // At the end [pA]
+    double seconds;                 // Processing time
+};
+
+// The number of configurations of the grid (the product of the numbers of values; 1 without axes).
+int sweepConfigurations(const std::vector<SweepAxis>& axes);
+// The values of the configuration (the last axis changes fastest).
+std::vector<double> sweepValues(const std::vector<SweepAxis>& axes, int configuration);
+
+// Process the recording with one configuration, as bilakit_cli does (without the logs).
+SweepResult runSweepJob(const ProcessingConfig& base_config, const ProcessingControls& base_controls,
+    const SweepRecording& recording, int recording_index, const std::vector<SweepAxis>& axes, int configuration);
+
+// Every configuration on every recording, on num_threads threads (<= 0: the hardware concurrency).
+// The results are ordered by the configuration, then the recording, whatever the number of threads.
+// progress(done, total) is called after every job, from the worker threads (serialized).
+typedef std::function<void(int done, int total)> SweepProgress;
+std::vector<SweepResult> runSweep(const ProcessingConfig& base_config, const ProcessingControls& base_controls,
+    const std::vector<SweepRecording>& recordings, const std::vector<SweepAxis>& axes, int num_threads,
+    SweepProgress progress = SweepProgress(), long long* steals = nullptr);
+
+// The result matrix as CSV: one row per configuration and recording. Returns false if the file cannot be written.
+bool writeSweepCSV(const std::string& path, const std::vector<SweepResult>& results, const std::vector<SweepAxis>& axes,
+    const std::vector<SweepRecording>& recordings);
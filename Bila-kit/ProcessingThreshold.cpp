@@ -0,0 +1,170 @@
+/******************************************************************************
+// ProcessingThreshold.cpp
+//
+// This code idealizes the raw current into the number of open channels by the hysteresis threshold:
+//     (positive bias) lastOpenNumber++ if current > (lastOpenNumber + threshold) * current_per_channel + baseline
+//                     lastOpenNumber-- if current < (lastOpenNumber - threshold) * current_per_channel + baseline
+// (the inequalities are reversed for the negative bias).
+//
+// Since the number changes only at a small fraction of the samples, idealizeThreshold() first looks for the next sample
+// outside the "quiet" range [lower, upper], in which neither boundary (nor the rupture limits) can be crossed with the current
+// lastOpenNumber. The samples before it keep lastOpenNumber, and only the flagged sample goes through the sequential
+// state machine. The search compares 2-4 samples at once with SSE2/AVX2 (x86) or NEON (ARM), and falls back to plain C++.
+// Both paths compute the boundaries with the same function, so the output is exactly the same as the scalar path.
+******************************************************************************/
+
+#include "ProcessingThreshold.h"
+#include <math.h>
+
+// Define THRESHOLD_NO_SIMD to force the plain C++ path (e.g. for testing).
+#if defined(THRESHOLD_NO_SIMD)
+#elif defined(__AVX2__)
+#include <immintrin.h>
+#define THRESHOLD_USE_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define THRESHOLD_USE_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define THRESHOLD_USE_NEON
+#endif
+
+// Boundaries of the hysteresis for the current number of open channels.
+static inline double boundaryUp(const ThresholdParams& p, int lastOpenNumber) {
+    return (lastOpenNumber + p.threshold) * p.current_per_channel + p.baseline;
+}
+static inline double boundaryDown(const ThresholdParams& p, int lastOpenNumber) {
+    return (lastOpenNumber - p.threshold) * p.current_per_channel + p.baseline;
+}
+
+// Sequential state machine for a single sample. Returns false if the sample is out of the abort limits.
+// Polarity: the sign of current_per_channel (+1 or -1), or 0 if it is checked at runtime.
+template <int Polarity>
+static inline bool stepSample(double y, const ThresholdParams& p, int* lastOpenNumber) {
+    if (y < p.abort_lower || y > p.abort_upper) return false;
+    int L = *lastOpenNumber;
+    bool positive = (Polarity == 0) ? (p.current_per_channel > 0) : (Polarity > 0);
+    bool up, down;
+    if (positive) {
+        up = y > boundaryUp(p, L);
+        down = !up && y < boundaryDown(p, L);
+    }
+    else {
+        up = y < boundaryUp(p, L);
+        down = !up && y > boundaryDown(p, L);
+    }
+    if (up) {
+        L++;
+        if (p.max_open >= 0 && L > p.max_open) L = p.max_open;
+    }
+    else if (down) {
+        L--;
+        if (L < 0) L = 0;
+    }
+    *lastOpenNumber = L;
+    return true;
+}
+
+int idealizeThresholdScalar(const double* current, int* destination, int n, const ThresholdParams& p, int* lastOpenNumber) {
+    for (int idx = 0; idx < n; idx++) {
+        if (!stepSample<0>(current[idx], p, lastOpenNumber)) return idx;
+        destination[idx] = *lastOpenNumber;
+    }
+    return n;
+}
+
+int findOutOfRange(const double* current, int n, double lower, double upper) {
+    int idx = 0;
+#if defined(THRESHOLD_USE_AVX2)
+    const __m256d lo = _mm256_set1_pd(lower);
+    const __m256d hi = _mm256_set1_pd(upper);
+    for (; idx + 16 <= n; idx += 16) {
+        // 16 samples per iteration, one branch.
+        __m256d y0 = _mm256_loadu_pd(current + idx);
+        __m256d y1 = _mm256_loadu_pd(current + idx + 4);
+        __m256d y2 = _mm256_loadu_pd(current + idx + 8);
+        __m256d y3 = _mm256_loadu_pd(current + idx + 12);
+        __m256d out0 = _mm256_or_pd(_mm256_cmp_pd(y0, lo, _CMP_LT_OQ), _mm256_cmp_pd(y0, hi, _CMP_GT_OQ));
+        __m256d out1 = _mm256_or_pd(_mm256_cmp_pd(y1, lo, _CMP_LT_OQ), _mm256_cmp_pd(y1, hi, _CMP_GT_OQ));
+        __m256d out2 = _mm256_or_pd(_mm256_cmp_pd(y2, lo, _CMP_LT_OQ), _mm256_cmp_pd(y2, hi, _CMP_GT_OQ));
+        __m256d out3 = _mm256_or_pd(_mm256_cmp_pd(y3, lo, _CMP_LT_OQ), _mm256_cmp_pd(y3, hi, _CMP_GT_OQ));
+        __m256d any = _mm256_or_pd(_mm256_or_pd(out0, out1), _mm256_or_pd(out2, out3));
+        if (_mm256_movemask_pd(any)) break;
+    }
+#elif defined(THRESHOLD_USE_SSE2)
+    const __m128d lo = _mm_set1_pd(lower);
+    const __m128d hi = _mm_set1_pd(upper);
+    for (; idx + 8 <= n; idx += 8) {
+        __m128d y0 = _mm_loadu_pd(current + idx);
+        __m128d y1 = _mm_loadu_pd(current + idx + 2);
+        __m128d y2 = _mm_loadu_pd(current + idx + 4);
+        __m128d y3 = _mm_loadu_pd(current + idx + 6);
+        __m128d out0 = _mm_or_pd(_mm_cmplt_pd(y0, lo), _mm_cmpgt_pd(y0, hi));
+        __m128d out1 = _mm_or_pd(_mm_cmplt_pd(y1, lo), _mm_cmpgt_pd(y1, hi));
+        __m128d out2 = _mm_or_pd(_mm_cmplt_pd(y2, lo), _mm_cmpgt_pd(y2, hi));
+        __m128d out3 = _mm_or_pd(_mm_cmplt_pd(y3, lo), _mm_cmpgt_pd(y3, hi));
+        __m128d any = _mm_or_pd(_mm_or_pd(out0, out1), _mm_or_pd(out2, out3));
+        if (_mm_movemask_pd(any)) break;
+    }
+#elif defined(THRESHOLD_USE_NEON)
+    const float64x2_t lo = vdupq_n_f64(lower);
+    const float64x2_t hi = vdupq_n_f64(upper);
+    for (; idx + 8 <= n; idx += 8) {
+        float64x2_t y0 = vld1q_f64(current + idx);
+        float64x2_t y1 = vld1q_f64(current + idx + 2);
+        float64x2_t y2 = vld1q_f64(current + idx + 4);
+        float64x2_t y3 = vld1q_f64(current + idx + 6);
+        uint64x2_t out0 = vorrq_u64(vcltq_f64(y0, lo), vcgtq_f64(y0, hi));
+        uint64x2_t out1 = vorrq_u64(vcltq_f64(y1, lo), vcgtq_f64(y1, hi));
+        uint64x2_t out2 = vorrq_u64(vcltq_f64(y2, lo), vcgtq_f64(y2, hi));
+        uint64x2_t out3 = vorrq_u64(vcltq_f64(y3, lo), vcgtq_f64(y3, hi));
+        uint64x2_t any = vorrq_u64(vorrq_u64(out0, out1), vorrq_u64(out2, out3));
+        if (vmaxvq_u32(vreinterpretq_u32_u64(any))) break;
+    }
+#endif
+    // The remainder (and the vector group that contains the flagged sample).
+    for (; idx < n; idx++) {
+        if (current[idx] < lower || current[idx] > upper) return idx;
+    }
+    return n;
+}
+
+template <int Polarity>
+int idealizeThresholdFixed(const double* current, int* destination, int n, const ThresholdParams& p, int* lastOpenNumber) {
+    int idx = 0;
+    while (idx < n) {
+        // The quiet range for the current lastOpenNumber.
+        // At the limits (0 or max_open), a crossing does not change the number, so that boundary is ignored.
+        int L = *lastOpenNumber;
+        bool at_bottom = (L == 0);
+        bool at_top = (p.max_open >= 0 && L == p.max_open);
+        double lower, upper;
+        if (Polarity > 0) {
+            lower = at_bottom ? -HUGE_VAL : boundaryDown(p, L);
+            upper = at_top ? HUGE_VAL : boundaryUp(p, L);
+        }
+        else {
+            lower = at_top ? -HUGE_VAL : boundaryUp(p, L);
+            upper = at_bottom ? HUGE_VAL : boundaryDown(p, L);
+        }
+        if (lower < p.abort_lower) lower = p.abort_lower;
+        if (upper > p.abort_upper) upper = p.abort_upper;
+
+        int next = idx + findOutOfRange(current + idx, n - idx, lower, upper);
+        for (; idx < next; idx++) destination[idx] = L;
+        if (idx == n) break;
+
+        // The flagged sample goes through the sequential state machine.
+        if (!stepSample<Polarity>(current[idx], p, lastOpenNumber)) return idx;
+        destination[idx] = *lastOpenNumber;
+        idx++;
+    }
+    return n;
+}
+template int idealizeThresholdFixed<1>(const double*, int*, int, const ThresholdParams&, int*);
+template int idealizeThresholdFixed<-1>(const double*, int*, int, const ThresholdParams&, int*);
+
+int idealizeThreshold(const double* current, int* destination, int n, const ThresholdParams& p, int* lastOpenNumber) {
+    if (p.current_per_channel > 0) return idealizeThresholdFixed<1>(current, destination, n, p, lastOpenNumber);
+    return idealizeThresholdFixed<-1>(current, destination, n, p, lastOpenNumber);
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+/******************************************************************************
+* ProcessingThreshold.h
+*
+* Threshold (hysteresis) idealization of ion channel currents, with a vectorized pre-scan.
+* See ProcessingThreshold.cpp for details.
+******************************************************************************/
+
+struct ThresholdParams {
+    double baseline;            // Current when all channels are closed [pA]
+    double current_per_channel; // Current per single channel [pA]. Must not be in [-0.1, 0.1].
+    double threshold;           // Hysteresis width in units of current_per_channel (e.g. 0.75)
+    int max_open;               // Upper limit of the number of open channels (< 0: unlimited)
+    double abort_lower;         // Idealization is aborted at the first sample < abort_lower (e.g. -rupture_threshold)
+    double abort_upper;         // Idealization is aborted at the first sample > abort_upper (e.g. rupture_threshold)
+};
+
+// Idealize current[0 .. n-1] into destination[] starting from *lastOpenNumber, which is updated.
+// Returns n, or the index of the first sample out of [abort_lower, abort_upper] (destination[] is filled up to that index).
+// idealizeThresholdScalar() processes every sample one by one (reference implementation).
+// idealizeThreshold() skips the ranges where no boundary can be crossed with the vectorized pre-scan. The output is identical.
+int idealizeThresholdScalar(const double* current, int* destination, int n, const ThresholdParams& p, int* lastOpenNumber);
+int idealizeThreshold(const double* current, int* destination, int n, const ThresholdParams& p, int* lastOpenNumber);
+// Same as idealizeThreshold(), with the sign of current_per_channel fixed at compile time (Polarity = +1 or -1).
+template <int Polarity>
+int idealizeThresholdFixed(const double* current, int* destination, int n, const ThresholdParams& p, int* lastOpenNumber);
+
+// Returns the index of the first sample with current[idx] < lower or current[idx] > upper, or n if there is none.
+// NaN is regarded as in the range.
+int findOutOfRange(const double* current, int n, double lower, double upper);
@@ -0,0 +1,186 @@
+/******************************************************************************
+// ProtocolScheduler.cpp
+//
+// This code steps the holding voltage through a programmed list for the Po-V calibration of ion channels,
+// and fits the Boltzmann (sigmoidal) function to the results online.
+//
+// Each step dwells until the 95% confidence interval of the mean Po becomes narrower than the target,
+// then moves on immediately, instead of dwelling a fixed (long enough) time.
+// The blocks acquired before the new voltage is applied are not counted (see update()).
+// The fitted parameters correspond to "a" and "x0" in the Processing Block (p = 1 / (1 + exp(-a*(x-x0)))).
+******************************************************************************/
+
+#include "ProtocolScheduler.h"
+#include <math.h>
+
+ProtocolScheduler::ProtocolScheduler()
+    : target_halfwidth(0.05), min_dwell(5), max_dwell(60), running(false),
+      step(0), switching(false), blocks(0)
+{}
+
+void ProtocolScheduler::setup(const std::vector<int>& voltages_arg, double target_halfwidth_arg, int min_dwell_arg, int max_dwell_arg) {
+    voltages = voltages_arg;
+    target_halfwidth = target_halfwidth_arg;
+    min_dwell = (min_dwell_arg < 2) ? 2 : min_dwell_arg;      // At least 2 values are required for the confidence interval.
+    max_dwell = (max_dwell_arg < min_dwell) ? min_dwell : max_dwell_arg;
+    running = false;
+}
+
+void ProtocolScheduler::start() {
+    results.clear();
+    step = 0;
+    switching = true;
+    blocks = 0;
+    opProb_stats.clear();
+    running = !voltages.empty();
+}
+
+void ProtocolScheduler::abort() {
+    running = false;
+}
+
+int ProtocolScheduler::currentVoltage() const {
+    if (voltages.empty()) return 0;
+    return voltages[step < (int)voltages.size() ? step : voltages.size() - 1];
+}
+
+bool ProtocolScheduler::update(double opProb, int voltage) {
+    if (!running) return false;
+    // The blocks queued at the previous voltage are still processed after the switch is requested.
+    if (switching) {
+        if (voltage != voltages[step]) return false;
+        switching = false;
+    }
+
+    blocks++;
+    if (opProb >= 0) opProb_stats.add(opProb);
+
+    // 95% confidence interval of the mean Po, estimated from the block-to-block variation.
+    int valid_num = (int)opProb_stats.size();
+    double mean = opProb_stats.mean();
+    double halfwidth = (valid_num >= 2) ? 1.96 * opProb_stats.sem() : 1.0;
+
+    bool converged = (valid_num >= min_dwell && halfwidth <= target_halfwidth);
+    if (!converged && blocks < max_dwell) return false;
+
+    // Finish the current step and move on to the next voltage.
+    ProtocolStepResult result;
+    result.voltage = voltages[step];
+    result.opProb = (valid_num > 0) ? mean : -99;
+    result.opProb_halfwidth = halfwidth;
+    result.dwell = valid_num;
+    result.converged = converged;
+    results.push_back(result);
+
+    step++;
+    switching = true;
+    blocks = 0;
+    opProb_stats.clear();
+    if (step >= (int)voltages.size()) running = false;
+    return true;
+}
+
+// Weighted Levenberg-Marquardt fitting of p = 1 / (1 + exp(-a * (V - x0))).
+// The initial values are obtained by the linear regression of logit(p) against V.
+bool ProtocolScheduler::fitBoltzmann(double* a, double* x0, double* a_se, double* x0_se) const {
+    std::vector<double> xs, ps, ws;
+    for (const ProtocolStepResult& r : results) {
+        if (r.opProb <= 0 || r.opProb >= 1) continue;
+        double sigma = r.opProb_halfwidth / 1.96;
+        if (sigma < 0.01) sigma = 0.01;     // Avoid the domination by a single step.
+        xs.push_back(r.voltage);
+        ps.push_back(r.opProb);
+        ws.push_back(1.0 / (sigma * sigma));
+    }
+    int n = (int)xs.size();
+    if (n < 2) return false;
+
+    // Initial values
+    double sx = 0, sy = 0, sxx = 0, sxy = 0, sw = 0;
+    for (int i = 0; i < n; i++) {
+        double p = ps[i];
+        if (p < 0.01) p = 0.01;
+        if (p > 0.99) p = 0.99;
+        double y = log(p / (1 - p));
+        sw += ws[i];
+        sx += ws[i] * xs[i];
+        sy += ws[i] * y;
+        sxx += ws[i] * xs[i] * xs[i];
+        sxy += ws[i] * xs[i] * y;
+    }
+    double denom = sw * sxx - sx * sx;
+    if (fabs(denom) < 1e-12) return false;     // All steps at the same voltage.
+    double slope = (sw * sxy - sx * sy) / denom;
+    double intercept = (sy - slope * sx) / sw;
+    if (fabs(slope) < 1e-9) return false;
+    double pa = slope;
+    double px0 = -intercept / slope;
+
+    // Levenberg-Marquardt iterations
+    auto chi2_of = [&](double ta, double tx0) {
+        double chi2 = 0;
+        for (int i = 0; i < n; i++) {
+            double f = 1.0 / (1.0 + exp(-ta * (xs[i] - tx0)));
+            chi2 += ws[i] * (ps[i] - f) * (ps[i] - f);
+        }
+        return chi2;
+    };
+    double chi2 = chi2_of(pa, px0);
+    double lambda = 1e-3;
+    double jtj[3] = {};    // J^T W J.  [0]: a-a, [1]: a-x0, [2]: x0-x0
+    for (int iter = 0; iter < 100; iter++) {
+        double g[2] = {};
+        jtj[0] = jtj[1] = jtj[2] = 0;
+        for (int i = 0; i < n; i++) {
+            double f = 1.0 / (1.0 + exp(-pa * (xs[i] - px0)));
+            double d = f * (1 - f);
+            double ja = d * (xs[i] - px0);
+            double jx0 = -pa * d;
+            double r = ps[i] - f;
+            g[0] += ws[i] * ja * r;
+            g[1] += ws[i] * jx0 * r;
+            jtj[0] += ws[i] * ja * ja;
+            jtj[1] += ws[i] * ja * jx0;
+            jtj[2] += ws[i] * jx0 * jx0;
+        }
+        double m00 = jtj[0] * (1 + lambda);
+        double m11 = jtj[2] * (1 + lambda);
+        double det = m00 * m11 - jtj[1] * jtj[1];
+        if (fabs(det) < 1e-300) break;
+        double da = (m11 * g[0] - jtj[1] * g[1]) / det;
+        double dx0 = (m00 * g[1] - jtj[1] * g[0]) / det;
+        double new_chi2 = chi2_of(pa + da, px0 + dx0);
+        if (new_chi2 < chi2) {
+            pa += da;
+            px0 += dx0;
+            lambda *= 0.1;
+            bool done = (chi2 - new_chi2) < 1e-12 * (1 + chi2);
+            chi2 = new_chi2;
+            if (done) break;
+        }
+        else {
+            lambda *= 10;
+            if (lambda > 1e10) break;
+        }
+    }
+
+    // Standard errors from the covariance matrix (scaled by the reduced chi-square when the degree of freedom is available).
+    jtj[0] = jtj[1] = jtj[2] = 0;
+    for (int i = 0; i < n; i++) {
+        double f = 1.0 / (1.0 + exp(-pa * (xs[i] - px0)));
+        double d = f * (1 - f);
+        double ja = d * (xs[i] - px0);
+        double jx0 = -pa * d;
+        jtj[0] += ws[i] * ja * ja;
+        jtj[1] += ws[i] * ja * jx0;
+        jtj[2] += ws[i] * jx0 * jx0;
+    }
+    double det = jtj[0] * jtj[2] - jtj[1] * jtj[1];
+    if (fabs(det) < 1e-300) return false;
+    double scale = (n > 2) ? chi2 / (n - 2) : 1.0;
+    *a = pa;
+    *x0 = px0;
+    *a_se = sqrt(fabs(jtj[2] / det * scale));
+    *x0_se = sqrt(fabs(jtj[0] / det * scale));
+    return true;
+}
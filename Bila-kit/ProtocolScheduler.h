@@ -0,0 +1,61 @@
+#pragma once
+
+/******************************************************************************
+* ProtocolScheduler.h
+*
+* Automated holding-voltage step protocol for Po-V (Boltzmann) calibration.
+* See ProtocolScheduler.cpp for details.
+******************************************************************************/
+
+#include <vector>
+#include "ProcessingStats.h"
+
+// Result of a single voltage step.
+struct ProtocolStepResult {
+    int voltage;            // Holding voltage [mV]
+    double opProb;          // Mean open probability during the step
+    double opProb_halfwidth;    // Half width of the 95% confidence interval of opProb
+    int dwell;              // Number of valid 1 s blocks used for the step
+    bool converged;         // false if the step was terminated by max_dwell
+};
+
+class ProtocolScheduler
+{
+public:
+    ProtocolScheduler();
+
+    // voltages: the list of holding voltages [mV] to be stepped through.
+    // target_halfwidth: the step finishes once the 95% CI half width of Po becomes smaller than this value.
+    // min_dwell, max_dwell: the minimum/maximum number of valid 1 s blocks per step.
+    void setup(const std::vector<int>& voltages, double target_halfwidth, int min_dwell, int max_dwell);
+    void start();
+    void abort();
+    bool isRunning() const { return running; }
+    int currentVoltage() const;
+
+    // Called once per 1 s block with the open probability of the block (negative if not available) and the holding
+    // voltage at which the block was acquired [mV].
+    // The amplifier applies a new voltage one block (or more) after it is requested, so at the start and after every
+    // step the blocks are skipped until the first one at currentVoltage().
+    // Returns true when the current step is finished. Then the result is available by lastResult(),
+    // and the next voltage by currentVoltage() (unless isRunning() turned false at the end of the list).
+    bool update(double opProb, int voltage);
+    const ProtocolStepResult& lastResult() const { return results.back(); }
+    const std::vector<ProtocolStepResult>& allResults() const { return results; }
+
+    // Fit p = 1 / (1 + exp(-a * (V - x0))) to the step results by weighted least squares.
+    // Returns false if the fit is not possible (e.g. less than two voltages with 0 < Po < 1).
+    bool fitBoltzmann(double* a, double* x0, double* a_se, double* x0_se) const;
+
+private:
+    std::vector<int> voltages;
+    std::vector<ProtocolStepResult> results;
+    double target_halfwidth;
+    int min_dwell;
+    int max_dwell;
+    bool running;
+    int step;           // Index of the current voltage
+    bool switching;     // true until the first block at the current voltage is processed
+    int blocks;         // Number of blocks (including invalid ones) at the current step
+    RunningStats opProb_stats;  // Valid Po values at the current step
+};
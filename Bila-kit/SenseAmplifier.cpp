@@ -8,6 +8,7 @@
 #include "MyHelper.h"
 #include "TecellaAmp.h"
 #include "TecellaAmpExample_00.h"
+#include <chrono>
 
 TECELLA_HNDL h;
 
@@ -62,7 +63,12 @@ int finalizeAmplifier() {
 
 
 // (Re)set the value for membrane holding voltage.  Input example: 50 -> 50 mV.
-void changeVoltageAmplifier(int value) {
+// Returns the time [ms] spent for reprogramming the amplifier, or -1 on failure.
+// Since the acquisition is (re)started every 1 s block, the new voltage takes effect at the first sample of the next block.
+double changeVoltageAmplifier(int value) {
 	double voltage = value * 0.001;
-	setup_stimulus(h, voltage);
+	auto start_time = std::chrono::steady_clock::now();
+	if (setup_hold_voltage(h, voltage) != TECELLA_ERR_OK) return -1;
+	auto end_time = std::chrono::steady_clock::now();
+	return std::chrono::duration<double, std::milli>(end_time - start_time).count();
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+/******************************************************************************
+// SenseAmplifierNone.cpp
+//
+// This code replaces SenseAmplifier.cpp in the builds without the Tecella backend (BILAKIT_WITH_TECELLA=OFF in CMake).
+// No amplifier can be opened, so the GUI works with the local files only.
+******************************************************************************/
+
+#include "MyHelper.h"
+
+// No amplifier is available: always fails, and the GUI reports "Unable to open PICO".
+int setupAmplifier(int choice) {
+    return 1;
+}
+
+void readAmplifier(double* timestamp, double* destination, int dataIndex_loop_num) {
+    for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
+        timestamp[idx] = dataIndex_loop_num + idx / double(SAMPLE_FREQ);
+        destination[idx] = 0;
+    }
+}
+
+void stopAmplifier() {
+}
+
+int finalizeAmplifier() {
+    return 0;
+}
+
+double changeVoltageAmplifier(int value) {
+    return -1;
+}
@@ -0,0 +1,124 @@
+/******************************************************************************
+// SenseReplay.cpp
+//
+// This code loads a local ATF/CSV recording and replays it block by block (SAMPLE_FREQ samples per block).
+// It is free of Qt, so that the same parsing is used by the GUI (SenseLocal.cpp) and the headless runner.
+//
+// style specification:
+//   * Several rows at the top might be headers to be disposed.
+//   * Column 1 must be Time [s].  ATF file matches this condition.  However, in the exported CSV file, the unit become [ms], so adaptation (*0.001) must be applied.
+//   * Column 2 must be Current [pA].
+//   * Separator of columns should be tab (ATF) or conma(CSV).
+//   * A field which is not a number is read as 0 (as QString::toDouble()), and a row without the second column is skipped.
+******************************************************************************/
+
+#include "SenseReplay.h"
+#include "MyHelper.h"
+#include "Platform.h"
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+// Whether "s" ends with "suffix", ignoring the case.
+static bool endsWithNoCase(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    if (s.size() < n) return false;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)s[s.size() - n + i]) != tolower((unsigned char)suffix[i])) return false;
+    }
+    return true;
+}
+
+// The number at the beginning of the field [begin, end), or 0 if there is none.
+static double parseField(const char* begin, const char* end) {
+    char* stop;
+    double value = strtod(begin, &stop);
+    return (stop <= end) ? value : 0;
+}
+
+int ReplayFile::open(const std::string& filename, int extension, bool isSeconds) {
+    // Read the whole file at once, then parse it in memory.
+    FILE* fp;
+    fopen_s(&fp, filename.c_str(), "rb");
+    if (!fp) return -2;
+    std::string text;
+    char buffer[65536];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), fp)) > 0) text.append(buffer, n);
+    fclose(fp);
+
+    time.clear();   // Release the data before newly import one.
+    current.clear();
+    // ATF files ... The files which are exported from Clampfit or other software by "export" function.
+    //               The first 10 rows are headers to be disposed of.
+    // CSV files ... The files which are exported from Clampfit or other software by "Transfer Traces" function.
+    //               The first row is a header to be disposed of.
+    int skip = (extension == 0) ? 10 : 1;
+    const char separator = (extension == 0) ? '\t' : ',';
+    // In case the time unit is [ms] (e.g. The Transfer Traces function), [ms] -> [s].
+    // (The re-usage of the data recorded by this system, and the ATF files, are in [s].)
+    const double time_scale = (extension == 0 || isSeconds) ? 1 : 0.001;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = text.find('\n', pos);
+        if (end == std::string::npos) end = text.size();
+        if (skip > 0) {
+            skip--;
+        }
+        else {
+            const char* line = text.c_str() + pos;
+            const char* line_end = text.c_str() + end;
+            const char* second = (const char*)memchr(line, separator, end - pos);
+            if (second != nullptr) {
+                time.push_back(parseField(line, second) * time_scale);    // Time [s]
+                current.push_back(parseField(second + 1, line_end));      // Current [pA]
+            }
+        }
+        pos = end + 1;
+    }
+    if (time.empty()) return -3;
+
+    // Test cde for voltage changing function.
+    change_time.clear();
+    change_value.clear();
+    if (endsWithNoCase(filename, "BK_mimura_VoltageChanging.atf")) {
+        const double t[] = { 1370.4, 1380.8, 1428.4, 1438.2, 1468.4, 1498.4, 1529.2, 1538.6, 1568.9, 1598.2 };
+        const int v[] = { 0, +30, 0, -20, -40, -60, 0, +20, +40, +60 };
+        change_time.assign(t, t + 10);
+        change_value.assign(v, v + 10);
+    }
+    if (endsWithNoCase(filename, "20220912_BKvoltage_trimmed.atf")) {
+        const double t[] = { 711.9, 727.9, 840.1, 855.4, 870.1, 882.4 };
+        const int v[] = { 0, +30, +60, -30, -60, +30 };
+        change_time.assign(t, t + 6);
+        change_value.assign(v, v + 6);
+    }
+    return 0;
+}
+
+int ReplayFile::blocks() const {
+    return (int)(time.size() / SAMPLE_FREQ);
+}
+
+int ReplayFile::read(double* timestamp, double* destination, int dataIndex_loop_num, int* switchIndex) const {
+    // Check if the data is out of range from the file or not.
+    if ((size_t)(dataIndex_loop_num + 1) * SAMPLE_FREQ > time.size()) return -1;
+
+    // Copy the required data to the destination.
+    size_t offset = (size_t)dataIndex_loop_num * SAMPLE_FREQ;
+    for (int idx = 0; idx < SAMPLE_FREQ; idx++) {
+        timestamp[idx] = time[offset + idx];
+        destination[idx] = current[offset + idx];
+    }
+
+    // Specify the changing of bias voltage if applicable.
+    for (size_t i = 0; i < change_time.size(); i++) {
+        if (timestamp[0] <= change_time[i] && change_time[i] < timestamp[SAMPLE_FREQ - 1]) {
+            int idx = 0;
+            while (idx < SAMPLE_FREQ - 1 && timestamp[idx] < change_time[i]) idx++;
+            *switchIndex = idx;
+            return change_value[i];
+        }
+    }
+    return 1;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+/******************************************************************************
+* SenseReplay.h
+*
+* Local ATF/CSV recordings replayed block by block, without Qt (used by SenseLocal.cpp and bilakit_cli).
+* See SenseReplay.cpp for details.
+******************************************************************************/
+
+#include <string>
+#include <vector>
+
+class ReplayFile
+{
+public:
+    // Load the whole file. extension: 0 = ATF, 1 = CSV.  isSeconds: (CSV only) the time column is in [s], otherwise [ms].
+    // Returns 0 on success, -2 if the file cannot be opened, -3 if it contains no data.
+    int open(const std::string& filename, int extension, bool isSeconds);
+
+    // Copy the block "dataIndex_loop_num" (SAMPLE_FREQ samples), like readLocal():
+    //   -1: the block is out of range of the file.
+    //    1: normal.
+    //   otherwise: the holding voltage [mV] switched in this block; switchIndex receives the first sample at the new voltage.
+    int read(double* timestamp, double* destination, int dataIndex_loop_num, int* switchIndex) const;
+
+    double startTime() const { return time.empty() ? 0 : time[0]; }
+    int size() const { return (int)time.size(); }
+    // The number of whole blocks in the file.
+    int blocks() const;
+
+private:
+    std::vector<double> time;       // [s]
+    std::vector<double> current;    // [pA]
+    std::vector<double> change_time;    // The holding voltage switches known for the file [s]
+    std::vector<int> change_value;      // [mV]
+};
@@ -0,0 +1,97 @@
+/******************************************************************************
+// SenseSimulated.cpp
+//
+// This code generates the current of a bilayer with independent channels, in place of the amplifier.
+// Since the true number of open channels is known at every sample, the idealizers and the features can be checked
+// against the ground truth, and the whole pipeline can run for hours without hardware.
+//
+//   * Each channel is a two-state Markov chain (closed <-> open) with the given rates, sampled at sample_freq.
+//   * current = baseline + drift * t + (open channels) * current_per_channel + mains + white noise
+//   * The random numbers are generated by xorshift64* and Box-Muller, so the trace depends only on the seed and
+//     read() does not allocate.
+******************************************************************************/
+
+#include "SenseSimulated.h"
+#include <math.h>
+
+static const double PI = 3.14159265358979323846;
+
+SimulationParams defaultSimulationParams() {
+    SimulationParams p;
+    p.channels = 4;
+    p.current_per_channel = -11.5;
+    p.baseline = 0;
+    p.noise_sd = 1.0;
+    p.open_rate = 20;
+    p.close_rate = 20;
+    p.mains_amplitude = 0;
+    p.mains_freq = 50;
+    p.drift = 0;
+    p.seed = 1;
+    return p;
+}
+
+SimulatedAmplifier::SimulatedAmplifier()
+{
+    setup(defaultSimulationParams(), 5000, 5000);
+}
+
+void SimulatedAmplifier::setup(const SimulationParams& params, double sample_freq_arg, int block_size) {
+    p = params;
+    if (p.channels < 0) p.channels = 0;
+    if (p.channels > SIMULATION_MAX_CHANNELS) p.channels = SIMULATION_MAX_CHANNELS;
+    sample_freq = sample_freq_arg;
+    // Exact for a chain sampled at 1 / sample_freq: P(open at t + dt | closed at t) etc. for the total rate.
+    double total = p.open_rate + p.close_rate;
+    double decay = (total > 0) ? 1 - exp(-total / sample_freq) : 0;
+    p_open = (total > 0) ? p.open_rate / total * decay : 0;
+    p_close = (total > 0) ? p.close_rate / total * decay : 0;
+    truth.assign(block_size, 0);
+    reset();
+}
+
+void SimulatedAmplifier::reset() {
+    state = p.seed ? p.seed : 0x9E3779B97F4A7C15ULL;     // xorshift must not start from 0
+    has_spare = false;
+    spare = 0;
+    for (int c = 0; c < SIMULATION_MAX_CHANNELS; c++) open[c] = false;
+    t = 0;
+}
+
+double SimulatedAmplifier::uniform() {
+    state ^= state >> 12;
+    state ^= state << 25;
+    state ^= state >> 27;
+    return ((state * 0x2545F4914F6CDD1DULL) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+double SimulatedAmplifier::gaussian() {
+    if (has_spare) {
+        has_spare = false;
+        return spare;
+    }
+    double u1 = uniform();
+    double u2 = uniform();
+    if (u1 < 1e-300) u1 = 1e-300;
+    double r = sqrt(-2 * log(u1));
+    spare = r * sin(2 * PI * u2);
+    has_spare = true;
+    return r * cos(2 * PI * u2);
+}
+
+void SimulatedAmplifier::read(double* timestamp, double* destination, int block_index, int n) {
+    if (n > (int)truth.size()) n = (int)truth.size();
+    const double w = 2 * PI * p.mains_freq / sample_freq;
+    for (int idx = 0; idx < n; idx++, t++) {
+        int k = 0;
+        for (int c = 0; c < p.channels; c++) {
+            if (uniform() < (open[c] ? p_close : p_open)) open[c] = !open[c];
+            if (open[c]) k++;
+        }
+        truth[idx] = k;
+        double x = p.baseline + p.drift * (t / sample_freq) + k * p.current_per_channel + p.noise_sd * gaussian();
+        if (p.mains_amplitude != 0) x += p.mains_amplitude * sin(w * t);
+        timestamp[idx] = block_index + idx / sample_freq;
+        destination[idx] = x;
+    }
+}
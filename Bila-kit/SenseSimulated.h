@@ -0,0 +1,60 @@
+#pragma once
+
+/******************************************************************************
+* SenseSimulated.h
+*
+* Simulated amplifier: ion channel current with a known ground truth, for the tests and the runs without hardware.
+* See SenseSimulated.cpp for details.
+******************************************************************************/
+
+#include <vector>
+
+#define SIMULATION_MAX_CHANNELS 64
+
+struct SimulationParams {
+    int channels;               // Number of channels in the bilayer (up to SIMULATION_MAX_CHANNELS)
+    double current_per_channel; // Current per single open channel [pA]
+    double baseline;            // Current when all channels are closed [pA]
+    double noise_sd;            // White noise [pA rms]
+    double open_rate;           // Closed -> open rate of each channel [1/s]
+    double close_rate;          // Open -> closed rate of each channel [1/s]
+    double mains_amplitude;     // Amplitude of the mains interference [pA] (0: none)
+    double mains_freq;          // [Hz]
+    double drift;               // Linear drift of the baseline [pA/s]
+    unsigned long long seed;    // Seed of the random numbers (the same seed gives the same trace)
+};
+
+// Default: 4 BK-like channels (-11.5 pA at -40 mV), Po = 0.5, 1 pA rms noise, no interference and no drift.
+SimulationParams defaultSimulationParams();
+
+class SimulatedAmplifier
+{
+public:
+    SimulatedAmplifier();
+
+    // block_size: the maximum number of samples per read() (the ground truth buffer is allocated here only).
+    void setup(const SimulationParams& params, double sample_freq, int block_size);
+    // Restart from the seed with all channels closed.
+    void reset();
+
+    // Generate n (<= block_size) samples, like readAmplifier(): timestamp[idx] = block_index + idx / sample_freq.
+    void read(double* timestamp, double* destination, int block_index, int n);
+
+    // The true number of open channels at each sample of the last read().
+    const int* openChannels() const { return truth.data(); }
+    const SimulationParams& params() const { return p; }
+
+private:
+    double uniform();       // [0, 1)
+    double gaussian();      // Standard normal (Box-Muller)
+
+    SimulationParams p;
+    double sample_freq;
+    double p_open, p_close; // Transition probabilities per sample
+    unsigned long long state;   // xorshift64* state
+    bool has_spare;
+    double spare;
+    bool open[SIMULATION_MAX_CHANNELS];
+    long long t;            // Absolute sample index of the next sample
+    std::vector<int> truth;
+};
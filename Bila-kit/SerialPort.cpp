@@ -0,0 +1,73 @@
+/******************************************************************************
+// SerialPort.cpp
+//
+// This code provides the serial communication of the headless builds (bilakit_cli), in place of qcustomserial.cpp
+// which needs QSerialPort. The Actuation Block (ActuationSerial.cpp) calls the same sendSerial().
+//
+//   * A terminal device (e.g. /dev/ttyACM0 of the Arduino Mega) is configured like qcustomserial.cpp: 9600 baud, 8N1, raw.
+//   * Any other path (a regular file, a FIFO) receives the commands as they are, so that a batch run or a soak test
+//     records what would have been sent to the Arduino.
+//   * On Windows, the headless build has no serial communication.
+******************************************************************************/
+
+#include "MyHelper.h"
+#include <string.h>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+int serialTarget = -1; // -1: no serial, 0: Arduino, 1: Legato180
+#ifndef _WIN32
+static int port = -1;
+#endif
+
+// Open "device" as the Arduino. Returns 0 on success (then serialTarget = 0).
+int setupSerialDevice(const char* device) {
+#ifndef _WIN32
+    closeSerial();
+    port = open(device, O_WRONLY | O_NOCTTY | O_CREAT | O_APPEND, 0644);
+    if (port < 0) return -1;
+    if (isatty(port)) {
+        struct termios tio;
+        if (tcgetattr(port, &tio) == 0) {
+            cfmakeraw(&tio);
+            cfsetispeed(&tio, B9600);
+            cfsetospeed(&tio, B9600);
+            tio.c_cflag &= ~(CSTOPB | PARENB | CSIZE);
+            tio.c_cflag |= CS8 | CLOCAL;
+            tcsetattr(port, TCSANOW, &tio);
+        }
+    }
+    serialTarget = 0;
+    return 0;
+#else
+    return -1;
+#endif
+}
+
+// Send a command to the Arduino (see qcustomserial.cpp for the commands).
+void sendSerial(const char* data) {
+#ifndef _WIN32
+    if (port < 0) return;
+    size_t length = strlen(data);
+    while (length > 0) {
+        ssize_t n = write(port, data, length);
+        if (n <= 0) return;
+        data += n;
+        length -= n;
+    }
+#endif
+}
+
+void sendSerial_pump() {
+}
+
+void closeSerial() {
+#ifndef _WIN32
+    if (port >= 0) close(port);
+    port = -1;
+#endif
+    serialTarget = -1;
+}
@@ -280,10 +280,13 @@ void setup_per_channel_settings(TECELLA_HNDL h)
 ******************************************************************************/
 // This function shows how to program the stimulus for both
 // single stimulus systems and multi stimulus systems.
+static int cached_nstimuli = 0;	// hw_props.nstimuli, cached by setup_stimulus() for setup_hold_voltage().
+
 void setup_stimulus(TECELLA_HNDL h, double voltage)
 {
 	TECELLA_HW_PROPS hw_props;
 	tecella_get_hw_props(h, &hw_props);
+	cached_nstimuli = hw_props.nstimuli;
 
 	wprintf(L"\nSetting up the stimuli...\n");
 
@@ -322,6 +325,33 @@ void setup_stimulus(TECELLA_HNDL h, double voltage)
 }
 
 
+/******************************************************************************
+* Hold voltage - Added (lean version of setup_stimulus for frequent voltage switching.)
+******************************************************************************/
+// This function only reprograms the holding voltage and the stimulus segments.
+// Unlike setup_stimulus(), it neither re-queries the hardware properties, nor prints
+// to the console, nor reads back the programmed stimuli, so that it can be called
+// on the GUI thread while the acquisition is live.
+// setup_stimulus() must be called once beforehand (it is called in setupAmplifier()).
+TECELLA_ERRNUM setup_hold_voltage(TECELLA_HNDL h, double voltage)
+{
+	TECELLA_ERRNUM err = tecella_stimulus_set_hold(h, voltage);
+	if (err) return err;
+
+	const int SEGMENT_COUNT = 3;
+	TECELLA_STIMULUS_SEGMENT stimulus[SEGMENT_COUNT] = {
+		{TECELLA_STIMULUS_SEGMENT_SET, voltage, 0, 250e-3, 0},
+		{TECELLA_STIMULUS_SEGMENT_SET, voltage, 0, 500e-3, 0},
+		{TECELLA_STIMULUS_SEGMENT_SET, voltage, 0, 250e-3, 0},
+	};
+	for (int i = 0; i < cached_nstimuli; ++i) {
+		err = tecella_stimulus_set(h, stimulus, SEGMENT_COUNT, 1, 1, i);
+		if (err) return err;
+	}
+	return TECELLA_ERR_OK;
+}
+
+
 /******************************************************************************
 * Acquire function
 * Acquire WITHOUT Callback  - Modified
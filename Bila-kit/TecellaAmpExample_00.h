@@ -21,6 +21,7 @@ void setup_source_and_gain(TECELLA_HNDL h);
 void setup_auto_compensation(TECELLA_HNDL h);
 void setup_per_channel_settings(TECELLA_HNDL h);
 void setup_stimulus(TECELLA_HNDL h, double voltage = 0.050);
+TECELLA_ERRNUM setup_hold_voltage(TECELLA_HNDL h, double voltage);  // Lean version of setup_stimulus() for switching the holding voltage during acquisition.
 
 void acquire_without_callback(TECELLA_HNDL h, double* timestamp, double* destination);  // Acquire current by blocking manner. (Tecella specific function)
 void acquire_stop(TECELLA_HNDL h);		// Stop acquireing.
\ No newline at end of file
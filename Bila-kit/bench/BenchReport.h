@@ -0,0 +1,95 @@
+#pragma once
+
+/******************************************************************************
+* BenchReport.h
+*
+* Timing and the JSON report of the benchmarks (bench_hotpaths.cpp, bench_replot.cpp).
+* Every iteration is timed separately, so that the latency percentiles are reported beside the throughput.
+******************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <string>
+#include <vector>
+#include <stdio.h>
+
+struct BenchResult {
+    std::string name;
+    double samples;             // Samples processed per iteration (0: not applicable)
+    double bytes;               // Bytes read or written per iteration (0: not applicable)
+    std::vector<double> ns;     // Latency of every iteration [ns], sorted
+    std::string extra;          // Additional JSON members (e.g. "\"max_abs_diff\":0"), or empty
+};
+
+class BenchReport
+{
+public:
+    // Run f() "warmup" times untimed, then "iterations" times timed, and record the result.
+    template <typename F>
+    BenchResult& run(const std::string& name, double samples, double bytes, int iterations, int warmup, F f) {
+        for (int i = 0; i < warmup; i++) f();
+        BenchResult r;
+        r.name = name;
+        r.samples = samples;
+        r.bytes = bytes;
+        r.ns.reserve(iterations);
+        for (int i = 0; i < iterations; i++) {
+            std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+            f();
+            r.ns.push_back(std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - t0).count());
+        }
+        std::sort(r.ns.begin(), r.ns.end());
+        results.push_back(r);
+        print(results.back());
+        return results.back();
+    }
+
+    // One line per result on stdout.
+    static void print(const BenchResult& r) {
+        double mean = mean_ns(r);
+        printf("%-36s %12.1f us  p99 %12.1f us", r.name.c_str(), mean / 1000, percentile(r, 0.99) / 1000);
+        if (r.samples > 0) printf("  %9.3f ns/sample", mean / r.samples);
+        if (r.bytes > 0) printf("  %9.1f MB/s", r.bytes / mean * 1000);
+        printf("\n");
+    }
+
+    // Write all results as {"benchmark": ..., "results": [...]}. Returns false if the file cannot be written.
+    bool writeJSON(const char* path, const char* benchmark) const {
+        FILE* fp = fopen(path, "w");
+        if (!fp) return false;
+        fprintf(fp, "{\n  \"benchmark\": \"%s\",\n  \"results\": [\n", benchmark);
+        for (size_t k = 0; k < results.size(); k++) {
+            const BenchResult& r = results[k];
+            double mean = mean_ns(r);
+            fprintf(fp, "    {\"name\": \"%s\", \"iterations\": %d, \"samples_per_iteration\": %.0f, \"bytes_per_iteration\": %.0f, ",
+                r.name.c_str(), (int)r.ns.size(), r.samples, r.bytes);
+            fprintf(fp, "\"mean_ns\": %.1f, ", mean);
+            if (r.samples > 0) fprintf(fp, "\"ns_per_sample\": %.4f, ", mean / r.samples);
+            else fprintf(fp, "\"ns_per_sample\": null, ");
+            if (r.bytes > 0) fprintf(fp, "\"mb_per_s\": %.3f, ", r.bytes / mean * 1000);
+            else fprintf(fp, "\"mb_per_s\": null, ");
+            fprintf(fp, "\"latency_ns\": {\"min\": %.1f, \"p50\": %.1f, \"p90\": %.1f, \"p99\": %.1f, \"max\": %.1f}",
+                percentile(r, 0), percentile(r, 0.5), percentile(r, 0.9), percentile(r, 0.99), percentile(r, 1));
+            if (!r.extra.empty()) fprintf(fp, ", %s", r.extra.c_str());
+            fprintf(fp, "}%s\n", (k + 1 < results.size()) ? "," : "");
+        }
+        fprintf(fp, "  ]\n}\n");
+        return fclose(fp) == 0;
+    }
+
+    // The q-quantile (0 <= q <= 1) of the sorted latencies, by the nearest rank.
+    static double percentile(const BenchResult& r, double q) {
+        if (r.ns.empty()) return 0;
+        size_t k = (size_t)(q * (r.ns.size() - 1) + 0.5);
+        return r.ns[k];
+    }
+    static double mean_ns(const BenchResult& r) {
+        double s = 0;
+        for (double v : r.ns) s += v;
+        return r.ns.empty() ? 0 : s / r.ns.size();
+    }
+
+private:
+    std::deque<BenchResult> results;    // (The references returned by run() stay valid.)
+};
@@ -0,0 +1,296 @@
+/******************************************************************************
+// bench_hotpaths.cpp
+//
+// Micro- and macro-benchmarks of the hot paths of a 1 s block, reported as JSON (see BenchReport.h) to track the
+// regressions release over release:
+//   * convolve_EDGE (convolve.cpp) against the running-sum and prefix-sum replacements (the outputs are compared).
+//   * The idealizers: threshold (scalar / pre-scan), the nanopore edge detection, HMM and CUSUM.
+//   * Po estimation (ProcessingPoEstimate.cpp).
+//   * The ATF/CSV parsers (SenseReplay.cpp) on the bundled ATF recordings (data/).
+//   * Writing the raw current log: CSV rows, binary, and the enqueue into the export worker (PipelineStages.cpp).
+// The graphs (QCustomPlot::replot()) are benchmarked by bench_replot.cpp, which needs Qt.
+//
+// Usage: bench_hotpaths [--data DIR] [--iterations N] [--json FILE]
+// Returns non-zero if a replacement of convolve_EDGE differs from it, or a data file cannot be parsed.
+******************************************************************************/
+
+#include "BenchReport.h"
+#include "../MyHelper.h"
+#include "../SenseSimulated.h"
+#include "../SenseReplay.h"
+#include "../PipelineStages.h"
+#include "../ProcessingPipeline.h"
+#include "../ProcessingThreshold.h"
+#include "../ProcessingPoEstimate.h"
+#include "../ProcessingHMM.h"
+#include "../ProcessingCUSUM.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const int BLOCK = SAMPLE_FREQ;
+static const int HALF = 150;        // Half width of the kernel of convolve_EDGE (301 taps)
+static const int PREV = 500;        // Samples of the previous block passed to convolve_EDGE (previousCurrent[])
+
+// Replacement 1: the sums of both halves of the kernel are slid by one sample (O(1) per sample).
+static void convolveEdgeRunning(const double* X, double* Y, const double* prevX, int prevX_size) {
+    // x(t) with the padding of convolve_EDGE: the previous block before 0, the last sample after the end.
+    auto x = [&](int t) { return (t < 0) ? prevX[prevX_size + t] : ((t >= BLOCK) ? X[BLOCK - 1] : X[t]); };
+    double left = 0, right = 0;
+    for (int k = 1; k <= HALF; k++) {
+        left += x(-k);
+        right += x(k);
+    }
+    for (int i = 0; i < BLOCK; i++) {
+        Y[i] = (right - left) / (2 * HALF);
+        left += x(i) - x(i - HALF);
+        right += x(i + HALF + 1) - x(i + 1);
+    }
+}
+
+// Replacement 2: the differences of the prefix sums of the padded signal (O(1) per sample, no branch in the loop).
+static void convolveEdgePrefix(const double* X, double* Y, const double* prevX, int prevX_size, std::vector<double>* prefix) {
+    // prefix[k] = sum of the padded signal from t = -HALF - 1 to t = k - HALF - 2.
+    std::vector<double>& P = *prefix;
+    P.resize(BLOCK + 2 * HALF + 2);
+    P[0] = 0;
+    for (int k = 1; k < (int)P.size(); k++) {
+        int t = k - HALF - 2;
+        double v = (t < 0) ? prevX[prevX_size + t] : ((t >= BLOCK) ? X[BLOCK - 1] : X[t]);
+        P[k] = P[k - 1] + v;
+    }
+    for (int i = 0; i < BLOCK; i++) {
+        // right: t = i + 1 .. i + HALF,  left: t = i - HALF .. i - 1
+        double right = P[i + HALF + 2 + HALF] - P[i + HALF + 2];
+        double left = P[i + HALF + 1] - P[i + 1];
+        Y[i] = (right - left) / (2 * HALF);
+    }
+}
+
+static double maxAbsDiff(const double* a, const double* b, int n) {
+    double m = 0;
+    for (int i = 0; i < n; i++) m = fmax(m, fabs(a[i] - b[i]));
+    return m;
+}
+
+int main(int argc, char** argv) {
+    std::string data_dir = "data";
+    std::string json_path = "bench_hotpaths.json";
+    int iterations = 200;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) data_dir = argv[++i];
+        else if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) json_path = argv[++i];
+        else {
+            fprintf(stderr, "Usage: bench_hotpaths [--data DIR] [--iterations N] [--json FILE]\n");
+            return 2;
+        }
+    }
+    if (iterations < 1) iterations = 1;
+    const int warmup = (iterations + 9) / 10;
+    BenchReport report;
+    int failures = 0;
+    volatile double sink = 0;
+
+    // ****** Test signals: 4 BK channels at -40 mV, and AHL nanopores inserting at +50 mV (1 pA rms noise).
+    SimulatedAmplifier amplifier;
+    SimulationParams bk = defaultSimulationParams();
+    amplifier.setup(bk, SAMPLE_FREQ, BLOCK);
+    std::vector<double> time(BLOCK), bkCurrent(BLOCK), bkPrevious(BLOCK);
+    amplifier.read(time.data(), bkPrevious.data(), 0, BLOCK);
+    amplifier.read(time.data(), bkCurrent.data(), 1, BLOCK);
+    SimulationParams ahl = defaultSimulationParams();
+    ahl.current_per_channel = 0.89 * 50;
+    ahl.open_rate = 0.5;
+    ahl.close_rate = 0.05;
+    amplifier.setup(ahl, SAMPLE_FREQ, BLOCK);
+    std::vector<double> ahlCurrent(BLOCK), ahlPrevious(BLOCK);
+    amplifier.read(time.data(), ahlPrevious.data(), 0, BLOCK);
+    amplifier.read(time.data(), ahlCurrent.data(), 1, BLOCK);
+    const double* prev = ahlPrevious.data() + BLOCK - PREV;
+
+    // ****** convolve_EDGE and the replacements
+    std::vector<double> edge(BLOCK), edgeRunning(BLOCK), edgePrefix(BLOCK), prefix;
+    report.run("convolve_EDGE/current", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        convolve_EDGE(ahlCurrent.data(), edge.data(), (double*)prev, PREV);
+    });
+    BenchResult& running = report.run("convolve_EDGE/running_sum", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        convolveEdgeRunning(ahlCurrent.data(), edgeRunning.data(), prev, PREV);
+    });
+    BenchResult& prefixed = report.run("convolve_EDGE/prefix_sum", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        convolveEdgePrefix(ahlCurrent.data(), edgePrefix.data(), prev, PREV, &prefix);
+    });
+    double diff[2] = { maxAbsDiff(edge.data(), edgeRunning.data(), BLOCK), maxAbsDiff(edge.data(), edgePrefix.data(), BLOCK) };
+    char extra[64];
+    snprintf(extra, sizeof(extra), "\"max_abs_diff\": %.3e", diff[0]);
+    running.extra = extra;
+    snprintf(extra, sizeof(extra), "\"max_abs_diff\": %.3e", diff[1]);
+    prefixed.extra = extra;
+    for (int k = 0; k < 2; k++) {
+        // The edge filter output is compared against detection thresholds of several pA: 1e-9 pA is far below them.
+        if (!(diff[k] < 1e-9)) {
+            printf("convolve_EDGE replacement %d differs by %e [pA]\n", k + 1, diff[k]);
+            failures++;
+        }
+    }
+
+    // ****** Idealizers
+    std::vector<int> idealized(BLOCK);
+    ThresholdParams tp;
+    tp.baseline = 0;
+    tp.current_per_channel = bk.current_per_channel;
+    tp.threshold = 0.75;
+    tp.max_open = -1;
+    tp.abort_lower = -300;
+    tp.abort_upper = 300;
+    report.run("idealize/threshold_scalar", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        int last = 0;
+        sink = sink + idealizeThresholdScalar(bkCurrent.data(), idealized.data(), BLOCK, tp, &last);
+    });
+    report.run("idealize/threshold", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        int last = 0;
+        sink = sink + idealizeThreshold(bkCurrent.data(), idealized.data(), BLOCK, tp, &last);
+    });
+    PipelineParams pp;
+    pp.baseline = 0;
+    pp.current_per_channel = ahl.current_per_channel;
+    pp.threshold = 0.75;
+    pp.detection_threshold = 0.15;
+    pp.max_open = -1;
+    pp.rupture_threshold = 300;
+    pp.cage_threshold = 80;
+    std::vector<int> ahlIdealized(BLOCK);
+    report.run("idealize/nanopore_edge", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        PipelineState state = { 0, 0 };
+        sink = sink + runIdealization(0, 0, ahlCurrent.data(), edge.data(), ahlIdealized.data(), BLOCK, pp, &state);
+    });
+    HMMIdealizer hmm;
+    hmm.reset(bk.channels, SAMPLE_FREQ);
+    hmm.setLevels(0, bk.current_per_channel);
+    std::vector<int> hmmIdealized(BLOCK);
+    report.run("idealize/hmm", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        hmm.idealize(bkCurrent.data(), hmmIdealized.data(), BLOCK, true);
+    });
+    CUSUMDetector cusum;
+    cusum.setup(0.5 * ahl.current_per_channel, 10, SAMPLE_FREQ);
+    StepEvent events[CUSUM_MAX_EVENTS];
+    report.run("idealize/cusum", BLOCK, BLOCK * sizeof(double), iterations, warmup, [&]() {
+        cusum.reset();
+        sink = sink + cusum.process(ahlCurrent.data(), BLOCK, events, CUSUM_MAX_EVENTS);
+    });
+
+    // ****** Po estimation (on the threshold idealization of the BK block)
+    int last = 0;
+    idealizeThreshold(bkCurrent.data(), idealized.data(), BLOCK, tp, &last);
+    report.run("po_estimate/free_n", BLOCK, BLOCK * sizeof(int), iterations, warmup, [&]() {
+        sink = sink + estimateOpenProbability(idealized.data(), 0, BLOCK).opProb;
+    });
+    report.run("po_estimate/fixed_n", BLOCK, BLOCK * sizeof(int), iterations, warmup, [&]() {
+        sink = sink + estimateOpenProbability(idealized.data(), 0, BLOCK, bk.channels).opProb;
+    });
+
+    // ****** Parsers on the bundled recordings
+    static const char* const FILES[] = { "minus20mV.atf", "minus40mV.atf", "minus60mV.atf", "plus20mV.atf", "plus30mV.atf", "plus40mV.atf", "plus60mV.atf" };
+    const int parse_iterations = (iterations + 19) / 20;
+    std::vector<double> csvTime, csvCurrent;
+    for (const char* name : FILES) {
+        std::string path = data_dir + "/" + name;
+        FILE* fp = fopen(path.c_str(), "rb");
+        if (!fp) {
+            printf("%s: not found\n", path.c_str());
+            failures++;
+            continue;
+        }
+        fseek(fp, 0, SEEK_END);
+        double bytes = (double)ftell(fp);
+        fclose(fp);
+        ReplayFile replay;
+        if (replay.open(path, 0, true) != 0) {
+            printf("%s: cannot be parsed\n", path.c_str());
+            failures++;
+            continue;
+        }
+        report.run(std::string("parse_atf/") + name, replay.size(), bytes, parse_iterations, 1, [&]() {
+            ReplayFile r;
+            sink = sink + r.open(path, 0, true);
+        });
+        if (csvTime.empty()) {
+            // The first recording is also converted to CSV for the CSV parser.
+            std::vector<double> t(BLOCK), c(BLOCK);
+            int switchIndex;
+            for (int b = 0; b < replay.blocks(); b++) {
+                replay.read(t.data(), c.data(), b, &switchIndex);
+                csvTime.insert(csvTime.end(), t.begin(), t.end());
+                csvCurrent.insert(csvCurrent.end(), c.begin(), c.end());
+            }
+        }
+    }
+    if (!csvTime.empty()) {
+        const char* csv_path = "bench_hotpaths_parse.csv";
+        FILE* fp = fopen(csv_path, "w");
+        if (fp) {
+            fprintf(fp, "time [s],current [pA]\n");
+            for (size_t k = 0; k < csvTime.size(); k++) fprintf(fp, "%lf,%lf\n", csvTime[k], csvCurrent[k]);
+            double bytes = (double)ftell(fp);
+            fclose(fp);
+            report.run("parse_csv", (double)csvTime.size(), bytes, parse_iterations, 1, [&]() {
+                ReplayFile r;
+                sink = sink + r.open(csv_path, 1, true);
+            });
+            remove(csv_path);
+        }
+    }
+
+    // ****** Writing the raw current log of a block (as the amplifier acquisition does)
+    std::string rows;
+    rows.reserve(BLOCK * 32);
+    const char* csv_log = "bench_hotpaths_log.csv";
+    const char* bin_log = "bench_hotpaths_log.bin";
+    FILE* csv_fp = fopen(csv_log, "w");
+    FILE* bin_fp = fopen(bin_log, "wb");
+    if (csv_fp && bin_fp) {
+        rows.clear();
+        for (int idx = 0; idx < BLOCK; idx++) appendf(&rows, "%lf,%lf\n", time[idx], bkCurrent[idx]);
+        report.run("log/csv_format", BLOCK, (double)rows.size(), iterations, warmup, [&]() {
+            rows.clear();
+            for (int idx = 0; idx < BLOCK; idx++) appendf(&rows, "%lf,%lf\n", time[idx], bkCurrent[idx]);
+        });
+        report.run("log/csv_format_write", BLOCK, (double)rows.size(), iterations, warmup, [&]() {
+            rows.clear();
+            for (int idx = 0; idx < BLOCK; idx++) appendf(&rows, "%lf,%lf\n", time[idx], bkCurrent[idx]);
+            fwrite(rows.data(), 1, rows.size(), csv_fp);
+        });
+        report.run("log/binary_write", BLOCK, 2.0 * BLOCK * sizeof(double), iterations, warmup, [&]() {
+            fwrite(time.data(), sizeof(double), BLOCK, bin_fp);
+            fwrite(bkCurrent.data(), sizeof(double), BLOCK, bin_fp);
+        });
+    }
+    if (csv_fp) fclose(csv_fp);
+    if (bin_fp) fclose(bin_fp);
+    remove(csv_log);
+    remove(bin_log);
+    {
+        // The cost on the GUI thread: the rows are handed to the export worker, which writes them meanwhile.
+        ExportStage exporter;
+        exporter.start(iterations + warmup + 1, (int)rows.size() + 1);
+        exporter.append(csv_log, "time [s],current [pA]\n", true);
+        report.run("log/export_stage_append", BLOCK, (double)rows.size(), iterations, warmup, [&]() {
+            exporter.append(csv_log, rows);
+        });
+        exporter.flush();
+        exporter.stop();
+        remove(csv_log);
+    }
+
+    if (!report.writeJSON(json_path.c_str(), "bench_hotpaths")) {
+        printf("Unable to write %s\n", json_path.c_str());
+        failures++;
+    }
+    else {
+        printf("Written to %s\n", json_path.c_str());
+    }
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,130 @@
+/******************************************************************************
+// bench_pipeline.cpp
+//
+// Benchmark of the specialized processing pipelines (ProcessingPipeline.cpp) against the generic loop,
+// for every protein policy and polarity on synthetic 1 s blocks (5000 samples).
+// The outputs are also compared, and the program returns non-zero if they differ.
+******************************************************************************/
+
+#include "../ProcessingPipeline.h"
+#include <chrono>
+#include <random>
+#include <stdio.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const int BLOCK = 5000;
+static const int ROUNDS = 7;
+
+struct BenchCase {
+    const char* name;
+    int proteinType;
+    int BKstimuli;
+    double current_per_channel;
+    int channels;
+};
+
+// Telegraph signal (ion channels) or a staircase of insertions (nanopores) with Gaussian noise.
+static void makeBlock(std::mt19937& rng, const BenchCase& c, std::vector<double>& current, std::vector<double>& filtered) {
+    std::normal_distribution<double> gauss(0, 0.15 * fabs(c.current_per_channel));
+    std::uniform_real_distribution<double> uni(0, 1);
+    current.resize(BLOCK);
+    filtered.resize(BLOCK);
+    int k = 0;
+    for (int idx = 0; idx < BLOCK; idx++) {
+        if (c.proteinType == 0) {
+            if (idx % 1200 == 600 && k < c.channels) k++;
+        }
+        else {
+            for (int ch = 0; ch < c.channels; ch++) if (uni(rng) < 0.002) k += (uni(rng) < 0.5) ? 1 : -1;
+            if (k < 0) k = 0;
+            if (k > c.channels) k = c.channels;
+        }
+        current[idx] = k * c.current_per_channel + gauss(rng);
+    }
+    // Edge filter (the difference of the means of 150 samples on both sides, as convolve_EDGE).
+    const int half = 150;
+    for (int idx = 0; idx < BLOCK; idx++) {
+        double s = 0;
+        for (int j = 1; j <= half; j++) {
+            int a = idx + j < BLOCK ? idx + j : BLOCK - 1;
+            int b = idx - j >= 0 ? idx - j : 0;
+            s += current[a] - current[b];
+        }
+        filtered[idx] = s / (2 * half);
+    }
+}
+
+int main(int argc, char** argv) {
+    int repeat = 2000;
+    if (argc > 1) repeat = atoi(argv[1]);
+    const BenchCase cases[] = {
+        { "nanopore +", 0, 0, 44.5, 4 },
+        { "nanopore -", 0, 0, -44.5, 4 },
+        { "ion channel +", 1, 0, 11.5, 4 },
+        { "ion channel -", 1, 0, -11.5, 4 },
+        { "inhibitor +", 1, 1, 11.5, 1 },
+        { "inhibitor -", 1, 1, -11.5, 1 },
+    };
+    std::mt19937 rng(1234);
+    int failures = 0;
+    printf("%-16s %14s %14s %8s\n", "case", "generic [us]", "special [us]", "speedup");
+    for (const BenchCase& c : cases) {
+        std::vector<double> current, filtered;
+        makeBlock(rng, c, current, filtered);
+        PipelineParams p;
+        p.baseline = 0;
+        p.current_per_channel = c.current_per_channel;
+        p.threshold = 0.75;
+        p.detection_threshold = 0.15;
+        p.max_open = (c.BKstimuli == 1) ? 1 : -1;
+        p.rupture_threshold = 300;
+        p.cage_threshold = 80;
+        std::vector<int> out_generic(BLOCK, -1), out_special(BLOCK, -1);
+
+        // Correctness
+        PipelineState s_generic = { 0, 0 }, s_special = { 0, 0 };
+        PipelineFeatures f_generic = emptyFeatures(), f_special = emptyFeatures();
+        int n_generic = runIdealizationGeneric(c.proteinType, c.BKstimuli, current.data(), filtered.data(), out_generic.data(), BLOCK, p, &s_generic);
+        int n_special = runIdealization(c.proteinType, c.BKstimuli, current.data(), filtered.data(), out_special.data(), BLOCK, p, &s_special);
+        runFeaturesGeneric(c.proteinType, current.data(), out_generic.data(), 50, n_generic, &f_generic);
+        runFeatures(c.proteinType, current.data(), out_special.data(), 50, n_special, &f_special);
+        if (n_generic != n_special || memcmp(out_generic.data(), out_special.data(), sizeof(int) * BLOCK) != 0
+            || s_generic.lastOpenNumber != s_special.lastOpenNumber || s_generic.on_detection != s_special.on_detection
+            || f_generic.maxOpenNumber != f_special.maxOpenNumber || f_generic.zero_num != f_special.zero_num || f_generic.one_num != f_special.one_num
+            || f_generic.zero_sum != f_special.zero_sum || f_generic.one_sum != f_special.one_sum) {
+            printf("%-16s MISMATCH\n", c.name);
+            failures++;
+            continue;
+        }
+
+        // Timing (idealization + features per block): the best of ROUNDS rounds, the two paths alternating, so that a
+        // burst of the other load of the machine does not decide the comparison.
+        double us[2] = { HUGE_VAL, HUGE_VAL };
+        for (int round = 0; round < ROUNDS * 2; round++) {
+            const int mode = round % 2;
+            volatile int sink = 0;
+            auto t0 = std::chrono::steady_clock::now();
+            for (int r = 0; r < repeat; r++) {
+                PipelineState s = { 0, 0 };
+                PipelineFeatures f = emptyFeatures();
+                int* out = mode ? out_special.data() : out_generic.data();
+                if (mode) {
+                    int n = runIdealization(c.proteinType, c.BKstimuli, current.data(), filtered.data(), out, BLOCK, p, &s);
+                    runFeatures(c.proteinType, current.data(), out, 50, n, &f);
+                }
+                else {
+                    int n = runIdealizationGeneric(c.proteinType, c.BKstimuli, current.data(), filtered.data(), out, BLOCK, p, &s);
+                    runFeaturesGeneric(c.proteinType, current.data(), out, 50, n, &f);
+                }
+                sink += f.maxOpenNumber;
+            }
+            double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count() / repeat * 1e6;
+            if (t < us[mode]) us[mode] = t;
+        }
+        printf("%-16s %14.2f %14.2f %7.2fx\n", c.name, us[0], us[1], us[0] / us[1]);
+    }
+    return failures ? 1 : 0;
+}
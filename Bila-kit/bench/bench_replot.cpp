@@ -0,0 +1,94 @@
+/******************************************************************************
+// bench_replot.cpp
+//
+// Benchmark of QCustomPlot::replot() with the point counts of the GUI, reported as JSON (see BenchReport.h).
+// The graphs are set up like MyMain::initialize_graphs(): the raw current and the idealized data keep up to 240 s
+// (1.2 M points) before the buffers are cleared, while 8 s are shown; the PSD has 2049 bins on log-log axes.
+// Runs on the "offscreen" platform unless QT_QPA_PLATFORM is set. Needs Qt (BILAKIT_BUILD_GUI).
+//
+// Usage: bench_replot [--iterations N] [--json FILE]
+******************************************************************************/
+
+#include "BenchReport.h"
+#include "../MyHelper.h"
+#include "../qcustomplot.h"
+#include <QApplication>
+#include <math.h>
+#include <random>
+#include <string.h>
+
+int main(int argc, char** argv) {
+    std::string json_path = "bench_replot.json";
+    int iterations = 50;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--iterations") == 0 && i + 1 < argc) iterations = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) json_path = argv[++i];
+    }
+    if (iterations < 1) iterations = 1;
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) qputenv("QT_QPA_PLATFORM", "offscreen");
+    QApplication app(argc, argv);
+    BenchReport report;
+    std::mt19937 rng(1234);
+    std::normal_distribution<double> gauss(0, 1);
+
+    // ****** The raw current (above) and the idealized data (below), 1000 x 250 pixels each.
+    const int SECONDS[] = { 8, 60, 240 };
+    for (int seconds : SECONDS) {
+        QCustomPlot raw, idealized;
+        raw.resize(1000, 250);
+        idealized.resize(1000, 250);
+        raw.addGraph();
+        raw.graph(0)->setPen(QPen(QColor(40, 110, 255)));
+        raw.axisRect()->setupFullAxesBox();
+        raw.yAxis->setRange(-60, 5);
+        idealized.addGraph();
+        idealized.graph(0)->setPen(QPen(QColor(255, 110, 40), 1));
+        idealized.axisRect()->setupFullAxesBox();
+        idealized.yAxis->setRange(-1, 5);
+        int open = 0;
+        for (int idx = 0; idx < seconds * SAMPLE_FREQ; idx++) {
+            double t = (double)idx / SAMPLE_FREQ;
+            if (rng() % 500 == 0) open = (int)(rng() % 5);
+            raw.graph(0)->addData(t, -11.5 * open + gauss(rng));
+            idealized.graph(0)->addData(t, open);
+        }
+        raw.xAxis->setRange(seconds - 8, 8);
+        idealized.xAxis->setRange(seconds - 8, 8);
+        double points = (double)seconds * SAMPLE_FREQ;
+        report.run("replot/raw_" + std::to_string(seconds) + "s", points, 0, iterations, 2, [&]() {
+            raw.replot(QCustomPlot::rpImmediateRefresh);
+        });
+        report.run("replot/idealized_" + std::to_string(seconds) + "s", points, 0, iterations, 2, [&]() {
+            idealized.replot(QCustomPlot::rpImmediateRefresh);
+        });
+    }
+
+    // ****** The PSD (log-log), 4096-point segments.
+    QCustomPlot psd;
+    psd.resize(1000, 250);
+    psd.addGraph();
+    psd.graph(0)->setPen(QPen(QColor(40, 160, 80)));
+    psd.xAxis->setScaleType(QCPAxis::stLogarithmic);
+    psd.xAxis->setTicker(QSharedPointer<QCPAxisTickerLog>(new QCPAxisTickerLog));
+    psd.yAxis->setScaleType(QCPAxis::stLogarithmic);
+    psd.yAxis->setTicker(QSharedPointer<QCPAxisTickerLog>(new QCPAxisTickerLog));
+    psd.axisRect()->setupFullAxesBox();
+    QVector<double> freq, power;
+    for (int k = 1; k <= 2048; k++) {
+        freq.push_back(k * (double)SAMPLE_FREQ / 4096);
+        power.push_back(1e-3 / freq.back() * exp(0.2 * gauss(rng)));
+    }
+    psd.graph(0)->setData(freq, power, true);
+    psd.xAxis->setRange(1, SAMPLE_FREQ / 2);
+    psd.yAxis->setRange(1e-7, 1e-2);
+    report.run("replot/psd", freq.size(), 0, iterations, 2, [&]() {
+        psd.replot(QCustomPlot::rpImmediateRefresh);
+    });
+
+    if (!report.writeJSON(json_path.c_str(), "bench_replot")) {
+        printf("Unable to write %s\n", json_path.c_str());
+        return 1;
+    }
+    printf("Written to %s\n", json_path.c_str());
+    return 0;
+}
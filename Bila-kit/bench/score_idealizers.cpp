@@ -0,0 +1,345 @@
+/******************************************************************************
+// score_idealizers.cpp
+//
+// Accuracy versus speed of the idealization engines on simulated traces with the exact ground truth (SenseSimulated.cpp),
+// swept over the S/N ratio, the kinetics and the number of channels, for each protein:
+//   * Ion channels (BK-like, -11.5 pA): threshold, threshold after the 1 kHz Gaussian filter, HMM and CUSUM (1 ms).
+//   * Nanopores (AHL-like, +44.5 pA, insertions which seldom leave): the edge detection (convolve_EDGE), CUSUM (10 ms)
+//     and threshold.
+// The engines are called as in ProcessingBlock.cpp, block by block, with the baseline and the current per channel known
+// (the corrections and the adaptive thresholds are not part of the score). For the ion channels, the number of channels is
+// also known ("max open" of the GUI, and N of the HMM).
+//
+// Scores of each engine and condition:
+//   * precision / recall of the transitions: a detected unit step matches a true one of the same direction within
+//     the tolerance (--tolerance-ms, one to one, in time order). F1 is their harmonic mean.
+//   * timing error: the mean |detected - true| time of the matched transitions [ms].
+//   * Po bias (ion channels): mean(idealized) / N - mean(truth) / N. Level bias (nanopores): mean(idealized - truth).
+//   * Msamples/s of the engine alone.
+// The engines are compared in a Pareto table (F1 against speed) per protein, and for each S/N ratio, the fastest engine
+// whose worst F1 (over the kinetics and the channel counts) meets --min-f1 is reported.
+//
+// Usage: score_idealizers [--quick] [--seconds S] [--tolerance-ms T] [--min-f1 F] [--csv FILE]
+******************************************************************************/
+
+#include "../MyHelper.h"
+#include "../SenseSimulated.h"
+#include "../ProcessingThreshold.h"
+#include "../ProcessingPipeline.h"
+#include "../ProcessingFilter.h"
+#include "../ProcessingHMM.h"
+#include "../ProcessingCUSUM.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const int BLOCK = SAMPLE_FREQ;
+
+enum Engine { ENGINE_THRESHOLD, ENGINE_THRESHOLD_GAUSS, ENGINE_HMM, ENGINE_CUSUM_FAST, ENGINE_EDGE, ENGINE_CUSUM, NUM_ENGINES };
+static const char* const ENGINE_NAMES[NUM_ENGINES] = { "threshold", "threshold+gauss1k", "hmm", "cusum(1ms)", "edge", "cusum(10ms)" };
+
+struct Condition {
+    int proteinType;        // 0: nanopores, 1: ion channels
+    double snr;             // |current per channel| / noise [-]
+    double open_rate;       // [1/s]
+    double close_rate;      // [1/s]
+    int channels;
+};
+
+struct Score {
+    int truth_transitions;
+    int detected_transitions;
+    int matched;
+    double timing_error_ms;     // Mean |error| of the matched transitions
+    double bias;                // Po bias (ion channels) or level bias (nanopores)
+    double msamples_per_s;
+    double precision() const { return detected_transitions ? (double)matched / detected_transitions : (truth_transitions ? 0 : 1); }
+    double recall() const { return truth_transitions ? (double)matched / truth_transitions : 1; }
+    double f1() const {
+        double p = precision(), r = recall();
+        return (p + r > 0) ? 2 * p * r / (p + r) : 0;
+    }
+};
+
+// Unit steps of a level trace: the index of the first sample at the new level, for each direction.
+// Samples < 0 (not idealized) neither start nor end a step.
+static void transitions(const std::vector<int>& level, std::vector<int>* up, std::vector<int>* down) {
+    up->clear();
+    down->clear();
+    for (size_t i = 1; i < level.size(); i++) {
+        if (level[i] < 0 || level[i - 1] < 0 || level[i] == level[i - 1]) continue;
+        int d = level[i] - level[i - 1];
+        for (int k = 0; k < abs(d); k++) (d > 0 ? up : down)->push_back((int)i);
+    }
+}
+
+// Match the detected steps to the true ones within "tolerance" samples, one to one in time order.
+static void matchTransitions(const std::vector<int>& truth, const std::vector<int>& detected, int tolerance, int* matched, double* error_sum) {
+    size_t i = 0, j = 0;
+    while (i < truth.size() && j < detected.size()) {
+        int d = detected[j] - truth[i];
+        if (abs(d) <= tolerance) {
+            (*matched)++;
+            *error_sum += abs(d);
+            i++;
+            j++;
+        }
+        else if (d < 0) {
+            j++;    // A false detection
+        }
+        else {
+            i++;    // A missed transition
+        }
+    }
+}
+
+// Run one engine over the whole trace, block by block. Returns the elapsed time [s].
+static double runEngine(int engine, const Condition& c, double current_per_channel, const std::vector<double>& trace, std::vector<int>* out) {
+    const int blocks = (int)trace.size() / BLOCK;
+    out->assign(trace.size(), -1);
+    std::vector<double> block(BLOCK), filtered(BLOCK), previous(500, 0.0);
+    ThresholdParams tp;
+    tp.baseline = 0;
+    tp.current_per_channel = current_per_channel;
+    tp.threshold = 0.75;
+    tp.max_open = (c.proteinType == 1) ? c.channels : -1;
+    tp.abort_lower = -1e9;  // (No rupture in the simulated traces.)
+    tp.abort_upper = 1e9;
+    PipelineParams pp;
+    pp.baseline = 0;
+    pp.current_per_channel = current_per_channel;
+    pp.threshold = 0.75;
+    pp.detection_threshold = 0.15;
+    pp.max_open = tp.max_open;
+    pp.rupture_threshold = 1e9;
+    pp.cage_threshold = 1e9;
+    PipelineState state = { 0, 0 };
+    LowPassFilter filter;
+    filter.setup(FILTER_GAUSSIAN, 1000, SAMPLE_FREQ);
+    const int filter_delay = (int)floor(filter.delay() + 0.5);
+    HMMIdealizer hmm;
+    hmm.reset(c.channels, SAMPLE_FREQ);
+    hmm.setLevels(0, current_per_channel);
+    CUSUMDetector cusum;
+    cusum.setup(0.5 * current_per_channel, (engine == ENGINE_CUSUM_FAST) ? 1 : 10, SAMPLE_FREQ);
+    StepEvent events[CUSUM_MAX_EVENTS];
+    int lastOpenNumber = 0;
+
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    for (int b = 0; b < blocks; b++) {
+        int* dest = out->data() + (size_t)b * BLOCK;
+        for (int idx = 0; idx < BLOCK; idx++) block[idx] = trace[(size_t)b * BLOCK + idx];
+        switch (engine) {
+        case ENGINE_THRESHOLD:
+            idealizeThreshold(block.data(), dest, BLOCK, tp, &lastOpenNumber);
+            break;
+        case ENGINE_THRESHOLD_GAUSS:
+            filter.process(block.data(), block.data(), BLOCK);
+            idealizeThreshold(block.data(), dest, BLOCK, tp, &lastOpenNumber);
+            break;
+        case ENGINE_HMM:
+            hmm.idealize(block.data(), dest, BLOCK);
+            break;
+        case ENGINE_CUSUM_FAST:
+        case ENGINE_CUSUM: {
+            // As ProcessingBlock.cpp: each step is converted to the change of the number of channels.
+            int num_events = cusum.process(block.data(), BLOCK, events, CUSUM_MAX_EVENTS);
+            int filled = 0;
+            for (int e = 0; e < num_events; e++) {
+                int pos = events[e].index;
+                if (pos < filled) pos = filled;
+                for (; filled < pos; filled++) dest[filled] = lastOpenNumber;
+                lastOpenNumber += (int)floor(events[e].amplitude / current_per_channel + 0.5);
+                if (lastOpenNumber < 0) lastOpenNumber = 0;
+                if (tp.max_open >= 0 && lastOpenNumber > tp.max_open) lastOpenNumber = tp.max_open;
+            }
+            for (; filled < BLOCK; filled++) dest[filled] = lastOpenNumber;
+            break;
+        }
+        case ENGINE_EDGE:
+            convolve_EDGE(block.data(), filtered.data(), previous.data(), 500);
+            runIdealization(0, 0, block.data(), filtered.data(), dest, BLOCK, pp, &state);
+            for (int idx = 0; idx < 500; idx++) previous[idx] = block[BLOCK - 500 + idx];
+            break;
+        }
+    }
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    if (engine == ENGINE_THRESHOLD_GAUSS && filter_delay > 0) {
+        // The constant delay of the filter is compensated, as the offline analysis would.
+        out->erase(out->begin(), out->begin() + filter_delay);
+        out->insert(out->end(), filter_delay, -1);
+    }
+    return elapsed;
+}
+
+static Score scoreCondition(int engine, const Condition& c, int seconds, int tolerance, unsigned long long seed) {
+    SimulationParams sim = defaultSimulationParams();
+    sim.channels = c.channels;
+    sim.current_per_channel = (c.proteinType == 0) ? 0.89 * 50 : -11.5;
+    sim.noise_sd = fabs(sim.current_per_channel) / c.snr;
+    sim.open_rate = c.open_rate;
+    sim.close_rate = c.close_rate;
+    sim.seed = seed;
+    SimulatedAmplifier amplifier;
+    amplifier.setup(sim, SAMPLE_FREQ, BLOCK);
+    std::vector<double> trace((size_t)seconds * BLOCK), time(BLOCK);
+    std::vector<int> truth((size_t)seconds * BLOCK);
+    for (int b = 0; b < seconds; b++) {
+        amplifier.read(time.data(), trace.data() + (size_t)b * BLOCK, b, BLOCK);
+        memcpy(truth.data() + (size_t)b * BLOCK, amplifier.openChannels(), sizeof(int) * BLOCK);
+    }
+
+    std::vector<int> idealized;
+    double elapsed = runEngine(engine, c, sim.current_per_channel, trace, &idealized);
+
+    Score s;
+    std::vector<int> truth_up, truth_down, det_up, det_down;
+    transitions(truth, &truth_up, &truth_down);
+    transitions(idealized, &det_up, &det_down);
+    s.truth_transitions = (int)(truth_up.size() + truth_down.size());
+    s.detected_transitions = (int)(det_up.size() + det_down.size());
+    s.matched = 0;
+    double error_sum = 0;
+    matchTransitions(truth_up, det_up, tolerance, &s.matched, &error_sum);
+    matchTransitions(truth_down, det_down, tolerance, &s.matched, &error_sum);
+    s.timing_error_ms = s.matched ? error_sum / s.matched * 1000.0 / SAMPLE_FREQ : 0;
+    double sum_idealized = 0, sum_truth = 0;
+    long long n = 0;
+    for (size_t i = 0; i < truth.size(); i++) {
+        if (idealized[i] < 0) continue;
+        sum_idealized += idealized[i];
+        sum_truth += truth[i];
+        n++;
+    }
+    double scale = (c.proteinType == 1) ? 1.0 / c.channels : 1.0;
+    s.bias = n ? (sum_idealized - sum_truth) / n * scale : NAN;
+    s.msamples_per_s = trace.size() / elapsed / 1e6;
+    return s;
+}
+
+int main(int argc, char** argv) {
+    int seconds = 20;
+    double tolerance_ms = 2;
+    double min_f1 = 0.9;
+    bool quick = false;
+    std::string csv_path;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--quick") == 0) quick = true;
+        else if (strcmp(argv[i], "--seconds") == 0 && i + 1 < argc) seconds = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--tolerance-ms") == 0 && i + 1 < argc) tolerance_ms = atof(argv[++i]);
+        else if (strcmp(argv[i], "--min-f1") == 0 && i + 1 < argc) min_f1 = atof(argv[++i]);
+        else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) csv_path = argv[++i];
+        else {
+            fprintf(stderr, "Usage: score_idealizers [--quick] [--seconds S] [--tolerance-ms T] [--min-f1 F] [--csv FILE]\n");
+            return 2;
+        }
+    }
+    if (quick) seconds = 2;
+    if (seconds < 1) seconds = 1;
+    const int tolerance = (int)(tolerance_ms * SAMPLE_FREQ / 1000 + 0.5);
+
+    // ****** The sweep: S/N x kinetics x channels for each protein.
+    std::vector<Condition> conditions;
+    const double channel_snr[] = { 2, 4, 8 };
+    const double channel_rate[] = { 3, 30, 300 };     // Opening = closing rate [1/s] (Po = 0.5)
+    const int channel_n[] = { 1, 2, 4 };
+    const double pore_snr[] = { 4, 8, 16 };
+    const double pore_rate[] = { 0.5, 2 };             // Insertion rate per pore [1/s] (leaving at the half rate)
+    const int pore_n[] = { 2, 4 };
+    for (double snr : channel_snr) for (double rate : channel_rate) for (int n : channel_n) {
+        if (quick && (n != 2 || rate != 30)) continue;
+        conditions.push_back({ 1, snr, rate, rate, n });
+    }
+    for (double snr : pore_snr) for (double rate : pore_rate) for (int n : pore_n) {
+        if (quick && (n != 2 || rate != 2)) continue;
+        conditions.push_back({ 0, snr, rate, 0.5 * rate, n });
+    }
+    const int channel_engines[] = { ENGINE_THRESHOLD, ENGINE_THRESHOLD_GAUSS, ENGINE_HMM, ENGINE_CUSUM_FAST };
+    const int pore_engines[] = { ENGINE_EDGE, ENGINE_CUSUM, ENGINE_THRESHOLD };
+
+    FILE* csv = nullptr;
+    if (!csv_path.empty()) {
+        csv = fopen(csv_path.c_str(), "w");
+        if (!csv) {
+            fprintf(stderr, "Unable to write %s\n", csv_path.c_str());
+            return 1;
+        }
+        fprintf(csv, "protein,snr,open_rate [1/s],close_rate [1/s],channels,engine,truth_transitions,detected_transitions,"
+            "precision,recall,f1,timing_error [ms],bias,msamples_per_s\n");
+    }
+
+    for (int protein = 1; protein >= 0; protein--) {
+        const int* engines = (protein == 1) ? channel_engines : pore_engines;
+        const int num_engines = (protein == 1) ? 4 : 3;
+        printf("\n%s (%d s per condition, tolerance %.1f ms)\n", (protein == 1) ? "Ion channels" : "Nanopores", seconds, tolerance_ms);
+        printf("%5s %7s %3s  %-18s %9s %7s %7s %7s %10s %9s %12s\n", "S/N", "rate", "N", "engine", "truth", "prec", "recall", "F1",
+            "err [ms]", (protein == 1) ? "Po bias" : "lvl bias", "Msamples/s");
+        const double* snrs = (protein == 1) ? channel_snr : pore_snr;
+        double f1_sum[NUM_ENGINES] = { 0 }, f1_min[NUM_ENGINES], err_sum[NUM_ENGINES] = { 0 }, bias_sum[NUM_ENGINES] = { 0 }, speed_sum[NUM_ENGINES] = { 0 };
+        double f1_min_snr[3][NUM_ENGINES];     // Worst F1 at each S/N ratio
+        for (int e = 0; e < NUM_ENGINES; e++) {
+            f1_min[e] = 1;
+            for (int k = 0; k < 3; k++) f1_min_snr[k][e] = 1;
+        }
+        bool snr_seen[3] = { false, false, false };
+        int num_conditions = 0;
+        unsigned long long seed = 1;
+        for (const Condition& c : conditions) {
+            if (c.proteinType != protein) continue;
+            num_conditions++;
+            seed++;
+            for (int k = 0; k < num_engines; k++) {
+                int e = engines[k];
+                Score s = scoreCondition(e, c, seconds, tolerance, seed);    // The same trace for every engine
+                printf("%5.0f %7.2f %3d  %-18s %9d %7.3f %7.3f %7.3f %10.3f %9.4f %12.2f\n", c.snr, c.open_rate, c.channels, ENGINE_NAMES[e],
+                    s.truth_transitions, s.precision(), s.recall(), s.f1(), s.timing_error_ms, s.bias, s.msamples_per_s);
+                if (csv) {
+                    fprintf(csv, "%s,%g,%g,%g,%d,%s,%d,%d,%f,%f,%f,%f,%f,%f\n", (protein == 1) ? "ion_channel" : "nanopore", c.snr, c.open_rate,
+                        c.close_rate, c.channels, ENGINE_NAMES[e], s.truth_transitions, s.detected_transitions, s.precision(), s.recall(), s.f1(),
+                        s.timing_error_ms, s.bias, s.msamples_per_s);
+                }
+                f1_sum[e] += s.f1();
+                if (s.f1() < f1_min[e]) f1_min[e] = s.f1();
+                for (int k = 0; k < 3; k++) {
+                    if (snrs[k] != c.snr) continue;
+                    snr_seen[k] = true;
+                    if (s.f1() < f1_min_snr[k][e]) f1_min_snr[k][e] = s.f1();
+                }
+                err_sum[e] += s.timing_error_ms;
+                bias_sum[e] += fabs(s.bias);
+                speed_sum[e] += s.msamples_per_s;
+            }
+        }
+        if (num_conditions == 0) continue;
+
+        // ****** Pareto table: an engine is dominated if another one is both faster and more accurate (mean F1).
+        printf("\n%-18s %8s %8s %10s %10s %12s %7s\n", "engine", "mean F1", "min F1", "err [ms]", "|bias|", "Msamples/s", "Pareto");
+        for (int k = 0; k < num_engines; k++) {
+            int e = engines[k];
+            bool dominated = false;
+            for (int j = 0; j < num_engines; j++) {
+                int o = engines[j];
+                if (o == e) continue;
+                if (f1_sum[o] >= f1_sum[e] && speed_sum[o] >= speed_sum[e] && (f1_sum[o] > f1_sum[e] || speed_sum[o] > speed_sum[e])) dominated = true;
+            }
+            printf("%-18s %8.3f %8.3f %10.3f %10.4f %12.2f %7s\n", ENGINE_NAMES[e], f1_sum[e] / num_conditions, f1_min[e],
+                err_sum[e] / num_conditions, bias_sum[e] / num_conditions, speed_sum[e] / num_conditions, dominated ? "" : "*");
+        }
+        for (int k = 0; k < 3; k++) {
+            if (!snr_seen[k]) continue;
+            int fastest = -1;
+            for (int j = 0; j < num_engines; j++) {
+                int e = engines[j];
+                if (f1_min_snr[k][e] >= min_f1 && (fastest < 0 || speed_sum[e] > speed_sum[fastest])) fastest = e;
+            }
+            if (fastest >= 0) printf("S/N %2.0f: the fastest engine with F1 >= %.2f in every condition is %s\n", snrs[k], min_f1, ENGINE_NAMES[fastest]);
+            else printf("S/N %2.0f: no engine reaches F1 >= %.2f in every condition\n", snrs[k], min_f1);
+        }
+    }
+    if (csv) fclose(csv);
+    return 0;
+}
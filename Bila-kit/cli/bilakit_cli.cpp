@@ -0,0 +1,358 @@
+/******************************************************************************
+// bilakit_cli.cpp
+//
+// This code is the headless runner of Bila-kit: the same Sense -> Processing -> Actuation pipeline as the GUI,
+// without Qt, for the batch reanalysis of the recordings, the soak tests and the runs on Linux.
+//
+//   * Sense Block:      a local ATF/CSV file (SenseReplay.cpp), or the simulated amplifier (SenseSimulated.cpp).
+//   * Processing Block: ProcessingBlock.cpp, driven with the settings of "Setup" and the check boxes given as options.
+//                       The log files are the same as the GUI (<log-dir>/<date>-<protein>-Processed.csv etc.).
+//   * Actuation Block:  ActuationSerial.cpp through SerialPort.cpp (--serial).
+//
+// The blocks are processed as fast as possible, unless --realtime (1 block per second, like the GUI).
+// The Po-V protocol needs the amplifier, and is not available here.
+******************************************************************************/
+
+#include "../MyHelper.h"
+#include "../ProcessingBlock.h"
+#include "../PipelineStages.h"
+#include "../SenseReplay.h"
+#include "../SenseSimulated.h"
+#include "../Platform.h"
+#include <chrono>
+#include <string>
+#include <thread>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: bilakit_cli (--input FILE | --simulate SECONDS) [options]\n"
+        "\n"
+        "Sense Block\n"
+        "  --input FILE             ATF (.atf) or CSV (.csv) recording\n"
+        "  --csv-ms                 The time column of the CSV file is in [ms] (default: [s])\n"
+        "  --simulate SECONDS       Simulated amplifier (see SenseSimulated.h)\n"
+        "  --sim-channels N         Number of channels (default 4)\n"
+        "  --sim-current PA         Current per open channel [pA] (default: conductance * voltage)\n"
+        "  --sim-noise PA           White noise [pA rms] (default 1)\n"
+        "  --sim-open-rate HZ       Closed -> open rate [1/s] (default 20)\n"
+        "  --sim-close-rate HZ      Open -> closed rate [1/s] (default 20)\n"
+        "  --sim-mains PA           Amplitude of the mains interference [pA] (default 0)\n"
+        "  --sim-drift PA_PER_S     Linear drift of the baseline [pA/s] (default 0)\n"
+        "  --sim-seed N             Seed of the random numbers (default 1)\n"
+        "\n"
+        "Processing Block (the settings of \"Setup\")\n"
+        "  --protein ahl|bk|bk-verapamil    (default ahl)\n"
+        "  --idealizer threshold|hmm|cusum  (default threshold)\n"
+        "  --postprocess none|conductance|emphasis  (default none)\n"
+        "  --conductance NS         Conductance per channel [nS] (default: 0.89 AHL, 0.299 BK)\n"
+        "  --voltage MV             Holding voltage [mV] (default: 50 AHL, -40 BK, 30 BK verapamil)\n"
+        "  --baseline PA            Baseline [pA] (default 0)\n"
+        "  --false-rate RATE        Target false-event rate [1/s] (default 0.01, 0: fixed thresholds)\n"
+        "  --mains-freq HZ          Nominal mains frequency [Hz] (default 50)\n"
+        "  --cusum-delay MS         Detection delay of CUSUM [ms] (default 10)\n"
+        "\n"
+        "Processing Block (the check boxes)\n"
+        "  --filter none|gaussian|bessel    Software low-pass filter (default none)\n"
+        "  --cutoff HZ              Cutoff of the software filter [Hz] (default 500)\n"
+        "  --mains-cancel           Mains cancellation\n"
+        "  --max-open N             Fix the number of channels\n"
+        "  --no-baseline-correction\n"
+        "  --no-conductance-correction\n"
+        "  --auto-calibration\n"
+        "\n"
+        "Output\n"
+        "  --log-dir DIR            Directory of the log files (default \"log\")\n"
+        "  --prefix NAME            Prefix of the log files in DIR (default: <date>-<protein>-)\n"
+        "  --raw-tiered             Log the raw current of the simulated amplifier at the full rate around the events only,\n"
+        "                           and its min/max/mean elsewhere (default: every sample)\n"
+        "  --raw-pre MS             Tiered raw logging: the full rate before each event [ms] (default 500)\n"
+        "  --raw-post MS            Tiered raw logging: the full rate after each event [ms] (default 500)\n"
+        "  --raw-summary MS         Tiered raw logging: the min/max/mean interval elsewhere [ms] (default 50)\n"
+        "  --stream NAME            Publish the live stream in shared memory as NAME (see PipelineStream.h, e.g. bilakit)\n"
+        "  --results ENDPOINT       Serve the results of every block to the display clients (e.g. tcp:5757, see PipelineResults.h)\n"
+        "  --serial DEVICE          Send the Actuation Block commands to DEVICE (a tty, or any file)\n"
+        "  --realtime               Pace the blocks at 1 block per second\n"
+        "  --quiet                  Print the errors only\n");
+}
+
+static bool quiet = false;
+
+static void printMessage(const char* text) {
+    if (!quiet) printf("%s\n", text);
+}
+
+// The value of the option argv[*i] (the next argument). Exits if it is missing.
+static const char* optionValue(int argc, char** argv, int* i) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "%s requires a value.\n", argv[*i]);
+        exit(2);
+    }
+    return argv[++*i];
+}
+
+// Returns the index of "value" in "names" (terminated by nullptr). Exits if it is not found.
+static int optionChoice(const char* option, const char* value, const char* const* names) {
+    for (int k = 0; names[k]; k++) {
+        if (strcmp(value, names[k]) == 0) return k;
+    }
+    fprintf(stderr, "Unknown value of %s: %s\n", option, value);
+    exit(2);
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+    static const char* const PROTEINS[] = { "ahl", "bk", "bk-verapamil", nullptr };
+    static const char* const IDEALIZERS[] = { "threshold", "hmm", "cusum", nullptr };
+    static const char* const POSTPROCESSES[] = { "none", "conductance", "emphasis", nullptr };
+    static const char* const FILTERS[] = { "none", "gaussian", "bessel", nullptr };
+
+    std::string input;
+    bool isSeconds = true;
+    double simulate_seconds = 0;
+    SimulationParams sim = defaultSimulationParams();
+    bool sim_current_specified = false;
+    int protein = 0;
+    ProcessingConfig config = defaultProcessingConfig();
+    bool conductance_specified = false;
+    bool voltage_specified = false;
+    ProcessingControls controls = defaultProcessingControls();
+    std::string log_dir = "log";
+    std::string prefix;
+    std::string serial_device;
+    std::string stream_name;
+    std::string results_endpoint;
+    bool realtime = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (strcmp(a, "--input") == 0) input = optionValue(argc, argv, &i);
+        else if (strcmp(a, "--csv-ms") == 0) isSeconds = false;
+        else if (strcmp(a, "--simulate") == 0) simulate_seconds = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--sim-channels") == 0) sim.channels = atoi(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--sim-current") == 0) { sim.current_per_channel = atof(optionValue(argc, argv, &i)); sim_current_specified = true; }
+        else if (strcmp(a, "--sim-noise") == 0) sim.noise_sd = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--sim-open-rate") == 0) sim.open_rate = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--sim-close-rate") == 0) sim.close_rate = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--sim-mains") == 0) sim.mains_amplitude = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--sim-drift") == 0) sim.drift = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--sim-seed") == 0) sim.seed = strtoull(optionValue(argc, argv, &i), nullptr, 10);
+        else if (strcmp(a, "--protein") == 0) protein = optionChoice(a, optionValue(argc, argv, &i), PROTEINS);
+        else if (strcmp(a, "--idealizer") == 0) config.idealizerType = optionChoice(a, optionValue(argc, argv, &i), IDEALIZERS);
+        else if (strcmp(a, "--postprocess") == 0) config.postprocessType = optionChoice(a, optionValue(argc, argv, &i), POSTPROCESSES);
+        else if (strcmp(a, "--conductance") == 0) { config.conductance = atof(optionValue(argc, argv, &i)); conductance_specified = true; }
+        else if (strcmp(a, "--voltage") == 0) { config.bias_voltage = atoi(optionValue(argc, argv, &i)); voltage_specified = true; }
+        else if (strcmp(a, "--baseline") == 0) config.baseline = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--false-rate") == 0) config.target_false_rate = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--mains-freq") == 0) config.mains_freq = atoi(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--cusum-delay") == 0) config.cusum_delay_ms = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--filter") == 0) controls.filterType = optionChoice(a, optionValue(argc, argv, &i), FILTERS);
+        else if (strcmp(a, "--cutoff") == 0) controls.filterCutoff = atoi(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--mains-cancel") == 0) controls.mains_cancellation = true;
+        else if (strcmp(a, "--max-open") == 0) controls.max_open = atoi(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--no-baseline-correction") == 0) controls.baseline_correction = false;
+        else if (strcmp(a, "--no-conductance-correction") == 0) controls.conductance_correction = false;
+        else if (strcmp(a, "--auto-calibration") == 0) controls.auto_calibration = true;
+        else if (strcmp(a, "--log-dir") == 0) log_dir = optionValue(argc, argv, &i);
+        else if (strcmp(a, "--prefix") == 0) prefix = optionValue(argc, argv, &i);
+        else if (strcmp(a, "--stream") == 0) stream_name = optionValue(argc, argv, &i);
+        else if (strcmp(a, "--results") == 0) results_endpoint = optionValue(argc, argv, &i);
+        else if (strcmp(a, "--raw-tiered") == 0) config.raw_recording = 1;
+        else if (strcmp(a, "--raw-pre") == 0) config.raw_pre_ms = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--raw-post") == 0) config.raw_post_ms = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--raw-summary") == 0) config.raw_summary_ms = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--serial") == 0) serial_device = optionValue(argc, argv, &i);
+        else if (strcmp(a, "--realtime") == 0) realtime = true;
+        else if (strcmp(a, "--quiet") == 0) quiet = true;
+        else if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) { usage(); return 0; }
+        else {
+            fprintf(stderr, "Unknown option: %s\n\n", a);
+            usage();
+            return 2;
+        }
+    }
+    if (input.empty() == (simulate_seconds <= 0)) {
+        usage();
+        return 2;
+    }
+
+    // ****** The settings of "Setup" (see MyMain::on_pushBtnClicked()).
+    config.proteinType = (protein == 0) ? 0 : 1;
+    config.BKstimuli = (protein == 2) ? 1 : 0;
+    if (!conductance_specified) config.conductance = (config.proteinType == 0) ? 0.89 : 0.299;     // [nS]
+    if (!voltage_specified) config.bias_voltage = (config.proteinType == 0) ? 50 : ((config.BKstimuli == 0) ? -40 : 30);    // [mV]
+    if (config.idealizerType == 1 && config.proteinType != 1) {
+        printMessage("HMM idealization is available only for ion channels. Threshold is used instead.");
+        config.idealizerType = 0;
+    }
+    if (config.idealizerType == 2 && config.proteinType != 0) {
+        printMessage("CUSUM idealization is available only for nanopores. Threshold is used instead.");
+        config.idealizerType = 0;
+    }
+    if (config.bias_voltage == 0) {
+        fprintf(stderr, "The holding voltage must not be 0 [mV].\n");
+        return 2;
+    }
+
+    // ****** Sense Block
+    ReplayFile replay;
+    SimulatedAmplifier amplifier;
+    int total_blocks;
+    if (!input.empty()) {
+        int extension = endsWith(input, ".csv") || endsWith(input, ".CSV") ? 1 : 0;
+        int result = replay.open(input, extension, isSeconds);
+        if (result != 0) {
+            fprintf(stderr, "Unable to open %s (%d).\n", input.c_str(), result);
+            return 1;
+        }
+        config.dataStartTime = replay.startTime();
+        config.log_raw = false;     // The local files have the raw current already.
+        total_blocks = replay.blocks();
+    }
+    else {
+        if (!sim_current_specified) sim.current_per_channel = config.conductance * config.bias_voltage;
+        sim.baseline = config.baseline;
+        amplifier.setup(sim, SAMPLE_FREQ, SAMPLE_FREQ);
+        config.dataStartTime = 0;
+        config.log_raw = true;      // Like the amplifier.
+        total_blocks = (int)simulate_seconds;
+    }
+
+    // ****** Actuation Block
+    if (!serial_device.empty() && setupSerialDevice(serial_device.c_str()) != 0) {
+        fprintf(stderr, "Unable to open %s.\n", serial_device.c_str());
+        return 1;
+    }
+
+    // ****** The live stream for the external tools (see PipelineStream.h).
+    StreamPublisher stream;
+    if (!stream_name.empty()) {
+        int result = stream.open(stream_name.c_str(), SAMPLE_FREQ, config.proteinType);
+        if (result != 0) {
+            fprintf(stderr, "Unable to publish the stream %s (%d).\n", stream_name.c_str(), result);
+            return 1;
+        }
+    }
+
+    // ****** The results for the display clients (see PipelineResults.h).
+    ResultServer resultServer;
+    if (!results_endpoint.empty()) {
+        int result = resultServer.start(results_endpoint);
+        if (result != 0) {
+            fprintf(stderr, "Unable to serve the results on %s (%d).\n", results_endpoint.c_str(), result);
+            return 1;
+        }
+    }
+
+    // ****** Logging output (the same files as the GUI).
+    if (makeDirectory(log_dir.c_str()) != 0) {
+        fprintf(stderr, "Unable to create %s.\n", log_dir.c_str());
+        return 1;
+    }
+    std::string log_prefix = prefix.empty() ? logFilePrefix(log_dir, config.proteinType) : log_dir + PATH_SEPARATOR + prefix;
+    ExportStage exportStage;
+    exportStage.start(64);
+    ProcessingBlock processing;
+    processing.setMessageFunction(printMessage);
+    processing.start(config, controls, log_prefix, &exportStage);
+    printMessage(("Logging to " + log_prefix + "*.csv").c_str());
+    if (stream.active()) {
+        processing.setStream(&stream);
+        printMessage(("Publishing the live stream " + stream_name).c_str());
+    }
+    if (resultServer.running()) {
+        processing.setResultServer(&resultServer);
+        printMessage(("Serving the results on " + results_endpoint).c_str());
+    }
+
+    // ****** Start the Sense Block in its worker thread, as the GUI does.
+    AcquisitionStage acquisitionStage;
+    acquisitionStage.setup(SAMPLE_FREQ, 8);
+    AcquisitionStage::ReadFunction read = [&](SenseBlock* block) {
+        if (block->index >= total_blocks) {
+            block->status = -1;     // The data range is over.
+            return;
+        }
+        if (!input.empty()) {
+            int switchIndex = 0;
+            int returnLocal = replay.read(block->time.data(), block->current.data(), block->index, &switchIndex);
+            if (returnLocal == -1) {
+                block->status = -1;
+            }
+            else if (returnLocal != 1) {
+                // The local file contains "bias voltage changing signal" at this timestep.
+                block->status = 1;
+                block->voltage = returnLocal;
+                block->switch_index = switchIndex;
+            }
+        }
+        else {
+            amplifier.read(block->time.data(), block->current.data(), block->index, SAMPLE_FREQ);
+        }
+    };
+    acquisitionStage.start(read, realtime ? 1 : 0, realtime ? 1 : 0);
+
+    StageStats processingStats, actuationStats, renderStats;
+    int blocks = 0;
+    int ruptured_blocks = 0;
+    std::chrono::steady_clock::time_point run_start = std::chrono::steady_clock::now();
+    for (;;) {
+        SenseBlock* block = acquisitionStage.front();
+        if (block == nullptr) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            continue;
+        }
+        if (block->status == -1) {
+            acquisitionStage.pop();
+            break;
+        }
+        std::chrono::steady_clock::time_point processing_start = std::chrono::steady_clock::now();
+        if (block->status == 1 && block->voltage != processing.config.bias_voltage) {
+            processing.voltage_switch_index = block->switch_index;
+            processing.setHoldingVoltage(block->voltage, &controls);
+            char text[64];
+            snprintf(text, sizeof(text), "Holding voltage: %d [mV] at %lf [s]", block->voltage, block->time[0]);
+            printMessage(text);
+        }
+        processing.process(block, &controls);
+        processingStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - processing_start).count(), acquisitionStage.depth());
+
+        std::chrono::steady_clock::time_point actuation_start = std::chrono::steady_clock::now();
+        conductActuationSerial(processing.rupture_flag, processing.recovery_flag, processing.maxOpenNumber);
+        if (config.proteinType == 1 && !processing.rupture_flag) conductActuationStimuli(config.BKstimuli, processing.opProb, processing.stimuli);
+        actuationStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - actuation_start).count(), 0);
+
+        processing.writePipeline(processing.currentTime[0], acquisitionStage.stats(), processingStats.snapshot(acquisitionStage.depth()),
+            actuationStats.snapshot(0), renderStats.snapshot(0));
+        if (processing.rupture_flag) ruptured_blocks++;
+        blocks++;
+        acquisitionStage.pop();
+    }
+    acquisitionStage.stop();
+    processing.finish();
+    stream.close();
+    resultServer.stop();
+    exportStage.flush();
+    exportStage.stop();
+    closeSerial();
+
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - run_start).count();
+    if (!quiet) {
+        StageSnapshot p = processingStats.snapshot(0);
+        printf("%d blocks (%d ruptured) in %.3f [s], processing mean %.3f [ms], max %.3f [ms]\n",
+            blocks, ruptured_blocks, elapsed, p.service_ms_mean, p.service_ms_max);
+        const TieredRecorder& raw = processing.rawRecording();
+        if (config.log_raw && config.raw_recording == 1 && raw.samples() > 0) {
+            printf("Raw current: %lld of %lld samples at the full rate (%.1f%%), %lld summary rows\n", raw.fullSamples(), raw.samples(),
+                100.0 * raw.fullSamples() / raw.samples(), raw.summaryRows());
+        }
+    }
+    return 0;
+}
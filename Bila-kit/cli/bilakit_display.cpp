@@ -0,0 +1,108 @@
+/******************************************************************************
+// bilakit_display.cpp
+//
+// This code is the reference display client of the results server (PipelineResults.h), which replaces the sub-window
+// mirrored to the sub display by Miracast: run it on the PC of the sub display, and it prints the stimuli estimated
+// in every block, in red when they exceed the threshold ("Emphasis when exceeding threshold").
+//
+//   bilakit_display --connect tcp:192.168.0.10:5757
+//
+// The GUI serves this PC only by default: to serve the PC of the sub display, start it with "--results tcp:0.0.0.0:5757".
+//
+// It reconnects every second while the server (the GUI, or "bilakit_cli --results ENDPOINT") is not running.
+******************************************************************************/
+
+#include "../PipelineResults.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <thread>
+
+#define COLOR_RED "\x1b[31m"
+#define COLOR_GRAY "\x1b[90m"
+#define COLOR_RESET "\x1b[0m"
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: bilakit_display [--connect ENDPOINT] [--count N] [--no-color]\n"
+        "  --connect ENDPOINT  The results server: tcp:HOST:PORT, tcp:PORT or unix:PATH (default tcp:127.0.0.1:%d)\n"
+        "  --count N           Exit after N blocks\n"
+        "  --no-color          No ANSI colors (the emphasis is marked by \"!!\")\n", RESULT_DEFAULT_PORT);
+}
+
+// One line per block, as the sub-window: "[Verapamil] is now 12 uM (8 - 16)" or "Membrane potential is now 40 mV (...)".
+static void printResult(const ResultMessage& m, bool color) {
+    const bool valid = (m.flags & RESULT_VALID) != 0;
+    const bool emphasis = (m.flags & RESULT_EMPHASIS) != 0;
+    const char* label = (m.stimuli_type == 1) ? "[Verapamil] is now" : "Membrane potential is now";
+    const char* unit = (m.stimuli_type == 1) ? "uM" : "mV";
+    char value[3][16], po[16];
+    if (valid) snprintf(po, sizeof(po), "%.3f", m.opProb);
+    else snprintf(po, sizeof(po), "-");
+    if (valid) {
+        snprintf(value[0], sizeof(value[0]), "%d", int(round(m.stimuli)));
+        snprintf(value[1], sizeof(value[1]), "%d", int(round(m.stimuli_upper)));
+        snprintf(value[2], sizeof(value[2]), "%d", int(round(m.stimuli_lower)));
+    }
+    else {
+        for (int k = 0; k < 3; k++) snprintf(value[k], sizeof(value[k]), "[XX]");
+    }
+    const char* begin = !color ? "" : emphasis ? COLOR_RED : valid ? "" : COLOR_GRAY;
+    printf("%s%8.1f [s]  %s %s %s (%s - %s)%s", begin, m.time, label, value[0], unit, value[2], value[1],
+        (emphasis && !color) ? " !!" : "");
+    printf("  Po %s  N %d  %+d mV%s%s\n", po, m.channels,
+        m.bias_voltage, (m.flags & RESULT_RUPTURE) ? "  RUPTURE" : (m.flags & RESULT_RECOVERY) ? "  recovering" : "",
+        color ? COLOR_RESET : "");
+    fflush(stdout);
+}
+
+int main(int argc, char** argv) {
+    std::string endpoint = "tcp:127.0.0.1:" + std::to_string(RESULT_DEFAULT_PORT);
+    long count = -1;
+    bool color = true;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--connect") == 0 && i + 1 < argc) endpoint = argv[++i];
+        else if (strcmp(argv[i], "--count") == 0 && i + 1 < argc) count = atol(argv[++i]);
+        else if (strcmp(argv[i], "--no-color") == 0) color = false;
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    ResultSubscriber subscriber;
+    long blocks = 0, lost = 0;
+    uint64_t next_seq = 0;
+    bool waiting = false;
+    while (count < 0 || blocks < count) {
+        if (!subscriber.connected()) {
+            if (subscriber.connect(endpoint) != 0) {
+                if (!waiting) fprintf(stderr, "Waiting for the results server on %s...\n", endpoint.c_str());
+                waiting = true;
+                std::this_thread::sleep_for(std::chrono::seconds(1));
+                continue;
+            }
+            fprintf(stderr, "Connected to %s\n", endpoint.c_str());
+            waiting = false;
+            next_seq = 0;
+        }
+        ResultMessage m;
+        int result = subscriber.receive(&m, 1000);
+        if (result < 0) {
+            fprintf(stderr, "Disconnected from %s\n", endpoint.c_str());
+            subscriber.close();
+            continue;
+        }
+        if (result == 0) continue;
+        // The gaps of the sequence numbers: the messages dropped while this client was too slow.
+        if (next_seq != 0 && m.seq > next_seq) lost += (long)(m.seq - next_seq);
+        next_seq = m.seq + 1;
+        printResult(m, color);
+        blocks++;
+    }
+    fprintf(stderr, "%ld blocks (%ld lost)\n", blocks, lost);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/******************************************************************************
+// bilakit_sweep.cpp
+//
+// This code is the parameter sweep of the Processing Block: every combination of the given parameter values is run
+// on every recording in parallel (ProcessingSweep.cpp), and the result matrix is written as CSV.
+//
+//   bilakit_sweep --input data/plus40mV.atf@40 --input data/minus40mV.atf@-40 --protein bk --false-rate 0
+//                 --sweep threshold=0.5:1.0:0.05 --sweep drift_guard=5,10,20 --out sweep.csv
+//
+// The settings other than the swept parameters are the options of bilakit_cli. Nothing is logged per configuration.
+******************************************************************************/
+
+#include "../MyHelper.h"
+#include "../ProcessingSweep.h"
+#include <chrono>
+#include <string>
+#include <vector>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static void usage() {
+    fprintf(stderr,
+        "Usage: bilakit_sweep --input FILE[@MV] [--input ...] --sweep NAME=VALUES [--sweep ...] [options]\n"
+        "\n"
+        "Recordings (decoded once, shared by all configurations)\n"
+        "  --input FILE[@MV]        ATF (.atf) or CSV (.csv) recording, with its holding voltage [mV] (default: --voltage)\n"
+        "  --csv-ms                 The time column of the CSV files is in [ms] (default: [s])\n"
+        "\n"
+        "Parameter grid\n"
+        "  --sweep NAME=V1,V2,...   The values of a parameter, or\n"
+        "  --sweep NAME=FIRST:LAST:STEP\n"
+        "                           NAME: %s\n"
+        "                           (threshold and detection_threshold apply while the thresholds are fixed: --false-rate 0)\n"
+        "\n"
+        "Processing Block (as bilakit_cli)\n"
+        "  --protein ahl|bk|bk-verapamil    (default ahl)\n"
+        "  --idealizer threshold|hmm|cusum  (default threshold)\n"
+        "  --postprocess none|conductance   (default none)\n"
+        "  --conductance NS         (default: 0.89 AHL, 0.299 BK)\n"
+        "  --voltage MV             (default: 50 AHL, -40 BK, 30 BK verapamil)\n"
+        "  --false-rate RATE        (default 0.01, 0: fixed thresholds)\n"
+        "  --filter none|gaussian|bessel, --cutoff HZ, --mains-cancel, --max-open N\n"
+        "  --no-baseline-correction, --no-conductance-correction, --auto-calibration\n"
+        "\n"
+        "Output\n"
+        "  --threads N              Worker threads (default: the hardware concurrency)\n"
+        "  --out FILE               The result matrix (CSV, one row per configuration and recording)\n"
+        "  --quiet                  Print the errors only\n", sweepParameterNames());
+}
+
+// The value of the option argv[*i] (the next argument). Exits if it is missing.
+static const char* optionValue(int argc, char** argv, int* i) {
+    if (*i + 1 >= argc) {
+        fprintf(stderr, "%s requires a value.\n", argv[*i]);
+        exit(2);
+    }
+    return argv[++*i];
+}
+
+// Returns the index of "value" in "names" (terminated by nullptr). Exits if it is not found.
+static int optionChoice(const char* option, const char* value, const char* const* names) {
+    for (int k = 0; names[k]; k++) {
+        if (strcmp(value, names[k]) == 0) return k;
+    }
+    fprintf(stderr, "Unknown value of %s: %s\n", option, value);
+    exit(2);
+}
+
+static bool endsWith(const std::string& s, const char* suffix) {
+    size_t n = strlen(suffix);
+    return s.size() >= n && s.compare(s.size() - n, n, suffix) == 0;
+}
+
+int main(int argc, char** argv) {
+    static const char* const PROTEINS[] = { "ahl", "bk", "bk-verapamil", nullptr };
+    static const char* const IDEALIZERS[] = { "threshold", "hmm", "cusum", nullptr };
+    static const char* const POSTPROCESSES[] = { "none", "conductance", nullptr };
+    static const char* const FILTERS[] = { "none", "gaussian", "bessel", nullptr };
+
+    std::vector<std::string> inputs;
+    bool isSeconds = true;
+    std::vector<SweepAxis> axes;
+    int protein = 0;
+    ProcessingConfig config = defaultProcessingConfig();
+    bool conductance_specified = false;
+    bool voltage_specified = false;
+    ProcessingControls controls = defaultProcessingControls();
+    int threads = 0;
+    std::string out;
+    bool quiet = false;
+
+    for (int i = 1; i < argc; i++) {
+        const char* a = argv[i];
+        if (strcmp(a, "--input") == 0) inputs.push_back(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--csv-ms") == 0) isSeconds = false;
+        else if (strcmp(a, "--sweep") == 0) {
+            SweepAxis axis;
+            std::string error;
+            if (!parseSweepAxis(optionValue(argc, argv, &i), &axis, &error)) {
+                fprintf(stderr, "--sweep: %s\n", error.c_str());
+                return 2;
+            }
+            axes.push_back(axis);
+        }
+        else if (strcmp(a, "--protein") == 0) protein = optionChoice(a, optionValue(argc, argv, &i), PROTEINS);
+        else if (strcmp(a, "--idealizer") == 0) config.idealizerType = optionChoice(a, optionValue(argc, argv, &i), IDEALIZERS);
+        else if (strcmp(a, "--postprocess") == 0) config.postprocessType = optionChoice(a, optionValue(argc, argv, &i), POSTPROCESSES);
+        else if (strcmp(a, "--conductance") == 0) { config.conductance = atof(optionValue(argc, argv, &i)); conductance_specified = true; }
+        else if (strcmp(a, "--voltage") == 0) { config.bias_voltage = atoi(optionValue(argc, argv, &i)); voltage_specified = true; }
+        else if (strcmp(a, "--false-rate") == 0) config.target_false_rate = atof(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--filter") == 0) controls.filterType = optionChoice(a, optionValue(argc, argv, &i), FILTERS);
+        else if (strcmp(a, "--cutoff") == 0) controls.filterCutoff = atoi(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--mains-cancel") == 0) controls.mains_cancellation = true;
+        else if (strcmp(a, "--max-open") == 0) controls.max_open = atoi(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--no-baseline-correction") == 0) controls.baseline_correction = false;
+        else if (strcmp(a, "--no-conductance-correction") == 0) controls.conductance_correction = false;
+        else if (strcmp(a, "--auto-calibration") == 0) controls.auto_calibration = true;
+        else if (strcmp(a, "--threads") == 0) threads = atoi(optionValue(argc, argv, &i));
+        else if (strcmp(a, "--out") == 0) out = optionValue(argc, argv, &i);
+        else if (strcmp(a, "--quiet") == 0) quiet = true;
+        else if (strcmp(a, "--help") == 0 || strcmp(a, "-h") == 0) { usage(); return 0; }
+        else {
+            fprintf(stderr, "Unknown option: %s\n\n", a);
+            usage();
+            return 2;
+        }
+    }
+    if (inputs.empty()) {
+        usage();
+        return 2;
+    }
+
+    // ****** The settings of "Setup" (as bilakit_cli).
+    config.proteinType = (protein == 0) ? 0 : 1;
+    config.BKstimuli = (protein == 2) ? 1 : 0;
+    if (!conductance_specified) config.conductance = (config.proteinType == 0) ? 0.89 : 0.299;     // [nS]
+    if (!voltage_specified) config.bias_voltage = (config.proteinType == 0) ? 50 : ((config.BKstimuli == 0) ? -40 : 30);    // [mV]
+    if (config.idealizerType == 1 && config.proteinType != 1) config.idealizerType = 0;
+    if (config.idealizerType == 2 && config.proteinType != 0) config.idealizerType = 0;
+    if (!quiet && config.target_false_rate > 0) {
+        for (const SweepAxis& axis : axes) {
+            if (axis.name == "threshold" || axis.name == "detection_threshold" || axis.name == "nanopore_detection_threshold") {
+                printf("Note: %s applies only until the noise is known, since the thresholds are adaptive (--false-rate 0 fixes them).\n", axis.name.c_str());
+            }
+        }
+    }
+
+    // ****** Decode every recording once.
+    std::vector<SweepRecording> recordings(inputs.size());
+    for (size_t k = 0; k < inputs.size(); k++) {
+        std::string path = inputs[k];
+        recordings[k].bias_voltage = config.bias_voltage;
+        size_t at = path.rfind('@');
+        if (at != std::string::npos && at > 0) {
+            recordings[k].bias_voltage = atoi(path.c_str() + at + 1);
+            path = path.substr(0, at);
+        }
+        if (recordings[k].bias_voltage == 0) {
+            fprintf(stderr, "The holding voltage of %s must not be 0 [mV].\n", path.c_str());
+            return 2;
+        }
+        int extension = endsWith(path, ".csv") || endsWith(path, ".CSV") ? 1 : 0;
+        int result = recordings[k].file.open(path, extension, isSeconds);
+        if (result != 0) {
+            fprintf(stderr, "Unable to open %s (%d).\n", path.c_str(), result);
+            return 1;
+        }
+        size_t slash = path.find_last_of("/\\");
+        recordings[k].name = (slash == std::string::npos) ? path : path.substr(slash + 1);
+    }
+
+    // ****** Run the grid.
+    const int num_configurations = sweepConfigurations(axes);
+    const int total = num_configurations * (int)recordings.size();
+    if (!quiet) printf("%d configurations x %d recordings = %d jobs\n", num_configurations, (int)recordings.size(), total);
+    std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+    int last_percent = -1;
+    SweepProgress progress = [&](int done, int all) {
+        int percent = done * 100 / all;
+        if (!quiet && percent / 10 != last_percent / 10) {
+            printf("  %3d%% (%d / %d)\n", percent, done, all);
+            fflush(stdout);
+        }
+        last_percent = percent;
+    };
+    long long steals = 0;
+    std::vector<SweepResult> results = runSweep(config, controls, recordings, axes, threads, progress, &steals);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+    if (!out.empty() && !writeSweepCSV(out, results, axes, recordings)) {
+        fprintf(stderr, "Unable to write %s.\n", out.c_str());
+        return 1;
+    }
+
+    // ****** The matrix: the configurations x the recordings (Po for ion channels, the mean number of nanopores otherwise).
+    if (!quiet) {
+        double busy = 0;
+        for (const SweepResult& r : results) busy += r.seconds;
+        printf("\n%s\n", (config.proteinType == 0) ? "Mean number of nanopores" : "Mean Po");
+        for (const SweepAxis& axis : axes) printf("%12.12s ", axis.name.c_str());
+        for (const SweepRecording& rec : recordings) printf("%14.14s ", rec.name.c_str());
+        printf("\n");
+        for (int c = 0; c < num_configurations; c++) {
+            const std::vector<double> values = sweepValues(axes, c);
+            for (double v : values) printf("%12g ", v);
+            for (size_t k = 0; k < recordings.size(); k++) {
+                const SweepResult& r = results[c * recordings.size() + k];
+                double v = (config.proteinType == 0) ? r.channels_mean : r.opProb_mean;
+                if (isnan(v)) printf("%14s ", "-");
+                else printf("%14.4f ", v);
+            }
+            printf("\n");
+        }
+        printf("\n%d jobs in %.2f [s] (%.2f [s] of processing, %lld stolen)%s%s\n", total, elapsed, busy, steals,
+            out.empty() ? "" : ", written to ", out.c_str());
+    }
+    return 0;
+}
@@ -0,0 +1,115 @@
+/******************************************************************************
+// bilakit_tail.c
+//
+// This code is the reference reader of the live stream (PipelineStream.h): it follows the stream published by the
+// GUI or by "bilakit_cli --stream NAME", and prints the features of every block as CSV rows, with the number of the
+// raw samples received and lost. It uses the reader API only, as the external tools do.
+//
+//   bilakit_tail --name bilakit --samples
+//
+// It waits for the stream to be published, and exits once the session is finished (or after --blocks N).
+******************************************************************************/
+
+#include "../PipelineStream.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <windows.h>
+static void sleepMs(int ms) { Sleep(ms); }
+#else
+#include <unistd.h>
+static void sleepMs(int ms) { usleep(ms * 1000); }
+#endif
+
+#define CHUNK 8192
+
+static void usage(void) {
+    fprintf(stderr,
+        "Usage: bilakit_tail [--name NAME] [--samples] [--blocks N] [--timeout S]\n"
+        "  --name NAME      The stream (default " BKSTREAM_DEFAULT_NAME ")\n"
+        "  --samples        Also read the raw samples and the idealized levels (the mean current of each block)\n"
+        "  --from-start     Start from the oldest block still in the stream (default: the next block)\n"
+        "  --blocks N       Exit after N blocks\n"
+        "  --timeout S      Give up if the stream is not published within S seconds (default: wait)\n");
+}
+
+int main(int argc, char** argv) {
+    const char* name = BKSTREAM_DEFAULT_NAME;
+    int samples = 0, from_start = 0;
+    long max_blocks = -1;
+    double timeout = -1;
+    BkStreamReader* reader;
+    const BkStreamHeader* h;
+    uint64_t feature_seq, sample_seq, lost_blocks = 0, lost_samples = 0, received_samples = 0;
+    long blocks = 0;
+    int waited = 0, i;
+    static double current[CHUNK];
+    static int32_t level[CHUNK];
+    double sum = 0;
+    long n = 0, open_samples = 0;
+
+    for (i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--name") == 0 && i + 1 < argc) name = argv[++i];
+        else if (strcmp(argv[i], "--samples") == 0) samples = 1;
+        else if (strcmp(argv[i], "--from-start") == 0) from_start = 1;
+        else if (strcmp(argv[i], "--blocks") == 0 && i + 1 < argc) max_blocks = atol(argv[++i]);
+        else if (strcmp(argv[i], "--timeout") == 0 && i + 1 < argc) timeout = atof(argv[++i]);
+        else {
+            usage();
+            return 2;
+        }
+    }
+
+    while ((reader = bkstream_open(name)) == NULL) {
+        if (timeout >= 0 && waited * 0.1 >= timeout) {
+            fprintf(stderr, "The stream %s is not published.\n", name);
+            return 1;
+        }
+        sleepMs(100);
+        waited++;
+    }
+    h = bkstream_header(reader);
+    fprintf(stderr, "Stream %s: %u Hz, protein type %d, writer %d, %u samples / %u blocks buffered\n", name, h->sample_rate,
+        h->protein_type, h->writer_pid, h->sample_capacity, h->feature_capacity);
+    feature_seq = from_start ? 0 : bkstream_feature_head(reader);
+    sample_seq = from_start ? 0 : bkstream_sample_head(reader);
+
+    printf("seq,time [s],opProb [-],opProb_se [-],stimuli,channels [-],max_open [-],baseline [pA],current_per_channel [pA],"
+        "noise [pA],voltage [mV],flags%s\n", samples ? ",samples [-],mean_current [pA],open_fraction [-]" : "");
+    for (;;) {
+        BkStreamFeatures f;
+        int finished = bkstream_finished(reader);
+        // The samples first, so that those of the block are received before its features.
+        if (samples) {
+            size_t k, got;
+            while ((got = bkstream_read_samples(reader, &sample_seq, NULL, current, level, CHUNK, &lost_samples)) > 0) {
+                for (k = 0; k < got; k++) {
+                    sum += current[k];
+                    if (level[k] > 0) open_samples++;
+                }
+                n += (long)got;
+                received_samples += got;
+            }
+        }
+        if (bkstream_read_features(reader, &feature_seq, &f, 1, &lost_blocks) == 1) {
+            printf("%llu,%lf,%lf,%lf,%lf,%d,%d,%lf,%lf,%lf,%d,%d", (unsigned long long)f.seq, f.time, f.opProb, f.opProb_se, f.stimuli,
+                f.channels, f.max_open, f.baseline, f.current_per_channel, f.noise_sigma, f.bias_voltage, f.flags);
+            if (samples) printf(",%ld,%lf,%lf", n, n ? sum / n : 0.0, n ? (double)open_samples / n : 0.0);
+            printf("\n");
+            fflush(stdout);
+            sum = 0;
+            n = 0;
+            open_samples = 0;
+            if (++blocks == max_blocks) break;
+            continue;
+        }
+        if (finished) break;    // Everything published before the end has been read.
+        sleepMs(20);
+    }
+    fprintf(stderr, "%ld blocks (%llu lost)", blocks, (unsigned long long)lost_blocks);
+    if (samples) fprintf(stderr, ", %llu samples (%llu lost)", (unsigned long long)received_samples, (unsigned long long)lost_samples);
+    fprintf(stderr, "\n");
+    bkstream_close(reader);
+    return 0;
+}
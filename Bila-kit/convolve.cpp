@@ -9,32 +9,28 @@
 // h[]: filter (averaging + Prewitt)  [-1, -1, -1, ..., -1, 0, 1, ..., 1, 1, 1]
 // prevX[500] : signal at previous timestep (for padding).
 // Y[SAMPLE_FREQ] : filtered signal
-const int kernel_size = 301;
-//const int kernel_size = 101;
-void convolve_EDGE(double* X, double* Y, double* prevX, int prevX_size) {
-    
-    // Filter preparation
-    double H[kernel_size];
-    for (int i = 0; i < (kernel_size - 1) / 2; i++) H[i] = -1;
-    for (int i = (kernel_size - 1) / 2; i < (kernel_size + 1) / 2; i++) H[i] = 0;
-    for (int i = (kernel_size + 1) / 2; i < kernel_size; i++) H[i] = 1;
+// kernel_size : the length of h[] (odd, e.g. 301 or 101). Limited to 2 * prevX_size + 1, so that the padding is in prevX[].
+void convolve_EDGE(double* X, double* Y, double* prevX, int prevX_size, int kernel_size) {
+    if (kernel_size > 2 * prevX_size + 1) kernel_size = 2 * prevX_size + 1;
+    if (kernel_size < 3) kernel_size = 3;
+    if (kernel_size % 2 == 0) kernel_size--;
+
+    // Filter preparation (h[] is -1 for the first half and +1 for the second half, so the convolution is split into the
+    // two halves instead of multiplying by h[j]. The sum is taken in the same order, so the output is the same.)
+    const int half = (kernel_size - 1) / 2;
 
     // Convolution
     for (int i = 0; i < SAMPLE_FREQ; i++) {
-        Y[i] = 0;
-        for (int j = 0; j < kernel_size; j++) {
-            int tar = i + j - (kernel_size - 1) / 2;
-            if (tar < 0) {
-                Y[i] += prevX[prevX_size + tar] * H[j];
-            }
-            else if (tar >= SAMPLE_FREQ) {
-                Y[i] += X[SAMPLE_FREQ-1] * H[j];
-            }
-            else {
-                Y[i] += X[tar] * H[j];
-            }
-        }
-        Y[i] /= ((double)kernel_size - 1);
+        double sum = 0;
+        // The -1 half: the samples before i (in prevX[] before the start of the block).
+        int tar = i - half;
+        for (; tar < 0; tar++) sum -= prevX[prevX_size + tar];
+        for (; tar < i; tar++) sum -= X[tar];
+        // The +1 half: the samples after i (the last sample is repeated after the end of the block).
+        tar = i + 1;
+        for (; tar <= i + half && tar < SAMPLE_FREQ; tar++) sum += X[tar];
+        for (; tar <= i + half; tar++) sum += X[SAMPLE_FREQ - 1];
+        Y[i] = sum / ((double)kernel_size - 1);
     }
 }
 
@@ -10,6 +10,7 @@
 #include "MyMain.h"
 #include <QtSerialPort/QSerialPort>
 #include <QtSerialPort/QSerialPortInfo>
+#include <QThread>
 
 QSerialPort port;
 int serialTarget = -1; // -1: no serial, 0: Arduino, 1: Legato180
@@ -71,7 +72,13 @@ void setupSerial(MyMain* mainwindow)
 // "x\n": Instruct the stepper motor to rotate only a single step.
 // "c\n": Instruct the stepper motor to stop.
 
+// The port is written by the GUI thread, which owns it: the commands of the Actuation Block (in the processing stage) are queued to it.
 void sendSerial(const char* data) {
+    if (QThread::currentThread() != port.thread()) {
+        QByteArray command(data);
+        QMetaObject::invokeMethod(&port, [command]() { sendSerial(command.constData()); }, Qt::QueuedConnection);
+        return;
+    }
     if (port.isOpen()) {
         port.write(data);
     }
@@ -0,0 +1,23 @@
+#pragma once
+
+/******************************************************************************
+* Check.h
+*
+* The checks shared by the tests (tests/): CHECK(cond, format, ...) prints the failure and counts it, and finishChecks()
+* prints the summary and returns the exit code of the test (non-zero on failure).
+******************************************************************************/
+
+#include <stdio.h>
+
+static int failures = 0;
+
+#define CHECK(cond, ...) do { if (!(cond)) { failures++; printf("FAILED: "); printf(__VA_ARGS__); printf("\n"); } } while (0)
+
+static inline int finishChecks(const char* passed) {
+    if (failures) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("%s\n", passed);
+    return 0;
+}
@@ -0,0 +1,153 @@
+/******************************************************************************
+// test_allocations.cpp
+//
+// Checks that the steady-state per-block path does not allocate: the global operator new is replaced by a counting
+// one, and the simulated amplifier runs through the acquisition stage, ProcessingBlock::process() (as the GUI and
+// bilakit_cli drive it) and the CSV export stage:
+//   * An hour (3600 blocks) of BK with the mains cancellation, the Gaussian filter, the HMM, the drift tracking, the
+//     auto calibration, the noise-adaptive thresholds, the dwells and kinetics, the PSD and the tiered raw recording.
+//   * Ten minutes of nanopores with the Bessel filter, the CUSUM detector, the conductance measurement and every raw sample.
+// Every allocation after the warm-up (in any thread) is a failure. Returns non-zero on failure.
+//
+// The allocations by malloc() in the C library (e.g. fopen) and in Qt (the graphs and the text widgets) are not covered.
+******************************************************************************/
+
+#include "../SenseSimulated.h"
+#include "../PipelineStages.h"
+#include "../ProcessingBlock.h"
+#include "Check.h"
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+#include <thread>
+
+static const int WARMUP_BLOCKS = 60;
+
+// ****** Counting allocator
+
+static std::atomic<bool> counting(false);
+static std::atomic<long long> allocations(0);
+
+static void* countedAlloc(size_t size) {
+    if (counting.load(std::memory_order_relaxed)) allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+
+void* operator new(size_t size) {
+    void* p = countedAlloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new[](size_t size) {
+    void* p = countedAlloc(size);
+    if (!p) throw std::bad_alloc();
+    return p;
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return countedAlloc(size); }
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+// ****** The acquisition, as bilakit_cli drives it
+
+static SimulatedAmplifier amplifier;
+
+static void readSimulated(SenseBlock* block) {
+    amplifier.read(block->time.data(), block->current.data(), block->index, SAMPLE_FREQ);
+}
+
+// Run the simulated amplifier through the Processing Block for WARMUP_BLOCKS + blocks.
+// The messages for the operator are counted as well (e.g. the drift of the baseline).
+static void runAcquisition(const char* name, const ProcessingConfig& config, ProcessingControls controls, SimulationParams sim, int blocks) {
+    sim.current_per_channel = config.conductance * config.bias_voltage;
+    sim.baseline = config.baseline;
+    amplifier.setup(sim, SAMPLE_FREQ, SAMPLE_FREQ);
+
+    std::string prefix = std::string("test_allocations-") + name + "-";
+    ExportStage exportStage;
+    exportStage.start(64);
+    ProcessingBlock processing;
+    int messages = 0;
+    processing.setMessageFunction([&messages](const char*) { messages++; });
+    processing.start(config, controls, prefix, &exportStage);
+    StageStats processingStats, actuationStats, renderStats;
+    AcquisitionStage acquisitionStage;
+    acquisitionStage.setup(SAMPLE_FREQ, 8);
+    acquisitionStage.start(readSimulated, 0, 0);
+
+    long long warmup_allocations = 0;
+    allocations.store(0);
+    counting.store(true);
+    for (int b = 0; b < WARMUP_BLOCKS + blocks; b++) {
+        if (b == WARMUP_BLOCKS) {
+            warmup_allocations = allocations.load();
+            allocations.store(0);
+        }
+        SenseBlock* block;
+        while ((block = acquisitionStage.front()) == nullptr) std::this_thread::sleep_for(std::chrono::microseconds(100));
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        processing.process(block, &controls);
+        processingStats.record(std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count(), acquisitionStage.depth());
+        processing.writePipeline(processing.currentTime[0], acquisitionStage.stats(), processingStats.snapshot(acquisitionStage.depth()),
+            actuationStats.snapshot(0), renderStats.snapshot(0));
+        acquisitionStage.pop();
+    }
+    // Wait for the workers, whose allocations are counted as well.
+    exportStage.flush();
+    counting.store(false);
+    long long steady_allocations = allocations.load();
+    acquisitionStage.stop();
+    processing.finish();
+    exportStage.stop();
+
+    printf("%s: %lld allocations in the warm-up (%d blocks), %lld in the steady state (%d blocks), %d messages\n",
+        name, warmup_allocations, WARMUP_BLOCKS, steady_allocations, blocks, messages);
+    CHECK(steady_allocations == 0, "%s: %lld allocations after the warm-up", name, steady_allocations);
+    CHECK(processingStats.snapshot(0).items == WARMUP_BLOCKS + blocks, "%s: blocks processed", name);
+
+    const char* files[] = { "Processed.csv", "POSTProcessed.csv", "Raw.csv", "RawSummary.csv", "RawWindows.csv", "Dwell.csv",
+        "Quality.csv", "Pipeline.csv" };
+    for (const char* file : files) remove((prefix + file).c_str());
+}
+
+int main() {
+    SimulationParams sim = defaultSimulationParams();
+    sim.mains_amplitude = 2;
+    sim.drift = 0.001;
+
+    ProcessingConfig config = defaultProcessingConfig();
+    config.proteinType = 1;
+    config.idealizerType = 1;
+    config.conductance = 0.299;
+    config.bias_voltage = 40;
+    config.log_raw = true;
+    config.raw_recording = 1;
+    config.raw_pre_ms = 100;
+    config.raw_post_ms = 100;
+    config.raw_summary_ms = 10;
+    ProcessingControls controls = defaultProcessingControls();
+    controls.filterType = FILTER_GAUSSIAN;
+    controls.filterCutoff = 1000;
+    controls.mains_cancellation = true;
+    controls.auto_calibration = true;
+    runAcquisition("bk", config, controls, sim, 3600);
+
+    config = defaultProcessingConfig();
+    config.idealizerType = 2;
+    config.postprocessType = 1;
+    config.log_raw = true;
+    controls = defaultProcessingControls();
+    controls.filterType = FILTER_BESSEL;
+    controls.filterCutoff = 1000;
+    sim.channels = 3;
+    sim.open_rate = 0.05;
+    sim.close_rate = 0.02;
+    runAcquisition("nanopore", config, controls, sim, 600);
+
+    return finishChecks("All allocation checks passed");
+}
@@ -0,0 +1,356 @@
+/******************************************************************************
+// test_estimators.cpp
+//
+// Checks the estimators of the Processing Block on synthetic channels whose levels, noise and drift are known,
+// with the settings of ProcessingBlock.cpp:
+//   * ConductanceEstimator (ProcessingConductance.cpp): the baseline, the current per channel, the noise and the level
+//     weights of three BK channels are found from the amplitude histogram and the guesses of the operator (off by
+//     2 pA and 0.5 pA), and those of two rarely open channels without the guesses.
+//   * DriftTracker (ProcessingDrift.cpp): a baseline drifting by 0.5 pA/s under the channel openings is followed,
+//     and the closed-state noise is measured.
+//   * NoiseEstimator (ProcessingNoise.cpp): the level means and RMS, the lag-1 autocorrelation of white and of
+//     filtered (AR(1)) noise, the hysteresis width which gives the target false-event rate, and the rupture threshold.
+//   * LogHistogram and fitDwellTimes (ProcessingKinetics.cpp): the bins of the dwells from one sample up, and the time
+//     constants, the weights and the number of components of dwells drawn from one and two exponentials, also with
+//     a time constant near the sampling interval (where the truncation at one sample matters).
+//   * DwellTracker (ProcessingKinetics.cpp): the dwells of a known idealized trace, with the dwells spanning the block
+//     boundaries, and without the dwells cut by the start, by the samples not idealized and by breakRun().
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../ProcessingConductance.h"
+#include "../ProcessingDrift.h"
+#include "../ProcessingKinetics.h"
+#include "../ProcessingNoise.h"
+#include "Check.h"
+#include <math.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+static const double FS = 5000;
+static const int BLOCK = 5000;
+
+// Independent channels opening at open_rate and closing at close_rate [1/s] (Po = open_rate / (open_rate + close_rate)).
+// The noise is AR(1) with the lag-1 autocorrelation rho and the standard deviation sd.
+struct SyntheticChannels {
+    int channels;
+    double open_rate, close_rate;
+    double unitary, sd, rho;
+    std::mt19937 rng;
+    std::vector<bool> open;
+    double noise;
+
+    SyntheticChannels(int channels, double unitary, double sd, double rho, unsigned seed)
+        : channels(channels), open_rate(50), close_rate(100), unitary(unitary), sd(sd), rho(rho), rng(seed), open(channels, false), noise(0) {}
+
+    // One block at the baseline "baseline[i]": the current and the number of open channels.
+    void block(const double* baseline, double* current, int* idealized) {
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        std::normal_distribution<double> gauss(0.0, sd * sqrt(1 - rho * rho));
+        for (int i = 0; i < BLOCK; i++) {
+            int k = 0;
+            for (int c = 0; c < channels; c++) {
+                if (uniform(rng) < (open[c] ? close_rate : open_rate) / FS) open[c] = !open[c];
+                if (open[c]) k++;
+            }
+            noise = rho * noise + gauss(rng);
+            current[i] = baseline[i] + k * unitary + noise;
+            idealized[i] = k;
+        }
+    }
+};
+
+// expected[k]: the fraction of the time with k open channels (binomial).
+static void runConductance(const char* name, int count, double open_rate, double baseline_guess, double unitary_guess,
+    const double* expected) {
+    const double baseline = 2, unitary = -11.5, sd = 1;
+    SyntheticChannels channels(count, unitary, sd, 0, count);
+    channels.open_rate = open_rate;
+    ConductanceEstimator estimator;
+    estimator.setup(-300, 300, 0.1, 0.98);
+    estimator.reset(baseline_guess, unitary_guess);
+    std::vector<double> base(BLOCK, baseline), current(BLOCK);
+    std::vector<int> idealized(BLOCK);
+    for (int b = 0; b < 30; b++) {
+        channels.block(base.data(), current.data(), idealized.data());
+        estimator.update(current.data(), BLOCK);
+    }
+    const ConductanceEstimate& e = estimator.estimate();
+    CHECK(e.valid && e.levels >= count, "conductance %s: valid %d, %d levels", name, (int)e.valid, e.levels);
+    CHECK(fabs(e.baseline - baseline) < 0.2, "conductance %s: baseline %f, expected %f", name, e.baseline, baseline);
+    CHECK(fabs(e.unitary - unitary) < 0.2, "conductance %s: unitary %f, expected %f", name, e.unitary, unitary);
+    CHECK(fabs(e.sigma - sd) < 0.1, "conductance %s: sigma %f, expected %f", name, e.sigma, sd);
+    for (int k = 0; k <= count && k < e.levels; k++) {
+        CHECK(fabs(e.weight[k] - expected[k]) < 0.05, "conductance %s: the weight of level %d is %f, expected %f", name, k,
+            e.weight[k], expected[k]);
+    }
+}
+
+static void testConductance() {
+    // Po = 1/3: the most frequent level is one open channel, so the guesses tell which level is the baseline.
+    const double three[4] = { 8.0 / 27, 12.0 / 27, 6.0 / 27, 1.0 / 27 };
+    runConductance("(guessed)", 3, 50, 0, -12, three);
+    // Po = 1/6: the closed level is the most frequent.
+    const double two[3] = { 25.0 / 36, 10.0 / 36, 1.0 / 36 };
+    runConductance("(blind)", 2, 20, 0, 0, two);
+}
+
+static void testDrift() {
+    const double start = 5, slope = 0.5, sd = 1;
+    SyntheticChannels channels(2, -11.5, sd, 0, 2);
+    DriftTracker tracker;
+    tracker.setup(FS, 0.5, 10);
+    tracker.reset(start, sd);
+    std::vector<double> base(BLOCK), current(BLOCK);
+    std::vector<int> idealized(BLOCK);
+    double worst = 0;
+    for (int b = 0; b < 60; b++) {
+        for (int i = 0; i < BLOCK; i++) base[i] = start + slope * (b * BLOCK + i) / FS;
+        channels.block(base.data(), current.data(), idealized.data());
+        tracker.update(current.data(), idealized.data(), BLOCK);
+        double error = fabs(tracker.baseline() - base[BLOCK - 1]);
+        if (b >= 5 && error > worst) worst = error;
+    }
+    // The Kalman filter of a random walk lags a ramp by a fraction of the drift in its time constant.
+    CHECK(worst < 0.3, "drift: the baseline is up to %f pA off the drifting one", worst);
+    CHECK(tracker.samplesUsed() > BLOCK / 10 && tracker.samplesUsed() < BLOCK, "drift: %d samples used", tracker.samplesUsed());
+    CHECK(fabs(tracker.noiseSD() - sd) < 0.1, "drift: noise SD %f, expected %f", tracker.noiseSD(), sd);
+    CHECK(tracker.baselineSD() > 0 && tracker.baselineSD() < 0.3, "drift: baseline SD %f", tracker.baselineSD());
+
+    // A baseline jump of 3 pA is followed within a few seconds.
+    for (int b = 0; b < 5; b++) {
+        for (int i = 0; i < BLOCK; i++) base[i] = 8;
+        channels.block(base.data(), current.data(), idealized.data());
+        tracker.update(current.data(), idealized.data(), BLOCK);
+    }
+    CHECK(fabs(tracker.baseline() - 8) < 0.3, "drift: the baseline %f after a step to 8 pA", tracker.baseline());
+}
+
+static NoiseEstimate runNoise(NoiseEstimator* estimator, double rho, double sd, double unitary, unsigned seed) {
+    SyntheticChannels channels(2, unitary, sd, rho, seed);
+    estimator->setup(FS, 0.01, 0.9, 10);
+    estimator->reset();
+    std::vector<double> base(BLOCK, 1.0), current(BLOCK);
+    std::vector<int> idealized(BLOCK);
+    for (int b = 0; b < 40; b++) {
+        channels.block(base.data(), current.data(), idealized.data());
+        estimator->update(current.data(), idealized.data(), BLOCK);
+    }
+    return estimator->estimate(unitary, 0.7, 0.2, 100);
+}
+
+static void testNoise() {
+    const double sd = 1, unitary = -8;
+    NoiseEstimator estimator;
+
+    // White noise: rho = 0, and the levels at the baseline and at the multiples of the unitary current.
+    NoiseEstimate e = runNoise(&estimator, 0, sd, unitary, 3);
+    CHECK(e.valid, "noise: not valid after 40 blocks");
+    for (int k = 0; k <= 2; k++) {
+        CHECK(fabs(e.level_mean[k] - (1 + k * unitary)) < 0.1 && fabs(e.level_rms[k] - sd) < 0.1, "noise: level %d: %f +/- %f, expected %f +/- %f",
+            k, e.level_mean[k], e.level_rms[k], 1 + k * unitary, sd);
+    }
+    CHECK(fabs(e.sigma - sd) < 0.1 && fabs(e.sigma_hf - sd) < 0.1 && fabs(e.rho) < 0.1, "noise: white: sigma %f, sigma_hf %f, rho %f",
+        e.sigma, e.sigma_hf, e.rho);
+    CHECK(fabs(e.snr - fabs(unitary) / e.sigma) < 1e-9, "noise: SNR %f", e.snr);
+    // The hysteresis width is where the noise crosses at the target rate (inside the limits of [0.5, 0.95]).
+    double rate = estimator.falseEventRate(e.sigma, e.rho, e.threshold * fabs(unitary));
+    CHECK(e.threshold > 0.5 && e.threshold < 0.95 && fabs(rate - 0.01) < 1e-3, "noise: threshold %f gives %f false events/s",
+        e.threshold, rate);
+    // Even the open level of two channels does not reach the rupture threshold.
+    CHECK(e.rupture_threshold > fabs(1 + 2 * unitary) + 4 * sd, "noise: rupture threshold %f", e.rupture_threshold);
+
+    // The noise filtered by the amplifier (AR(1), rho = 0.6): fewer crossings, so a narrower hysteresis for the same rate.
+    NoiseEstimate filtered = runNoise(&estimator, 0.6, sd, unitary, 5);
+    CHECK(filtered.valid && fabs(filtered.rho - 0.6) < 0.05 && fabs(filtered.sigma - sd) < 0.1, "noise: AR(1): sigma %f, rho %f, expected %f, 0.6",
+        filtered.sigma, filtered.rho, sd);
+    CHECK(filtered.threshold < e.threshold, "noise: AR(1): threshold %f, white %f", filtered.threshold, e.threshold);
+
+    // Too few samples: the defaults.
+    estimator.reset();
+    NoiseEstimate none = estimator.estimate(unitary, 0.7, 0.2, 100);
+    CHECK(!none.valid && none.threshold == 0.7 && none.detection_threshold == 0.2 && none.rupture_threshold == 100,
+        "noise: the defaults are not returned before the samples");
+}
+
+// A histogram of "count" dwells of sampling interval dt [ms] from a mixture of exponentials: the geometric distribution of
+// the sampled dwells, P(d) = (1 - q) q^(d - 1), q = exp(-dt / tau).
+static void drawDwells(LogHistogram* hist, int components, const double* tau, const double* weight, int count, unsigned seed) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    for (int k = 0; k < count; k++) {
+        int j = (components == 2 && uniform(rng) >= weight[0]) ? 1 : 0;
+        std::geometric_distribution<int> failures(1 - exp(-hist->dt() / tau[j]));
+        hist->add(1 + failures(rng));
+    }
+}
+
+static void testLogHistogram() {
+    LogHistogram hist;
+    hist.setup(0.2);
+    // Every dwell in the bin of its duration (the bins without an integer duration stay empty).
+    bool binned = true;
+    for (int d = 1; d <= 100000; d = (d < 100) ? d + 1 : d * 11 / 10) {
+        LogHistogram one;
+        one.setup(0.2);
+        one.add(d);
+        int found = -1;
+        for (int i = 0; i < KINETICS_BINS; i++) {
+            if (one.bin(i) == 1) found = i;
+        }
+        double ms = d * 0.2;
+        if (found < 0 || ms < one.edge(found) - 1e-9 || ms >= one.edge(found + 1) - 1e-9) {
+            CHECK(false, "histogram: a dwell of %d samples in bin %d", d, found);
+            binned = false;
+            break;
+        }
+        hist.add(d);
+    }
+    CHECK(binned && hist.bin(0) == 1 && hist.edge(0) == 0.2, "histogram: one sample in bin %f from %f ms", hist.bin(0), hist.edge(0));
+    // Nothing shorter than one sample, and the dwells longer than the last edge in the last bin.
+    double count = hist.count(), sum = hist.sumDuration();
+    hist.add(0);
+    CHECK(hist.count() == count && hist.sumDuration() == sum, "histogram: a dwell of 0 samples was added");
+    double last = hist.bin(KINETICS_BINS - 1);
+    hist.add(2000000000);
+    CHECK(hist.bin(KINETICS_BINS - 1) == last + 1 && fabs(hist.sumDuration() - sum - 4e8) < 1e-3, "histogram: the longest dwell");
+    hist.clear();
+    CHECK(hist.count() == 0 && hist.sumDuration() == 0, "histogram: clear() kept the dwells");
+}
+
+static void testDwellFit() {
+    const double dt = 1000.0 / FS;
+    LogHistogram hist;
+
+    // One exponential of 2 ms (10 samples).
+    const double one_tau[1] = { 2.0 }, one_weight[1] = { 1.0 };
+    hist.setup(dt);
+    drawDwells(&hist, 1, one_tau, one_weight, 5000, 11);
+    KineticsFit fit = fitDwellTimes(hist);
+    CHECK(fit.components == 1 && fabs(fit.tau[0] - 2.0) < 0.06 && fit.dwells == 5000, "fit: one exponential: %d components, tau %f ms",
+        fit.components, fit.tau[0]);
+
+    // 1 ms (60 %) and 20 ms (40 %): two peaks on the log bins.
+    const double two_tau[2] = { 1.0, 20.0 }, two_weight[2] = { 0.6, 0.4 };
+    hist.setup(dt);
+    drawDwells(&hist, 2, two_tau, two_weight, 20000, 12);
+    fit = fitDwellTimes(hist);
+    CHECK(fit.components == 2, "fit: two exponentials: %d components", fit.components);
+    for (int j = 0; j < 2 && fit.components == 2; j++) {
+        CHECK(fabs(fit.tau[j] - two_tau[j]) < 0.05 * two_tau[j] && fabs(fit.weight[j] - two_weight[j]) < 0.03,
+            "fit: two exponentials: component %d: tau %f ms, weight %f, expected %f, %f", j, fit.tau[j], fit.weight[j], two_tau[j], two_weight[j]);
+    }
+    // Limited to one component: a single time constant between the two.
+    KineticsFit single = fitDwellTimes(hist, 1);
+    CHECK(single.components == 1 && single.tau[0] > two_tau[0] && single.tau[0] < two_tau[1], "fit: one of two exponentials: tau %f ms",
+        single.tau[0]);
+
+    // A time constant of 1.5 samples: half the dwells last one sample. The mean dwell (dt / (1 - q)) overestimates it,
+    // while the fit of the truncated distribution recovers it.
+    const double fast_tau[1] = { 1.5 * dt };
+    hist.setup(dt);
+    drawDwells(&hist, 1, fast_tau, one_weight, 5000, 13);
+    fit = fitDwellTimes(hist);
+    double mean_dwell = hist.sumDuration() / hist.count();
+    CHECK(fit.components == 1 && fabs(fit.tau[0] - fast_tau[0]) < 0.05 * fast_tau[0] && mean_dwell > 1.3 * fast_tau[0],
+        "fit: tau of 1.5 samples: %f ms, expected %f, mean dwell %f", fit.tau[0], fast_tau[0], mean_dwell);
+
+    // Too few dwells: no fit.
+    hist.setup(dt);
+    for (int k = 0; k < 4; k++) hist.add(10);
+    fit = fitDwellTimes(hist);
+    CHECK(fit.components == 0 && fit.dwells == 4, "fit: 4 dwells: %d components", fit.components);
+}
+
+struct Dwell {
+    int level;      // -1: not idealized
+    int start, duration;
+};
+
+static void testDwellTracker() {
+    // Dwells of 1 to 3000 samples at 0, 1 or 2 open channels, and a stretch not idealized.
+    std::mt19937 rng(14);
+    std::uniform_int_distribution<int> length(1, 3000), level(0, 2);
+    std::vector<Dwell> dwells;
+    int total = 0, previous = -1;
+    for (int k = 0; k < 120; k++) {
+        Dwell d;
+        d.level = (k == 60) ? -1 : level(rng);
+        while (d.level == previous) d.level = level(rng);
+        d.start = total;
+        d.duration = length(rng);
+        dwells.push_back(d);
+        total += d.duration;
+        previous = d.level;
+    }
+    std::vector<int> idealized(total);
+    std::vector<double> current(total);
+    for (const Dwell& d : dwells) {
+        for (int i = d.start; i < d.start + d.duration; i++) {
+            idealized[i] = d.level;
+            current[i] = -10.0 * d.level + ((i % 2) ? 0.5 : -0.5);
+        }
+    }
+
+    // Blocks of 777 samples, and breakRun() before the block starting at "broken".
+    const int block = 777, broken = 40 * block;
+    DwellTracker tracker;
+    tracker.setup(FS, 64);
+    std::vector<Dwell> found;
+    bool negative_start = false;
+    for (int start = 0; start < total; start += block) {
+        if (start == broken) tracker.breakRun();
+        int n = std::min(total - start, block);
+        int count = tracker.process(idealized.data() + start, current.data() + start, n);
+        for (int k = 0; k < count; k++) {
+            const DwellEvent& e = tracker.events()[k];
+            found.push_back(Dwell{ e.level, start + e.start, e.duration });
+            if (e.start < 0) negative_start = true;
+            CHECK(fabs(e.mean_current - (-10.0 * e.level)) < 0.5 / e.duration + 1e-9, "tracker: dwell at %d: mean %f pA at level %d",
+                start + e.start, e.mean_current, e.level);
+        }
+    }
+
+    // Recorded: the dwells between two transitions, except the first one, the last one (not finished), the neighbours
+    // of the samples not idealized and the dwells across the break.
+    std::vector<Dwell> expected;
+    int closed = 0;
+    for (size_t k = 1; k + 1 < dwells.size(); k++) {
+        const Dwell& d = dwells[k];
+        if (d.level < 0 || dwells[k - 1].level < 0 || dwells[k + 1].level < 0) continue;
+        if (d.start <= broken && broken <= d.start + d.duration) continue;
+        expected.push_back(d);
+        if (d.level == 0) closed++;
+    }
+    bool same = (found.size() == expected.size());
+    for (size_t k = 0; same && k < found.size(); k++) {
+        same = (found[k].level == expected[k].level && found[k].start == expected[k].start && found[k].duration == expected[k].duration);
+        CHECK(same, "tracker: dwell %d: level %d at %d for %d samples, expected %d at %d for %d", (int)k, found[k].level, found[k].start,
+            found[k].duration, expected[k].level, expected[k].start, expected[k].duration);
+    }
+    CHECK(found.size() == expected.size() && expected.size() > 90, "tracker: %d dwells, expected %d", (int)found.size(), (int)expected.size());
+    CHECK(negative_start, "tracker: no dwell started in a previous block");
+    CHECK(tracker.closedHistogram().count() == closed && tracker.openHistogram().count() == (int)expected.size() - closed,
+        "tracker: %f closed and %f open dwells in the histograms, expected %d and %d", tracker.closedHistogram().count(),
+        tracker.openHistogram().count(), closed, (int)expected.size() - closed);
+
+    // Over the capacity of the event table: the events are dropped, the histograms still count them.
+    DwellTracker small;
+    small.setup(FS, 2);
+    const int levels[8] = { 0, 1, 1, 0, 2, 2, 1, 0 };
+    const double zero[8] = { 0 };
+    int count = small.process(levels, zero, 8);
+    CHECK(count == 2 && small.dropped() == 2 && small.openHistogram().count() == 3 && small.closedHistogram().count() == 1,
+        "tracker: capacity 2: %d events, %d dropped", count, small.dropped());
+}
+
+int main() {
+    testConductance();
+    testDrift();
+    testNoise();
+    testLogHistogram();
+    testDwellFit();
+    testDwellTracker();
+    return finishChecks("All estimator checks passed");
+}
@@ -0,0 +1,211 @@
+/******************************************************************************
+// test_filters.cpp
+//
+// Checks the signal conditioning of the Processing Block on synthetic signals with known content:
+//   * LowPassFilter (ProcessingFilter.cpp): the DC gain, the gain at the cutoff and above it, the delay of a step
+//     (which the Processing Block removes from the event times), and the same output whatever the block boundaries.
+//     The decimated output is every "decimation"-th sample of the full-rate one, also without a filter.
+//   * MainsCanceller (ProcessingMains.cpp): a 50.2 Hz fundamental and its 3rd harmonic over channel steps and white noise
+//     are tracked and removed, and the steps are kept.
+//   * SpectrumMonitor (ProcessingSpectrum.cpp): the PSD of white noise is flat at 2 sigma^2 / fs, a sine appears in its
+//     bin and band, and the band RMS add up to the RMS of the signal.
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../ProcessingFilter.h"
+#include "../ProcessingMains.h"
+#include "../ProcessingSpectrum.h"
+#include "Check.h"
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <thread>
+#include <vector>
+
+static const double FS = 5000;
+static const int BLOCK = 5000;
+static const double PI = 3.14159265358979323846;
+
+// Filter x in blocks of "block" samples.
+static std::vector<double> filtered(LowPassFilter* filter, const std::vector<double>& x, int block) {
+    std::vector<double> y(x.size());
+    for (size_t start = 0; start < x.size(); start += block) {
+        int n = (int)std::min(x.size() - start, (size_t)block);
+        filter->process(x.data() + start, y.data() + start, n);
+    }
+    return y;
+}
+
+// The amplitude of the sine of frequency f after the filter (measured after the transient).
+static double sineGain(int type, double cutoff, double f) {
+    LowPassFilter filter;
+    filter.setup(type, cutoff, FS);
+    std::vector<double> x(4 * BLOCK);
+    for (size_t i = 0; i < x.size(); i++) x[i] = sin(2 * PI * f * i / FS);
+    std::vector<double> y = filtered(&filter, x, BLOCK);
+    double sumsq = 0;
+    for (size_t i = 2 * BLOCK; i < x.size(); i++) sumsq += y[i] * y[i];
+    return sqrt(2 * sumsq / (x.size() - 2 * BLOCK));
+}
+
+static void testLowPass(int type, const char* name) {
+    const double cutoff = 500;
+    LowPassFilter filter;
+    filter.setup(type, cutoff, FS);
+    CHECK(filter.type() == type && filter.delay() > 0, "%s: type %d, delay %f", name, filter.type(), filter.delay());
+
+    // A step from 0 to 10 pA after a constant start: the output starts at the steady state, and crosses the middle
+    // of the step at the delay.
+    const int step = 1000;
+    std::vector<double> x(2 * BLOCK, 0.0);
+    for (size_t i = step; i < x.size(); i++) x[i] = 10;
+    std::vector<double> y = filtered(&filter, x, BLOCK);
+    CHECK(fabs(y[0]) < 1e-12 && fabs(y[step - 100]) < 1e-9 && fabs(y[x.size() - 1] - 10) < 1e-6, "%s: the levels %f, %f, %f",
+        name, y[0], y[step - 100], y[x.size() - 1]);
+    int crossing = step;
+    while (crossing < (int)y.size() && y[crossing] < 5) crossing++;
+    // The crossing is between the samples crossing - 1 and crossing.
+    double at = crossing - 1 + (5 - y[crossing - 1]) / (y[crossing] - y[crossing - 1]);
+    CHECK(fabs(at - step - filter.delay()) < 0.6, "%s: the step crosses its middle %.2f samples after it, delay %.2f", name,
+        at - step, filter.delay());
+
+    // The state is carried over: the same output for any block boundaries.
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0.0, 1.0);
+    for (double& v : x) v = noise(rng);
+    filter.reset();
+    std::vector<double> whole = filtered(&filter, x, (int)x.size());
+    filter.reset();
+    std::vector<double> pieces = filtered(&filter, x, 777);
+    double diff = 0;
+    for (size_t i = 0; i < x.size(); i++) diff = std::max(diff, fabs(whole[i] - pieces[i]));
+    CHECK(diff < 1e-9, "%s: the output depends on the blocks by %e", name, diff);
+
+    // -3 dB at the cutoff, the pass band kept and the stop band removed.
+    double at_cutoff = sineGain(type, cutoff, cutoff), pass = sineGain(type, cutoff, cutoff / 10), stop = sineGain(type, cutoff, 4 * cutoff);
+    CHECK(fabs(at_cutoff - sqrt(0.5)) < 0.03, "%s: gain %f at the cutoff", name, at_cutoff);
+    CHECK(pass > 0.99 && pass < 1.001 && stop < 0.05, "%s: gain %f at cutoff / 10, %f at 4 * cutoff", name, pass, stop);
+
+    // Decimated by 4 (the output rate of 1250 Hz is above twice the cutoff): the samples 0, 4, 8, ... of the full-rate
+    // output, with the phase carried over the blocks of 777 samples.
+    const int decimation = 4;
+    LowPassFilter decimated;
+    decimated.setup(type, cutoff, FS, 4, decimation);
+    std::vector<double> slow(x.size());
+    int m = 0;
+    for (size_t start = 0; start < x.size(); start += 777) {
+        int n = (int)std::min(x.size() - start, (size_t)777);
+        m += decimated.process(x.data() + start, slow.data() + m, n);
+    }
+    int expected = ((int)x.size() + decimation - 1) / decimation;
+    diff = 0;
+    for (int k = 0; k < m && k < expected; k++) diff = std::max(diff, fabs(slow[k] - whole[k * decimation]));
+    CHECK(m == expected && diff < 1e-9, "%s: %d decimated samples (expected %d), off by %e", name, m, expected, diff);
+}
+
+static void testMains() {
+    MainsCanceller canceller;
+    canceller.setup(FS, 50, 5, 0.5);
+    const double f = 50.2, a1 = 5, a3 = 2, sd = 0.5;
+    std::mt19937 rng(2);
+    std::normal_distribution<double> noise(0.0, sd);
+    std::vector<double> clean(BLOCK), x(BLOCK), y(BLOCK);
+    double residual = 0, step_in = 0, step_out = 0;
+    int residual_n = 0, step_n = 0;
+    for (int b = 0; b < 30; b++) {
+        for (int i = 0; i < BLOCK; i++) {
+            double t = (b * BLOCK + i) / FS;
+            // A channel of -10 pA, open for 0.1 s every 0.25 s.
+            clean[i] = 3 + ((i % 1250) >= 1000 ? -10 : 0) + noise(rng);
+            x[i] = clean[i] + a1 * sin(2 * PI * f * t) + a3 * sin(2 * PI * 3 * f * t + 1);
+        }
+        canceller.process(x.data(), y.data(), BLOCK);
+        if (b < 20) continue;
+        for (int i = 0; i < BLOCK; i++) {
+            residual += (y[i] - clean[i]) * (y[i] - clean[i]);
+            residual_n++;
+            // The mean of the open samples relative to the closed ones before them.
+            if ((i % 1250) >= 1050) {
+                step_in += clean[i] - clean[i - 1050 + 900];
+                step_out += y[i] - y[i - 1050 + 900];
+                step_n++;
+            }
+        }
+    }
+    double rms = sqrt(residual / residual_n);
+    CHECK(fabs(canceller.frequency() - f) < 0.05, "mains: frequency %f, expected %f", canceller.frequency(), f);
+    CHECK(fabs(canceller.amplitude(1) - a1) < 0.25 && fabs(canceller.amplitude(3) - a3) < 0.25 && canceller.amplitude(2) < 0.25,
+        "mains: amplitudes %f, %f, %f, expected %f, 0, %f", canceller.amplitude(1), canceller.amplitude(2), canceller.amplitude(3), a1, a3);
+    CHECK(rms < 0.2 * sqrt(a1 * a1 / 2 + a3 * a3 / 2), "mains: %f pA rms left of %f", rms, sqrt(a1 * a1 / 2 + a3 * a3 / 2));
+    CHECK(fabs(step_out - step_in) / step_n < 0.2, "mains: the channel step is %f pA after the canceller, %f before", step_out / step_n,
+        step_in / step_n);
+}
+
+static bool waitSpectrum(SpectrumMonitor* monitor, SpectrumResult* result) {
+    for (int k = 0; k < 5000; k++) {
+        if (monitor->poll(result)) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return false;
+}
+
+static void testSpectrum() {
+    const double sd = 2, amplitude = 3, f = 200;
+    SpectrumMonitor monitor;
+    monitor.setup(FS, 4096, 0.5, 0.7);
+    SpectrumResult result;
+    std::mt19937 rng(3);
+    std::normal_distribution<double> noise(0.0, sd);
+    std::vector<double> x(BLOCK);
+    bool updated = false;
+    for (int b = 0; b < 20; b++) {
+        for (int i = 0; i < BLOCK; i++) x[i] = 10 + noise(rng) + amplitude * sin(2 * PI * f * (b * BLOCK + i) / FS);
+        monitor.request(x.data(), BLOCK);
+        updated = waitSpectrum(&monitor, &result);
+    }
+    CHECK(updated && result.segments > 20 && result.psd.size() == 2048 && result.frequency.size() == 2048, "spectrum: %d segments, %d bins",
+        result.segments, (int)result.psd.size());
+    if (!updated || result.psd.size() != 2048) return;
+
+    // White noise: 2 sigma^2 / fs, and the median is not moved by the sine.
+    double white = 2 * sd * sd / FS;
+    CHECK(fabs(result.noise_floor - white) < 0.1 * white, "spectrum: noise floor %e, expected %e", result.noise_floor, white);
+    size_t peak = 0;
+    for (size_t k = 0; k < result.psd.size(); k++) {
+        if (result.psd[k] > result.psd[peak]) peak = k;
+    }
+    CHECK(fabs(result.frequency[peak] - f) < FS / 4096, "spectrum: the peak at %f Hz, expected %f", result.frequency[peak], f);
+
+    // The bands: the noise spreads over the bands by their width, the sine is in 100-1000 Hz (the DC is excluded).
+    const double edges[SPECTRUM_BANDS + 1] = { 1, 10, 100, 1000, FS / 2 };
+    double total = 0;
+    for (int b = 0; b < SPECTRUM_BANDS; b++) {
+        double expected = white * (edges[b + 1] - edges[b]) + ((b == 2) ? amplitude * amplitude / 2 : 0);
+        CHECK(fabs(result.band_rms[b] * result.band_rms[b] - expected) < 0.15 * expected, "spectrum: band %d: %f pA rms, expected %f", b,
+            result.band_rms[b], sqrt(expected));
+        total += result.band_rms[b] * result.band_rms[b];
+    }
+    double power = sd * sd + amplitude * amplitude / 2;
+    CHECK(fabs(total - power) < 0.05 * power, "spectrum: the bands add up to %f pA rms, expected %f", sqrt(total), sqrt(power));
+}
+
+int main() {
+    testLowPass(FILTER_GAUSSIAN, "Gaussian");
+    testLowPass(FILTER_BESSEL, "Bessel");
+    LowPassFilter none;
+    none.setup(FILTER_NONE, 500, FS);
+    CHECK(none.delay() == 0, "no filter: delay %f", none.delay());
+    none.setup(FILTER_GAUSSIAN, 3000, FS);      // Above the Nyquist frequency
+    CHECK(none.type() == FILTER_NONE && none.delay() == 0, "cutoff above Nyquist: type %d, delay %f", none.type(), none.delay());
+    none.setup(FILTER_NONE, 0, FS, 4, 3);
+    const double ramp[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    double picked[8] = { 0 };
+    int m = none.process(ramp, picked, 5);
+    m += none.process(ramp + 5, picked + m, 3);
+    CHECK(m == 3 && picked[0] == 0 && picked[1] == 3 && picked[2] == 6, "no filter, decimated by 3: %d samples %f, %f, %f", m,
+        picked[0], picked[1], picked[2]);
+    testMains();
+    testSpectrum();
+    return finishChecks("All filter checks passed");
+}
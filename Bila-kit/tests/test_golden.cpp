@@ -0,0 +1,301 @@
+/******************************************************************************
+// test_golden.cpp
+//
+// Golden-output regression of the Processing Block (ProcessingBlock.cpp): every bundled recording (data/) and
+// two simulated nanopore runs are processed as bilakit_cli does, and the results are compared with the stored golden
+// outputs (tests/golden):
+//   * <case>.csv               per second: the number of channels, Po and the estimated membrane voltage.
+//   * <case>-conductance.csv   (nanopores) the conductance events (POSTProcessed.csv).
+// (capture.txt is not a case: a single 1 s block with 250 ms timestamps, and no recorded protein or holding voltage.)
+// The throughput of every case is also reported. A performance rewrite of the hot loops must pass this test.
+//
+// Usage: test_golden --data DIR --golden DIR [--out DIR] [--update]
+//   --update   rewrite the golden outputs (review the diff before committing them).
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../MyHelper.h"
+#include "../ProcessingBlock.h"
+#include "../PipelineStages.h"
+#include "../SenseReplay.h"
+#include "../SenseSimulated.h"
+#include "../Platform.h"
+#include "Check.h"
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+// Tolerances. The number of channels and the number of conductance events must match exactly.
+static const double OPPROB_TOL = 1e-4;
+static const double VOLTAGE_TOL = 0.5;          // [mV] (the Boltzmann inversion amplifies the differences of Po near 0 and 1)
+static const double CONDUCTANCE_TOL = 0.1;      // [pS]
+static const double EVENT_TIME_TOL = 0.011;     // [s] (the events are exported with 0.01 s resolution)
+
+struct GoldenCase {
+    const char* name;
+    const char* file;       // nullptr: the simulated amplifier (nanopores)
+    int proteinType;
+    int bias_voltage;       // [mV]
+    int idealizerType;
+    int postprocessType;
+    int seconds;            // (Simulated only)
+};
+
+// The per-second results. opProb < 0: not estimated.
+struct GoldenRow {
+    int time;
+    int channels;
+    double opProb;
+    double stimuli;
+};
+
+struct ConductanceEvent {
+    double time;
+    double conductance;
+};
+
+static bool readRows(const std::string& path, std::vector<GoldenRow>* rows) {
+    FILE* fp = fopen(path.c_str(), "r");
+    if (!fp) return false;
+    char line[256];
+    if (!fgets(line, sizeof(line), fp)) {
+        fclose(fp);
+        return false;
+    }
+    rows->clear();
+    while (fgets(line, sizeof(line), fp)) {
+        GoldenRow r;
+        char op[64], st[64];
+        if (sscanf(line, "%d,%d,%63[^,],%63[^,\n]", &r.time, &r.channels, op, st) != 4) continue;
+        r.opProb = (strcmp(op, "#N/A") == 0) ? -1 : atof(op);
+        r.stimuli = (strcmp(st, "#N/A") == 0) ? NAN : atof(st);
+        rows->push_back(r);
+    }
+    fclose(fp);
+    return true;
+}
+
+static bool writeRows(const std::string& path, const std::vector<GoldenRow>& rows) {
+    FILE* fp;
+    fopen_s(&fp, path.c_str(), "w");
+    if (!fp) return false;
+    fprintf(fp, "time [s],channels [-],opProb,estimatedStimuli\n");
+    for (const GoldenRow& r : rows) {
+        fprintf(fp, "%d,%d,", r.time, r.channels);
+        if (r.opProb < 0) fprintf(fp, "#N/A,");
+        else fprintf(fp, "%.6f,", r.opProb);
+        if (isnan(r.stimuli)) fprintf(fp, "#N/A\n");
+        else fprintf(fp, "%.6f\n", r.stimuli);
+    }
+    return fclose(fp) == 0;
+}
+
+// POSTProcessed.csv (or its golden copy). A missing file has no event.
+static std::vector<ConductanceEvent> readEvents(const std::string& path) {
+    std::vector<ConductanceEvent> events;
+    FILE* fp = fopen(path.c_str(), "r");
+    if (!fp) return events;
+    char line[256];
+    if (fgets(line, sizeof(line), fp)) {
+        while (fgets(line, sizeof(line), fp)) {
+            ConductanceEvent e;
+            if (sscanf(line, "%lf,%lf", &e.time, &e.conductance) == 2) events.push_back(e);
+        }
+    }
+    fclose(fp);
+    return events;
+}
+
+static bool writeEvents(const std::string& path, const std::vector<ConductanceEvent>& events) {
+    FILE* fp;
+    fopen_s(&fp, path.c_str(), "w");
+    if (!fp) return false;
+    fprintf(fp, "step_time [s],conductance [pS]\n");
+    for (const ConductanceEvent& e : events) fprintf(fp, "%.2f,%.2f\n", e.time, e.conductance);
+    return fclose(fp) == 0;
+}
+
+// Process one case like bilakit_cli. Returns the processing time [s] (-1 if the input cannot be read).
+static double runCase(const GoldenCase& c, const std::string& data_dir, const std::string& out_dir,
+    std::vector<GoldenRow>* rows, std::vector<ConductanceEvent>* events, int* samples) {
+    ProcessingConfig config = defaultProcessingConfig();
+    config.proteinType = c.proteinType;
+    config.BKstimuli = 0;
+    config.idealizerType = c.idealizerType;
+    config.postprocessType = c.postprocessType;
+    config.conductance = (c.proteinType == 0) ? 0.89 : 0.299;
+    config.bias_voltage = c.bias_voltage;
+    ProcessingControls controls = defaultProcessingControls();
+
+    ReplayFile replay;
+    SimulatedAmplifier amplifier;
+    int blocks;
+    if (c.file) {
+        if (replay.open(data_dir + PATH_SEPARATOR + c.file, 0, true) != 0) return -1;
+        config.dataStartTime = replay.startTime();
+        blocks = replay.blocks();
+    }
+    else {
+        SimulationParams sim = defaultSimulationParams();
+        sim.current_per_channel = config.conductance * config.bias_voltage;
+        sim.channels = 3;
+        sim.open_rate = 0.05;   // Insertions every ~10 s, which seldom leave.
+        sim.close_rate = 0.02;
+        sim.seed = 20220619;
+        amplifier.setup(sim, SAMPLE_FREQ, SAMPLE_FREQ);
+        blocks = c.seconds;
+    }
+
+    ExportStage exportStage;
+    exportStage.start(64);
+    ProcessingBlock processing;
+    std::string prefix = out_dir + PATH_SEPARATOR + c.name + "-";
+    processing.start(config, controls, prefix, &exportStage);
+
+    SenseBlock block;
+    block.time.resize(SAMPLE_FREQ);
+    block.current.resize(SAMPLE_FREQ);
+    rows->clear();
+    double elapsed = 0;
+    for (int b = 0; b < blocks; b++) {
+        block.index = b;
+        block.status = 0;
+        block.switch_index = -1;
+        if (c.file) {
+            int switchIndex = 0;
+            int result = replay.read(block.time.data(), block.current.data(), b, &switchIndex);
+            if (result == -1) break;
+            if (result != 1) {
+                block.status = 1;
+                block.voltage = result;
+                block.switch_index = switchIndex;
+            }
+        }
+        else {
+            amplifier.read(block.time.data(), block.current.data(), b, SAMPLE_FREQ);
+        }
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        if (block.status == 1 && block.voltage != processing.config.bias_voltage) {
+            processing.voltage_switch_index = block.switch_index;
+            processing.setHoldingVoltage(block.voltage, &controls);
+        }
+        processing.process(&block, &controls);
+        elapsed += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+
+        GoldenRow r;
+        r.time = processing.nowTime;
+        r.channels = processing.rupture_flag ? -1 : processing.maxOpenNumber;
+        bool estimated = (c.proteinType != 0 && !processing.rupture_flag && processing.opProb >= 0);
+        r.opProb = estimated ? processing.opProb : -1;
+        r.stimuli = estimated ? processing.stimuli : NAN;
+        rows->push_back(r);
+    }
+    exportStage.flush();
+    exportStage.stop();
+    *events = readEvents(prefix + "POSTProcessed.csv");
+    *samples = (int)rows->size() * SAMPLE_FREQ;
+    return elapsed;
+}
+
+static void compareCase(const GoldenCase& c, const std::vector<GoldenRow>& golden, const std::vector<GoldenRow>& rows,
+    const std::vector<ConductanceEvent>& golden_events, const std::vector<ConductanceEvent>& events) {
+    CHECK(golden.size() == rows.size(), "%s: %d seconds (golden %d)", c.name, (int)rows.size(), (int)golden.size());
+    int reported = 0;
+    for (size_t k = 0; k < golden.size() && k < rows.size(); k++) {
+        const GoldenRow& g = golden[k];
+        const GoldenRow& r = rows[k];
+        bool same = (g.time == r.time) && (g.channels == r.channels) && ((g.opProb < 0) == (r.opProb < 0))
+            && (g.opProb < 0 || fabs(g.opProb - r.opProb) <= OPPROB_TOL)
+            && (isnan(g.stimuli) == isnan(r.stimuli)) && (isnan(g.stimuli) || fabs(g.stimuli - r.stimuli) <= VOLTAGE_TOL);
+        if (!same && reported++ < 5) {
+            CHECK(false, "%s: t = %d [s]: channels %d, Po %f, stimuli %f (golden: t = %d [s], channels %d, Po %f, stimuli %f)", c.name,
+                r.time, r.channels, r.opProb, r.stimuli, g.time, g.channels, g.opProb, g.stimuli);
+        }
+        else if (!same) {
+            failures++;
+        }
+    }
+    CHECK(golden_events.size() == events.size(), "%s: %d conductance events (golden %d)", c.name, (int)events.size(), (int)golden_events.size());
+    for (size_t k = 0; k < golden_events.size() && k < events.size(); k++) {
+        CHECK(fabs(golden_events[k].time - events[k].time) <= EVENT_TIME_TOL && fabs(golden_events[k].conductance - events[k].conductance) <= CONDUCTANCE_TOL,
+            "%s: conductance event %d: %.2f [s] %.2f [pS] (golden %.2f [s] %.2f [pS])", c.name, (int)k,
+            events[k].time, events[k].conductance, golden_events[k].time, golden_events[k].conductance);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string data_dir = "data";
+    std::string golden_dir = "tests/golden";
+    std::string out_dir = "golden_out";
+    bool update = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) data_dir = argv[++i];
+        else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) golden_dir = argv[++i];
+        else if (strcmp(argv[i], "--out") == 0 && i + 1 < argc) out_dir = argv[++i];
+        else if (strcmp(argv[i], "--update") == 0) update = true;
+        else {
+            printf("Usage: test_golden --data DIR --golden DIR [--out DIR] [--update]\n");
+            return 2;
+        }
+    }
+    if (makeDirectory(out_dir.c_str()) != 0) {
+        printf("Unable to create %s\n", out_dir.c_str());
+        return 1;
+    }
+
+    // BK channels at the holding voltage of each recording, and AHL nanopores (conductance measurement).
+    const GoldenCase cases[] = {
+        { "minus20mV", "minus20mV.atf", 1, -20, 0, 0, 0 },
+        { "minus40mV", "minus40mV.atf", 1, -40, 0, 0, 0 },
+        { "minus60mV", "minus60mV.atf", 1, -60, 0, 0, 0 },
+        { "plus20mV", "plus20mV.atf", 1, 20, 0, 0, 0 },
+        { "plus30mV", "plus30mV.atf", 1, 30, 0, 0, 0 },
+        { "plus40mV", "plus40mV.atf", 1, 40, 0, 0, 0 },
+        { "plus60mV", "plus60mV.atf", 1, 60, 0, 0, 0 },
+        { "plus40mV-hmm", "plus40mV.atf", 1, 40, 1, 0, 0 },
+        { "simulated-ahl", nullptr, 0, 50, 0, 1, 60 },
+        { "simulated-ahl-cusum", nullptr, 0, 50, 2, 1, 60 },
+    };
+
+    printf("%-22s %8s %8s %14s %12s\n", "case", "seconds", "events", "Msamples/s", "x realtime");
+    long long total_samples = 0;
+    double total_elapsed = 0;
+    for (const GoldenCase& c : cases) {
+        std::vector<GoldenRow> rows;
+        std::vector<ConductanceEvent> events;
+        int samples = 0;
+        double elapsed = runCase(c, data_dir, out_dir, &rows, &events, &samples);
+        if (elapsed < 0) {
+            CHECK(false, "%s: unable to read %s", c.name, c.file);
+            continue;
+        }
+        total_samples += samples;
+        total_elapsed += elapsed;
+        printf("%-22s %8d %8d %14.2f %12.0f\n", c.name, (int)rows.size(), (int)events.size(),
+            samples / elapsed / 1e6, (double)samples / SAMPLE_FREQ / elapsed);
+
+        std::string golden_path = golden_dir + PATH_SEPARATOR + c.name + ".csv";
+        std::string events_path = golden_dir + PATH_SEPARATOR + c.name + "-conductance.csv";
+        if (update) {
+            CHECK(writeRows(golden_path, rows), "%s: unable to write %s", c.name, golden_path.c_str());
+            if (c.postprocessType == 1) CHECK(writeEvents(events_path, events), "%s: unable to write %s", c.name, events_path.c_str());
+            continue;
+        }
+        std::vector<GoldenRow> golden;
+        if (!readRows(golden_path, &golden)) {
+            CHECK(false, "%s: no golden output %s (run with --update)", c.name, golden_path.c_str());
+            continue;
+        }
+        compareCase(c, golden, rows, readEvents(events_path), events);
+    }
+    if (total_elapsed > 0) {
+        printf("%-22s %8lld %8s %14.2f %12.0f\n", "total", total_samples / SAMPLE_FREQ, "",
+            total_samples / total_elapsed / 1e6, (double)total_samples / SAMPLE_FREQ / total_elapsed);
+    }
+
+    return finishChecks(update ? "Golden outputs updated" : "All golden outputs matched");
+}
@@ -0,0 +1,97 @@
+/******************************************************************************
+// test_poestimate.cpp
+//
+// Checks the maximum-likelihood estimate of N and Po (ProcessingPoEstimate.cpp) on idealized traces of N simulated
+// channels with a known open probability (independent two-state channels, dwells of tens of samples):
+//   * N is found exactly, and Po is within 4 standard errors (and 0.03) of the true value.
+//   * The edge cases: a single channel, Po close to 0 (N is then not identifiable, but N * Po is, and Po is with a
+//     fixed N), Po close to and equal to 1, no opening at all, the samples which are not idealized, and a fixed N above
+//     PO_ESTIMATE_MAX_LEVEL (limited to it).
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../ProcessingPoEstimate.h"
+#include "Check.h"
+#include <math.h>
+#include <random>
+#include <vector>
+
+// The idealized trace (the number of open channels) of N independent channels with the open probability p.
+// rate: the probability per sample that a channel changes its state, summed over both directions.
+static std::vector<int> simulate(int N, double p, int samples, unsigned seed, double rate = 0.05) {
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    const double to_open = rate * p, to_close = rate * (1 - p);
+    std::vector<bool> open(N);
+    for (int c = 0; c < N; c++) open[c] = uniform(rng) < p;
+    std::vector<int> trace(samples);
+    for (int k = 0; k < samples; k++) {
+        int level = 0;
+        for (int c = 0; c < N; c++) {
+            if (open[c] ? uniform(rng) < to_close : uniform(rng) < to_open) open[c] = !open[c];
+            level += open[c];
+        }
+        trace[k] = level;
+    }
+    return trace;
+}
+
+static void checkEstimate(int N, double p, int fixedN = -1) {
+    std::vector<int> trace = simulate(N, p, 200000, 7 * N + (unsigned)(p * 100));
+    PoEstimate e = estimateOpenProbability(trace.data(), 0, (int)trace.size(), fixedN);
+    CHECK(e.valid && e.samples == (int)trace.size() && e.runs > 1000, "N %d, Po %.2f: valid %d, %d samples, %d runs", N, p,
+        (int)e.valid, e.samples, e.runs);
+    CHECK(e.N == N, "N %d, Po %.2f: N estimated as %d", N, p, e.N);
+    CHECK(fabs(e.opProb - p) < 4 * e.opProb_se && fabs(e.opProb - p) < 0.03, "N %d, Po %.2f: Po estimated as %.4f (se %.4f)",
+        N, p, e.opProb, e.opProb_se);
+    CHECK(e.opProb_se > 0 && e.opProb_se < 0.05, "N %d, Po %.2f: standard error %f", N, p, e.opProb_se);
+}
+
+int main() {
+    checkEstimate(4, 0.5);
+    checkEstimate(3, 0.3);
+    checkEstimate(5, 0.7);
+    checkEstimate(1, 0.5);     // A single channel
+    checkEstimate(1, 0.1);
+
+    // Po close to 1: the channels are almost always open.
+    checkEstimate(2, 0.97);
+    // Po equal to 1: every channel is always open (Po is kept below 1 for the standard error).
+    std::vector<int> all_open(10000, 3);
+    PoEstimate e = estimateOpenProbability(all_open.data(), 0, (int)all_open.size());
+    CHECK(e.valid && e.N == 3 && e.opProb > 0.99 && e.opProb <= 1, "all open: N %d, Po %f", e.N, e.opProb);
+
+    // Po close to 0: two channels never open together in a short trace, so N is not identifiable and the smallest N
+    // which explains the trace is taken, but N * Po (the mean number of open channels) is right, and so is Po with N fixed.
+    std::vector<int> rare = simulate(3, 0.02, 200000, 11);
+    double mean = 0;
+    for (int k : rare) mean += k;
+    mean /= rare.size();
+    e = estimateOpenProbability(rare.data(), 0, (int)rare.size());
+    CHECK(e.valid && e.N >= 1 && e.N <= 3 && fabs(e.N * e.opProb - mean) < 1e-9, "rare openings: N %d, Po %f (mean %f)", e.N, e.opProb, mean);
+    checkEstimate(3, 0.02, 3);
+
+    // No opening at all: Po cannot be estimated.
+    std::vector<int> closed(10000, 0);
+    e = estimateOpenProbability(closed.data(), 0, (int)closed.size());
+    CHECK(!e.valid && e.opProb == -99 && e.maxOpenNumber == 0, "all closed: valid %d, Po %f", (int)e.valid, e.opProb);
+
+    // The samples which are not idealized (< 0) are skipped, and so is everything outside [start, end).
+    std::vector<int> trace = simulate(2, 0.4, 50000, 13);
+    PoEstimate reference = estimateOpenProbability(trace.data(), 0, (int)trace.size());
+    std::vector<int> padded(1000, -1);
+    padded.insert(padded.end(), trace.begin(), trace.end());
+    padded.insert(padded.end(), 1000, 2);
+    e = estimateOpenProbability(padded.data(), 0, 1000 + (int)trace.size());
+    CHECK(e.samples == reference.samples && e.N == reference.N && e.opProb == reference.opProb,
+        "with samples not idealized: %d samples, N %d, Po %f (expected %d, %d, %f)", e.samples, e.N, e.opProb,
+        reference.samples, reference.N, reference.opProb);
+
+    // A fixed N beyond the estimator (e.g. max_open=130 in a sweep): the largest N it handles.
+    e = estimateOpenProbability(trace.data(), 0, (int)trace.size(), PO_ESTIMATE_MAX_LEVEL + 2);
+    CHECK(e.valid && e.N == PO_ESTIMATE_MAX_LEVEL && fabs(e.N * e.opProb - reference.N * reference.opProb) < 1e-9
+        && e.logLikelihood < reference.logLikelihood, "fixed N %d: N %d, Po %f, log-likelihood %f (%f with N %d)",
+        PO_ESTIMATE_MAX_LEVEL + 2, e.N, e.opProb, e.logLikelihood, reference.logLikelihood, reference.N);
+
+    return finishChecks("All Po estimate checks passed");
+}
@@ -0,0 +1,74 @@
+/******************************************************************************
+// test_protocol.cpp
+//
+// Checks the Po-V protocol (ProtocolScheduler.cpp) on channels whose Po follows a known Boltzmann function of the
+// holding voltage, with an amplifier which applies a requested voltage one block (or more) late, as the Sense worker
+// does while the next block is already queued:
+//   * Every step holds only the blocks acquired at its voltage, so its Po is that of the voltage.
+//   * The fitted a and x0 are those of the channels.
+//   * The same without a lag, with a longer one, and when the first voltage is already applied.
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../ProtocolScheduler.h"
+#include "Check.h"
+#include <math.h>
+#include <deque>
+#include <random>
+#include <vector>
+
+static const double A = 0.05, X0 = 10;     // The channels: Po = 1 / (1 + exp(-A * (V - X0)))
+static const double PO_SD = 0.01;           // Block-to-block variation of Po
+
+static double boltzmann(int voltage) {
+    return 1.0 / (1.0 + exp(-A * (voltage - X0)));
+}
+
+// lag: the number of blocks acquired at the old voltage after a switch is requested.
+static void runProtocol(int lag, int initial_voltage) {
+    const std::vector<int> voltages = { -60, -40, -20, 20, 40, 60 };
+    ProtocolScheduler protocol;
+    protocol.setup(voltages, 0.01, 5, 60);
+    protocol.start();
+
+    std::mt19937 rng(lag + 1);
+    std::normal_distribution<double> noise(0.0, PO_SD);
+    // The voltage applied to the blocks acquired from now on. The blocks already queued keep their voltage.
+    std::deque<int> queued(lag, initial_voltage);
+    int applied = protocol.currentVoltage();
+
+    int block = 0;
+    for (; block < 2000 && protocol.isRunning(); block++) {
+        queued.push_back(applied);
+        int voltage = queued.front();
+        queued.pop_front();
+        // A rupture every 13 blocks: the block has no Po.
+        double opProb = (block % 13 == 12) ? -1 : boltzmann(voltage) + noise(rng);
+        if (protocol.update(opProb, voltage) && protocol.isRunning()) applied = protocol.currentVoltage();
+    }
+    CHECK(!protocol.isRunning(), "lag %d: the protocol is still running after %d blocks", lag, block);
+
+    const std::vector<ProtocolStepResult>& results = protocol.allResults();
+    CHECK(results.size() == voltages.size(), "lag %d: %d steps, expected %d", lag, (int)results.size(), (int)voltages.size());
+    for (size_t s = 0; s < results.size() && s < voltages.size(); s++) {
+        const ProtocolStepResult& r = results[s];
+        double expected = boltzmann(voltages[s]);
+        CHECK(r.voltage == voltages[s] && r.converged && r.dwell >= 5, "lag %d: step %d at %d mV, converged %d, dwell %d", lag,
+            (int)s, r.voltage, (int)r.converged, r.dwell);
+        CHECK(fabs(r.opProb - expected) < 0.015 && r.opProb_halfwidth <= 0.01, "lag %d: %d mV: Po %.4f (+/- %.4f), expected %.4f",
+            lag, r.voltage, r.opProb, r.opProb_halfwidth, expected);
+    }
+
+    double a, x0, a_se, x0_se;
+    bool fitted = protocol.fitBoltzmann(&a, &x0, &a_se, &x0_se);
+    CHECK(fitted && fabs(a - A) < 0.005 && fabs(x0 - X0) < 2, "lag %d: fit %d, a %f (SE %f), x0 %f (SE %f)", lag, (int)fitted,
+        a, a_se, x0, x0_se);
+}
+
+int main() {
+    runProtocol(1, 50);    // The Sense worker: the next block is queued when the switch is requested.
+    runProtocol(0, 50);
+    runProtocol(3, 50);
+    runProtocol(1, -60);   // The first voltage is already applied: no block is skipped at the start.
+    return finishChecks("All protocol checks passed");
+}
@@ -0,0 +1,221 @@
+/******************************************************************************
+// test_recorder.cpp
+//
+// Checks the tiered recorder of the raw current (ProcessingRecorder.cpp) on a ramp (the current of the sample g is g,
+// so every row tells which samples it holds):
+//   * Every sample within the window of an event is written at the full rate, including the pre-trigger samples of
+//     the previous block and the windows cut by the end of the data; the other samples are summarized, exactly once.
+//   * The summaries hold the right min/max/mean and are aligned; the rows lag the acquisition by the pre-trigger window.
+//   * The window rows list the merged events and their kinds, and triggerLevels() finds the transitions and ruptures.
+//   * The events of the filtered current are moved back by the filter delay, into the previous block if needed,
+//     with their whole windows.
+//   * The same, with the events of every block triggered in the reverse order (e.g. the voltage switch after the
+//     transitions, as the Processing Block does).
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../ProcessingRecorder.h"
+#include "Check.h"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const int BLOCK = 1000;
+static const int BLOCKS = 5;
+static const int PRE = 100, POST = 200, SUMMARY = 50;
+
+struct Output {
+    std::string full, summary, windows;
+};
+
+// The samples written at the full rate (their current is their index), and the summarized ones, counted per sample.
+static void parse(const Output& out, std::vector<int>* full_count, std::vector<int>* summary_count) {
+    full_count->assign(BLOCK * BLOCKS, 0);
+    summary_count->assign(BLOCK * BLOCKS, 0);
+    const char* p = out.full.c_str();
+    double t, v;
+    int consumed;
+    while (sscanf(p, "%lf,%lf\n%n", &t, &v, &consumed) == 2) {
+        int g = (int)lround(v);
+        CHECK(g >= 0 && g < BLOCK * BLOCKS && fabs(t - g / 5000.0) < 1e-6, "full-rate row %f,%f", t, v);
+        if (g >= 0 && g < BLOCK * BLOCKS) (*full_count)[g]++;
+        p += consumed;
+    }
+    p = out.summary.c_str();
+    int n;
+    double mn, mx, mean;
+    while (sscanf(p, "%lf,%d,%lf,%lf,%lf\n%n", &t, &n, &mn, &mx, &mean, &consumed) == 5) {
+        int first = (int)lround(mn), last = (int)lround(mx);
+        CHECK(last - first + 1 == n && fabs(mean - (first + last) / 2.0) < 1e-6 && fabs(t - first / 5000.0) < 1e-6,
+            "summary row %f,%d,%f,%f,%f", t, n, mn, mx, mean);
+        CHECK(n <= SUMMARY && (last + 1) / SUMMARY - first / SUMMARY <= 1, "summary row [%d, %d] crosses the alignment", first, last);
+        for (int g = first; g <= last && g < BLOCK * BLOCKS; g++) (*summary_count)[g]++;
+        p += consumed;
+    }
+}
+
+static void testWindows(bool reverse) {
+    RecorderParams params = { PRE, POST, SUMMARY };
+    TieredRecorder recorder;
+    recorder.setup(params, BLOCK);
+    Output out;
+    // The events: in a block; near the start of a block (the pre-trigger samples are in the previous block);
+    // at the end of a block (the window continues in the next one); and at the end of the data.
+    const int events[][2] = { { 1020, TRIGGER_VOLTAGE }, { 1500, TRIGGER_TRANSITION }, { 1550, TRIGGER_CONDUCTANCE },
+        { 2050, TRIGGER_VOLTAGE }, { 3990, TRIGGER_TRANSITION }, { 4995, TRIGGER_RUPTURE } };
+    const int num_events = (int)(sizeof(events) / sizeof(events[0]));
+    std::vector<double> time(BLOCK), current(BLOCK);
+    for (int b = 0; b < BLOCKS; b++) {
+        for (int idx = 0; idx < BLOCK; idx++) {
+            time[idx] = (b * BLOCK + idx) / 5000.0;
+            current[idx] = b * BLOCK + idx;
+        }
+        recorder.push(time.data(), current.data(), BLOCK);
+        for (int k = 0; k < num_events; k++) {
+            const int* e = events[reverse ? num_events - 1 - k : k];
+            if (e[0] / BLOCK == b) recorder.trigger(e[0] % BLOCK, e[1]);
+        }
+        recorder.emit(&out.full, &out.summary, &out.windows);
+        if (b == 0) {
+            std::vector<int> full, summary;
+            parse(out, &full, &summary);
+            int held = 0;
+            for (int g = 0; g < BLOCK; g++) held += (full[g] + summary[g] == 0);
+            CHECK(held == PRE, "%d samples held after the first block, expected %d (the pre-trigger window)", held, PRE);
+        }
+    }
+    recorder.emit(&out.full, &out.summary, &out.windows, true);
+
+    std::vector<int> full, summary;
+    parse(out, &full, &summary);
+    std::vector<bool> in_window(BLOCK * BLOCKS, false);
+    for (const int* e : events) {
+        for (int g = e[0] - PRE; g < e[0] + POST; g++) {
+            if (g >= 0 && g < BLOCK * BLOCKS) in_window[g] = true;
+        }
+    }
+    int wrong = 0, full_total = 0;
+    for (int g = 0; g < BLOCK * BLOCKS; g++) {
+        if (in_window[g] ? (full[g] != 1 || summary[g] != 0) : (full[g] != 0 || summary[g] != 1)) {
+            if (wrong++ < 5) printf("  sample %d: %d full-rate, %d summarized (window: %d)\n", g, full[g], summary[g], (int)in_window[g]);
+        }
+        full_total += full[g];
+    }
+    CHECK(wrong == 0, "%d samples are not written as expected", wrong);
+    CHECK(recorder.fullSamples() == full_total && recorder.samples() == BLOCK * BLOCKS, "statistics: %lld full-rate, %lld samples",
+        recorder.fullSamples(), recorder.samples());
+
+    // The windows: [920, 1220), [1400, 1750) with 2 events, [1950, 2250), [3890, 4190), [4895, 5000) cut by the end.
+    const char* order = reverse ? "reverse order: " : "";
+    char kinds[5][64];
+    double start[5], end[5];
+    int num[5];
+    const char* p = out.windows.c_str();
+    int rows = 0, consumed;
+    while (rows < 5 && sscanf(p, "%lf,%lf,%d,%63[^\n]\n%n", &start[rows], &end[rows], &num[rows], kinds[rows], &consumed) == 4) {
+        p += consumed;
+        rows++;
+    }
+    CHECK(rows == 5 && *p == '\0', "%s%d window rows, expected 5", order, rows);
+    if (rows == 5) {
+        CHECK(fabs(start[0] - 920 / 5000.0) < 1e-6 && fabs(end[0] - 1219 / 5000.0) < 1e-6 && num[0] == 1 && strcmp(kinds[0], "voltage") == 0,
+            "%swindow 1: %f - %f, %d events, %s", order, start[0], end[0], num[0], kinds[0]);
+        CHECK(fabs(start[1] - 1400 / 5000.0) < 1e-6 && fabs(end[1] - 1749 / 5000.0) < 1e-6 && num[1] == 2 && strcmp(kinds[1], "transition|conductance") == 0,
+            "%swindow 2: %f - %f, %d events, %s", order, start[1], end[1], num[1], kinds[1]);
+        CHECK(num[2] == 1 && strcmp(kinds[2], "voltage") == 0, "%swindow 3: %d events, %s", order, num[2], kinds[2]);
+        CHECK(fabs(start[3] - 3890 / 5000.0) < 1e-6 && fabs(end[3] - 4189 / 5000.0) < 1e-6, "%swindow 4: %f - %f", order, start[3], end[3]);
+        CHECK(fabs(end[4] - 4999 / 5000.0) < 1e-6 && strcmp(kinds[4], "rupture") == 0, "%swindow 5: ends at %f, %s", order, end[4], kinds[4]);
+    }
+}
+
+// Overlapping windows triggered out of order are merged on both ends, and absorb the windows they reach.
+static void testMerge() {
+    RecorderParams params = { PRE, POST, SUMMARY };
+    TieredRecorder recorder;
+    recorder.setup(params, BLOCK);
+    std::vector<double> time(BLOCK), current(BLOCK);
+    for (int idx = 0; idx < BLOCK; idx++) {
+        time[idx] = idx / 5000.0;
+        current[idx] = idx;
+    }
+    Output out;
+    recorder.push(time.data(), current.data(), BLOCK);
+    recorder.trigger(700, TRIGGER_TRANSITION);     // [600, 900)
+    recorder.trigger(300, TRIGGER_TRANSITION);     // [200, 500)
+    recorder.trigger(450, TRIGGER_VOLTAGE);        // [350, 650): joins both
+    recorder.emit(&out.full, &out.summary, &out.windows, true);
+    double start = 0, end = 0;
+    int num = 0;
+    char kinds[64] = "";
+    int fields = sscanf(out.windows.c_str(), "%lf,%lf,%d,%63[^\n]", &start, &end, &num, kinds);
+    CHECK(fields == 4 && fabs(start - 200 / 5000.0) < 1e-6 && fabs(end - 899 / 5000.0) < 1e-6 && num == 3
+        && strcmp(kinds, "transition|voltage") == 0 && out.windows.find('\n') == out.windows.size() - 1,
+        "merged windows:\n%s", out.windows.c_str());
+    CHECK(recorder.fullSamples() == 700, "%lld full-rate samples, expected 700", recorder.fullSamples());
+}
+
+static void testLevels() {
+    RecorderParams params = { 10, 10, 100 };
+    TieredRecorder recorder;
+    recorder.setup(params, BLOCK);
+    std::vector<double> time(BLOCK, 0.0), current(BLOCK, 0.0);
+    std::vector<int> levels(BLOCK, 0);
+    for (int idx = 300; idx < 400; idx++) levels[idx] = 1;     // A transition at 300 and 400
+    for (int idx = 800; idx < BLOCK; idx++) levels[idx] = -1;  // A rupture at 800
+    Output out;
+    recorder.push(time.data(), current.data(), BLOCK);
+    recorder.triggerLevels(levels.data(), BLOCK);
+    recorder.emit(&out.full, &out.summary, &out.windows);
+    for (int idx = 0; idx < BLOCK; idx++) levels[idx] = 0;      // The recovery at the start of the next block
+    recorder.push(time.data(), current.data(), BLOCK);
+    recorder.triggerLevels(levels.data(), BLOCK);
+    recorder.emit(&out.full, &out.summary, &out.windows, true);
+    int transitions = 0, ruptures = 0;
+    for (size_t pos = 0; (pos = out.windows.find("transition", pos)) != std::string::npos; pos++) transitions++;
+    for (size_t pos = 0; (pos = out.windows.find("rupture", pos)) != std::string::npos; pos++) ruptures++;
+    CHECK(transitions == 2 && ruptures == 2, "%d transition and %d rupture windows, expected 2 and 2:\n%s", transitions, ruptures, out.windows.c_str());
+    CHECK(recorder.fullSamples() == 4 * 20, "%lld full-rate samples, expected %d", recorder.fullSamples(), 4 * 20);
+}
+
+// triggerLevels() with the lag of a filter: the windows are around the transitions of the unfiltered current,
+// including a transition found at the start of a block which happened at the end of the previous one.
+static void testLag() {
+    RecorderParams params = { 10, 10, 100, 5 };
+    TieredRecorder recorder;
+    recorder.setup(params, BLOCK);
+    std::vector<double> time(BLOCK), current(BLOCK, 0.0);
+    std::vector<int> levels(BLOCK, 0);
+    for (int idx = 300; idx < BLOCK; idx++) levels[idx] = 1;
+    Output out;
+    for (int b = 0; b < 2; b++) {
+        for (int idx = 0; idx < BLOCK; idx++) time[idx] = (b * BLOCK + idx) / 5000.0;
+        recorder.push(time.data(), current.data(), BLOCK);
+        recorder.triggerLevels(levels.data(), BLOCK, 5);
+        recorder.emit(&out.full, &out.summary, &out.windows, b == 1);
+        for (int idx = 0; idx < BLOCK; idx++) levels[idx] = (idx < 2) ? 1 : 0;     // A transition at 2 of the second block
+    }
+    double start[2] = { 0, 0 }, end[2] = { 0, 0 };
+    int num = 0;
+    const char* row = out.windows.c_str();
+    for (int w = 0; w < 2 && row && *row; w++) {
+        if (sscanf(row, "%lf,%lf", &start[w], &end[w]) == 2) num++;
+        row = strchr(row, '\n');
+        if (row) row++;
+    }
+    CHECK(num == 2 && fabs(start[0] - 285 / 5000.0) < 1e-6 && fabs(end[0] - 304 / 5000.0) < 1e-6, "first window %f - %f:\n%s",
+        start[0], end[0], out.windows.c_str());
+    CHECK(fabs(start[1] - (BLOCK - 13) / 5000.0) < 1e-6 && fabs(end[1] - (BLOCK + 6) / 5000.0) < 1e-6, "second window %f - %f:\n%s",
+        start[1], end[1], out.windows.c_str());
+    CHECK(recorder.fullSamples() == 2 * 20, "%lld full-rate samples, expected %d", recorder.fullSamples(), 2 * 20);
+}
+
+int main() {
+    testWindows(false);
+    testWindows(true);
+    testMerge();
+    testLevels();
+    testLag();
+    return finishChecks("All recorder checks passed");
+}
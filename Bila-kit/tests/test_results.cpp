@@ -0,0 +1,159 @@
+/******************************************************************************
+// test_results.cpp
+//
+// Checks the results server (PipelineResults.cpp) on the loopback interface:
+//   * Every subscriber receives every message published, in order, with its sequence number.
+//   * A subscriber which never reads loses its oldest messages, without slowing down publish() or the other
+//     subscribers.
+//   * The subscribers which are gone are dropped, a Unix socket works (not on Windows), and a bad endpoint fails.
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../PipelineResults.h"
+#include "Check.h"
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static ResultMessage message(int k) {
+    ResultMessage m;
+    memset(&m, 0, sizeof(m));
+    m.time = k;
+    m.opProb = 0.5;
+    m.stimuli = 2.0 * k;
+    m.channels = 3;
+    m.flags = RESULT_VALID | ((k % 2) ? RESULT_EMPHASIS : 0);
+    m.bias_voltage = 40;
+    m.protein_type = 1;
+    return m;
+}
+
+// Wait until the server counts "n" subscribers (they are accepted by its worker).
+static bool waitClients(const ResultServer& server, int n) {
+    for (int k = 0; k < 500; k++) {
+        if (server.clients() == n) return true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return false;
+}
+
+static void testFanOut(const std::string& endpoint, const std::string& connect) {
+    ResultServer server;
+    int result = server.start(endpoint);
+    CHECK(result == 0, "unable to serve on %s (%d)", endpoint.c_str(), result);
+    if (result != 0) return;
+    std::string target = connect.empty() ? "tcp:127.0.0.1:" + std::to_string(server.port()) : connect;
+    ResultSubscriber subscribers[3];
+    for (ResultSubscriber& s : subscribers) CHECK(s.connect(target) == 0, "unable to connect to %s", target.c_str());
+    CHECK(waitClients(server, 3), "%d subscribers instead of 3", server.clients());
+
+    for (int k = 0; k < 10; k++) server.publish(message(k));
+    for (int i = 0; i < 3; i++) {
+        int wrong = 0, received = 0;
+        ResultMessage m;
+        while (received < 10 && subscribers[i].receive(&m, 2000) == 1) {
+            ResultMessage expected = message(received);
+            wrong += (m.seq != (uint64_t)received || m.time != expected.time || m.stimuli != expected.stimuli
+                || m.flags != expected.flags || m.bias_voltage != 40 || m.protein_type != 1);
+            received++;
+        }
+        CHECK(received == 10 && wrong == 0, "%s: subscriber %d received %d messages (%d wrong)", endpoint.c_str(), i, received, wrong);
+        CHECK(subscribers[i].receive(&m, 50) == 0, "%s: subscriber %d received a message which was not published", endpoint.c_str(), i);
+    }
+    CHECK(server.dropped() == 0, "%s: %lld messages dropped", endpoint.c_str(), server.dropped());
+
+    // The subscribers which are gone.
+    subscribers[0].close();
+    CHECK(waitClients(server, 2), "%s: %d subscribers after a disconnect", endpoint.c_str(), server.clients());
+    server.stop();
+    ResultMessage m;
+    CHECK(subscribers[1].receive(&m, 2000) == -1 && !subscribers[1].connected(), "%s: the end of the server is not seen", endpoint.c_str());
+}
+
+// The socket buffers are much smaller for a Unix socket than on the loopback interface of Linux (megabytes).
+static void testSlowSubscriber(const std::string& endpoint) {
+    ResultServer server;
+    CHECK(server.start(endpoint, 16) == 0, "unable to serve on %s", endpoint.c_str());
+    std::string target = (server.port() > 0) ? "tcp:127.0.0.1:" + std::to_string(server.port()) : endpoint;
+    ResultSubscriber slow, fast;
+    CHECK(slow.connect(target) == 0 && fast.connect(target) == 0, "unable to connect to %s", target.c_str());
+    CHECK(waitClients(server, 2), "%d subscribers instead of 2", server.clients());
+
+    // The slow subscriber never reads: once the socket buffers are full, it loses its oldest messages.
+    const int messages = 20000;
+    uint64_t last = 0;
+    int received = 0, unordered = 0;
+    std::thread reader([&]() {
+        ResultMessage m;
+        bool first = true;
+        while (fast.receive(&m, 2000) == 1) {
+            if (!first && m.seq <= last) unordered++;
+            first = false;
+            last = m.seq;
+            received++;
+            if (last == (uint64_t)messages - 1) break;
+        }
+    });
+    double slowest = 0;
+    for (int k = 0; k < messages; k++) {
+        auto start = std::chrono::steady_clock::now();
+        server.publish(message(k));
+        double us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+        if (us > slowest) slowest = us;
+        // (Lets the worker and the reader in on a single core, so that the messages are dropped by the subscriber
+        // rather than by the queue of the worker.)
+        while (server.pending() > 128) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        if (k % 16 == 0) std::this_thread::yield();
+    }
+    reader.join();
+    CHECK(last == (uint64_t)messages - 1, "the fast subscriber stopped at the message %llu of %d", (unsigned long long)last, messages);
+    CHECK(unordered == 0, "%d messages out of order", unordered);
+    CHECK(server.dropped() > 0, "no message was dropped");
+
+    // What the slow subscriber reads at last: the oldest messages, then the newest ones.
+    ResultMessage m;
+    uint64_t previous = 0;
+    int slow_received = 0, gaps = 0;
+    unordered = 0;
+    while (slow.receive(&m, 200) == 1) {
+        if (slow_received > 0 && m.seq <= previous) unordered++;
+        if (slow_received > 0 && m.seq > previous + 1) gaps++;
+        previous = m.seq;
+        slow_received++;
+    }
+    CHECK(gaps > 0 && unordered == 0 && previous == (uint64_t)messages - 1, "the slow subscriber received %d messages up to %llu (%d gaps, %d out of order)",
+        slow_received, (unsigned long long)previous, gaps, unordered);
+    printf("Slow subscriber: %d of %d messages received (%lld dropped in all), the fast one %d; publish() %.1f [us] at most\n",
+        slow_received, messages, server.dropped(), received, slowest);
+}
+
+static void testEndpoints() {
+    ResultServer server;
+    CHECK(server.start("udp:5757") != 0 && !server.running(), "the endpoint udp:5757 was accepted");
+    CHECK(server.start("tcp:not-a-port") != 0 && !server.running(), "the endpoint tcp:not-a-port was accepted");
+    CHECK(server.start("tcp:127.0.0.1:0") == 0 && server.port() > 0, "no port was taken for tcp:127.0.0.1:0");
+    ResultServer second;
+    std::string taken = "tcp:127.0.0.1:" + std::to_string(server.port());
+    CHECK(second.start(taken) != 0, "the port of %s was taken twice", taken.c_str());
+    ResultSubscriber subscriber;
+    server.stop();
+    CHECK(subscriber.connect(taken) != 0, "connected to %s after the server stopped", taken.c_str());
+}
+
+int main() {
+    testFanOut("tcp:127.0.0.1:0", "");
+#ifndef _WIN32
+    std::string path = "/tmp/bilakit_test_results.sock";
+    testFanOut("unix:" + path, "unix:" + path);
+#endif
+#ifndef _WIN32
+    testSlowSubscriber("unix:" + path);
+#else
+    testSlowSubscriber("tcp:127.0.0.1:0");
+#endif
+    testEndpoints();
+    return finishChecks("All results checks passed");
+}
@@ -0,0 +1,198 @@
+/******************************************************************************
+// test_stats.cpp
+//
+// Checks the streaming statistics (ProcessingStats.cpp) against the batch statistics of the same values:
+//   * RunningStats: the mean, the unbiased variance and the standard error, also with a large offset (where the
+//     naive sum of squares loses its digits).
+//   * P2Quantile: the median (and the 90th percentile) of normal, uniform and skewed values, and the exact quantile
+//     of the first few values.
+//   * ExpAverage: the weighted mean of the values (a batch sum of the weights alpha (1 - alpha)^age), the prior of set(),
+//     and the variance of stationary values.
+//   * SlidingMean: the mean and the variance of the last "window" values, also with a large offset after many
+//     windows (the running sums are recomputed once per window), and of fewer values than the window.
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../ProcessingStats.h"
+#include "Check.h"
+#include <algorithm>
+#include <math.h>
+#include <random>
+#include <vector>
+
+static double batchMean(const std::vector<double>& x) {
+    double sum = 0;
+    for (double v : x) sum += v;
+    return sum / x.size();
+}
+
+static double batchVariance(const std::vector<double>& x) {
+    double m = batchMean(x), sum = 0;
+    for (double v : x) sum += (v - m) * (v - m);
+    return sum / (x.size() - 1);
+}
+
+// The p-quantile of the sorted values (linear interpolation).
+static double batchQuantile(std::vector<double> x, double p) {
+    std::sort(x.begin(), x.end());
+    double h = p * (x.size() - 1);
+    size_t i = (size_t)h;
+    return (i + 1 < x.size()) ? x[i] + (h - i) * (x[i + 1] - x[i]) : x[i];
+}
+
+static void testRunningStats() {
+    std::mt19937 rng(1);
+    const double offsets[] = { 0.0, 1e6 };
+    for (double offset : offsets) {
+        std::normal_distribution<double> normal(offset + 3.0, 2.0);
+        std::vector<double> x(20000);
+        RunningStats s;
+        for (double& v : x) {
+            v = normal(rng);
+            s.add(v);
+        }
+        double m = batchMean(x), var = batchVariance(x);
+        CHECK(s.size() == (long long)x.size(), "offset %g: %lld values", offset, s.size());
+        CHECK(fabs(s.mean() - m) < 1e-9 * (1 + fabs(m)), "offset %g: mean %.12f, batch %.12f", offset, s.mean(), m);
+        CHECK(fabs(s.variance() - var) < 1e-6 * var, "offset %g: variance %.12f, batch %.12f", offset, s.variance(), var);
+        CHECK(fabs(s.sem() - sqrt(var / x.size())) < 1e-6 * s.sem(), "offset %g: sem %f", offset, s.sem());
+        CHECK(s.lower() < m && m < s.upper(), "offset %g: the mean is outside its confidence interval", offset);
+    }
+
+    RunningStats s;
+    CHECK(s.isEmpty() && s.mean() == 0 && s.variance() == 0 && s.sem() == 0, "an empty RunningStats is not zero");
+    s.add(5.0);
+    CHECK(s.mean() == 5.0 && s.variance() == 0 && s.sem() == 0, "one value: mean %f, variance %f", s.mean(), s.variance());
+    s.add(7.0);
+    CHECK(s.mean() == 6.0 && s.variance() == 2.0, "two values: mean %f, variance %f", s.mean(), s.variance());
+    s.clear();
+    CHECK(s.isEmpty() && s.mean() == 0, "clear() kept the values");
+}
+
+template <class Distribution>
+static void checkQuantile(const char* name, Distribution distribution, double p, double tolerance) {
+    std::mt19937 rng(2);
+    std::vector<double> x(20000);
+    P2Quantile q(p);
+    for (double& v : x) {
+        v = distribution(rng);
+        q.add(v);
+    }
+    double exact = batchQuantile(x, p);
+    // The tolerance is relative to the spread of the values (the interquartile range).
+    double iqr = batchQuantile(x, 0.75) - batchQuantile(x, 0.25);
+    CHECK(fabs(q.quantile() - exact) < tolerance * iqr, "%s: %.0f%% quantile %f, batch %f", name, p * 100, q.quantile(), exact);
+}
+
+static void testP2Quantile() {
+    checkQuantile("normal", std::normal_distribution<double>(10.0, 3.0), 0.5, 0.02);
+    checkQuantile("uniform", std::uniform_real_distribution<double>(-1.0, 1.0), 0.5, 0.02);
+    checkQuantile("exponential", std::exponential_distribution<double>(0.5), 0.5, 0.02);
+    checkQuantile("normal", std::normal_distribution<double>(10.0, 3.0), 0.9, 0.03);
+
+    // Fewer than five values: the exact quantile of the stored values.
+    P2Quantile q(0.5);
+    CHECK(q.isEmpty() && q.quantile() == 0, "an empty P2Quantile is not zero");
+    const double first[] = { 9, 1, 5 };
+    for (double v : first) q.add(v);
+    CHECK(q.quantile() == 5, "the median of {9, 1, 5} is %f", q.quantile());
+    q.clear();
+    q.add(4);
+    CHECK(q.size() == 1 && q.quantile() == 4, "clear() kept the values");
+
+    // The outliers around Po = 0 or 1 (the use in the Processing Block) hardly move the median (sigma = 1 here).
+    std::vector<double> x;
+    q.clear();
+    std::mt19937 rng(3);
+    std::normal_distribution<double> normal(40.0, 1.0);
+    for (int k = 0; k < 2000; k++) {
+        double v = (k % 10 == 0) ? ((k % 20 == 0) ? -1000.0 : 1000.0) : normal(rng);
+        x.push_back(v);
+        q.add(v);
+    }
+    double exact = batchQuantile(x, 0.5);
+    CHECK(fabs(q.quantile() - exact) < 0.25, "with outliers: median %f, batch %f", q.quantile(), exact);
+}
+
+static void testExpAverage() {
+    const double alpha = 0.05;
+    std::mt19937 rng(4);
+    std::normal_distribution<double> normal(3.0, 2.0);
+    std::vector<double> x(2000);
+    ExpAverage a(alpha);
+    CHECK(a.isEmpty() && a.mean() == 0 && a.variance() == 0, "an empty ExpAverage is not zero");
+    for (double& v : x) {
+        v = normal(rng);
+        a.add(v);
+    }
+    // The first value has the weight of all the values before it: (1 - alpha)^(n - 1).
+    double m = x[0] * pow(1 - alpha, (double)x.size() - 1);
+    for (size_t i = 1; i < x.size(); i++) m += alpha * pow(1 - alpha, (double)(x.size() - 1 - i)) * x[i];
+    CHECK(!a.isEmpty() && fabs(a.mean() - m) < 1e-9, "mean %.12f, batch %.12f", a.mean(), m);
+    // About 1 / alpha values in the average: the variance of stationary values within a few of its standard errors.
+    CHECK(fabs(a.variance() - 4.0) < 2.0, "variance %f, expected 4", a.variance());
+
+    // A long stationary series: the variance converges to that of the values.
+    ExpAverage slow(0.001);
+    RunningStats batch;
+    for (int k = 0; k < 100000; k++) {
+        double v = normal(rng);
+        slow.add(v);
+        batch.add(v);
+    }
+    CHECK(fabs(slow.mean() - 3.0) < 0.3 && fabs(slow.variance() - batch.variance()) < 0.1 * batch.variance(),
+        "alpha 0.001: mean %f, variance %f, batch %f", slow.mean(), slow.variance(), batch.variance());
+
+    // A prior mean from set() is moved by alpha towards the first value, instead of being replaced by it.
+    ExpAverage b(0.5);
+    b.set(10);
+    b.add(20);
+    CHECK(b.mean() == 15, "the prior 10 and the value 20: mean %f", b.mean());
+    b.clear();
+    b.add(20);
+    CHECK(b.mean() == 20 && b.variance() == 0, "after clear(): mean %f, variance %f", b.mean(), b.variance());
+    // alpha = 1: only the last value.
+    b.setAlpha(1);
+    b.add(7);
+    CHECK(b.mean() == 7, "alpha 1: mean %f", b.mean());
+}
+
+static void testSlidingMean() {
+    const int window = 100;
+    std::mt19937 rng(5);
+    const double offsets[] = { 0.0, 1e6 };
+    for (double offset : offsets) {
+        std::normal_distribution<double> normal(offset + 3.0, 2.0);
+        std::vector<double> x;
+        SlidingMean s(window);
+        CHECK(s.isEmpty() && s.mean() == 0 && s.variance() == 0, "an empty SlidingMean is not zero");
+        double worst_mean = 0, worst_var = 0;
+        for (int k = 0; k < 100 * window + 37; k++) {
+            x.push_back(normal(rng));
+            s.add(x.back());
+            if (x.size() % 61 != 0 && x.size() != 3) continue;
+            std::vector<double> last(x.end() - std::min((int)x.size(), window), x.end());
+            worst_mean = std::max(worst_mean, fabs(s.mean() - batchMean(last)));
+            worst_var = std::max(worst_var, fabs(s.variance() - batchVariance(last)));
+        }
+        CHECK(s.size() == window, "offset %g: %d values in a window of %d", offset, s.size(), window);
+        CHECK(worst_mean < 1e-9 * (1 + offset) && worst_var < 1e-6 * 4,
+            "offset %g: the mean is off by %e and the variance by %e", offset, worst_mean, worst_var);
+    }
+
+    SlidingMean s(3);
+    const double values[] = { 1, 2, 3, 10 };
+    for (double v : values) s.add(v);
+    CHECK(s.size() == 3 && s.mean() == 5 && fabs(s.variance() - 19) < 1e-9, "{2, 3, 10}: mean %f, variance %f", s.mean(), s.variance());
+    s.clear();
+    s.add(4);
+    CHECK(s.size() == 1 && s.mean() == 4 && s.variance() == 0, "clear() kept the values");
+}
+
+int main() {
+    testRunningStats();
+    testP2Quantile();
+    testExpAverage();
+    testSlidingMean();
+    return finishChecks("All statistics checks passed");
+}
@@ -0,0 +1,144 @@
+/******************************************************************************
+// test_stream.cpp
+//
+// Checks the live stream in shared memory (PipelineStream.cpp and PipelineStreamReader.c):
+//   * The header, the samples and the features are read back with their sequence numbers.
+//   * A reader too slow by more than a ring skips to the oldest samples, and counts the lost ones exactly.
+//   * A reader tailing a writer which overruns it all the time never returns a torn sample (the time, the current
+//     and the level of a sample are written to the three rings separately, and must match).
+//   * The end of the session is seen by the readers, and the name is removed.
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../PipelineStream.h"
+#include "Check.h"
+#include <atomic>
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+static const char* const NAME = "bilakit_test_stream";
+static const uint32_t SAMPLES = 1024, FEATURES = 8;
+
+// A block of n samples from the sequence number "first": time = seq, current = 2 * seq, level = seq % 7.
+static void publishBlock(StreamPublisher* publisher, uint64_t first, int n) {
+    std::vector<double> time(n), current(n);
+    std::vector<int> level(n);
+    for (int k = 0; k < n; k++) {
+        time[k] = (double)(first + k);
+        current[k] = 2.0 * (first + k);
+        level[k] = (int)((first + k) % 7);
+    }
+    BkStreamFeatures f;
+    memset(&f, 0, sizeof(f));
+    f.time = time[0];
+    f.opProb = 0.5;
+    f.bias_voltage = -40;
+    f.max_open = n;
+    publisher->publish(time.data(), current.data(), level.data(), n, f);
+}
+
+static bool consistent(double time, double current, int32_t level) {
+    uint64_t seq = (uint64_t)time;
+    return current == 2.0 * time && level == (int32_t)(seq % 7);
+}
+
+static void testReadBack() {
+    StreamPublisher publisher;
+    CHECK(bkstream_open(NAME) == nullptr, "a stream is open before it is published");
+    CHECK(publisher.open(NAME, 5000, 1, SAMPLES, FEATURES) == 0, "unable to publish %s", NAME);
+    CHECK(publisher.open(NAME, 5000, 1, 1000, FEATURES) != 0 && !publisher.active(), "a capacity which is not a power of 2 was accepted");
+    CHECK(publisher.open(NAME, 5000, 1, SAMPLES, FEATURES) == 0, "unable to publish %s again", NAME);
+    BkStreamReader* reader = bkstream_open(NAME);
+    CHECK(reader != nullptr, "unable to open %s", NAME);
+    if (reader == nullptr) return;
+    const BkStreamHeader* h = bkstream_header(reader);
+    CHECK(h->sample_rate == 5000 && h->protein_type == 1 && h->sample_capacity == SAMPLES && h->feature_capacity == FEATURES
+        && h->state == BKSTREAM_LIVE, "header: %u Hz, protein %d, %u / %u slots, state %u", h->sample_rate, h->protein_type,
+        h->sample_capacity, h->feature_capacity, h->state);
+
+    // Three blocks, read back in full.
+    for (int b = 0; b < 3; b++) publishBlock(&publisher, b * 300, 300);
+    uint64_t seq = 0, lost = 0;
+    std::vector<double> time(SAMPLES), current(SAMPLES);
+    std::vector<int32_t> level(SAMPLES);
+    size_t n = bkstream_read_samples(reader, &seq, time.data(), current.data(), level.data(), SAMPLES, &lost);
+    int wrong = 0;
+    for (size_t k = 0; k < n; k++) wrong += (time[k] != (double)k || !consistent(time[k], current[k], level[k]));
+    CHECK(n == 900 && seq == 900 && lost == 0 && wrong == 0, "%d samples (%d wrong, %d lost), expected 900", (int)n, wrong, (int)lost);
+    CHECK(bkstream_read_samples(reader, &seq, time.data(), nullptr, nullptr, SAMPLES, &lost) == 0, "a sample was read twice");
+    BkStreamFeatures f[FEATURES];
+    uint64_t fseq = 0;
+    n = bkstream_read_features(reader, &fseq, f, FEATURES, &lost);
+    CHECK(n == 3 && f[2].seq == 2 && f[2].first_sample == 600 && f[2].time == 600 && f[2].bias_voltage == -40,
+        "%d features, the last one: seq %llu, first sample %llu", (int)n, (unsigned long long)f[2].seq, (unsigned long long)f[2].first_sample);
+
+    // 10 blocks (more than both rings) without reading: the reader skips to the oldest ones.
+    for (int b = 3; b < 13; b++) publishBlock(&publisher, b * 300, 300);
+    lost = 0;
+    n = bkstream_read_samples(reader, &seq, time.data(), current.data(), level.data(), SAMPLES, &lost);
+    CHECK(n == SAMPLES && lost == 3000 - SAMPLES && time[0] == 3900 - SAMPLES && consistent(time[n - 1], current[n - 1], level[n - 1]),
+        "after an overrun: %d samples from %f, %d lost", (int)n, time[0], (int)lost);
+    lost = 0;
+    n = bkstream_read_features(reader, &fseq, f, FEATURES, &lost);
+    CHECK(n == FEATURES && lost == 10 - FEATURES && f[0].seq == 13 - FEATURES, "after an overrun: %d features from %llu, %d lost",
+        (int)n, (unsigned long long)f[0].seq, (int)lost);
+    CHECK(bkstream_sample_head(reader) == 3900 && bkstream_feature_head(reader) == 13 && publisher.samples() == 3900 && publisher.blocks() == 13,
+        "heads: %llu samples, %llu blocks", (unsigned long long)bkstream_sample_head(reader), (unsigned long long)bkstream_feature_head(reader));
+
+    // The end of the session.
+    CHECK(!bkstream_finished(reader), "the session is finished while it is live");
+    publisher.close();
+    CHECK(bkstream_finished(reader), "the end of the session is not seen");
+    CHECK(bkstream_read_samples(reader, &seq, time.data(), nullptr, nullptr, SAMPLES, &lost) == 0, "a sample after the end");
+    BkStreamReader* late = bkstream_open(NAME);
+    CHECK(late == nullptr, "the name was not removed at the end");
+    bkstream_close(late);
+    bkstream_close(reader);
+}
+
+static void testConcurrent() {
+    StreamPublisher publisher;
+    CHECK(publisher.open(NAME, 5000, 0, SAMPLES, FEATURES) == 0, "unable to publish %s", NAME);
+    BkStreamReader* reader = bkstream_open(NAME);
+    CHECK(reader != nullptr, "unable to open %s", NAME);
+    if (reader == nullptr) return;
+    const int blocks = 20000, block = 100;
+    std::atomic<bool> done(false);
+    uint64_t received = 0, lost = 0;
+    int torn = 0, gaps = 0;
+    std::thread tail([&]() {
+        std::vector<double> time(64), current(64);
+        std::vector<int32_t> level(64);
+        uint64_t seq = 0;
+        for (;;) {
+            bool finished = done.load();
+            size_t n = bkstream_read_samples(reader, &seq, time.data(), current.data(), level.data(), 64, &lost);
+            for (size_t k = 0; k < n; k++) torn += !consistent(time[k], current[k], level[k]);
+            // The samples returned are contiguous, and follow the lost ones.
+            if (n > 0 && time[0] + n != (double)seq) gaps++;
+            received += n;
+            if (n == 0 && finished) break;
+        }
+    });
+    for (int b = 0; b < blocks; b++) {
+        publishBlock(&publisher, (uint64_t)b * block, block);
+        if (b % 16 == 0) std::this_thread::yield();     // (Lets the reader in on a single core.)
+    }
+    done.store(true);
+    tail.join();
+    CHECK(torn == 0, "%d torn samples were returned", torn);
+    CHECK(gaps == 0, "%d reads were not contiguous", gaps);
+    CHECK(received + lost == (uint64_t)blocks * block, "%llu received + %llu lost != %d published", (unsigned long long)received,
+        (unsigned long long)lost, blocks * block);
+    printf("Concurrent reader: %llu samples received, %llu lost (overrun by the writer)\n", (unsigned long long)received, (unsigned long long)lost);
+    bkstream_close(reader);
+    publisher.close();
+}
+
+int main() {
+    testReadBack();
+    testConcurrent();
+    return finishChecks("All stream checks passed");
+}
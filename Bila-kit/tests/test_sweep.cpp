@@ -0,0 +1,157 @@
+/******************************************************************************
+// test_sweep.cpp
+//
+// Checks the parameter sweep (ProcessingSweep.cpp):
+//   * WorkStealingPool runs every task exactly once, also when the tasks are of very different lengths.
+//   * The grids are parsed and enumerated as documented.
+//   * The results do not depend on the number of threads, and the default configuration without the logs gives
+//     the same Po as the golden output of the logged run (tests/golden).
+//
+// Usage: test_sweep --data DIR --golden DIR
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../MyHelper.h"
+#include "../ProcessingSweep.h"
+#include "../PipelineStages.h"
+#include "../Platform.h"
+#include "Check.h"
+#include <atomic>
+#include <chrono>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <thread>
+#include <vector>
+
+static void testPool() {
+    const int n = 200;
+    std::vector<std::atomic<int>> runs(n);
+    for (int t = 0; t < n; t++) runs[t].store(0);
+    WorkStealingPool pool;
+    // The tasks of worker 0 are long, so the others must steal them to finish early.
+    pool.run(n, 4, [&](int task, int) {
+        runs[task].fetch_add(1);
+        if (task % 4 == 0) std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    });
+    int wrong = 0;
+    for (int t = 0; t < n; t++) wrong += (runs[t].load() != 1);
+    CHECK(wrong == 0, "%d tasks were not run exactly once", wrong);
+    CHECK(pool.steals() > 0, "no task was stolen");
+
+    int count = 0;
+    pool.run(0, 4, [&](int, int) { count++; });
+    CHECK(count == 0, "a task was run for an empty pool");
+    pool.run(3, 1, [&](int, int worker) { count += (worker == 0); });
+    CHECK(count == 3, "a single worker ran %d of 3 tasks", count);
+}
+
+static void testAxes() {
+    SweepAxis axis;
+    std::string error;
+    CHECK(parseSweepAxis("threshold=0.5:1.0:0.25", &axis, &error) && axis.values.size() == 3 && fabs(axis.values[2] - 1.0) < 1e-12,
+        "threshold=0.5:1.0:0.25: %s", error.c_str());
+    CHECK(parseSweepAxis("kernel_size=101,201,301", &axis, &error) && axis.values.size() == 3 && axis.values[1] == 201,
+        "kernel_size=101,201,301: %s", error.c_str());
+    CHECK(parseSweepAxis("nanopore_detection_threshold=0.1", &axis, &error) && axis.values.size() == 1, "a single value: %s", error.c_str());
+    CHECK(!parseSweepAxis("unknown=1,2", &axis, &error), "an unknown parameter was accepted");
+    CHECK(!parseSweepAxis("threshold=1,x", &axis, &error), "a non-number was accepted");
+    CHECK(!parseSweepAxis("threshold=1:0:0.1", &axis, &error), "a reversed range was accepted");
+
+    std::vector<SweepAxis> axes(2);
+    axes[0].name = "threshold";
+    axes[0].values = { 0.5, 0.75 };
+    axes[1].name = "drift_guard";
+    axes[1].values = { 5, 10, 20 };
+    CHECK(sweepConfigurations(axes) == 6, "%d configurations of 2 x 3", sweepConfigurations(axes));
+    std::vector<double> v = sweepValues(axes, 4);
+    CHECK(v[0] == 0.75 && v[1] == 10, "configuration 4 = (%g, %g), expected (0.75, 10)", v[0], v[1]);
+    CHECK(sweepConfigurations(std::vector<SweepAxis>()) == 1, "no axis must give one configuration");
+}
+
+static bool sameResult(const SweepResult& a, const SweepResult& b) {
+    return a.recording == b.recording && a.configuration == b.configuration && a.blocks == b.blocks && a.ruptured_blocks == b.ruptured_blocks
+        && a.opProb_blocks == b.opProb_blocks && (a.opProb_mean == b.opProb_mean || (isnan(a.opProb_mean) && isnan(b.opProb_mean)))
+        && a.transitions_per_s == b.transitions_per_s && a.current_per_channel == b.current_per_channel && a.baseline == b.baseline;
+}
+
+static void testSweep(const std::string& data_dir, const std::string& golden_dir) {
+    ProcessingConfig config = defaultProcessingConfig();
+    config.proteinType = 1;
+    config.conductance = 0.299;
+    ProcessingControls controls = defaultProcessingControls();
+    std::vector<SweepRecording> recordings(2);
+    const char* files[2] = { "plus40mV.atf", "plus60mV.atf" };
+    const int voltages[2] = { 40, 60 };
+    for (int k = 0; k < 2; k++) {
+        recordings[k].name = files[k];
+        recordings[k].bias_voltage = voltages[k];
+        int result = recordings[k].file.open(data_dir + PATH_SEPARATOR + files[k], 0, true);
+        CHECK(result == 0, "unable to open %s (%d)", files[k], result);
+        if (result != 0) return;
+    }
+
+    // The default configuration gives the Po of the golden output (the same processing, without the logs).
+    std::vector<SweepResult> base = runSweep(config, controls, recordings, std::vector<SweepAxis>(), 2);
+    CHECK(base.size() == 2, "%d results of 1 configuration x 2 recordings", (int)base.size());
+    FILE* fp;
+    std::string golden = golden_dir + PATH_SEPARATOR + "plus40mV.csv";
+    fopen_s(&fp, golden.c_str(), "r");
+    CHECK(fp != nullptr, "unable to open %s", golden.c_str());
+    if (fp && base.size() == 2) {
+        char line[256];
+        double sum = 0;
+        int n = 0;
+        if (fgets(line, sizeof(line), fp)) {
+            while (fgets(line, sizeof(line), fp)) {
+                double op;
+                if (sscanf(line, "%*d,%*d,%lf", &op) == 1 && op > 0) {
+                    sum += op;
+                    n++;
+                }
+            }
+        }
+        fclose(fp);
+        CHECK(n == base[0].opProb_blocks, "plus40mV: %d blocks with Po, golden %d", base[0].opProb_blocks, n);
+        CHECK(n > 0 && fabs(sum / n - base[0].opProb_mean) < 1e-4, "plus40mV: mean Po %f, golden %f", base[0].opProb_mean, n ? sum / n : 0);
+    }
+
+    // A grid on 1 and 4 threads.
+    std::vector<SweepAxis> axes(2);
+    std::string error;
+    CHECK(parseSweepAxis("threshold=0.6,0.75,0.9", &axes[0], &error), "%s", error.c_str());
+    CHECK(parseSweepAxis("drift_guard=5,20", &axes[1], &error), "%s", error.c_str());
+    config.target_false_rate = 0;   // The thresholds are fixed, so that the threshold axis applies.
+    std::vector<SweepResult> serial = runSweep(config, controls, recordings, axes, 1);
+    long long steals = 0;
+    int last_done = 0;
+    bool ordered = true;
+    std::vector<SweepResult> parallel = runSweep(config, controls, recordings, axes, 4, [&](int done, int total) {
+        if (done != last_done + 1 || total != 12) ordered = false;
+        last_done = done;
+    }, &steals);
+    CHECK(ordered && last_done == 12, "the progress was not reported once per job (%d of 12)", last_done);
+    CHECK(serial.size() == 12 && parallel.size() == 12, "%d / %d results of 6 configurations x 2 recordings", (int)serial.size(), (int)parallel.size());
+    for (size_t k = 0; k < serial.size() && k < parallel.size(); k++) {
+        CHECK(sameResult(serial[k], parallel[k]), "result %d differs between 1 and 4 threads", (int)k);
+        CHECK(parallel[k].configuration == (int)k / 2 && parallel[k].recording == (int)k % 2, "result %d is out of order", (int)k);
+    }
+    // A lower threshold finds more transitions in the same recording.
+    if (serial.size() == 12) {
+        CHECK(serial[0].transitions_per_s > serial[4].transitions_per_s, "threshold 0.6: %f transitions/s, 0.9: %f",
+            serial[0].transitions_per_s, serial[4].transitions_per_s);
+    }
+}
+
+int main(int argc, char** argv) {
+    std::string data_dir = "data", golden_dir = "tests/golden";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--data") == 0 && i + 1 < argc) data_dir = argv[++i];
+        else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) golden_dir = argv[++i];
+    }
+    testPool();
+    testAxes();
+    testSweep(data_dir, golden_dir);
+    return finishChecks("All sweep checks passed");
+}
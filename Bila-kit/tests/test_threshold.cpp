@@ -0,0 +1,146 @@
+/******************************************************************************
+// test_threshold.cpp
+//
+// Checks that the vectorized pre-scan (idealizeThreshold) gives exactly the same output as the scalar path
+// (idealizeThresholdScalar) and as the original per-sample loop of update_graph_1Hz, on synthetic traces.
+// Returns non-zero on failure.
+******************************************************************************/
+
+#include "../ProcessingThreshold.h"
+#include "Check.h"
+#include <math.h>
+#include <stdio.h>
+#include <random>
+#include <vector>
+
+// The loop of the BK branch in update_graph_1Hz before the pre-scan was introduced (rupture and cage checks included).
+static int legacyLoop(const double* currentData, int* processedData, int n, const ThresholdParams& p, int* lastOpenNumber) {
+    const double threshold = p.threshold;
+    const double cpc = p.current_per_channel;
+    const double baseline = p.baseline;
+    for (int idx = 0; idx < n; idx++) {
+        double y_now = currentData[idx];
+        if (y_now < p.abort_lower || y_now > p.abort_upper) return idx;
+        if (cpc > 0.1) {
+            if (y_now > (*lastOpenNumber + threshold) * cpc + baseline) {
+                (*lastOpenNumber)++;
+                if (p.max_open >= 0 && *lastOpenNumber > p.max_open) *lastOpenNumber = p.max_open;
+            }
+            else if (y_now < (*lastOpenNumber - threshold) * cpc + baseline) {
+                (*lastOpenNumber)--;
+                if (*lastOpenNumber < 0) *lastOpenNumber = 0;
+            }
+        }
+        else if (cpc < -0.1) {
+            if (y_now < (*lastOpenNumber + threshold) * cpc + baseline) {
+                (*lastOpenNumber)++;
+                if (p.max_open >= 0 && *lastOpenNumber > p.max_open) *lastOpenNumber = p.max_open;
+            }
+            else if (y_now > (*lastOpenNumber - threshold) * cpc + baseline) {
+                (*lastOpenNumber)--;
+                if (*lastOpenNumber < 0) *lastOpenNumber = 0;
+            }
+        }
+        processedData[idx] = *lastOpenNumber;
+    }
+    return n;
+}
+
+// Telegraph signal of N channels with Gaussian noise.
+static std::vector<double> makeTrace(std::mt19937& rng, int n, int N, double cpc, double baseline, double noise, double rate) {
+    std::vector<double> trace(n);
+    std::normal_distribution<double> gauss(0, noise);
+    std::uniform_real_distribution<double> uni(0, 1);
+    int k = 0;
+    for (int idx = 0; idx < n; idx++) {
+        for (int c = 0; c < N; c++) {
+            if (uni(rng) < rate) k += (uni(rng) < 0.5) ? 1 : -1;
+        }
+        if (k < 0) k = 0;
+        if (k > N) k = N;
+        trace[idx] = baseline + k * cpc + gauss(rng);
+    }
+    return trace;
+}
+
+static void compareAll(const std::vector<double>& trace, const ThresholdParams& p, int initial, const char* name) {
+    int n = (int)trace.size();
+    std::vector<int> out_legacy(n, -7), out_scalar(n, -7), out_prescan(n, -7);
+    int L_legacy = initial, L_scalar = initial, L_prescan = initial;
+    int r_legacy = legacyLoop(trace.data(), out_legacy.data(), n, p, &L_legacy);
+    int r_scalar = idealizeThresholdScalar(trace.data(), out_scalar.data(), n, p, &L_scalar);
+    int r_prescan = idealizeThreshold(trace.data(), out_prescan.data(), n, p, &L_prescan);
+    CHECK(r_legacy == r_scalar && r_scalar == r_prescan, "%s: processed %d / %d / %d", name, r_legacy, r_scalar, r_prescan);
+    CHECK(L_legacy == L_scalar && L_scalar == L_prescan, "%s: lastOpenNumber %d / %d / %d", name, L_legacy, L_scalar, L_prescan);
+    int mismatch = 0;
+    for (int idx = 0; idx < n; idx++) {
+        if (out_legacy[idx] != out_scalar[idx] || out_scalar[idx] != out_prescan[idx]) mismatch++;
+    }
+    CHECK(mismatch == 0, "%s: %d samples differ", name, mismatch);
+}
+
+static void testFindOutOfRange(std::mt19937& rng) {
+    std::uniform_real_distribution<double> uni(-1, 1);
+    for (int n = 0; n <= 70; n++) {
+        for (int trial = 0; trial < 50; trial++) {
+            std::vector<double> y(n + 1);
+            for (int i = 0; i < n; i++) y[i] = uni(rng) * 0.5;
+            int expected = n;
+            if (n > 0 && trial % 3 != 0) {
+                expected = (int)(rng() % n);
+                y[expected] = (trial % 2) ? 0.9 : -0.9;
+                for (int i = expected + 1; i < n; i++) if (rng() % 4 == 0) y[i] = 0.95;
+            }
+            if (n > 0 && trial % 5 == 0) {
+                int j = (int)(rng() % n);
+                if (j != expected) y[j] = NAN;      // NaN is regarded as in the range.
+            }
+            int r = findOutOfRange(y.data(), n, -0.6, 0.6);
+            CHECK(r == expected, "findOutOfRange n=%d trial=%d: %d (expected %d)", n, trial, r, expected);
+        }
+    }
+}
+
+int main() {
+    std::mt19937 rng(20240601);
+    testFindOutOfRange(rng);
+
+    const double cpcs[] = { -11.5, 8.0, 2.3, -1.0 };
+    const double noises[] = { 0.5, 2.0, 6.0 };
+    int case_num = 0;
+    for (double cpc : cpcs) {
+        for (double noise : noises) {
+            for (int max_open : { -1, 1, 3 }) {
+                char name[128];
+                snprintf(name, sizeof(name), "cpc=%g noise=%g max_open=%d", cpc, noise, max_open);
+                ThresholdParams p = {};
+                p.baseline = 0.3;
+                p.current_per_channel = cpc;
+                p.threshold = 0.75;
+                p.max_open = max_open;
+                p.abort_lower = -300;
+                p.abort_upper = 300;
+                std::vector<double> trace = makeTrace(rng, 5000, 4, cpc, p.baseline, noise, 0.002);
+                compareAll(trace, p, 0, name);
+                compareAll(trace, p, -1, name);     // lastOpenNumber is -1 after a rupture.
+                // Faraday cage check (abort above 80 pA) and rupture in the middle of the block.
+                p.abort_upper = 80;
+                trace[3000 + case_num % 7] = (case_num % 2) ? 85 : -400;
+                compareAll(trace, p, 0, name);
+                // NaN samples
+                trace[1234] = NAN;
+                trace[4321] = NAN;
+                compareAll(trace, p, 0, name);
+                case_num++;
+            }
+        }
+    }
+    // Odd lengths (remainder of the vector loop).
+    for (int n = 1; n < 40; n++) {
+        ThresholdParams p = { 0.0, 5.0, 0.75, -1, -300, 300 };
+        std::vector<double> trace = makeTrace(rng, n, 3, 5.0, 0.0, 1.5, 0.1);
+        compareAll(trace, p, 0, "short");
+    }
+
+    return finishChecks("All threshold tests passed");
+}